@@ -118,9 +118,12 @@ parameter CL_OP_TABLE_SIZE = $clog2(OP_TABLE_SIZE);
 
 parameter CL_CPL_SIZE = $clog2(CPL_SIZE);
 
-parameter QUEUE_RAM_BE_WIDTH = 16;
+parameter QUEUE_RAM_BE_WIDTH = 24;
 parameter QUEUE_RAM_WIDTH = QUEUE_RAM_BE_WIDTH*8;
 
+// interrupt holdoff timer tick, in clock cycles (log2)
+parameter HOLDOFF_PRESCALE_WIDTH = 8;
+
 // bus width assertions
 initial begin
     if (OP_TAG_WIDTH < CL_OP_TABLE_SIZE) begin
@@ -158,12 +161,14 @@ reg op_axil_write_pipe_hazard;
 reg op_axil_read_pipe_hazard;
 reg op_req_pipe_hazard;
 reg op_commit_pipe_hazard;
+reg op_scan_pipe_hazard;
 reg stage_active;
 
 reg [PIPELINE-1:0] op_axil_write_pipe_reg = {PIPELINE{1'b0}}, op_axil_write_pipe_next;
 reg [PIPELINE-1:0] op_axil_read_pipe_reg = {PIPELINE{1'b0}}, op_axil_read_pipe_next;
 reg [PIPELINE-1:0] op_req_pipe_reg = {PIPELINE{1'b0}}, op_req_pipe_next;
 reg [PIPELINE-1:0] op_commit_pipe_reg = {PIPELINE{1'b0}}, op_commit_pipe_next;
+reg [PIPELINE-1:0] op_scan_pipe_reg = {PIPELINE{1'b0}}, op_scan_pipe_next;
 
 reg [QUEUE_INDEX_WIDTH-1:0] queue_ram_addr_pipeline_reg[PIPELINE-1:0], queue_ram_addr_pipeline_next[PIPELINE-1:0];
 reg [1:0] axil_reg_pipeline_reg[PIPELINE-1:0], axil_reg_pipeline_next[PIPELINE-1:0];
@@ -171,6 +176,12 @@ reg [AXIL_DATA_WIDTH-1:0] write_data_pipeline_reg[PIPELINE-1:0], write_data_pipe
 reg [AXIL_STRB_WIDTH-1:0] write_strobe_pipeline_reg[PIPELINE-1:0], write_strobe_pipeline_next[PIPELINE-1:0];
 reg [REQ_TAG_WIDTH-1:0] req_tag_pipeline_reg[PIPELINE-1:0], req_tag_pipeline_next[PIPELINE-1:0];
 
+reg [QUEUE_INDEX_WIDTH-1:0] scan_queue_reg = 0, scan_queue_next;
+reg scan_owed_reg = 1'b0, scan_owed_next;
+
+reg [HOLDOFF_PRESCALE_WIDTH-1:0] holdoff_prescale_reg = 0;
+reg [15:0] holdoff_tick_reg = 0;
+
 reg s_axis_enqueue_req_ready_reg = 1'b0, s_axis_enqueue_req_ready_next;
 
 reg [QUEUE_INDEX_WIDTH-1:0] m_axis_enqueue_resp_queue_reg = 0, m_axis_enqueue_resp_queue_next;
@@ -215,7 +226,12 @@ wire queue_ram_read_data_continuous = queue_ram_read_data_pipeline_reg[PIPELINE-
 wire queue_ram_read_data_armed = queue_ram_read_data_pipeline_reg[PIPELINE-1][54];
 wire queue_ram_read_data_enable = queue_ram_read_data_pipeline_reg[PIPELINE-1][55];
 wire [CL_OP_TABLE_SIZE-1:0] queue_ram_read_data_op_index = queue_ram_read_data_pipeline_reg[PIPELINE-1][63:56];
+wire queue_ram_read_data_holdoff_expired = queue_ram_read_data_pipeline_reg[PIPELINE-1][64];
 wire [ADDR_WIDTH-1:0] queue_ram_read_data_base_addr = {queue_ram_read_data_pipeline_reg[PIPELINE-1][127:76], 12'd0};
+wire [15:0] queue_ram_read_data_holdoff_time = queue_ram_read_data_pipeline_reg[PIPELINE-1][143:128];
+wire [15:0] queue_ram_read_data_holdoff_count = queue_ram_read_data_pipeline_reg[PIPELINE-1][159:144];
+wire [15:0] queue_ram_read_data_holdoff_ts = queue_ram_read_data_pipeline_reg[PIPELINE-1][175:160];
+wire [15:0] queue_ram_read_data_pending_count = queue_ram_read_data_pipeline_reg[PIPELINE-1][191:176];
 
 reg [OP_TABLE_SIZE-1:0] op_table_active = 0;
 reg [OP_TABLE_SIZE-1:0] op_table_commit = 0;
@@ -271,6 +287,22 @@ wire queue_full_active = ($unsigned(op_table_queue_ptr[queue_ram_read_data_op_in
 wire queue_full = queue_active ? queue_full_active : queue_full_idle;
 wire [QUEUE_PTR_WIDTH-1:0] queue_ram_read_active_prod_ptr = queue_active ? op_table_queue_ptr[queue_ram_read_data_op_index] : queue_ram_read_data_prod_ptr;
 
+// interrupt holdoff: events are held off until the holdoff time has elapsed since
+// the queue was last armed or generated an event, or until the number of held off
+// completions reaches the holdoff count
+wire [15:0] holdoff_elapsed = holdoff_tick_reg - queue_ram_read_data_holdoff_ts;
+wire holdoff_time_elapsed = queue_ram_read_data_holdoff_expired || holdoff_elapsed >= queue_ram_read_data_holdoff_time;
+wire holdoff_count_reached = queue_ram_read_data_holdoff_count != 0 && {1'b0, queue_ram_read_data_pending_count} + 1 >= queue_ram_read_data_holdoff_count;
+
+// holdoff scan issue slot: commit finalize and the holdoff scan both drive the
+// event output, so they never share the pipeline.  Every commit finalize makes
+// the next slot owed to the scan, and while the scan is owed a slot, commit
+// finalize and enqueue requests wait for it.  Each scan step therefore issues
+// within 2*PIPELINE cycles and a full sweep takes at most QUEUE_COUNT*2*PIPELINE
+// cycles, so a held off event is generated at most QUEUE_COUNT*2*PIPELINE cycles
+// after its holdoff time elapses (not counting AXI lite accesses and event
+// output backpressure, which also stall commit finalize).
+
 integer i, j;
 
 initial begin
@@ -300,6 +332,7 @@ always @* begin
     op_axil_read_pipe_next = {op_axil_read_pipe_reg, 1'b0};
     op_req_pipe_next = {op_req_pipe_reg, 1'b0};
     op_commit_pipe_next = {op_commit_pipe_reg, 1'b0};
+    op_scan_pipe_next = {op_scan_pipe_reg, 1'b0};
 
     queue_ram_addr_pipeline_next[0] = 0;
     axil_reg_pipeline_next[0] = 0;
@@ -314,6 +347,9 @@ always @* begin
         req_tag_pipeline_next[j] = req_tag_pipeline_reg[j-1];
     end
 
+    scan_queue_next = scan_queue_reg;
+    scan_owed_next = scan_owed_reg;
+
     s_axis_enqueue_req_ready_next = 1'b0;
 
     m_axis_enqueue_resp_queue_next = m_axis_enqueue_resp_queue_reg;
@@ -358,14 +394,16 @@ always @* begin
     op_axil_read_pipe_hazard = 1'b0;
     op_req_pipe_hazard = 1'b0;
     op_commit_pipe_hazard = 1'b0;
+    op_scan_pipe_hazard = 1'b0;
     stage_active = 1'b0;
 
     for (j = 0; j < PIPELINE; j = j + 1) begin
-        stage_active = op_axil_write_pipe_reg[j] || op_axil_read_pipe_reg[j] || op_req_pipe_reg[j] || op_commit_pipe_reg[j];
+        stage_active = op_axil_write_pipe_reg[j] || op_axil_read_pipe_reg[j] || op_req_pipe_reg[j] || op_commit_pipe_reg[j] || op_scan_pipe_reg[j];
         op_axil_write_pipe_hazard = op_axil_write_pipe_hazard || (stage_active && queue_ram_addr_pipeline_reg[j] == s_axil_awaddr_queue);
         op_axil_read_pipe_hazard = op_axil_read_pipe_hazard || (stage_active && queue_ram_addr_pipeline_reg[j] == s_axil_araddr_queue);
         op_req_pipe_hazard = op_req_pipe_hazard || (stage_active && queue_ram_addr_pipeline_reg[j] == s_axis_enqueue_req_queue);
         op_commit_pipe_hazard = op_commit_pipe_hazard || (stage_active && queue_ram_addr_pipeline_reg[j] == op_table_queue[op_table_finish_ptr_reg]);
+        op_scan_pipe_hazard = op_scan_pipe_hazard || (stage_active && queue_ram_addr_pipeline_reg[j] == scan_queue_reg);
     end
 
     // pipeline stage 0 - receive request
@@ -391,17 +429,19 @@ always @* begin
         queue_ram_read_ptr = s_axil_araddr_queue;
         queue_ram_addr_pipeline_next[0] = s_axil_araddr_queue;
         axil_reg_pipeline_next[0] = s_axil_araddr_reg;
-    end else if (op_table_active[op_table_finish_ptr_reg] && op_table_commit[op_table_finish_ptr_reg] && (!m_axis_event_valid_reg || m_axis_event_ready) && !op_commit_pipe_reg && !op_commit_pipe_hazard) begin
+    end else if (op_table_active[op_table_finish_ptr_reg] && op_table_commit[op_table_finish_ptr_reg] && (!m_axis_event_valid_reg || m_axis_event_ready) && !op_commit_pipe_reg && !op_scan_pipe_reg && !op_commit_pipe_hazard && !(enable && scan_owed_reg)) begin
         // enqueue commit finalize (update pointer)
         op_commit_pipe_next[0] = 1'b1;
 
+        scan_owed_next = 1'b1;
+
         op_table_finish_en = 1'b1;
 
         write_data_pipeline_next[0] = op_table_queue_ptr[op_table_finish_ptr_reg];
 
         queue_ram_read_ptr = op_table_queue[op_table_finish_ptr_reg];
         queue_ram_addr_pipeline_next[0] = op_table_queue[op_table_finish_ptr_reg];
-    end else if (enable && !op_table_active[op_table_start_ptr_reg] && s_axis_enqueue_req_valid && (!m_axis_enqueue_resp_valid || m_axis_enqueue_resp_ready) && !op_req_pipe_reg && !op_req_pipe_hazard) begin
+    end else if (enable && !op_table_active[op_table_start_ptr_reg] && s_axis_enqueue_req_valid && (!m_axis_enqueue_resp_valid || m_axis_enqueue_resp_ready) && !op_req_pipe_reg && !op_req_pipe_hazard && !scan_owed_reg) begin
         // enqueue request
         op_req_pipe_next[0] = 1'b1;
 
@@ -411,6 +451,15 @@ always @* begin
 
         queue_ram_read_ptr = s_axis_enqueue_req_queue;
         queue_ram_addr_pipeline_next[0] = s_axis_enqueue_req_queue;
+    end else if (enable && (!m_axis_event_valid_reg || m_axis_event_ready) && !op_commit_pipe_reg && !op_scan_pipe_reg && !op_scan_pipe_hazard) begin
+        // holdoff timer scan
+        op_scan_pipe_next[0] = 1'b1;
+
+        scan_queue_next = scan_queue_reg + 1;
+        scan_owed_next = 1'b0;
+
+        queue_ram_read_ptr = scan_queue_reg;
+        queue_ram_addr_pipeline_next[0] = scan_queue_reg;
     end
 
     // read complete, perform operation
@@ -461,13 +510,26 @@ always @* begin
         queue_ram_write_data[55:48] = queue_ram_read_data_pipeline_reg[PIPELINE-1][55:48];
         // generate event on producer pointer update
         if (queue_ram_read_data_armed) begin
-            m_axis_event_next = queue_ram_read_data_event;
-            m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
-            m_axis_event_valid_next = 1'b1;
+            if (holdoff_time_elapsed || holdoff_count_reached) begin
+                m_axis_event_next = queue_ram_read_data_event;
+                m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
+                m_axis_event_valid_next = 1'b1;
+
+                if (!queue_ram_read_data_continuous) begin
+                    queue_ram_write_data[54] = 1'b0;
+                    queue_ram_be[6] = 1'b1;
+                end
 
-            if (!queue_ram_read_data_continuous) begin
-                queue_ram_write_data[54] = 1'b0;
-                queue_ram_be[6] = 1'b1;
+                // restart holdoff
+                queue_ram_write_data[64] = 1'b0;
+                queue_ram_be[8] = 1'b1;
+                queue_ram_write_data[175:160] = holdoff_tick_reg;
+                queue_ram_write_data[191:176] = 0;
+                queue_ram_be[23:20] = 4'b1111;
+            end else begin
+                // hold off event
+                queue_ram_write_data[191:176] = queue_ram_read_data_pending_count + 1;
+                queue_ram_be[23:22] = 2'b11;
             end
         end
     end else if (op_axil_write_pipe_reg[PIPELINE-1]) begin
@@ -509,6 +571,16 @@ always @* begin
                             queue_ram_be[6] = 1'b1;
                         end
                     end
+                    32'h8003zzzz: begin
+                        // set holdoff time
+                        queue_ram_write_data[143:128] = write_data_pipeline_reg[PIPELINE-1][15:0];
+                        queue_ram_be[17:16] = 2'b11;
+                    end
+                    32'h8004zzzz: begin
+                        // set holdoff count
+                        queue_ram_write_data[159:144] = write_data_pipeline_reg[PIPELINE-1][15:0];
+                        queue_ram_be[19:18] = 2'b11;
+                    end
                     32'hC0zzzzzz: begin
                         // set EQN
                         if (!queue_ram_read_data_enable) begin
@@ -536,15 +608,27 @@ always @* begin
                         queue_ram_write_data[54] = 1'b1;
                         queue_ram_be[6] = 1'b1;
 
+                        // restart holdoff
+                        queue_ram_write_data[64] = 1'b0;
+                        queue_ram_be[8] = 1'b1;
+                        queue_ram_write_data[175:160] = holdoff_tick_reg;
+                        queue_ram_write_data[191:176] = 0;
+                        queue_ram_be[23:20] = 4'b1111;
+
                         if (queue_ram_read_data_enable && queue_ram_read_data_prod_ptr != write_data_pipeline_reg[PIPELINE-1][15:0]) begin
                             // armed and queue not empty
-                            // so generate event
-                            m_axis_event_next = queue_ram_read_data_event;
-                            m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
-                            m_axis_event_valid_next = 1'b1;
-
-                            queue_ram_write_data[54] = 1'b0;
-                            queue_ram_be[6] = 1'b1;
+                            if (queue_ram_read_data_holdoff_time == 0) begin
+                                // so generate event
+                                m_axis_event_next = queue_ram_read_data_event;
+                                m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
+                                m_axis_event_valid_next = 1'b1;
+
+                                queue_ram_write_data[54] = 1'b0;
+                                queue_ram_be[6] = 1'b1;
+                            end else begin
+                                // hold off event until holdoff time elapses
+                                queue_ram_write_data[191:176] = 1;
+                            end
                         end
                     end
                     32'h400001zz: begin
@@ -557,15 +641,29 @@ always @* begin
                         queue_ram_write_data[54] = write_data_pipeline_reg[PIPELINE-1][0];
                         queue_ram_be[6] = 1'b1;
 
+                        if (write_data_pipeline_reg[PIPELINE-1][0]) begin
+                            // restart holdoff
+                            queue_ram_write_data[64] = 1'b0;
+                            queue_ram_be[8] = 1'b1;
+                            queue_ram_write_data[175:160] = holdoff_tick_reg;
+                            queue_ram_write_data[191:176] = 0;
+                            queue_ram_be[23:20] = 4'b1111;
+                        end
+
                         if (queue_ram_read_data_enable && write_data_pipeline_reg[PIPELINE-1][0] && (queue_ram_read_data_prod_ptr != queue_ram_read_data_cons_ptr)) begin
                             // armed and queue not empty
-                            // so generate event
-                            m_axis_event_next = queue_ram_read_data_event;
-                            m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
-                            m_axis_event_valid_next = 1'b1;
-
-                            queue_ram_write_data[54] = 1'b0;
-                            queue_ram_be[6] = 1'b1;
+                            if (queue_ram_read_data_holdoff_time == 0) begin
+                                // so generate event
+                                m_axis_event_next = queue_ram_read_data_event;
+                                m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
+                                m_axis_event_valid_next = 1'b1;
+
+                                queue_ram_write_data[54] = 1'b0;
+                                queue_ram_be[6] = 1'b1;
+                            end else begin
+                                // hold off event until holdoff time elapses
+                                queue_ram_write_data[191:176] = 1;
+                            end
                         end
                     end
                     default: begin
@@ -609,6 +707,37 @@ always @* begin
                 s_axil_rdata_next[31:16] = queue_ram_read_data_cons_ptr;
             end
         endcase
+    end else if (op_scan_pipe_reg[PIPELINE-1]) begin
+        // holdoff timer scan
+        queue_ram_write_ptr = queue_ram_addr_pipeline_reg[PIPELINE-1];
+
+        if (queue_ram_read_data_enable && queue_ram_read_data_armed && holdoff_time_elapsed) begin
+            if (queue_ram_read_data_pending_count != 0) begin
+                // holdoff time elapsed with events pending
+                // so generate event
+                m_axis_event_next = queue_ram_read_data_event;
+                m_axis_event_source_next = queue_ram_addr_pipeline_reg[PIPELINE-1];
+                m_axis_event_valid_next = 1'b1;
+
+                if (!queue_ram_read_data_continuous) begin
+                    queue_ram_write_data[54] = 1'b0;
+                    queue_ram_be[6] = 1'b1;
+                end
+
+                // restart holdoff
+                queue_ram_write_data[64] = 1'b0;
+                queue_ram_be[8] = 1'b1;
+                queue_ram_write_data[175:160] = holdoff_tick_reg;
+                queue_ram_write_data[191:176] = 0;
+                queue_ram_be[23:20] = 4'b1111;
+                queue_ram_wr_en = 1'b1;
+            end else if (!queue_ram_read_data_holdoff_expired) begin
+                // mark holdoff expired so that the timestamp can wrap
+                queue_ram_write_data[64] = 1'b1;
+                queue_ram_be[8] = 1'b1;
+                queue_ram_wr_en = 1'b1;
+            end
+        end
     end
 
     // enqueue commit (record in table)
@@ -625,6 +754,13 @@ always @(posedge clk) begin
         op_axil_read_pipe_reg <= {PIPELINE{1'b0}};
         op_req_pipe_reg <= {PIPELINE{1'b0}};
         op_commit_pipe_reg <= {PIPELINE{1'b0}};
+        op_scan_pipe_reg <= {PIPELINE{1'b0}};
+
+        scan_queue_reg <= 0;
+        scan_owed_reg <= 1'b0;
+
+        holdoff_prescale_reg <= 0;
+        holdoff_tick_reg <= 0;
 
         s_axis_enqueue_req_ready_reg <= 1'b0;
         m_axis_enqueue_resp_valid_reg <= 1'b0;
@@ -646,6 +782,15 @@ always @(posedge clk) begin
         op_axil_read_pipe_reg <= op_axil_read_pipe_next;
         op_req_pipe_reg <= op_req_pipe_next;
         op_commit_pipe_reg <= op_commit_pipe_next;
+        op_scan_pipe_reg <= op_scan_pipe_next;
+
+        scan_queue_reg <= scan_queue_next;
+        scan_owed_reg <= scan_owed_next;
+
+        holdoff_prescale_reg <= holdoff_prescale_reg + 1;
+        if (&holdoff_prescale_reg) begin
+            holdoff_tick_reg <= holdoff_tick_reg + 1;
+        end
 
         s_axis_enqueue_req_ready_reg <= s_axis_enqueue_req_ready_next;
         m_axis_enqueue_resp_valid_reg <= m_axis_enqueue_resp_valid_next;
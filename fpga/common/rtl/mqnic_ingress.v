@@ -71,7 +71,12 @@ module mqnic_ingress #
      */
     output wire [15:0]                      rx_csum,
     output wire                             rx_csum_valid,
-    input  wire                             rx_csum_ready
+    input  wire                             rx_csum_ready,
+
+    /*
+     * Configuration
+     */
+    input  wire [40*8-1:0]                  rx_hash_key
 );
 
 localparam RX_HASH_WIDTH = 32;
@@ -104,7 +109,7 @@ if (RX_HASH_ENABLE) begin
         .s_axis_tkeep(s_axis_tkeep),
         .s_axis_tvalid(s_axis_tvalid & s_axis_tready),
         .s_axis_tlast(s_axis_tlast),
-        .hash_key(320'h6d5a56da255b0ec24167253d43a38fb0d0ca2bcbae7b30b477cb2da38030f20c6a42b73bbeac01fa),
+        .hash_key(rx_hash_key),
         .m_axis_hash(rx_hash_int),
         .m_axis_hash_type(rx_hash_type_int),
         .m_axis_hash_valid(rx_hash_valid_int)
@@ -281,6 +281,8 @@ wire [15:0]  rx_csum;
 wire         rx_csum_valid;
 wire         rx_csum_ready;
 
+wire [40*8-1:0] rx_hash_key;
+
 wire [RAM_ADDR_WIDTH-1:0]        dma_rx_desc_addr;
 wire [DMA_CLIENT_LEN_WIDTH-1:0]  dma_rx_desc_len;
 wire [DMA_CLIENT_TAG_WIDTH-1:0]  dma_rx_desc_tag;
@@ -520,6 +522,7 @@ rx_engine_inst (
     /*
      * Configuration
      */
+    .rx_hash_key(rx_hash_key),
     .mtu(mtu),
     .enable(1'b1)
 );
@@ -619,7 +622,12 @@ ingress_inst (
      */
     .rx_csum(rx_csum),
     .rx_csum_valid(rx_csum_valid),
-    .rx_csum_ready(rx_csum_ready)
+    .rx_csum_ready(rx_csum_ready),
+
+    /*
+     * Configuration
+     */
+    .rx_hash_key(rx_hash_key)
 );
 
 dma_client_axis_sink #(
@@ -26,10 +26,14 @@ module mqnic_rx_queue_map #
     parameter DEST_WIDTH = QUEUE_INDEX_WIDTH+1,
     // Flow hash width
     parameter HASH_WIDTH = 32,
+    // Flow hash key width
+    parameter HASH_KEY_WIDTH = 40*8,
+    // Flow table address width
+    parameter FLOW_TBL_ADDR_WIDTH = 8,
     // Tag width
     parameter TAG_WIDTH = 8,
     // Control register interface address width
-    parameter REG_ADDR_WIDTH = $clog2(16 + PORTS*16),
+    parameter REG_ADDR_WIDTH = $clog2(16 + PORTS*16 + HASH_KEY_WIDTH/8 + 16),
     // Control register interface data width
     parameter REG_DATA_WIDTH = 32,
     // Control register interface byte enable width
@@ -89,6 +93,11 @@ module mqnic_rx_queue_map #
     output wire                          s_axil_rvalid,
     input  wire                          s_axil_rready,
 
+    /*
+     * Flow hash key output
+     */
+    output wire [HASH_KEY_WIDTH-1:0]     hash_key,
+
     /*
      * Request input
      */
@@ -112,6 +121,13 @@ localparam FULL_TABLE_ADDR_WIDTH = CL_PORTS+INDIR_TBL_ADDR_WIDTH;
 
 localparam RBB = RB_BASE_ADDR & {REG_ADDR_WIDTH{1'b1}};
 
+localparam HASH_KEY_WORDS = HASH_KEY_WIDTH/32;
+localparam HASH_KEY_OFFSET = 16 + PORTS*16;
+localparam FLOW_TBL_OFFSET = HASH_KEY_OFFSET + HASH_KEY_WIDTH/8;
+
+// default Toeplitz hash key
+localparam [HASH_KEY_WIDTH-1:0] HASH_KEY_DEFAULT = 320'h6d5a56da255b0ec24167253d43a38fb0d0ca2bcbae7b30b477cb2da38030f20c6a42b73bbeac01fa;
+
 // check configuration
 initial begin
     if (REG_DATA_WIDTH != 32) begin
@@ -124,12 +140,17 @@ initial begin
         $finish;
     end
 
-    if (REG_ADDR_WIDTH < $clog2(16 + PORTS*16)) begin
+    if (HASH_KEY_WIDTH % 32 != 0) begin
+        $error("Error: Hash key width must be a multiple of 32 (instance %m)");
+        $finish;
+    end
+
+    if (REG_ADDR_WIDTH < $clog2(16 + PORTS*16 + HASH_KEY_WIDTH/8 + 16)) begin
         $error("Error: Register address width too narrow (instance %m)");
         $finish;
     end
 
-    if (RB_NEXT_PTR >= RB_BASE_ADDR && RB_NEXT_PTR < RB_BASE_ADDR + 16 + PORTS*16) begin
+    if (RB_NEXT_PTR >= RB_BASE_ADDR && RB_NEXT_PTR < RB_BASE_ADDR + 16 + PORTS*16 + HASH_KEY_WIDTH/8 + 16) begin
         $error("Error: RB_NEXT_PTR overlaps block (instance %m)");
         $finish;
     end
@@ -153,6 +174,10 @@ end
 (* ramstyle = "no_rw_check" *)
 reg [AXIL_DATA_WIDTH-1:0] indir_tbl_mem[(2**FULL_TABLE_ADDR_WIDTH)-1:0];
 
+// flow table entry: {valid, queue, hash}
+(* ramstyle = "no_rw_check" *)
+reg [1+QUEUE_INDEX_WIDTH+HASH_WIDTH-1:0] flow_tbl_mem[(2**FLOW_TBL_ADDR_WIDTH)-1:0];
+
 // control registers
 reg reg_wr_ack_reg = 1'b0;
 reg [REG_DATA_WIDTH-1:0] reg_rd_data_reg = 0;
@@ -162,9 +187,19 @@ reg [QUEUE_INDEX_WIDTH-1:0] offset_reg[PORTS-1:0];
 reg [PORTS-1:0] app_direct_en_reg = 0;
 reg [QUEUE_INDEX_WIDTH-1:0] hash_mask_reg[PORTS-1:0];
 reg [QUEUE_INDEX_WIDTH-1:0] app_mask_reg[PORTS-1:0];
+reg [HASH_KEY_WIDTH-1:0] hash_key_reg = HASH_KEY_DEFAULT;
+
+reg [FLOW_TBL_ADDR_WIDTH-1:0] flow_tbl_wr_index_reg = 0;
+reg [HASH_WIDTH-1:0] flow_tbl_wr_hash_reg = 0;
+reg [QUEUE_INDEX_WIDTH-1:0] flow_tbl_wr_queue_reg = 0;
+reg flow_tbl_wr_valid_reg = 1'b0;
+reg flow_tbl_wr_en_reg = 1'b0;
 
 reg [FULL_TABLE_ADDR_WIDTH-1:0] indir_tbl_index_reg = 0;
 reg [QUEUE_INDEX_WIDTH-1:0] indir_tbl_queue_reg = 0;
+reg [FLOW_TBL_ADDR_WIDTH-1:0] flow_tbl_index_reg = 0;
+reg [1+QUEUE_INDEX_WIDTH+HASH_WIDTH-1:0] flow_tbl_entry_reg = 0;
+reg [HASH_WIDTH-1:0] req_hash_d1_reg = 0, req_hash_d2_reg = 0;
 reg [DEST_WIDTH-1:0] req_dest_d1_reg = 0, req_dest_d2_reg = 0;
 reg [TAG_WIDTH-1:0] req_tag_d1_reg = 0, req_tag_d2_reg = 0;
 reg req_valid_d1_reg = 0, req_valid_d2_reg = 0;
@@ -179,6 +214,8 @@ assign reg_rd_data = reg_rd_data_reg;
 assign reg_rd_wait = 1'b0;
 assign reg_rd_ack = reg_rd_ack_reg;
 
+assign hash_key = hash_key_reg;
+
 assign resp_queue = resp_queue_reg;
 assign resp_tag = resp_tag_reg;
 assign resp_valid = resp_valid_reg;
@@ -199,6 +236,12 @@ initial begin
             indir_tbl_mem[j] = 0;
         end
     end
+
+    for (i = 0; i < 2**FLOW_TBL_ADDR_WIDTH; i = i + 2**(FLOW_TBL_ADDR_WIDTH/2)) begin
+        for (j = i; j < i + 2**(FLOW_TBL_ADDR_WIDTH/2); j = j + 1) begin
+            flow_tbl_mem[j] = 0;
+        end
+    end
 end
 
 integer k;
@@ -208,6 +251,8 @@ always @(posedge clk) begin
     reg_rd_data_reg <= 0;
     reg_rd_ack_reg <= 1'b0;
 
+    flow_tbl_wr_en_reg <= 1'b0;
+
     if (reg_wr_en && !reg_wr_ack_reg) begin
         // write operation
         reg_wr_ack_reg <= 1'b0;
@@ -222,6 +267,30 @@ always @(posedge clk) begin
                 reg_wr_ack_reg <= 1'b1;
             end
         end
+        for (k = 0; k < HASH_KEY_WORDS; k = k + 1) begin
+            if ({reg_wr_addr >> 2, 2'b00} == RBB+HASH_KEY_OFFSET + k*4) begin
+                // first key byte in MSBs of first word
+                hash_key_reg[HASH_KEY_WIDTH-32*k-1 -: 32] <= reg_wr_data;
+                reg_wr_ack_reg <= 1'b1;
+            end
+        end
+        if ({reg_wr_addr >> 2, 2'b00} == RBB+FLOW_TBL_OFFSET+4'h0) begin
+            // flow table index
+            flow_tbl_wr_index_reg <= reg_wr_data;
+            reg_wr_ack_reg <= 1'b1;
+        end
+        if ({reg_wr_addr >> 2, 2'b00} == RBB+FLOW_TBL_OFFSET+4'h4) begin
+            // flow table hash
+            flow_tbl_wr_hash_reg <= reg_wr_data;
+            reg_wr_ack_reg <= 1'b1;
+        end
+        if ({reg_wr_addr >> 2, 2'b00} == RBB+FLOW_TBL_OFFSET+4'h8) begin
+            // flow table queue and valid, write entry
+            flow_tbl_wr_queue_reg <= reg_wr_data;
+            flow_tbl_wr_valid_reg <= reg_wr_data[31];
+            flow_tbl_wr_en_reg <= 1'b1;
+            reg_wr_ack_reg <= 1'b1;
+        end
     end
 
     if (reg_rd_en && !reg_rd_ack_reg) begin
@@ -234,6 +303,14 @@ always @(posedge clk) begin
             RBB+7'h0C: begin
                 reg_rd_data_reg[7:0]  <= PORTS;
                 reg_rd_data_reg[15:8] <= INDIR_TBL_ADDR_WIDTH;
+                reg_rd_data_reg[23:16] <= HASH_KEY_WORDS;
+                reg_rd_data_reg[31:24] <= FLOW_TBL_ADDR_WIDTH;
+            end
+            RBB+FLOW_TBL_OFFSET+4'h0: reg_rd_data_reg <= flow_tbl_wr_index_reg;
+            RBB+FLOW_TBL_OFFSET+4'h4: reg_rd_data_reg <= flow_tbl_wr_hash_reg;
+            RBB+FLOW_TBL_OFFSET+4'h8: begin
+                reg_rd_data_reg <= flow_tbl_wr_queue_reg;
+                reg_rd_data_reg[31] <= flow_tbl_wr_valid_reg;
             end
             default: reg_rd_ack_reg <= 1'b0;
         endcase
@@ -252,24 +329,36 @@ always @(posedge clk) begin
                 reg_rd_ack_reg <= 1'b1;
             end
         end
+        for (k = 0; k < HASH_KEY_WORDS; k = k + 1) begin
+            if ({reg_rd_addr >> 2, 2'b00} == RBB+HASH_KEY_OFFSET + k*4) begin
+                reg_rd_data_reg <= hash_key_reg[HASH_KEY_WIDTH-32*k-1 -: 32];
+                reg_rd_ack_reg <= 1'b1;
+            end
+        end
     end
 
     indir_tbl_index_reg[INDIR_TBL_ADDR_WIDTH-1:0] <= (req_dest & app_mask_reg[req_id]) + (req_hash & hash_mask_reg[req_id]);
     if (PORTS > 1) begin
         indir_tbl_index_reg[INDIR_TBL_ADDR_WIDTH +: CL_PORTS] <= req_id;
     end
+    flow_tbl_index_reg <= req_hash;
+    req_hash_d1_reg <= req_hash;
     req_dest_d1_reg <= req_dest;
     req_dest_d1_reg[DEST_WIDTH-1] <= req_dest[DEST_WIDTH-1] & app_direct_en_reg[req_id];
     req_tag_d1_reg <= req_tag;
     req_valid_d1_reg <= req_valid;
 
     indir_tbl_queue_reg <= indir_tbl_mem[indir_tbl_index_reg];
+    req_hash_d2_reg <= req_hash_d1_reg;
     req_dest_d2_reg <= req_dest_d1_reg;
     req_tag_d2_reg <= req_tag_d1_reg;
     req_valid_d2_reg <= req_valid_d1_reg;
 
     if (req_dest_d2_reg[DEST_WIDTH-1]) begin
         resp_queue_reg <= req_dest_d2_reg;
+    end else if (flow_tbl_entry_reg[QUEUE_INDEX_WIDTH+HASH_WIDTH] && flow_tbl_entry_reg[HASH_WIDTH-1:0] == req_hash_d2_reg) begin
+        // flow table hit
+        resp_queue_reg <= flow_tbl_entry_reg[HASH_WIDTH +: QUEUE_INDEX_WIDTH];
     end else begin
         resp_queue_reg <= indir_tbl_queue_reg;
     end
@@ -286,6 +375,9 @@ always @(posedge clk) begin
             hash_mask_reg[k] <= 0;
             app_mask_reg[k] <= 0;
         end
+        hash_key_reg <= HASH_KEY_DEFAULT;
+
+        flow_tbl_wr_en_reg <= 1'b0;
 
         req_valid_d1_reg <= 1'b0;
         req_valid_d2_reg <= 1'b0;
@@ -294,6 +386,15 @@ always @(posedge clk) begin
     end
 end
 
+// flow table
+always @(posedge clk) begin
+    if (flow_tbl_wr_en_reg) begin
+        flow_tbl_mem[flow_tbl_wr_index_reg] <= {flow_tbl_wr_valid_reg, flow_tbl_wr_queue_reg, flow_tbl_wr_hash_reg};
+    end
+
+    flow_tbl_entry_reg <= flow_tbl_mem[flow_tbl_index_reg];
+end
+
 // AXI lite interface
 reg read_eligible;
 reg write_eligible;
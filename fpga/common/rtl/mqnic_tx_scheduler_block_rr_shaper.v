@@ -0,0 +1,474 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+// Language: Verilog 2001
+
+`resetall
+`timescale 1ns / 1ps
+`default_nettype none
+
+/*
+ * TX scheduler block (round-robin with rate limiting and weighting)
+ */
+module mqnic_tx_scheduler_block #
+(
+    // Number of ports
+    parameter PORTS = 1,
+    // Scheduler index
+    parameter INDEX = 0,
+    // Width of control register interface address in bits
+    parameter REG_ADDR_WIDTH = 16,
+    // Width of control register interface data in bits
+    parameter REG_DATA_WIDTH = 32,
+    // Width of control register interface strb
+    parameter REG_STRB_WIDTH = (REG_DATA_WIDTH/8),
+    // Register block base address
+    parameter RB_BASE_ADDR = 0,
+    // Register block next pointer
+    parameter RB_NEXT_PTR = 0,
+    // Width of AXI lite data bus in bits
+    parameter AXIL_DATA_WIDTH = 32,
+    // Width of AXI lite address bus in bits
+    parameter AXIL_ADDR_WIDTH = 16,
+    // Width of AXI lite wstrb (width of data bus in words)
+    parameter AXIL_STRB_WIDTH = (AXIL_DATA_WIDTH/8),
+    // Offset to AXI lite interface
+    parameter AXIL_OFFSET = 0,
+    // Length field width
+    parameter LEN_WIDTH = 16,
+    // Transmit request tag field width
+    parameter REQ_TAG_WIDTH = 8,
+    // Number of outstanding operations
+    parameter OP_TABLE_SIZE = 16,
+    // Queue index width
+    parameter QUEUE_INDEX_WIDTH = 6,
+    // Pipeline setting
+    parameter PIPELINE = 3,
+    // Scheduler TDMA index width
+    parameter TDMA_INDEX_WIDTH = 8,
+    // PTP timestamp width
+    parameter PTP_TS_WIDTH = 96,
+    // AXI stream tdest signal width
+    parameter AXIS_TX_DEST_WIDTH = $clog2(PORTS)+4,
+    // Max transmit packet size
+    parameter MAX_TX_SIZE = 2048
+)
+(
+    input  wire                          clk,
+    input  wire                          rst,
+
+    /*
+     * Control register interface
+     */
+    input  wire [REG_ADDR_WIDTH-1:0]     ctrl_reg_wr_addr,
+    input  wire [REG_DATA_WIDTH-1:0]     ctrl_reg_wr_data,
+    input  wire [REG_STRB_WIDTH-1:0]     ctrl_reg_wr_strb,
+    input  wire                          ctrl_reg_wr_en,
+    output wire                          ctrl_reg_wr_wait,
+    output wire                          ctrl_reg_wr_ack,
+    input  wire [REG_ADDR_WIDTH-1:0]     ctrl_reg_rd_addr,
+    input  wire                          ctrl_reg_rd_en,
+    output wire [REG_DATA_WIDTH-1:0]     ctrl_reg_rd_data,
+    output wire                          ctrl_reg_rd_wait,
+    output wire                          ctrl_reg_rd_ack,
+
+    /*
+     * AXI-Lite slave interface
+     */
+    input  wire [AXIL_ADDR_WIDTH-1:0]    s_axil_awaddr,
+    input  wire [2:0]                    s_axil_awprot,
+    input  wire                          s_axil_awvalid,
+    output wire                          s_axil_awready,
+    input  wire [AXIL_DATA_WIDTH-1:0]    s_axil_wdata,
+    input  wire [AXIL_STRB_WIDTH-1:0]    s_axil_wstrb,
+    input  wire                          s_axil_wvalid,
+    output wire                          s_axil_wready,
+    output wire [1:0]                    s_axil_bresp,
+    output wire                          s_axil_bvalid,
+    input  wire                          s_axil_bready,
+    input  wire [AXIL_ADDR_WIDTH-1:0]    s_axil_araddr,
+    input  wire [2:0]                    s_axil_arprot,
+    input  wire                          s_axil_arvalid,
+    output wire                          s_axil_arready,
+    output wire [AXIL_DATA_WIDTH-1:0]    s_axil_rdata,
+    output wire [1:0]                    s_axil_rresp,
+    output wire                          s_axil_rvalid,
+    input  wire                          s_axil_rready,
+
+    /*
+     * Transmit request output (queue index)
+     */
+    output wire [QUEUE_INDEX_WIDTH-1:0]  m_axis_tx_req_queue,
+    output wire [REQ_TAG_WIDTH-1:0]      m_axis_tx_req_tag,
+    output wire [AXIS_TX_DEST_WIDTH-1:0] m_axis_tx_req_dest,
+    output wire                          m_axis_tx_req_valid,
+    input  wire                          m_axis_tx_req_ready,
+
+    /*
+     * Transmit request status input
+     */
+    input  wire [LEN_WIDTH-1:0]          s_axis_tx_req_status_len,
+    input  wire [REQ_TAG_WIDTH-1:0]      s_axis_tx_req_status_tag,
+    input  wire                          s_axis_tx_req_status_valid,
+
+    /*
+     * TX doorbell input
+     */
+    input  wire [QUEUE_INDEX_WIDTH-1:0]  s_axis_doorbell_queue,
+    input  wire                          s_axis_doorbell_valid,
+
+    /*
+     * PTP clock
+     */
+    input  wire [PTP_TS_WIDTH-1:0]       ptp_ts_96,
+    input  wire                          ptp_ts_step,
+
+    /*
+     * Configuration
+     */
+    input  wire [LEN_WIDTH-1:0]          mtu
+);
+
+parameter SCHED_COUNT = 2;
+parameter AXIL_SCHED_ADDR_WIDTH = AXIL_ADDR_WIDTH-$clog2(SCHED_COUNT);
+
+// default shaper refill period, 8 cycles per queue
+parameter SHAPER_REFILL_PERIOD = 2**(QUEUE_INDEX_WIDTH+3);
+
+localparam RBB = RB_BASE_ADDR & {REG_ADDR_WIDTH{1'b1}};
+
+// parameter sizing helpers
+function [31:0] w_32(input [31:0] val);
+    w_32 = val;
+endfunction
+
+// AXI lite connections
+wire [SCHED_COUNT*AXIL_ADDR_WIDTH-1:0] axil_sched_awaddr;
+wire [SCHED_COUNT*3-1:0]               axil_sched_awprot;
+wire [SCHED_COUNT-1:0]                 axil_sched_awvalid;
+wire [SCHED_COUNT-1:0]                 axil_sched_awready;
+wire [SCHED_COUNT*AXIL_DATA_WIDTH-1:0] axil_sched_wdata;
+wire [SCHED_COUNT*AXIL_STRB_WIDTH-1:0] axil_sched_wstrb;
+wire [SCHED_COUNT-1:0]                 axil_sched_wvalid;
+wire [SCHED_COUNT-1:0]                 axil_sched_wready;
+wire [SCHED_COUNT*2-1:0]               axil_sched_bresp;
+wire [SCHED_COUNT-1:0]                 axil_sched_bvalid;
+wire [SCHED_COUNT-1:0]                 axil_sched_bready;
+wire [SCHED_COUNT*AXIL_ADDR_WIDTH-1:0] axil_sched_araddr;
+wire [SCHED_COUNT*3-1:0]               axil_sched_arprot;
+wire [SCHED_COUNT-1:0]                 axil_sched_arvalid;
+wire [SCHED_COUNT-1:0]                 axil_sched_arready;
+wire [SCHED_COUNT*AXIL_DATA_WIDTH-1:0] axil_sched_rdata;
+wire [SCHED_COUNT*2-1:0]               axil_sched_rresp;
+wire [SCHED_COUNT-1:0]                 axil_sched_rvalid;
+wire [SCHED_COUNT-1:0]                 axil_sched_rready;
+
+// Scheduler
+wire [QUEUE_INDEX_WIDTH-1:0]  tx_sched_ctrl_queue;
+wire                          tx_sched_ctrl_enable;
+wire                          tx_sched_ctrl_valid;
+wire                          tx_sched_ctrl_ready;
+
+wire                          tx_sched_active;
+
+// control registers
+reg ctrl_reg_wr_ack_reg = 1'b0;
+reg [REG_DATA_WIDTH-1:0] ctrl_reg_rd_data_reg = 0;
+reg ctrl_reg_rd_ack_reg = 1'b0;
+
+reg sched_enable_reg = 1'b0;
+reg [AXIS_TX_DEST_WIDTH-1:0] sched_dest_reg = (INDEX % PORTS) << 4;
+
+reg [31:0] shaper_refill_period_reg = SHAPER_REFILL_PERIOD;
+
+assign ctrl_reg_wr_wait = 1'b0;
+assign ctrl_reg_wr_ack = ctrl_reg_wr_ack_reg;
+assign ctrl_reg_rd_data = ctrl_reg_rd_data_reg;
+assign ctrl_reg_rd_wait = 1'b0;
+assign ctrl_reg_rd_ack = ctrl_reg_rd_ack_reg;
+
+always @(posedge clk) begin
+    ctrl_reg_wr_ack_reg <= 1'b0;
+    ctrl_reg_rd_data_reg <= 0;
+    ctrl_reg_rd_ack_reg <= 1'b0;
+
+    if (ctrl_reg_wr_en && !ctrl_reg_wr_ack_reg) begin
+        // write operation
+        ctrl_reg_wr_ack_reg <= 1'b1;
+        case ({ctrl_reg_wr_addr >> 2, 2'b00})
+            // Scheduler
+            RBB+8'h28: begin
+                // Sched: Control
+                if (ctrl_reg_wr_strb[0]) begin
+                    sched_enable_reg <= ctrl_reg_wr_data[0];
+                end
+            end
+            RBB+8'h2C: begin
+                // Sched: dest
+                if (ctrl_reg_wr_strb[0]) begin
+                    sched_dest_reg <= ctrl_reg_wr_data[7:0];
+                end
+            end
+            // Shaper scheduler controller
+            RBB+8'h4C: shaper_refill_period_reg <= ctrl_reg_wr_data;  // Sched ctrl: Refill period
+            default: ctrl_reg_wr_ack_reg <= 1'b0;
+        endcase
+    end
+
+    if (ctrl_reg_rd_en && !ctrl_reg_rd_ack_reg) begin
+        // read operation
+        ctrl_reg_rd_ack_reg <= 1'b1;
+        case ({ctrl_reg_rd_addr >> 2, 2'b00})
+            // Scheduler block
+            RBB+8'h00: ctrl_reg_rd_data_reg <= 32'h0000C004;          // Sched block: Type
+            RBB+8'h04: ctrl_reg_rd_data_reg <= 32'h00000300;          // Sched block: Version
+            RBB+8'h08: ctrl_reg_rd_data_reg <= RB_NEXT_PTR;           // Sched block: Next header
+            RBB+8'h0C: ctrl_reg_rd_data_reg <= RB_BASE_ADDR+8'h10;    // Sched block: Offset
+            // Scheduler
+            RBB+8'h10: ctrl_reg_rd_data_reg <= 32'h0000C040;          // Sched: Type
+            RBB+8'h14: ctrl_reg_rd_data_reg <= 32'h00000100;          // Sched: Version
+            RBB+8'h18: ctrl_reg_rd_data_reg <= RB_BASE_ADDR+8'h30;    // Sched: Next header
+            RBB+8'h1C: ctrl_reg_rd_data_reg <= AXIL_OFFSET;           // Sched: Offset
+            RBB+8'h20: ctrl_reg_rd_data_reg <= 2**QUEUE_INDEX_WIDTH;  // Sched: Channel count
+            RBB+8'h24: ctrl_reg_rd_data_reg <= 4;                     // Sched: Channel stride
+            RBB+8'h28: begin
+                // Sched: Control
+                ctrl_reg_rd_data_reg[0] <= sched_enable_reg;
+            end
+            RBB+8'h2C: ctrl_reg_rd_data_reg <= sched_dest_reg;        // Sched: dest
+            // Shaper scheduler controller
+            RBB+8'h30: ctrl_reg_rd_data_reg <= 32'h0000C051;          // Sched ctrl: Type
+            RBB+8'h34: ctrl_reg_rd_data_reg <= 32'h00000100;          // Sched ctrl: Version
+            RBB+8'h38: ctrl_reg_rd_data_reg <= 0;                     // Sched ctrl: Next header
+            RBB+8'h3C: ctrl_reg_rd_data_reg <= AXIL_OFFSET+2**(AXIL_ADDR_WIDTH-1);  // Sched ctrl: Offset
+            RBB+8'h40: ctrl_reg_rd_data_reg <= 2**QUEUE_INDEX_WIDTH;  // Sched ctrl: Channel count
+            RBB+8'h44: ctrl_reg_rd_data_reg <= 16;                    // Sched ctrl: Channel stride
+            RBB+8'h48: begin
+                // Sched ctrl: Control
+                ctrl_reg_rd_data_reg[0] <= 1'b1;
+            end
+            RBB+8'h4C: ctrl_reg_rd_data_reg <= shaper_refill_period_reg;  // Sched ctrl: Refill period
+            default: ctrl_reg_rd_ack_reg <= 1'b0;
+        endcase
+    end
+
+    if (rst) begin
+        ctrl_reg_wr_ack_reg <= 1'b0;
+        ctrl_reg_rd_ack_reg <= 1'b0;
+
+        sched_enable_reg <= 1'b0;
+        sched_dest_reg <= (INDEX % PORTS) << 4;
+
+        shaper_refill_period_reg <= SHAPER_REFILL_PERIOD;
+    end
+end
+
+// AXI lite interconnect
+parameter AXIL_S_COUNT = 1;
+parameter AXIL_M_COUNT = SCHED_COUNT;
+
+axil_crossbar #(
+    .DATA_WIDTH(AXIL_DATA_WIDTH),
+    .ADDR_WIDTH(AXIL_ADDR_WIDTH),
+    .STRB_WIDTH(AXIL_STRB_WIDTH),
+    .S_COUNT(AXIL_S_COUNT),
+    .M_COUNT(AXIL_M_COUNT),
+    .M_ADDR_WIDTH({AXIL_M_COUNT{w_32(AXIL_SCHED_ADDR_WIDTH)}}),
+    .M_CONNECT_READ({AXIL_M_COUNT{{AXIL_S_COUNT{1'b1}}}}),
+    .M_CONNECT_WRITE({AXIL_M_COUNT{{AXIL_S_COUNT{1'b1}}}})
+)
+axil_crossbar_inst (
+    .clk(clk),
+    .rst(rst),
+    .s_axil_awaddr(s_axil_awaddr),
+    .s_axil_awprot(s_axil_awprot),
+    .s_axil_awvalid(s_axil_awvalid),
+    .s_axil_awready(s_axil_awready),
+    .s_axil_wdata(s_axil_wdata),
+    .s_axil_wstrb(s_axil_wstrb),
+    .s_axil_wvalid(s_axil_wvalid),
+    .s_axil_wready(s_axil_wready),
+    .s_axil_bresp(s_axil_bresp),
+    .s_axil_bvalid(s_axil_bvalid),
+    .s_axil_bready(s_axil_bready),
+    .s_axil_araddr(s_axil_araddr),
+    .s_axil_arprot(s_axil_arprot),
+    .s_axil_arvalid(s_axil_arvalid),
+    .s_axil_arready(s_axil_arready),
+    .s_axil_rdata(s_axil_rdata),
+    .s_axil_rresp(s_axil_rresp),
+    .s_axil_rvalid(s_axil_rvalid),
+    .s_axil_rready(s_axil_rready),
+    .m_axil_awaddr(axil_sched_awaddr),
+    .m_axil_awprot(axil_sched_awprot),
+    .m_axil_awvalid(axil_sched_awvalid),
+    .m_axil_awready(axil_sched_awready),
+    .m_axil_wdata(axil_sched_wdata),
+    .m_axil_wstrb(axil_sched_wstrb),
+    .m_axil_wvalid(axil_sched_wvalid),
+    .m_axil_wready(axil_sched_wready),
+    .m_axil_bresp(axil_sched_bresp),
+    .m_axil_bvalid(axil_sched_bvalid),
+    .m_axil_bready(axil_sched_bready),
+    .m_axil_araddr(axil_sched_araddr),
+    .m_axil_arprot(axil_sched_arprot),
+    .m_axil_arvalid(axil_sched_arvalid),
+    .m_axil_arready(axil_sched_arready),
+    .m_axil_rdata(axil_sched_rdata),
+    .m_axil_rresp(axil_sched_rresp),
+    .m_axil_rvalid(axil_sched_rvalid),
+    .m_axil_rready(axil_sched_rready)
+);
+
+assign m_axis_tx_req_dest = sched_dest_reg;
+
+tx_scheduler_rr #(
+    .AXIL_DATA_WIDTH(AXIL_DATA_WIDTH),
+    .AXIL_ADDR_WIDTH(AXIL_SCHED_ADDR_WIDTH),
+    .AXIL_STRB_WIDTH(AXIL_STRB_WIDTH),
+    .LEN_WIDTH(LEN_WIDTH),
+    .REQ_TAG_WIDTH(REQ_TAG_WIDTH),
+    .OP_TABLE_SIZE(OP_TABLE_SIZE),
+    .QUEUE_INDEX_WIDTH(QUEUE_INDEX_WIDTH),
+    .PIPELINE(PIPELINE),
+    .SCHED_CTRL_ENABLE(1)
+)
+tx_scheduler_inst (
+    .clk(clk),
+    .rst(rst),
+
+    /*
+     * Transmit request output (queue index)
+     */
+    .m_axis_tx_req_queue(m_axis_tx_req_queue),
+    .m_axis_tx_req_tag(m_axis_tx_req_tag),
+    .m_axis_tx_req_valid(m_axis_tx_req_valid),
+    .m_axis_tx_req_ready(m_axis_tx_req_ready),
+
+    /*
+     * Transmit request status input
+     */
+    .s_axis_tx_req_status_len(s_axis_tx_req_status_len),
+    .s_axis_tx_req_status_tag(s_axis_tx_req_status_tag),
+    .s_axis_tx_req_status_valid(s_axis_tx_req_status_valid),
+
+    /*
+     * Doorbell input
+     */
+    .s_axis_doorbell_queue(s_axis_doorbell_queue),
+    .s_axis_doorbell_valid(s_axis_doorbell_valid),
+
+    /*
+     * Scheduler control input
+     */
+    .s_axis_sched_ctrl_queue(tx_sched_ctrl_queue),
+    .s_axis_sched_ctrl_enable(tx_sched_ctrl_enable),
+    .s_axis_sched_ctrl_valid(tx_sched_ctrl_valid),
+    .s_axis_sched_ctrl_ready(tx_sched_ctrl_ready),
+
+    /*
+     * AXI-Lite slave interface
+     */
+    .s_axil_awaddr(axil_sched_awaddr[0*AXIL_ADDR_WIDTH +: AXIL_ADDR_WIDTH]),
+    .s_axil_awprot(axil_sched_awprot[0*3 +: 3]),
+    .s_axil_awvalid(axil_sched_awvalid[0*1 +: 1]),
+    .s_axil_awready(axil_sched_awready[0*1 +: 1]),
+    .s_axil_wdata(axil_sched_wdata[0*AXIL_DATA_WIDTH +: AXIL_DATA_WIDTH]),
+    .s_axil_wstrb(axil_sched_wstrb[0*AXIL_STRB_WIDTH +: AXIL_STRB_WIDTH]),
+    .s_axil_wvalid(axil_sched_wvalid[0*1 +: 1]),
+    .s_axil_wready(axil_sched_wready[0*1 +: 1]),
+    .s_axil_bresp(axil_sched_bresp[0*2 +: 2]),
+    .s_axil_bvalid(axil_sched_bvalid[0*1 +: 1]),
+    .s_axil_bready(axil_sched_bready[0*1 +: 1]),
+    .s_axil_araddr(axil_sched_araddr[0*AXIL_ADDR_WIDTH +: AXIL_ADDR_WIDTH]),
+    .s_axil_arprot(axil_sched_arprot[0*3 +: 3]),
+    .s_axil_arvalid(axil_sched_arvalid[0*1 +: 1]),
+    .s_axil_arready(axil_sched_arready[0*1 +: 1]),
+    .s_axil_rdata(axil_sched_rdata[0*AXIL_DATA_WIDTH +: AXIL_DATA_WIDTH]),
+    .s_axil_rresp(axil_sched_rresp[0*2 +: 2]),
+    .s_axil_rvalid(axil_sched_rvalid[0*1 +: 1]),
+    .s_axil_rready(axil_sched_rready[0*1 +: 1]),
+
+    /*
+     * Control
+     */
+    .enable(sched_enable_reg),
+    .active(tx_sched_active)
+);
+
+tx_scheduler_ctrl_shaper #(
+    .AXIL_DATA_WIDTH(AXIL_DATA_WIDTH),
+    .AXIL_ADDR_WIDTH(AXIL_SCHED_ADDR_WIDTH),
+    .AXIL_STRB_WIDTH(AXIL_STRB_WIDTH),
+    .LEN_WIDTH(LEN_WIDTH),
+    .REQ_TAG_WIDTH(REQ_TAG_WIDTH),
+    .QUEUE_INDEX_WIDTH(QUEUE_INDEX_WIDTH),
+    .CREDIT_WIDTH(32),
+    .STATUS_FIFO_DEPTH(16)
+)
+tx_scheduler_ctrl_shaper_inst (
+    .clk(clk),
+    .rst(rst),
+
+    /*
+     * Scheduler control output
+     */
+    .m_axis_sched_ctrl_queue(tx_sched_ctrl_queue),
+    .m_axis_sched_ctrl_enable(tx_sched_ctrl_enable),
+    .m_axis_sched_ctrl_valid(tx_sched_ctrl_valid),
+    .m_axis_sched_ctrl_ready(tx_sched_ctrl_ready),
+
+    /*
+     * Transmit request monitor input
+     */
+    .s_axis_tx_req_queue(m_axis_tx_req_queue),
+    .s_axis_tx_req_tag(m_axis_tx_req_tag),
+    .s_axis_tx_req_valid(m_axis_tx_req_valid),
+    .s_axis_tx_req_ready(m_axis_tx_req_ready),
+
+    /*
+     * Transmit request status input
+     */
+    .s_axis_tx_req_status_len(s_axis_tx_req_status_len),
+    .s_axis_tx_req_status_tag(s_axis_tx_req_status_tag),
+    .s_axis_tx_req_status_valid(s_axis_tx_req_status_valid),
+
+    /*
+     * AXI-Lite slave interface
+     */
+    .s_axil_awaddr(axil_sched_awaddr[1*AXIL_ADDR_WIDTH +: AXIL_ADDR_WIDTH]),
+    .s_axil_awprot(axil_sched_awprot[1*3 +: 3]),
+    .s_axil_awvalid(axil_sched_awvalid[1*1 +: 1]),
+    .s_axil_awready(axil_sched_awready[1*1 +: 1]),
+    .s_axil_wdata(axil_sched_wdata[1*AXIL_DATA_WIDTH +: AXIL_DATA_WIDTH]),
+    .s_axil_wstrb(axil_sched_wstrb[1*AXIL_STRB_WIDTH +: AXIL_STRB_WIDTH]),
+    .s_axil_wvalid(axil_sched_wvalid[1*1 +: 1]),
+    .s_axil_wready(axil_sched_wready[1*1 +: 1]),
+    .s_axil_bresp(axil_sched_bresp[1*2 +: 2]),
+    .s_axil_bvalid(axil_sched_bvalid[1*1 +: 1]),
+    .s_axil_bready(axil_sched_bready[1*1 +: 1]),
+    .s_axil_araddr(axil_sched_araddr[1*AXIL_ADDR_WIDTH +: AXIL_ADDR_WIDTH]),
+    .s_axil_arprot(axil_sched_arprot[1*3 +: 3]),
+    .s_axil_arvalid(axil_sched_arvalid[1*1 +: 1]),
+    .s_axil_arready(axil_sched_arready[1*1 +: 1]),
+    .s_axil_rdata(axil_sched_rdata[1*AXIL_DATA_WIDTH +: AXIL_DATA_WIDTH]),
+    .s_axil_rresp(axil_sched_rresp[1*2 +: 2]),
+    .s_axil_rvalid(axil_sched_rvalid[1*1 +: 1]),
+    .s_axil_rready(axil_sched_rready[1*1 +: 1]),
+
+    /*
+     * Configuration
+     */
+    .refill_period(shaper_refill_period_reg),
+
+    /*
+     * Status
+     */
+    .sched_active(tx_sched_active)
+);
+
+endmodule
+
+`resetall
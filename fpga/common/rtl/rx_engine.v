@@ -247,6 +247,7 @@ module rx_engine #
     /*
      * Configuration
      */
+    output wire [40*8-1:0]                  rx_hash_key,
     input  wire [DMA_CLIENT_LEN_WIDTH-1:0]  mtu,
     input  wire                             enable
 );
@@ -549,6 +550,11 @@ mqnic_rx_queue_map_inst (
     .s_axil_rvalid(s_axil_rvalid),
     .s_axil_rready(s_axil_rready),
 
+    /*
+     * Flow hash key output
+     */
+    .hash_key(rx_hash_key),
+
     /*
      * Request input
      */
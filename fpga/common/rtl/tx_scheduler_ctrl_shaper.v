@@ -0,0 +1,522 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+// Language: Verilog 2001
+
+`resetall
+`timescale 1ns / 1ps
+`default_nettype none
+
+/*
+ * Shaping transmit scheduler control module
+ *
+ * Per-queue token bucket rate limiting and deficit weighted round-robin,
+ * applied by enabling and disabling queues in the transmit scheduler.
+ *
+ * Per-queue registers (16 bytes per queue):
+ *   0x0: rate     bytes credited per refill period (0 = not rate limited)
+ *   0x4: quantum  bytes credited per round (0 = not weighted)
+ *   0x8: tokens   current rate credit (signed)
+ *   0xC: deficit  current round credit (signed)
+ *
+ * Writing rate or quantum also loads the corresponding credit counter.
+ */
+module tx_scheduler_ctrl_shaper #
+(
+    // Width of AXI lite data bus in bits
+    parameter AXIL_DATA_WIDTH = 32,
+    // Width of AXI lite address bus in bits
+    parameter AXIL_ADDR_WIDTH = 16,
+    // Width of AXI lite wstrb (width of data bus in words)
+    parameter AXIL_STRB_WIDTH = (AXIL_DATA_WIDTH/8),
+    // Length field width
+    parameter LEN_WIDTH = 16,
+    // Transmit request tag field width
+    parameter REQ_TAG_WIDTH = 8,
+    // Queue index width
+    parameter QUEUE_INDEX_WIDTH = 6,
+    // Credit counter width
+    parameter CREDIT_WIDTH = 32,
+    // Transmit status FIFO depth
+    parameter STATUS_FIFO_DEPTH = 16
+)
+(
+    input  wire                          clk,
+    input  wire                          rst,
+
+    /*
+     * Scheduler control output
+     */
+    output wire [QUEUE_INDEX_WIDTH-1:0]  m_axis_sched_ctrl_queue,
+    output wire                          m_axis_sched_ctrl_enable,
+    output wire                          m_axis_sched_ctrl_valid,
+    input  wire                          m_axis_sched_ctrl_ready,
+
+    /*
+     * Transmit request monitor input
+     */
+    input  wire [QUEUE_INDEX_WIDTH-1:0]  s_axis_tx_req_queue,
+    input  wire [REQ_TAG_WIDTH-1:0]      s_axis_tx_req_tag,
+    input  wire                          s_axis_tx_req_valid,
+    input  wire                          s_axis_tx_req_ready,
+
+    /*
+     * Transmit request status input
+     */
+    input  wire [LEN_WIDTH-1:0]          s_axis_tx_req_status_len,
+    input  wire [REQ_TAG_WIDTH-1:0]      s_axis_tx_req_status_tag,
+    input  wire                          s_axis_tx_req_status_valid,
+
+    /*
+     * AXI-Lite slave interface
+     */
+    input  wire [AXIL_ADDR_WIDTH-1:0]    s_axil_awaddr,
+    input  wire [2:0]                    s_axil_awprot,
+    input  wire                          s_axil_awvalid,
+    output wire                          s_axil_awready,
+    input  wire [AXIL_DATA_WIDTH-1:0]    s_axil_wdata,
+    input  wire [AXIL_STRB_WIDTH-1:0]    s_axil_wstrb,
+    input  wire                          s_axil_wvalid,
+    output wire                          s_axil_wready,
+    output wire [1:0]                    s_axil_bresp,
+    output wire                          s_axil_bvalid,
+    input  wire                          s_axil_bready,
+    input  wire [AXIL_ADDR_WIDTH-1:0]    s_axil_araddr,
+    input  wire [2:0]                    s_axil_arprot,
+    input  wire                          s_axil_arvalid,
+    output wire                          s_axil_arready,
+    output wire [AXIL_DATA_WIDTH-1:0]    s_axil_rdata,
+    output wire [1:0]                    s_axil_rresp,
+    output wire                          s_axil_rvalid,
+    input  wire                          s_axil_rready,
+
+    /*
+     * Configuration
+     */
+    input  wire [31:0]                   refill_period,
+
+    /*
+     * Status
+     */
+    input  wire                          sched_active
+);
+
+parameter QUEUE_COUNT = 2**QUEUE_INDEX_WIDTH;
+
+parameter ADDR_SHIFT = 4;
+
+parameter CL_STATUS_FIFO_DEPTH = $clog2(STATUS_FIFO_DEPTH);
+
+// bus width assertions
+initial begin
+    if (AXIL_DATA_WIDTH != 32) begin
+        $error("Error: AXI lite interface width must be 32 (instance %m)");
+        $finish;
+    end
+
+    if (AXIL_ADDR_WIDTH < QUEUE_INDEX_WIDTH+ADDR_SHIFT) begin
+        $error("Error: AXI lite address width too narrow (instance %m)");
+        $finish;
+    end
+
+    if (CREDIT_WIDTH > AXIL_DATA_WIDTH || CREDIT_WIDTH <= LEN_WIDTH) begin
+        $error("Error: Invalid credit counter width (instance %m)");
+        $finish;
+    end
+
+    if (2**CL_STATUS_FIFO_DEPTH != STATUS_FIFO_DEPTH) begin
+        $error("Error: Status FIFO depth must be a power of two (instance %m)");
+        $finish;
+    end
+end
+
+localparam [2:0]
+    OP_NONE = 3'd0,
+    OP_AXIL_WRITE = 3'd1,
+    OP_AXIL_READ = 3'd2,
+    OP_STATUS = 3'd3,
+    OP_SWEEP = 3'd4;
+
+reg [2:0] op_reg = OP_NONE, op_next;
+reg [QUEUE_INDEX_WIDTH-1:0] op_queue_reg = 0, op_queue_next;
+reg [1:0] op_sel_reg = 0, op_sel_next;
+reg [CREDIT_WIDTH-1:0] op_data_reg = 0, op_data_next;
+reg last_status_reg = 1'b0, last_status_next;
+
+reg [QUEUE_INDEX_WIDTH-1:0] sweep_ptr_reg = 0, sweep_ptr_next;
+reg sweep_active_reg = 1'b0, sweep_active_next;
+reg sweep_refill_reg = 1'b0, sweep_refill_next;
+reg sweep_round_reg = 1'b0, sweep_round_next;
+
+reg [31:0] refill_count_reg = 0, refill_count_next;
+reg refill_pending_reg = 1'b0, refill_pending_next;
+
+reg [QUEUE_INDEX_WIDTH:0] blocked_count_reg = 0, blocked_count_next;
+
+reg [QUEUE_INDEX_WIDTH-1:0] m_axis_sched_ctrl_queue_reg = 0, m_axis_sched_ctrl_queue_next;
+reg m_axis_sched_ctrl_enable_reg = 1'b0, m_axis_sched_ctrl_enable_next;
+reg m_axis_sched_ctrl_valid_reg = 1'b0, m_axis_sched_ctrl_valid_next;
+
+reg s_axil_awready_reg = 1'b0, s_axil_awready_next;
+reg s_axil_wready_reg = 1'b0, s_axil_wready_next;
+reg s_axil_bvalid_reg = 1'b0, s_axil_bvalid_next;
+reg s_axil_arready_reg = 1'b0, s_axil_arready_next;
+reg [AXIL_DATA_WIDTH-1:0] s_axil_rdata_reg = {AXIL_DATA_WIDTH{1'b0}}, s_axil_rdata_next;
+reg s_axil_rvalid_reg = 1'b0, s_axil_rvalid_next;
+
+// (* RAM_STYLE="BLOCK" *)
+reg [CREDIT_WIDTH-1:0] rate_ram[QUEUE_COUNT-1:0];
+// (* RAM_STYLE="BLOCK" *)
+reg [CREDIT_WIDTH-1:0] quantum_ram[QUEUE_COUNT-1:0];
+// (* RAM_STYLE="BLOCK" *)
+reg [CREDIT_WIDTH-1:0] token_ram[QUEUE_COUNT-1:0];
+// (* RAM_STYLE="BLOCK" *)
+reg [CREDIT_WIDTH-1:0] deficit_ram[QUEUE_COUNT-1:0];
+reg sched_en_ram[QUEUE_COUNT-1:0];
+
+reg [QUEUE_INDEX_WIDTH-1:0] queue_ram_read_ptr;
+reg queue_ram_rd_en;
+reg queue_ram_wr_en;
+
+reg [CREDIT_WIDTH-1:0] rate_rd_reg = 0;
+reg [CREDIT_WIDTH-1:0] quantum_rd_reg = 0;
+reg [CREDIT_WIDTH-1:0] token_rd_reg = 0;
+reg [CREDIT_WIDTH-1:0] deficit_rd_reg = 0;
+reg sched_en_rd_reg = 1'b0;
+
+reg [CREDIT_WIDTH-1:0] rate_wr;
+reg [CREDIT_WIDTH-1:0] quantum_wr;
+reg [CREDIT_WIDTH-1:0] token_wr;
+reg [CREDIT_WIDTH-1:0] deficit_wr;
+reg [CREDIT_WIDTH:0] credit_sum;
+reg eligible;
+reg blocked_rd;
+reg blocked_wr;
+
+// transmit request tag to queue mapping
+reg [QUEUE_INDEX_WIDTH-1:0] tag_queue_ram[2**REQ_TAG_WIDTH-1:0];
+
+// transmit status FIFO
+reg [QUEUE_INDEX_WIDTH-1:0] status_fifo_queue[STATUS_FIFO_DEPTH-1:0];
+reg [LEN_WIDTH-1:0] status_fifo_len[STATUS_FIFO_DEPTH-1:0];
+reg [CL_STATUS_FIFO_DEPTH+1-1:0] status_fifo_wr_ptr_reg = 0;
+reg [CL_STATUS_FIFO_DEPTH+1-1:0] status_fifo_rd_ptr_reg = 0, status_fifo_rd_ptr_next;
+
+wire status_fifo_empty = status_fifo_wr_ptr_reg == status_fifo_rd_ptr_reg;
+wire status_fifo_full = status_fifo_wr_ptr_reg == (status_fifo_rd_ptr_reg ^ {1'b1, {CL_STATUS_FIFO_DEPTH{1'b0}}});
+
+reg read_eligible;
+reg write_eligible;
+
+assign m_axis_sched_ctrl_queue = m_axis_sched_ctrl_queue_reg;
+assign m_axis_sched_ctrl_enable = m_axis_sched_ctrl_enable_reg;
+assign m_axis_sched_ctrl_valid = m_axis_sched_ctrl_valid_reg;
+
+assign s_axil_awready = s_axil_awready_reg;
+assign s_axil_wready = s_axil_wready_reg;
+assign s_axil_bresp = 2'b00;
+assign s_axil_bvalid = s_axil_bvalid_reg;
+assign s_axil_arready = s_axil_arready_reg;
+assign s_axil_rdata = s_axil_rdata_reg;
+assign s_axil_rresp = 2'b00;
+assign s_axil_rvalid = s_axil_rvalid_reg;
+
+integer i, j;
+
+initial begin
+    // two nested loops for smaller number of iterations per loop
+    // workaround for synthesizer complaints about large loop counts
+    for (i = 0; i < 2**QUEUE_INDEX_WIDTH; i = i + 2**(QUEUE_INDEX_WIDTH/2)) begin
+        for (j = i; j < i + 2**(QUEUE_INDEX_WIDTH/2); j = j + 1) begin
+            rate_ram[j] = 0;
+            quantum_ram[j] = 0;
+            token_ram[j] = 0;
+            deficit_ram[j] = 0;
+            sched_en_ram[j] = 1'b0;
+        end
+    end
+
+    for (i = 0; i < 2**REQ_TAG_WIDTH; i = i + 1) begin
+        tag_queue_ram[i] = 0;
+    end
+end
+
+always @* begin
+    op_next = OP_NONE;
+    op_queue_next = op_queue_reg;
+    op_sel_next = op_sel_reg;
+    op_data_next = op_data_reg;
+    last_status_next = last_status_reg;
+
+    sweep_ptr_next = sweep_ptr_reg;
+    sweep_active_next = sweep_active_reg;
+    sweep_refill_next = sweep_refill_reg;
+    sweep_round_next = sweep_round_reg;
+
+    refill_count_next = refill_count_reg;
+    refill_pending_next = refill_pending_reg;
+
+    blocked_count_next = blocked_count_reg;
+
+    status_fifo_rd_ptr_next = status_fifo_rd_ptr_reg;
+
+    queue_ram_read_ptr = 0;
+    queue_ram_rd_en = 1'b0;
+    queue_ram_wr_en = 1'b0;
+
+    rate_wr = rate_rd_reg;
+    quantum_wr = quantum_rd_reg;
+    token_wr = token_rd_reg;
+    deficit_wr = deficit_rd_reg;
+    credit_sum = 0;
+    eligible = 1'b0;
+    blocked_rd = 1'b0;
+    blocked_wr = 1'b0;
+
+    m_axis_sched_ctrl_queue_next = m_axis_sched_ctrl_queue_reg;
+    m_axis_sched_ctrl_enable_next = m_axis_sched_ctrl_enable_reg;
+    m_axis_sched_ctrl_valid_next = m_axis_sched_ctrl_valid_reg && !m_axis_sched_ctrl_ready;
+
+    s_axil_awready_next = 1'b0;
+    s_axil_wready_next = 1'b0;
+    s_axil_bvalid_next = s_axil_bvalid_reg && !s_axil_bready;
+
+    s_axil_arready_next = 1'b0;
+    s_axil_rdata_next = s_axil_rdata_reg;
+    s_axil_rvalid_next = s_axil_rvalid_reg && !s_axil_rready;
+
+    write_eligible = s_axil_awvalid && s_axil_wvalid && (!s_axil_bvalid || s_axil_bready) && (!s_axil_awready && !s_axil_wready);
+    read_eligible = s_axil_arvalid && !s_axil_rvalid && !s_axil_arready;
+
+    // refill timer
+    if (refill_period != 0) begin
+        if (refill_count_reg+1 >= refill_period) begin
+            refill_count_next = 0;
+            refill_pending_next = 1'b1;
+        end else begin
+            refill_count_next = refill_count_reg + 1;
+        end
+    end
+
+    // start a sweep for a pending refill, or start a new round when
+    // weighted queues are out of credit and the scheduler has run dry
+    if (!sweep_active_reg && (refill_pending_reg || (blocked_count_reg != 0 && !sched_active))) begin
+        sweep_active_next = 1'b1;
+        sweep_ptr_next = 0;
+        sweep_refill_next = refill_pending_reg;
+        sweep_round_next = blocked_count_reg != 0 && !sched_active;
+        refill_pending_next = 1'b0;
+    end
+
+    if (op_reg != OP_NONE) begin
+        // second cycle: update queue state
+        case (op_reg)
+            OP_AXIL_WRITE: begin
+                case (op_sel_reg)
+                    2'd0: begin
+                        rate_wr = op_data_reg;
+                        token_wr = op_data_reg;
+                    end
+                    2'd1: begin
+                        quantum_wr = op_data_reg;
+                        deficit_wr = op_data_reg;
+                    end
+                    2'd2: token_wr = op_data_reg;
+                    2'd3: deficit_wr = op_data_reg;
+                endcase
+            end
+            OP_AXIL_READ: begin
+                case (op_sel_reg)
+                    2'd0: s_axil_rdata_next = rate_rd_reg;
+                    2'd1: s_axil_rdata_next = quantum_rd_reg;
+                    2'd2: s_axil_rdata_next = $signed(token_rd_reg);
+                    2'd3: s_axil_rdata_next = $signed(deficit_rd_reg);
+                endcase
+                s_axil_rvalid_next = 1'b1;
+            end
+            OP_STATUS: begin
+                // charge transmitted bytes
+                if (rate_rd_reg != 0) begin
+                    token_wr = token_rd_reg - op_data_reg;
+                end
+                if (quantum_rd_reg != 0) begin
+                    deficit_wr = deficit_rd_reg - op_data_reg;
+                end
+            end
+            OP_SWEEP: begin
+                // refill tokens, capped at one period worth of credit
+                if (sweep_refill_reg && rate_rd_reg != 0) begin
+                    credit_sum = $signed(token_rd_reg) + $signed({1'b0, rate_rd_reg});
+                    if ($signed(credit_sum) > $signed({1'b0, rate_rd_reg})) begin
+                        token_wr = rate_rd_reg;
+                    end else begin
+                        token_wr = credit_sum;
+                    end
+                end
+                // start new round, capped at one quantum of credit
+                if (sweep_round_reg && quantum_rd_reg != 0) begin
+                    credit_sum = $signed(deficit_rd_reg) + $signed({1'b0, quantum_rd_reg});
+                    if ($signed(credit_sum) > $signed({1'b0, quantum_rd_reg})) begin
+                        deficit_wr = quantum_rd_reg;
+                    end else begin
+                        deficit_wr = credit_sum;
+                    end
+                end
+            end
+            default: begin end
+        endcase
+
+        eligible = (rate_wr == 0 || $signed(token_wr) > 0) && (quantum_wr == 0 || $signed(deficit_wr) > 0);
+        blocked_rd = quantum_rd_reg != 0 && $signed(deficit_rd_reg) <= 0;
+        blocked_wr = quantum_wr != 0 && $signed(deficit_wr) <= 0;
+
+        if (op_reg != OP_AXIL_READ) begin
+            queue_ram_wr_en = 1'b1;
+
+            if (blocked_wr && !blocked_rd) begin
+                blocked_count_next = blocked_count_reg + 1;
+            end else if (!blocked_wr && blocked_rd) begin
+                blocked_count_next = blocked_count_reg - 1;
+            end
+
+            // output register is free, checked when the operation was issued
+            if (eligible != sched_en_rd_reg) begin
+                m_axis_sched_ctrl_queue_next = op_queue_reg;
+                m_axis_sched_ctrl_enable_next = eligible;
+                m_axis_sched_ctrl_valid_next = 1'b1;
+            end
+        end
+    end else if (!m_axis_sched_ctrl_valid_reg || m_axis_sched_ctrl_ready) begin
+        // first cycle: issue operation and read queue state
+        if (write_eligible) begin
+            s_axil_awready_next = 1'b1;
+            s_axil_wready_next = 1'b1;
+            s_axil_bvalid_next = 1'b1;
+
+            op_next = OP_AXIL_WRITE;
+            op_queue_next = s_axil_awaddr >> ADDR_SHIFT;
+            op_sel_next = s_axil_awaddr >> 2;
+            op_data_next = s_axil_wdata;
+        end else if (read_eligible) begin
+            s_axil_arready_next = 1'b1;
+
+            op_next = OP_AXIL_READ;
+            op_queue_next = s_axil_araddr >> ADDR_SHIFT;
+            op_sel_next = s_axil_araddr >> 2;
+        end else if (!status_fifo_empty && !(sweep_active_reg && last_status_reg)) begin
+            // alternate with sweep so that neither can starve the other
+            last_status_next = 1'b1;
+
+            op_next = OP_STATUS;
+            op_queue_next = status_fifo_queue[status_fifo_rd_ptr_reg[CL_STATUS_FIFO_DEPTH-1:0]];
+            op_data_next = status_fifo_len[status_fifo_rd_ptr_reg[CL_STATUS_FIFO_DEPTH-1:0]];
+            status_fifo_rd_ptr_next = status_fifo_rd_ptr_reg + 1;
+        end else if (sweep_active_reg) begin
+            last_status_next = 1'b0;
+
+            op_next = OP_SWEEP;
+            op_queue_next = sweep_ptr_reg;
+            sweep_ptr_next = sweep_ptr_reg + 1;
+            if (sweep_ptr_reg == {QUEUE_INDEX_WIDTH{1'b1}}) begin
+                sweep_active_next = 1'b0;
+            end
+        end
+
+        if (op_next != OP_NONE) begin
+            queue_ram_rd_en = 1'b1;
+            queue_ram_read_ptr = op_queue_next;
+        end
+    end
+end
+
+always @(posedge clk) begin
+    op_reg <= op_next;
+    op_queue_reg <= op_queue_next;
+    op_sel_reg <= op_sel_next;
+    op_data_reg <= op_data_next;
+    last_status_reg <= last_status_next;
+
+    sweep_ptr_reg <= sweep_ptr_next;
+    sweep_active_reg <= sweep_active_next;
+    sweep_refill_reg <= sweep_refill_next;
+    sweep_round_reg <= sweep_round_next;
+
+    refill_count_reg <= refill_count_next;
+    refill_pending_reg <= refill_pending_next;
+
+    blocked_count_reg <= blocked_count_next;
+
+    status_fifo_rd_ptr_reg <= status_fifo_rd_ptr_next;
+
+    m_axis_sched_ctrl_queue_reg <= m_axis_sched_ctrl_queue_next;
+    m_axis_sched_ctrl_enable_reg <= m_axis_sched_ctrl_enable_next;
+    m_axis_sched_ctrl_valid_reg <= m_axis_sched_ctrl_valid_next;
+
+    s_axil_awready_reg <= s_axil_awready_next;
+    s_axil_wready_reg <= s_axil_wready_next;
+    s_axil_bvalid_reg <= s_axil_bvalid_next;
+    s_axil_arready_reg <= s_axil_arready_next;
+    s_axil_rdata_reg <= s_axil_rdata_next;
+    s_axil_rvalid_reg <= s_axil_rvalid_next;
+
+    if (queue_ram_rd_en) begin
+        rate_rd_reg <= rate_ram[queue_ram_read_ptr];
+        quantum_rd_reg <= quantum_ram[queue_ram_read_ptr];
+        token_rd_reg <= token_ram[queue_ram_read_ptr];
+        deficit_rd_reg <= deficit_ram[queue_ram_read_ptr];
+        sched_en_rd_reg <= sched_en_ram[queue_ram_read_ptr];
+    end
+
+    if (queue_ram_wr_en) begin
+        rate_ram[op_queue_reg] <= rate_wr;
+        quantum_ram[op_queue_reg] <= quantum_wr;
+        token_ram[op_queue_reg] <= token_wr;
+        deficit_ram[op_queue_reg] <= deficit_wr;
+        sched_en_ram[op_queue_reg] <= eligible;
+    end
+
+    // record queue for each transmit request tag
+    if (s_axis_tx_req_valid && s_axis_tx_req_ready) begin
+        tag_queue_ram[s_axis_tx_req_tag] <= s_axis_tx_req_queue;
+    end
+
+    // queue nonzero transmit status for accounting; if the FIFO overflows
+    // under a burst of minimum size frames, the limits are only relaxed
+    if (s_axis_tx_req_status_valid && s_axis_tx_req_status_len != 0 && !status_fifo_full) begin
+        status_fifo_queue[status_fifo_wr_ptr_reg[CL_STATUS_FIFO_DEPTH-1:0]] <= tag_queue_ram[s_axis_tx_req_status_tag];
+        status_fifo_len[status_fifo_wr_ptr_reg[CL_STATUS_FIFO_DEPTH-1:0]] <= s_axis_tx_req_status_len;
+        status_fifo_wr_ptr_reg <= status_fifo_wr_ptr_reg + 1;
+    end
+
+    if (rst) begin
+        op_reg <= OP_NONE;
+        last_status_reg <= 1'b0;
+
+        sweep_ptr_reg <= 0;
+        sweep_active_reg <= 1'b0;
+        sweep_refill_reg <= 1'b0;
+        sweep_round_reg <= 1'b0;
+
+        refill_count_reg <= 0;
+        refill_pending_reg <= 1'b0;
+
+        blocked_count_reg <= 0;
+
+        status_fifo_wr_ptr_reg <= 0;
+        status_fifo_rd_ptr_reg <= 0;
+
+        m_axis_sched_ctrl_valid_reg <= 1'b0;
+
+        s_axil_awready_reg <= 1'b0;
+        s_axil_wready_reg <= 1'b0;
+        s_axil_bvalid_reg <= 1'b0;
+        s_axil_arready_reg <= 1'b0;
+        s_axil_rvalid_reg <= 1'b0;
+    end
+end
+
+endmodule
+
+`resetall
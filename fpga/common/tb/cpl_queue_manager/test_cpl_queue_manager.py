@@ -89,6 +89,8 @@ MQNIC_CQ_PTR_MASK     = 0xFFFF
 
 MQNIC_CQ_CMD_SET_VF_ID         = 0x80010000
 MQNIC_CQ_CMD_SET_SIZE          = 0x80020000
+MQNIC_CQ_CMD_SET_HOLDOFF_TIME  = 0x80030000
+MQNIC_CQ_CMD_SET_HOLDOFF_COUNT = 0x80040000
 MQNIC_CQ_CMD_SET_EQN           = 0xC0000000
 MQNIC_CQ_CMD_SET_PROD_PTR      = 0x80800000
 MQNIC_CQ_CMD_SET_CONS_PTR      = 0x80900000
@@ -259,6 +261,177 @@ async def run_test(dut):
                 tb.log.info("Consumer pointer: %d", cons_ptr)
                 await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR | cons_ptr)
 
+    tb.log.info("Test interrupt holdoff")
+
+    q = 8
+
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 0)
+    await tb.axil_master.write_qword(q*16+MQNIC_CQ_BASE_ADDR_VF_REG, 0x5555555555000000 + 0x10000*q)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_VF_ID | 0)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_SIZE | 4)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_EQN | q)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_TIME | 4)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_COUNT | 0)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_PROD_PTR | 0)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 1)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR_ARM | 0)
+
+    async def enqueue(q):
+        await tb.enqueue_req_source.send(EnqueueReqTransaction(queue=q, tag=0))
+        resp = await tb.enqueue_resp_sink.recv()
+        assert resp.queue == q
+        assert not resp.full
+        assert not resp.error
+        await tb.enqueue_commit_source.send(EnqueueCommitTransaction(op_tag=resp.op_tag))
+
+    def get_events(q):
+        events = []
+        while not tb.event_sink.empty():
+            event = tb.event_sink.recv_nowait()
+            if event.event_source == q:
+                events.append(event)
+        return events
+
+    await Timer(1000, 'ns')
+    get_events(q)
+
+    # holdoff time of 4 ticks (1024 cycles), event held off after arm
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR_ARM | 0)
+    await enqueue(q)
+    await Timer(1000, 'ns')
+
+    assert not get_events(q)
+
+    # event generated by timer once holdoff expires
+    await Timer(8000, 'ns')
+
+    events = get_events(q)
+    tb.log.info("Events: %s", events)
+    assert len(events) == 1
+    assert events[0].event == q
+
+    # queue disarmed, no further events
+    await enqueue(q)
+    await Timer(8000, 'ns')
+
+    assert not get_events(q)
+
+    # long holdoff time, count threshold of 4
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_TIME | 1000)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_COUNT | 4)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR_ARM | 2)
+
+    for k in range(3):
+        await enqueue(q)
+
+    await Timer(1000, 'ns')
+
+    assert not get_events(q)
+
+    await enqueue(q)
+    await Timer(1000, 'ns')
+
+    events = get_events(q)
+    tb.log.info("Events: %s", events)
+    assert len(events) == 1
+    assert events[0].event == q
+
+    # arm with non-empty queue, event held off until holdoff expires
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_TIME | 4)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR_ARM | 2)
+    await Timer(1000, 'ns')
+
+    assert not get_events(q)
+
+    await Timer(8000, 'ns')
+
+    events = get_events(q)
+    tb.log.info("Events: %s", events)
+    assert len(events) == 1
+
+    # holdoff disabled, event generated immediately
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_TIME | 0)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_COUNT | 0)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR_ARM | 6)
+    await enqueue(q)
+    await Timer(100, 'ns')
+
+    events = get_events(q)
+    assert len(events) == 1
+
+    tb.log.info("Test interrupt holdoff under commit load")
+
+    load_q = 10
+
+    # load queue is left disarmed so its commits do not generate events
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 0)
+    await tb.axil_master.write_qword(load_q*16+MQNIC_CQ_BASE_ADDR_VF_REG, 0x5555555555000000 + 0x10000*load_q)
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_VF_ID | 0)
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_SIZE | 15)
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_EQN | load_q)
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_PROD_PTR | 0)
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR | 0)
+    await tb.axil_master.write_dword(load_q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 1)
+
+    load_active = True
+    load_sent = 0
+    load_committed = 0
+
+    async def load_req():
+        nonlocal load_sent
+        while load_active:
+            if load_sent - load_committed < OP_TABLE_SIZE:
+                await tb.enqueue_req_source.send(EnqueueReqTransaction(queue=load_q, tag=0))
+                load_sent += 1
+            else:
+                await RisingEdge(dut.clk)
+
+    async def load_commit():
+        nonlocal load_committed
+        while True:
+            resp = await tb.enqueue_resp_sink.recv()
+            assert resp.queue == load_q
+            assert not resp.full
+            assert not resp.error
+            await tb.enqueue_commit_source.send(EnqueueCommitTransaction(op_tag=resp.op_tag))
+            load_committed += 1
+
+    # holdoff time of 4 ticks (1024 cycles), one completion pending
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_HOLDOFF_TIME | 4)
+    await tb.axil_master.write_dword(q*16+MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR_ARM | 7)
+    await enqueue(q)
+    await Timer(100, 'ns')
+    get_events(q)
+
+    # continuous commits into the load queue while the holdoff expires
+    req_task = cocotb.start_soon(load_req())
+    commit_task = cocotb.start_soon(load_commit())
+
+    await Timer(1000, 'ns')
+
+    assert not get_events(q)
+
+    # holdoff (4096 ns) plus tick granularity (1024 ns) plus worst-case scan
+    # sweep of QUEUE_COUNT*2*PIPELINE cycles (4096 ns)
+    await Timer(10000, 'ns')
+
+    events = get_events(q)
+    tb.log.info("Events: %s", events)
+    assert len(events) == 1
+    assert events[0].event == q
+
+    load_active = False
+    await req_task
+    while load_committed < load_sent:
+        await RisingEdge(dut.clk)
+    commit_task.kill()
+
+    tb.log.info("Load commits: %d", load_committed)
+    assert load_committed > 0
+
+    prod_ptr = (await tb.axil_master.read_dword(load_q*16+MQNIC_CQ_PTR_REG)) & MQNIC_CQ_PTR_MASK
+    assert prod_ptr == load_committed & MQNIC_CQ_PTR_MASK
+
     await RisingEdge(dut.clk)
     await RisingEdge(dut.clk)
 
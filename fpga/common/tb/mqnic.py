@@ -156,6 +156,12 @@ MQNIC_RB_RX_QUEUE_MAP_CH_STRIDE        = 0x10
 MQNIC_RB_RX_QUEUE_MAP_CH_REG_OFFSET    = 0x00
 MQNIC_RB_RX_QUEUE_MAP_CH_REG_RSS_MASK  = 0x04
 MQNIC_RB_RX_QUEUE_MAP_CH_REG_APP_MASK  = 0x08
+MQNIC_RB_RX_QUEUE_MAP_HASH_KEY_STRIDE  = 0x04
+MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_INDEX   = 0x00
+MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_HASH    = 0x04
+MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_QUEUE   = 0x08
+
+MQNIC_RX_FLOW_TABLE_VALID = 0x80000000
 
 MQNIC_RB_EQM_TYPE        = 0x0000C010
 MQNIC_RB_EQM_VER         = 0x00000400
@@ -211,6 +217,19 @@ MQNIC_RB_SCHED_CTRL_TDMA_REG_CH_STRIDE  = 0x14
 MQNIC_RB_SCHED_CTRL_TDMA_REG_CTRL       = 0x18
 MQNIC_RB_SCHED_CTRL_TDMA_REG_TS_COUNT   = 0x1C
 
+MQNIC_RB_SCHED_CTRL_SHAPER_TYPE              = 0x0000C051
+MQNIC_RB_SCHED_CTRL_SHAPER_VER               = 0x00000100
+MQNIC_RB_SCHED_CTRL_SHAPER_REG_OFFSET        = 0x0C
+MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_COUNT      = 0x10
+MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_STRIDE     = 0x14
+MQNIC_RB_SCHED_CTRL_SHAPER_REG_CTRL          = 0x18
+MQNIC_RB_SCHED_CTRL_SHAPER_REG_REFILL_PERIOD = 0x1C
+
+MQNIC_SCHED_SHAPER_CH_REG_RATE     = 0x00
+MQNIC_SCHED_SHAPER_CH_REG_QUANTUM  = 0x04
+MQNIC_SCHED_SHAPER_CH_REG_TOKENS   = 0x08
+MQNIC_SCHED_SHAPER_CH_REG_DEFICIT  = 0x0C
+
 MQNIC_RB_TDMA_SCH_TYPE                     = 0x0000C060
 MQNIC_RB_TDMA_SCH_VER                      = 0x00000100
 MQNIC_RB_TDMA_SCH_REG_TS_COUNT             = 0x0C
@@ -268,6 +287,8 @@ MQNIC_CQ_PTR_MASK     = 0xFFFF
 
 MQNIC_CQ_CMD_SET_VF_ID         = 0x80010000
 MQNIC_CQ_CMD_SET_SIZE          = 0x80020000
+MQNIC_CQ_CMD_SET_HOLDOFF_TIME  = 0x80030000
+MQNIC_CQ_CMD_SET_HOLDOFF_COUNT = 0x80040000
 MQNIC_CQ_CMD_SET_EQN           = 0xC0000000
 MQNIC_CQ_CMD_SET_PROD_PTR      = 0x80800000
 MQNIC_CQ_CMD_SET_CONS_PTR      = 0x80900000
@@ -288,6 +309,8 @@ MQNIC_EQ_PTR_MASK     = 0xFFFF
 
 MQNIC_EQ_CMD_SET_VF_ID         = 0x80010000
 MQNIC_EQ_CMD_SET_SIZE          = 0x80020000
+MQNIC_EQ_CMD_SET_HOLDOFF_TIME  = 0x80030000
+MQNIC_EQ_CMD_SET_HOLDOFF_COUNT = 0x80040000
 MQNIC_EQ_CMD_SET_IRQN          = 0xC0000000
 MQNIC_EQ_CMD_SET_PROD_PTR      = 0x80800000
 MQNIC_EQ_CMD_SET_CONS_PTR      = 0x80900000
@@ -1067,6 +1090,15 @@ class SchedulerControlTdma(BaseScheduler):
         self.hw_regs = self.rb.parent.create_window(offset)
 
 
+class SchedulerControlShaper(BaseScheduler):
+    def __init__(self, port, index, rb):
+        super().__init__(port, index, rb)
+
+    async def init(self):
+        offset = await self.rb.read_dword(MQNIC_RB_SCHED_CTRL_SHAPER_REG_OFFSET)
+        self.hw_regs = self.rb.parent.create_window(offset)
+
+
 class SchedulerBlock:
     def __init__(self, interface, index, rb):
         self.interface = interface
@@ -1102,6 +1134,12 @@ class SchedulerBlock:
                 await s.init()
                 self.schedulers.append(s)
 
+                self.sched_count += 1
+            elif rb.type == MQNIC_RB_SCHED_CTRL_SHAPER_TYPE and rb.version == MQNIC_RB_SCHED_CTRL_SHAPER_VER:
+                s = SchedulerControlShaper(self, self.sched_count, rb)
+                await s.init()
+                self.schedulers.append(s)
+
                 self.sched_count += 1
 
         self.log.info("Scheduler count: %d", self.sched_count)
@@ -1176,6 +1214,10 @@ class Interface:
 
         self.rx_queue_map_indir_table_size = None
         self.rx_queue_map_indir_table = []
+        self.rx_hash_key_size = None
+        self.rx_hash_key_offset = None
+        self.rx_flow_table_size = None
+        self.rx_flow_table_offset = None
 
         self.eq = []
 
@@ -1278,6 +1320,10 @@ class Interface:
 
         val = await self.rx_queue_map_rb.read_dword(MQNIC_RB_RX_QUEUE_MAP_REG_CFG)
         self.rx_queue_map_indir_table_size = 2**((val >> 8) & 0xff)
+        self.rx_hash_key_size = ((val >> 16) & 0xff)*4
+        self.rx_hash_key_offset = MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET + MQNIC_RB_RX_QUEUE_MAP_CH_STRIDE*(val & 0xff)
+        self.rx_flow_table_size = 2**((val >> 24) & 0xff) if (val >> 24) & 0xff else 0
+        self.rx_flow_table_offset = self.rx_hash_key_offset + self.rx_hash_key_size
         self.rx_queue_map_indir_table = []
         for k in range(self.port_count):
             offset = await self.rx_queue_map_rb.read_dword(MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET +
@@ -1471,6 +1517,24 @@ class Interface:
     async def set_rx_queue_map_indir_table(self, port, index, val):
         await self.rx_queue_map_indir_table[port].write_dword(index*4, val)
 
+    async def get_rx_hash_key(self):
+        key = bytearray()
+        for k in range(self.rx_hash_key_size // 4):
+            val = await self.rx_queue_map_rb.read_dword(self.rx_hash_key_offset + MQNIC_RB_RX_QUEUE_MAP_HASH_KEY_STRIDE*k)
+            key.extend(val.to_bytes(4, 'big'))
+        return bytes(key)
+
+    async def set_rx_hash_key(self, key):
+        for k in range(self.rx_hash_key_size // 4):
+            val = int.from_bytes(key[k*4:k*4+4], 'big')
+            await self.rx_queue_map_rb.write_dword(self.rx_hash_key_offset + MQNIC_RB_RX_QUEUE_MAP_HASH_KEY_STRIDE*k, val)
+
+    async def set_rx_flow_table_entry(self, index, hash, queue, valid=True):
+        await self.rx_queue_map_rb.write_dword(self.rx_flow_table_offset + MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_INDEX, index)
+        await self.rx_queue_map_rb.write_dword(self.rx_flow_table_offset + MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_HASH, hash)
+        await self.rx_queue_map_rb.write_dword(self.rx_flow_table_offset + MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_QUEUE,
+                queue | (MQNIC_RX_FLOW_TABLE_VALID if valid else 0))
+
     async def recv(self):
         if not self.pkt_rx_queue:
             self.pkt_rx_sync.clear()
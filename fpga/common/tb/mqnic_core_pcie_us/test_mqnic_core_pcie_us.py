@@ -555,6 +555,53 @@ async def run_test_nic(dut):
 
         await tb.driver.interfaces[0].set_rx_queue_map_rss_mask(0, 0)
 
+    if tb.driver.interfaces[0].if_feature_rss and tb.driver.interfaces[0].rx_flow_table_size:
+        tb.log.info("Queue mapping flow table test")
+
+        key = int.from_bytes(await tb.driver.interfaces[0].get_rx_hash_key(), 'big')
+
+        def flow_hash(data):
+            k = tb.driver.interfaces[0].rx_hash_key_size*8-32
+            h = 0
+            for b in data:
+                for i in range(8):
+                    if b & 0x80 >> i:
+                        h ^= (key >> k) & 0xffffffff
+                    k -= 1
+            return h
+
+        # steer flow with dport 5 to queue 2
+        flow_data = bytes([192, 168, 1, 100, 192, 168, 1, 101]) + (1).to_bytes(2, 'big') + (5).to_bytes(2, 'big')
+        h = flow_hash(flow_data)
+        index = h & (tb.driver.interfaces[0].rx_flow_table_size-1)
+
+        await tb.driver.interfaces[0].set_rx_flow_table_entry(index, h, 2)
+
+        tb.loopback_enable = True
+
+        for k in range(8):
+            payload = bytes([x % 256 for x in range(256)])
+            eth = Ether(src='5A:51:52:53:54:55', dst='DA:D1:D2:D3:D4:D5')
+            ip = IP(src='192.168.1.100', dst='192.168.1.101')
+            udp = UDP(sport=1, dport=k+0)
+            test_pkt = eth / ip / udp / payload
+
+            await tb.driver.interfaces[0].start_xmit(test_pkt.build(), 0)
+
+        for k in range(8):
+            pkt = await tb.driver.interfaces[0].recv()
+
+            tb.log.info("Packet: %s", pkt)
+
+            if Ether(pkt.data)[UDP].dport == 5:
+                assert pkt.queue == 2
+            else:
+                assert pkt.queue == 0
+
+        tb.loopback_enable = False
+
+        await tb.driver.interfaces[0].set_rx_flow_table_entry(index, 0, 0, False)
+
     tb.log.info("Multiple small packets")
 
     count = 64
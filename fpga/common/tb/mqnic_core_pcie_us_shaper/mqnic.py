@@ -0,0 +1 @@
+../mqnic.py
\ No newline at end of file
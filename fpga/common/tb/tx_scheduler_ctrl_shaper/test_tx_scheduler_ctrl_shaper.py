@@ -0,0 +1,241 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: BSD-2-Clause-Views
+# Copyright (c) 2023 The Regents of the University of California
+
+import logging
+import os
+
+import cocotb_test.simulator
+
+import cocotb
+from cocotb.clock import Clock
+from cocotb.triggers import RisingEdge
+from cocotb.regression import TestFactory
+
+from cocotbext.axi import AxiLiteBus, AxiLiteMaster
+from cocotbext.axi.stream import define_stream
+
+
+SchedCtrlBus, SchedCtrlTransaction, SchedCtrlSource, SchedCtrlSink, SchedCtrlMonitor = define_stream("SchedCtrl",
+    signals=["queue", "enable", "valid"],
+    optional_signals=["ready"]
+)
+
+
+class TB(object):
+    def __init__(self, dut):
+        self.dut = dut
+
+        self.log = logging.getLogger("cocotb.tb")
+        self.log.setLevel(logging.DEBUG)
+
+        cocotb.start_soon(Clock(dut.clk, 4, units="ns").start())
+
+        self.axil_master = AxiLiteMaster(AxiLiteBus.from_prefix(dut, "s_axil"), dut.clk, dut.rst)
+
+        self.sched_ctrl_sink = SchedCtrlSink(SchedCtrlBus.from_prefix(dut, "m_axis_sched_ctrl"), dut.clk, dut.rst)
+
+        dut.s_axis_tx_req_queue.setimmediatevalue(0)
+        dut.s_axis_tx_req_tag.setimmediatevalue(0)
+        dut.s_axis_tx_req_valid.setimmediatevalue(0)
+        dut.s_axis_tx_req_ready.setimmediatevalue(0)
+
+        dut.s_axis_tx_req_status_len.setimmediatevalue(0)
+        dut.s_axis_tx_req_status_tag.setimmediatevalue(0)
+        dut.s_axis_tx_req_status_valid.setimmediatevalue(0)
+
+        dut.refill_period.setimmediatevalue(0)
+        dut.sched_active.setimmediatevalue(0)
+
+        self.queue_enable = {}
+        self.tag = 0
+
+        cocotb.start_soon(self._run_sched_ctrl())
+
+    async def reset(self):
+        self.dut.rst.setimmediatevalue(0)
+        await RisingEdge(self.dut.clk)
+        await RisingEdge(self.dut.clk)
+        self.dut.rst.value = 1
+        await RisingEdge(self.dut.clk)
+        await RisingEdge(self.dut.clk)
+        self.dut.rst.value = 0
+        await RisingEdge(self.dut.clk)
+        await RisingEdge(self.dut.clk)
+
+    async def _run_sched_ctrl(self):
+        while True:
+            cmd = await self.sched_ctrl_sink.recv()
+            self.queue_enable[int(cmd.queue)] = bool(int(cmd.enable))
+
+    async def transmit(self, queues, length, cycles):
+        # round-robin over queues enabled by the shaper, one packet every
+        # few cycles, similar to the round-robin scheduler and TX engine
+        tx_bytes = {q: 0 for q in queues}
+        index = 0
+
+        for k in range(cycles // 4):
+            enabled = [q for q in queues if self.queue_enable.get(q, False)]
+
+            self.dut.sched_active.value = 1 if enabled else 0
+
+            if enabled:
+                q = enabled[index % len(enabled)]
+                index += 1
+
+                self.dut.s_axis_tx_req_queue.value = q
+                self.dut.s_axis_tx_req_tag.value = self.tag
+                self.dut.s_axis_tx_req_valid.value = 1
+                self.dut.s_axis_tx_req_ready.value = 1
+                await RisingEdge(self.dut.clk)
+                self.dut.s_axis_tx_req_valid.value = 0
+
+                self.dut.s_axis_tx_req_status_len.value = length
+                self.dut.s_axis_tx_req_status_tag.value = self.tag
+                self.dut.s_axis_tx_req_status_valid.value = 1
+                await RisingEdge(self.dut.clk)
+                self.dut.s_axis_tx_req_status_valid.value = 0
+
+                self.tag = (self.tag + 1) % 256
+                tx_bytes[q] += length
+            else:
+                await RisingEdge(self.dut.clk)
+                await RisingEdge(self.dut.clk)
+
+            await RisingEdge(self.dut.clk)
+            await RisingEdge(self.dut.clk)
+
+        self.dut.sched_active.value = 0
+
+        return tx_bytes
+
+
+SHAPER_RATE_REG = 0x0
+SHAPER_QUANTUM_REG = 0x4
+SHAPER_TOKENS_REG = 0x8
+SHAPER_DEFICIT_REG = 0xC
+
+
+async def run_test(dut):
+
+    tb = TB(dut)
+
+    await tb.reset()
+
+    tb.log.info("Test read and write queue shaper registers")
+
+    await tb.axil_master.write_dword(3*16+SHAPER_RATE_REG, 1234)
+    await tb.axil_master.write_dword(3*16+SHAPER_QUANTUM_REG, 5678)
+
+    assert await tb.axil_master.read_dword(3*16+SHAPER_RATE_REG) == 1234
+    assert await tb.axil_master.read_dword(3*16+SHAPER_QUANTUM_REG) == 5678
+    assert await tb.axil_master.read_dword(3*16+SHAPER_TOKENS_REG) == 1234
+    assert await tb.axil_master.read_dword(3*16+SHAPER_DEFICIT_REG) == 5678
+
+    await tb.axil_master.write_dword(3*16+SHAPER_RATE_REG, 0)
+    await tb.axil_master.write_dword(3*16+SHAPER_QUANTUM_REG, 0)
+
+    tb.log.info("Test rate limiting")
+
+    refill_period = 256
+    periods = 40
+    length = 100
+    rates = {0: 200, 1: 400}
+
+    for q, rate in rates.items():
+        await tb.axil_master.write_dword(q*16+SHAPER_RATE_REG, rate)
+
+    dut.refill_period.value = refill_period
+
+    tx_bytes = await tb.transmit([0, 1, 2], length, refill_period*periods)
+
+    dut.refill_period.value = 0
+
+    for q, b in tx_bytes.items():
+        tb.log.info("Queue %d: %d bytes", q, b)
+
+    for q, rate in rates.items():
+        # initial bucket plus outstanding packet
+        assert abs(tx_bytes[q] - rate*periods) <= rate + 2*length
+
+    # unlimited queue uses remaining capacity
+    assert tx_bytes[2] > tx_bytes[0] + tx_bytes[1]
+
+    for q in rates:
+        await tb.axil_master.write_dword(q*16+SHAPER_RATE_REG, 0)
+
+    tb.log.info("Test weighted round-robin")
+
+    quanta = {0: 500, 1: 1500}
+
+    for q, quantum in quanta.items():
+        await tb.axil_master.write_dword(q*16+SHAPER_QUANTUM_REG, quantum)
+
+    tx_bytes = await tb.transmit([0, 1], length, 20000)
+
+    for q, b in tx_bytes.items():
+        tb.log.info("Queue %d: %d bytes", q, b)
+
+    ratio = tx_bytes[1] / tx_bytes[0]
+    tb.log.info("Ratio: %f", ratio)
+
+    assert 2.7 < ratio < 3.3
+
+    for q in quanta:
+        await tb.axil_master.write_dword(q*16+SHAPER_QUANTUM_REG, 0)
+
+    await RisingEdge(dut.clk)
+    await RisingEdge(dut.clk)
+
+
+if cocotb.SIM_NAME:
+
+    factory = TestFactory(run_test)
+    factory.generate_tests()
+
+
+# cocotb-test
+
+tests_dir = os.path.dirname(__file__)
+rtl_dir = os.path.abspath(os.path.join(tests_dir, '..', '..', 'rtl'))
+lib_dir = os.path.abspath(os.path.join(rtl_dir, '..', 'lib'))
+axi_rtl_dir = os.path.abspath(os.path.join(lib_dir, 'axi', 'rtl'))
+axis_rtl_dir = os.path.abspath(os.path.join(lib_dir, 'axis', 'rtl'))
+eth_rtl_dir = os.path.abspath(os.path.join(lib_dir, 'eth', 'rtl'))
+pcie_rtl_dir = os.path.abspath(os.path.join(lib_dir, 'pcie', 'rtl'))
+
+
+def test_tx_scheduler_ctrl_shaper(request):
+    dut = "tx_scheduler_ctrl_shaper"
+    module = os.path.splitext(os.path.basename(__file__))[0]
+    toplevel = dut
+
+    verilog_sources = [
+        os.path.join(rtl_dir, f"{dut}.v"),
+    ]
+
+    parameters = {}
+
+    parameters['AXIL_DATA_WIDTH'] = 32
+    parameters['QUEUE_INDEX_WIDTH'] = 4
+    parameters['AXIL_ADDR_WIDTH'] = parameters['QUEUE_INDEX_WIDTH'] + 4
+    parameters['AXIL_STRB_WIDTH'] = parameters['AXIL_DATA_WIDTH'] // 8
+    parameters['LEN_WIDTH'] = 16
+    parameters['REQ_TAG_WIDTH'] = 8
+    parameters['CREDIT_WIDTH'] = 32
+    parameters['STATUS_FIFO_DEPTH'] = 16
+
+    extra_env = {f'PARAM_{k}': str(v) for k, v in parameters.items()}
+
+    sim_build = os.path.join(tests_dir, "sim_build",
+        request.node.name.replace('[', '-').replace(']', ''))
+
+    cocotb_test.simulator.run(
+        python_search=[tests_dir],
+        verilog_sources=verilog_sources,
+        toplevel=toplevel,
+        module=module,
+        parameters=parameters,
+        sim_build=sim_build,
+        extra_env=extra_env,
+    )
@@ -18,6 +18,36 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+static int mqnic_enumerate(struct mqnic *dev)
+{
+    if (mqnic_reg_read32(dev->regs, 4) == 0xffffffff)
+    {
+        fprintf(stderr, "Error: device needs to be reset\n");
+        return -1;
+    }
+
+    dev->rb_list = mqnic_enumerate_reg_block_list(dev->regs, 0, dev->regs_size);
+
+    if (!dev->rb_list)
+    {
+        fprintf(stderr, "Error: filed to enumerate blocks\n");
+        return -1;
+    }
+
+    // Read ID registers
+    dev->fw_id_rb = mqnic_find_reg_block(dev->rb_list, MQNIC_RB_FW_ID_TYPE, MQNIC_RB_FW_ID_VER, 0);
+
+    if (!dev->fw_id_rb)
+    {
+        fprintf(stderr, "Error: FW ID block not found\n");
+        mqnic_free_reg_block_list(dev->rb_list);
+        dev->rb_list = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
 static int mqnic_try_open(struct mqnic *dev, const char *fmt, ...)
 {
     va_list ap;
@@ -107,6 +137,8 @@ static int mqnic_try_open(struct mqnic *dev, const char *fmt, ...)
             goto fail_ioctl;
         }
 
+        dev->irq_count = device_info.num_irqs;
+
         struct mqnic_ioctl_region_info region_info;
         region_info.argsz = sizeof(region_info);
         region_info.flags = 0;
@@ -247,35 +279,12 @@ static int mqnic_try_open(struct mqnic *dev, const char *fmt, ...)
         }
     }
 
-    if (mqnic_reg_read32(dev->regs, 4) == 0xffffffff)
-    {
-        fprintf(stderr, "Error: device needs to be reset\n");
-        goto fail_reset;
-    }
-
-    dev->rb_list = mqnic_enumerate_reg_block_list(dev->regs, 0, dev->regs_size);
-
-    if (!dev->rb_list)
-    {
-        fprintf(stderr, "Error: filed to enumerate blocks\n");
-        goto fail_enum;
-    }
-
-    // Read ID registers
-    dev->fw_id_rb = mqnic_find_reg_block(dev->rb_list, MQNIC_RB_FW_ID_TYPE, MQNIC_RB_FW_ID_VER, 0);
-
-    if (!dev->fw_id_rb)
-    {
-        fprintf(stderr, "Error: FW ID block not found\n");
+    if (mqnic_enumerate(dev))
         goto fail_enum;
-    }
 
     return 0;
 
 fail_enum:
-    if (dev->rb_list)
-        mqnic_free_reg_block_list(dev->rb_list);
-fail_reset:
 fail_mmap_regs:
     if (dev->ram)
         munmap((void *)dev->ram, dev->ram_size);
@@ -332,6 +341,39 @@ static int mqnic_try_open_miscdev(struct mqnic *dev, const char *fmt, ...)
     return mqnic_try_open(dev, "%s", path);
 }
 
+static int mqnic_try_open_vfio(struct mqnic *dev, const char *fmt, ...)
+{
+    va_list ap;
+    char path[PATH_MAX];
+
+    va_start(ap, fmt);
+    vsnprintf(path, sizeof(path), fmt, ap);
+    va_end(ap);
+
+    if (access(path, F_OK))
+        return -1;
+
+    if (mqnic_vfio_open(dev, path))
+        return -1;
+
+    if (mqnic_enumerate(dev))
+    {
+        if (dev->ram)
+            munmap((void *)dev->ram, dev->ram_size);
+        dev->ram = NULL;
+        if (dev->app_regs)
+            munmap((void *)dev->app_regs, dev->app_regs_size);
+        dev->app_regs = NULL;
+        if (dev->regs)
+            munmap((void *)dev->regs, dev->regs_size);
+        dev->regs = NULL;
+        mqnic_vfio_close(dev);
+        return -1;
+    }
+
+    return 0;
+}
+
 struct mqnic *mqnic_open(const char *dev_name)
 {
     struct mqnic *dev = calloc(1, sizeof(struct mqnic));
@@ -346,6 +388,24 @@ struct mqnic *mqnic_open(const char *dev_name)
     dev->fd = -1;
     dev->app_fd = -1;
     dev->ram_fd = -1;
+    dev->vfio_container_fd = -1;
+    dev->vfio_group_fd = -1;
+    dev->vfio_device_fd = -1;
+
+    // software device model
+    if (strcmp(dev_name, "sim") == 0)
+    {
+        if (mqnic_sim_open(dev))
+            goto fail_open;
+
+        if (mqnic_enumerate(dev))
+        {
+            mqnic_sim_close(dev);
+            goto fail_open;
+        }
+
+        goto open;
+    }
 
     // miscdev absolute path
     if (mqnic_try_open(dev, "%s", dev_name) == 0)
@@ -371,6 +431,18 @@ struct mqnic *mqnic_open(const char *dev_name)
     if (mqnic_try_open_miscdev(dev, "/sys/bus/pci/devices/0000:%s/misc/", dev_name) == 0)
         goto open;
 
+    // VFIO via PCIe sysfs path
+    if (mqnic_try_open_vfio(dev, "%s", dev_name) == 0)
+        goto open;
+
+    // VFIO via PCIe BDF (dddd:xx:yy.z)
+    if (mqnic_try_open_vfio(dev, "/sys/bus/pci/devices/%s", dev_name) == 0)
+        goto open;
+
+    // VFIO via PCIe BDF (xx:yy.z)
+    if (mqnic_try_open_vfio(dev, "/sys/bus/pci/devices/0000:%s", dev_name) == 0)
+        goto open;
+
     // PCIe sysfs path
     if (mqnic_try_open(dev, "%s/resource0", dev_name) == 0)
         goto open;
@@ -469,6 +541,8 @@ void mqnic_close(struct mqnic *dev)
     if (dev->rb_list)
         mqnic_free_reg_block_list(dev->rb_list);
 
+    mqnic_sim_close(dev);
+
     if (dev->ram)
         munmap((void *)dev->ram, dev->ram_size);
     if (dev->app_regs)
@@ -476,6 +550,8 @@ void mqnic_close(struct mqnic *dev)
     if (dev->regs)
         munmap((void *)dev->regs, dev->regs_size);
 
+    mqnic_vfio_close(dev);
+
     close(dev->fd);
     close(dev->app_fd);
     close(dev->ram_fd);
@@ -503,3 +579,28 @@ void mqnic_print_fw_id(struct mqnic *dev)
     if (dev->app_id)
         printf("Application ID: 0x%08x\n", dev->app_id);
 }
+
+int mqnic_get_irq_info(struct mqnic *dev, int index, struct mqnic_ioctl_irq_info *info)
+{
+    if (index < 0 || index >= dev->irq_count)
+        return -1;
+
+    // IRQ affinity is only known to the kernel driver
+    if (dev->fd < 0)
+        return -1;
+
+    info->argsz = sizeof(*info);
+    info->flags = 0;
+    info->index = index;
+
+    return ioctl(dev->fd, MQNIC_IOCTL_GET_IRQ_INFO, info);
+}
+
+// eventfd signalled by the interrupt, only when this process owns the device
+int mqnic_get_irq_fd(struct mqnic *dev, int index)
+{
+    if (!dev->irq_fd || index < 0 || index >= dev->irq_count)
+        return -1;
+
+    return dev->irq_fd[index];
+}
@@ -7,13 +7,38 @@
 #define MQNIC_H
 
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "mqnic_hw.h"
+#include "mqnic_ioctl.h"
 #include "reg_block.h"
+#include "reg_if.h"
 
-#define mqnic_reg_read32(base, reg) (((volatile uint32_t *)(base))[(reg)/4])
-#define mqnic_reg_write32(base, reg, val) (((volatile uint32_t *)(base))[(reg)/4]) = val
+// register accesses only take the slow path for the register space of a
+// software model
+static inline uint32_t mqnic_reg_read32_addr(volatile uint8_t *addr)
+{
+    struct mqnic_reg_window *window = mqnic_reg_window_lookup(addr);
+
+    if (__builtin_expect(window != NULL, 0))
+        return mqnic_reg_window_read32(window, addr);
+
+    return *(volatile uint32_t *)addr;
+}
+
+static inline void mqnic_reg_write32_addr(volatile uint8_t *addr, uint32_t val)
+{
+    struct mqnic_reg_window *window = mqnic_reg_window_lookup(addr);
+
+    if (__builtin_expect(window != NULL, 0))
+        mqnic_reg_window_write32(window, addr, val);
+    else
+        *(volatile uint32_t *)addr = val;
+}
+
+#define mqnic_reg_read32(base, reg) mqnic_reg_read32_addr((volatile uint8_t *)(base) + (reg))
+#define mqnic_reg_write32(base, reg, val) mqnic_reg_write32_addr((volatile uint8_t *)(base) + (reg), (val))
 
 struct mqnic;
 
@@ -21,6 +46,8 @@ struct mqnic_res {
     unsigned int count;
     volatile uint8_t *base;
     unsigned int stride;
+
+    uint64_t *bmap;
 };
 
 struct mqnic_sched {
@@ -100,6 +127,101 @@ struct mqnic_if {
 
     uint32_t sched_block_count;
     struct mqnic_sched_block *sched_blocks[MQNIC_MAX_PORTS];
+
+    struct mqnic_eq *eq;
+};
+
+// pinned and DMA mapped buffer region
+// via the misc device each page is mapped separately, so packet buffers
+// must not cross a page; via VFIO or the software model the region is a
+// single mapping
+struct mqnic_buf {
+    struct mqnic *mqnic;
+
+    uint32_t handle;
+    int alloc;
+
+    void *addr;
+    size_t size;
+    size_t page_size;
+    uint64_t *dma_addr;
+};
+
+// event queue driven from userspace (VFIO or software model)
+struct mqnic_eq {
+    struct mqnic *mqnic;
+    struct mqnic_if *interface;
+
+    int eqn;
+    int irq;
+    int fd;
+
+    uint32_t size;
+    uint32_t size_mask;
+    uint32_t stride;
+
+    uint32_t cons_ptr;
+
+    volatile uint8_t *regs;
+    struct mqnic_buf *ring_buf;
+    uint8_t *ring;
+};
+
+// packet buffer passed to the burst functions
+// TX: len is the frame length
+// RX: len is the buffer size when posted and the frame length on receive
+struct mqnic_pkt {
+    void *data;
+    uint64_t dma_addr;
+    uint32_t len;
+
+    uint32_t rx_hash;
+    uint8_t rx_hash_type;
+    uint8_t port;
+    uint16_t rx_csum;
+
+    uint32_t ts_ns;
+    uint16_t ts_s;
+
+    void *priv;
+};
+
+// TX or RX queue owned by this process, polled from a single thread
+struct mqnic_queue {
+    struct mqnic *mqnic;
+    struct mqnic_if *interface;
+
+    int type;
+    uint32_t handle;
+    int index;
+
+    uint32_t size;
+    uint32_t size_mask;
+    uint32_t stride;
+
+    uint32_t prod_ptr;
+    uint32_t cons_ptr;
+
+    volatile uint8_t *regs;
+    uint8_t *ring;
+    size_t ring_size;
+    struct mqnic_pkt **pkts;
+
+    int cqn;
+    uint32_t cq_size;
+    uint32_t cq_size_mask;
+    uint32_t cq_stride;
+
+    uint32_t cq_cons_ptr;
+
+    volatile uint8_t *cq_regs;
+    uint8_t *cq_ring;
+    size_t cq_ring_size;
+
+    // VFIO or software model only
+    struct mqnic_eq *eq;
+    struct mqnic_buf *ring_buf;
+    struct mqnic_buf *cq_ring_buf;
 };
 
 struct mqnic {
@@ -107,6 +229,20 @@ struct mqnic {
     int app_fd;
     int ram_fd;
 
+    int vfio_container_fd;
+    int vfio_group_fd;
+    int vfio_device_fd;
+
+    // usable IOVA ranges reported by the IOMMU and active DMA mappings
+    struct vfio_iova_range *vfio_iova_ranges;
+    int vfio_iova_range_count;
+    uint64_t vfio_iova_page_size;
+    struct mqnic_vfio_mapping *vfio_mappings;
+
+    struct mqnic_sim *sim;
+
+    int *irq_fd;
+
     size_t regs_size;
     volatile uint8_t *regs;
 
@@ -153,6 +289,8 @@ struct mqnic {
     uint32_t if_stride;
     uint32_t if_csr_offset;
 
+    uint32_t irq_count;
+
     char build_date_str[32];
 
     struct mqnic_if *interfaces[MQNIC_MAX_IF];
@@ -161,14 +299,24 @@ struct mqnic {
     char pci_device_path[PATH_MAX];
 };
 
+// true when this process drives the queues itself, without the kernel driver
+static inline int mqnic_owns_device(struct mqnic *dev)
+{
+    return dev->vfio_device_fd >= 0 || dev->sim;
+}
+
 // mqnic.c
 struct mqnic *mqnic_open(const char *dev_name);
 void mqnic_close(struct mqnic *dev);
 void mqnic_print_fw_id(struct mqnic *dev);
+int mqnic_get_irq_info(struct mqnic *dev, int index, struct mqnic_ioctl_irq_info *info);
+int mqnic_get_irq_fd(struct mqnic *dev, int index);
 
 // mqnic_res.c
 struct mqnic_res *mqnic_res_open(unsigned int count, volatile uint8_t *base, unsigned int stride);
 void mqnic_res_close(struct mqnic_res *res);
+int mqnic_res_alloc(struct mqnic_res *res);
+void mqnic_res_free(struct mqnic_res *res, int index);
 unsigned int mqnic_res_get_count(struct mqnic_res *res);
 volatile uint8_t *mqnic_res_get_addr(struct mqnic_res *res, int index);
 
@@ -180,6 +328,11 @@ uint32_t mqnic_interface_get_rx_mtu(struct mqnic_if *interface);
 uint32_t mqnic_interface_get_rx_queue_map_rss_mask(struct mqnic_if *interface, int port);
 uint32_t mqnic_interface_get_rx_queue_map_app_mask(struct mqnic_if *interface, int port);
 uint32_t mqnic_interface_get_rx_queue_map_indir_table(struct mqnic_if *interface, int port, int index);
+void mqnic_interface_set_tx_mtu(struct mqnic_if *interface, uint32_t mtu);
+void mqnic_interface_set_rx_mtu(struct mqnic_if *interface, uint32_t mtu);
+void mqnic_interface_set_rx_queue_map_rss_mask(struct mqnic_if *interface, int port, uint32_t val);
+void mqnic_interface_set_rx_queue_map_app_mask(struct mqnic_if *interface, int port, uint32_t val);
+void mqnic_interface_set_rx_queue_map_indir_table(struct mqnic_if *interface, int port, int index, uint32_t val);
 
 // mqnic_port.c
 struct mqnic_port *mqnic_port_open(struct mqnic_if *interface, int index, struct mqnic_reg_block *port_rb);
@@ -194,6 +347,42 @@ void mqnic_sched_block_close(struct mqnic_sched_block *block);
 // mqnic_scheduler.c
 struct mqnic_sched *mqnic_sched_open(struct mqnic_sched_block *block, int index, struct mqnic_reg_block *rb);
 void mqnic_sched_close(struct mqnic_sched *sched);
+void mqnic_sched_enable(struct mqnic_sched *sched);
+void mqnic_sched_disable(struct mqnic_sched *sched);
+
+// mqnic_eq.c
+struct mqnic_eq *mqnic_eq_open(struct mqnic_if *interface, int irq, unsigned int size);
+void mqnic_eq_close(struct mqnic_eq *eq);
+int mqnic_eq_get_fd(struct mqnic_eq *eq);
+void mqnic_eq_arm(struct mqnic_eq *eq);
+int mqnic_eq_poll(struct mqnic_eq *eq, uint32_t *cqn, int count);
+
+// mqnic_queue.c
+struct mqnic_buf *mqnic_buf_register(struct mqnic *dev, void *addr, size_t size);
+struct mqnic_buf *mqnic_buf_alloc(struct mqnic *dev, size_t size);
+void mqnic_buf_unregister(struct mqnic_buf *buf);
+uint64_t mqnic_buf_dma_addr(struct mqnic_buf *buf, const void *ptr);
+struct mqnic_queue *mqnic_queue_open(struct mqnic_if *interface, int type, unsigned int size);
+void mqnic_queue_close(struct mqnic_queue *q);
+int mqnic_queue_add_flow(struct mqnic_queue *q, uint32_t saddr, uint32_t daddr,
+        uint16_t sport, uint16_t dport);
+int mqnic_queue_del_flow(struct mqnic_queue *q, uint32_t saddr, uint32_t daddr,
+        uint16_t sport, uint16_t dport);
+int mqnic_tx_burst(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count);
+int mqnic_tx_complete(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count);
+int mqnic_rx_refill(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count);
+int mqnic_rx_burst(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count);
+int mqnic_queue_arm(struct mqnic_queue *q);
+
+// mqnic_vfio.c
+int mqnic_vfio_open(struct mqnic *dev, const char *pci_device_path);
+void mqnic_vfio_close(struct mqnic *dev);
+int mqnic_vfio_dma_map(struct mqnic *dev, void *addr, size_t size, uint64_t *iova);
+int mqnic_vfio_dma_unmap(struct mqnic *dev, void *addr, size_t size);
+
+// mqnic_sim.c
+int mqnic_sim_open(struct mqnic *dev);
+void mqnic_sim_close(struct mqnic *dev);
 
 // mqnic_clk_info.c
 void mqnic_clk_info_init(struct mqnic *dev);
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Event queues are only driven from userspace with the VFIO backend or the
+// software model.  The EQ raises its interrupt, which is signalled on the
+// eventfd returned by mqnic_eq_get_fd().  To sleep, poll the queues and the
+// EQ until they are empty, arm the CQs of interest and the EQ, then wait on
+// the eventfd.
+
+struct mqnic_eq *mqnic_eq_open(struct mqnic_if *interface, int irq, unsigned int size)
+{
+    struct mqnic *dev = interface->mqnic;
+    struct mqnic_eq *eq;
+
+    if (!mqnic_owns_device(dev))
+    {
+        fprintf(stderr, "Error: event queues require the VFIO or software model backend\n");
+        return NULL;
+    }
+
+    if (irq < 0 || (dev->irq_count && irq >= dev->irq_count))
+    {
+        fprintf(stderr, "Error: IRQ %d out of range\n", irq);
+        return NULL;
+    }
+
+    eq = calloc(1, sizeof(struct mqnic_eq));
+    if (!eq)
+        return NULL;
+
+    eq->mqnic = dev;
+    eq->interface = interface;
+
+    eq->irq = irq;
+    eq->fd = mqnic_get_irq_fd(dev, irq);
+
+    eq->eqn = mqnic_res_alloc(interface->eq_res);
+    if (eq->eqn < 0)
+    {
+        fprintf(stderr, "Error: no free event queues\n");
+        goto fail;
+    }
+
+    eq->size = 1;
+    while (eq->size < size)
+        eq->size <<= 1;
+    eq->size_mask = eq->size - 1;
+    eq->stride = MQNIC_EVENT_SIZE;
+
+    eq->ring_buf = mqnic_buf_alloc(dev, eq->size * eq->stride);
+    if (!eq->ring_buf)
+        goto fail;
+
+    eq->ring = eq->ring_buf->addr;
+
+    eq->regs = mqnic_res_get_addr(interface->eq_res, eq->eqn);
+
+    // deactivate queue
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_ENABLE | 0);
+    // set base address
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_BASE_ADDR_VF_REG + 0, eq->ring_buf->dma_addr[0] & 0xfffff000);
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_BASE_ADDR_VF_REG + 4, eq->ring_buf->dma_addr[0] >> 32);
+    // set size
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_SIZE | __builtin_ctz(eq->size));
+    // set IRQN
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_IRQN | eq->irq);
+    // set pointers
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_PROD_PTR | 0);
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_CONS_PTR | 0);
+    // activate queue
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_ENABLE | 1);
+
+    mqnic_eq_arm(eq);
+
+    return eq;
+
+fail:
+    mqnic_eq_close(eq);
+    return NULL;
+}
+
+void mqnic_eq_close(struct mqnic_eq *eq)
+{
+    if (!eq)
+        return;
+
+    if (eq->regs)
+        mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_ENABLE | 0);
+
+    mqnic_buf_unregister(eq->ring_buf);
+
+    if (eq->eqn >= 0)
+        mqnic_res_free(eq->interface->eq_res, eq->eqn);
+
+    free(eq);
+}
+
+int mqnic_eq_get_fd(struct mqnic_eq *eq)
+{
+    return eq->fd;
+}
+
+void mqnic_eq_arm(struct mqnic_eq *eq)
+{
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG, MQNIC_EQ_CMD_SET_ARM | 1);
+}
+
+// consume pending events, returning the CQNs of completion events
+int mqnic_eq_poll(struct mqnic_eq *eq, uint32_t *cqn, int count)
+{
+    struct mqnic_event *event;
+    int done = 0;
+
+    while (done < count)
+    {
+        event = (struct mqnic_event *)(eq->ring + (eq->cons_ptr & eq->size_mask) * eq->stride);
+
+        if (!!(event->phase & htole32(0x80000000)) == !!(eq->cons_ptr & eq->size))
+            break;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (le16toh(event->type) == MQNIC_EVENT_TYPE_CPL)
+            cqn[done++] = le16toh(event->source);
+
+        eq->cons_ptr++;
+    }
+
+    mqnic_reg_write32(eq->regs, MQNIC_EQ_CTRL_STATUS_REG,
+            MQNIC_EQ_CMD_SET_CONS_PTR | (eq->cons_ptr & MQNIC_EQ_PTR_MASK));
+
+    return done;
+}
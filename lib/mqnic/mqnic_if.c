@@ -213,6 +213,9 @@ void mqnic_if_close(struct mqnic_if *interface)
         interface->ports[k] = NULL;
     }
 
+    mqnic_eq_close(interface->eq);
+    interface->eq = NULL;
+
     mqnic_res_close(interface->eq_res);
     mqnic_res_close(interface->cq_res);
     mqnic_res_close(interface->txq_res);
@@ -250,3 +253,30 @@ uint32_t mqnic_interface_get_rx_queue_map_indir_table(struct mqnic_if *interface
 {
     return mqnic_reg_read32(interface->rx_queue_map_indir_table[port], index*4);
 }
+
+void mqnic_interface_set_tx_mtu(struct mqnic_if *interface, uint32_t mtu)
+{
+    mqnic_reg_write32(interface->if_ctrl_rb->regs, MQNIC_RB_IF_CTRL_REG_TX_MTU, mtu);
+}
+
+void mqnic_interface_set_rx_mtu(struct mqnic_if *interface, uint32_t mtu)
+{
+    mqnic_reg_write32(interface->if_ctrl_rb->regs, MQNIC_RB_IF_CTRL_REG_RX_MTU, mtu);
+}
+
+void mqnic_interface_set_rx_queue_map_rss_mask(struct mqnic_if *interface, int port, uint32_t val)
+{
+    mqnic_reg_write32(interface->rx_queue_map_rb->regs, MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET +
+        MQNIC_RB_RX_QUEUE_MAP_CH_STRIDE*port + MQNIC_RB_RX_QUEUE_MAP_CH_REG_RSS_MASK, val);
+}
+
+void mqnic_interface_set_rx_queue_map_app_mask(struct mqnic_if *interface, int port, uint32_t val)
+{
+    mqnic_reg_write32(interface->rx_queue_map_rb->regs, MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET +
+        MQNIC_RB_RX_QUEUE_MAP_CH_STRIDE*port + MQNIC_RB_RX_QUEUE_MAP_CH_REG_APP_MASK, val);
+}
+
+void mqnic_interface_set_rx_queue_map_indir_table(struct mqnic_if *interface, int port, int index, uint32_t val)
+{
+    mqnic_reg_write32(interface->rx_queue_map_indir_table[port], index*4, val);
+}
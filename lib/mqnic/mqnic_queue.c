@@ -0,0 +1,588 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+#include "mqnic_ioctl.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ordering between ring memory and doorbell writes, and between the
+// completion phase bit and the rest of the completion record
+#define mqnic_wmb() __sync_synchronize()
+#define mqnic_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+struct mqnic_buf *mqnic_buf_register(struct mqnic *dev, void *addr, size_t size)
+{
+    struct mqnic_buf *buf = calloc(1, sizeof(struct mqnic_buf));
+    struct mqnic_ioctl_buffer info;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (!buf)
+        return NULL;
+
+    buf->mqnic = dev;
+    buf->addr = addr;
+    buf->size = size;
+    buf->page_size = page_size;
+
+    if (((uintptr_t)addr | size) & (page_size-1))
+    {
+        fprintf(stderr, "Error: buffer must be page aligned\n");
+        goto fail;
+    }
+
+    if (mqnic_owns_device(dev))
+    {
+        // single mapping for the whole region, the software model accesses
+        // host memory by virtual address
+        buf->page_size = size;
+        buf->dma_addr = calloc(1, sizeof(*buf->dma_addr));
+        if (!buf->dma_addr)
+            goto fail;
+
+        if (dev->sim)
+            buf->dma_addr[0] = (uintptr_t)addr;
+        else if (mqnic_vfio_dma_map(dev, addr, size, buf->dma_addr))
+            goto fail;
+
+        return buf;
+    }
+
+    buf->dma_addr = calloc(size / page_size, sizeof(*buf->dma_addr));
+    if (!buf->dma_addr)
+        goto fail;
+
+    memset(&info, 0, sizeof(info));
+    info.argsz = sizeof(info);
+    info.addr = (uintptr_t)addr;
+    info.size = size;
+    info.dma_addr_table = (uintptr_t)buf->dma_addr;
+
+    if (ioctl(dev->fd, MQNIC_IOCTL_MAP_BUFFER, &info) != 0)
+    {
+        perror("MQNIC_IOCTL_MAP_BUFFER ioctl failed");
+        goto fail;
+    }
+
+    buf->handle = info.handle;
+
+    return buf;
+
+fail:
+    free(buf->dma_addr);
+    free(buf);
+    return NULL;
+}
+
+// allocate and register a buffer, backed by hugepages when large enough
+struct mqnic_buf *mqnic_buf_alloc(struct mqnic *dev, size_t size)
+{
+    size_t hugepage_size = 2*1024*1024;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    struct mqnic_buf *buf;
+    void *addr = MAP_FAILED;
+
+    if (size >= hugepage_size)
+    {
+        size_t alloc_size = (size + hugepage_size-1) & ~(hugepage_size-1);
+
+        addr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+
+        if (addr != MAP_FAILED)
+            size = alloc_size;
+    }
+
+    if (addr == MAP_FAILED)
+    {
+        size = (size + page_size-1) & ~(page_size-1);
+
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+
+        if (addr == MAP_FAILED)
+        {
+            perror("mmap buffer failed");
+            return NULL;
+        }
+    }
+
+    buf = mqnic_buf_register(dev, addr, size);
+
+    if (!buf)
+    {
+        munmap(addr, size);
+        return NULL;
+    }
+
+    buf->alloc = 1;
+
+    return buf;
+}
+
+// also frees the memory of buffers from mqnic_buf_alloc()
+void mqnic_buf_unregister(struct mqnic_buf *buf)
+{
+    struct mqnic_ioctl_buffer info;
+
+    if (!buf)
+        return;
+
+    if (buf->mqnic->vfio_device_fd >= 0)
+    {
+        mqnic_vfio_dma_unmap(buf->mqnic, buf->addr, buf->size);
+    }
+    else if (!buf->mqnic->sim)
+    {
+        memset(&info, 0, sizeof(info));
+        info.argsz = sizeof(info);
+        info.handle = buf->handle;
+
+        if (ioctl(buf->mqnic->fd, MQNIC_IOCTL_UNMAP_BUFFER, &info) != 0)
+            perror("MQNIC_IOCTL_UNMAP_BUFFER ioctl failed");
+    }
+
+    if (buf->alloc)
+        munmap(buf->addr, buf->size);
+
+    free(buf->dma_addr);
+    free(buf);
+}
+
+uint64_t mqnic_buf_dma_addr(struct mqnic_buf *buf, const void *ptr)
+{
+    size_t offset = (const uint8_t *)ptr - (const uint8_t *)buf->addr;
+
+    if ((const uint8_t *)ptr < (const uint8_t *)buf->addr || offset >= buf->size)
+        return 0;
+
+    return buf->dma_addr[offset / buf->page_size] + offset % buf->page_size;
+}
+
+// queue and completion queue allocated by the kernel driver
+static int mqnic_queue_alloc_ioctl(struct mqnic_queue *q, unsigned int size)
+{
+    struct mqnic *dev = q->mqnic;
+    struct mqnic_if *interface = q->interface;
+    struct mqnic_ioctl_queue info;
+
+    memset(&info, 0, sizeof(info));
+    info.argsz = sizeof(info);
+    info.if_index = interface->index;
+    info.type = q->type;
+    info.size = size;
+    info.desc_block_size = 1;
+
+    if (ioctl(dev->fd, MQNIC_IOCTL_ALLOC_QUEUE, &info) != 0)
+    {
+        perror("MQNIC_IOCTL_ALLOC_QUEUE ioctl failed");
+        return -1;
+    }
+
+    q->handle = info.handle;
+    q->index = info.index;
+
+    q->size = info.size;
+    q->size_mask = q->size - 1;
+    q->stride = info.stride;
+    q->regs = dev->regs + info.regs_offset;
+
+    q->cqn = info.cqn;
+    q->cq_size = info.cq_size;
+    q->cq_size_mask = q->cq_size - 1;
+    q->cq_stride = info.cq_stride;
+    q->cq_regs = dev->regs + info.cq_regs_offset;
+
+    q->ring_size = info.ring_size;
+    q->ring = mmap(NULL, q->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, info.ring_offset);
+    if (q->ring == MAP_FAILED)
+    {
+        perror("mmap queue ring failed");
+        q->ring = NULL;
+        return -1;
+    }
+
+    q->cq_ring_size = info.cq_ring_size;
+    q->cq_ring = mmap(NULL, q->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, info.cq_ring_offset);
+    if (q->cq_ring == MAP_FAILED)
+    {
+        perror("mmap completion ring failed");
+        q->cq_ring = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void mqnic_queue_free_ioctl(struct mqnic_queue *q)
+{
+    struct mqnic_ioctl_queue info;
+
+    if (q->cq_ring)
+        munmap(q->cq_ring, q->cq_ring_size);
+    if (q->ring)
+        munmap(q->ring, q->ring_size);
+
+    if (!q->handle)
+        return;
+
+    memset(&info, 0, sizeof(info));
+    info.argsz = sizeof(info);
+    info.handle = q->handle;
+
+    if (ioctl(q->mqnic->fd, MQNIC_IOCTL_FREE_QUEUE, &info) != 0)
+        perror("MQNIC_IOCTL_FREE_QUEUE ioctl failed");
+}
+
+// queue, completion queue and event queue driven entirely from userspace
+static int mqnic_queue_alloc_direct(struct mqnic_queue *q, unsigned int size)
+{
+    struct mqnic *dev = q->mqnic;
+    struct mqnic_if *interface = q->interface;
+    struct mqnic_res *res = q->type == MQNIC_QUEUE_TYPE_TX ? interface->txq_res : interface->rxq_res;
+
+    if (!interface->eq)
+    {
+        interface->eq = mqnic_eq_open(interface, dev->irq_count ? interface->index % dev->irq_count : 0, 1024);
+        if (!interface->eq)
+            return -1;
+    }
+
+    q->eq = interface->eq;
+
+    if (q->type == MQNIC_QUEUE_TYPE_TX)
+    {
+        if (size < MQNIC_MIN_TX_RING_SZ)
+            size = MQNIC_MIN_TX_RING_SZ;
+        if (size > MQNIC_MAX_TX_RING_SZ)
+            size = MQNIC_MAX_TX_RING_SZ;
+    }
+    else
+    {
+        if (size < MQNIC_MIN_RX_RING_SZ)
+            size = MQNIC_MIN_RX_RING_SZ;
+        if (size > MQNIC_MAX_RX_RING_SZ)
+            size = MQNIC_MAX_RX_RING_SZ;
+    }
+
+    q->size = 1;
+    while (q->size < size)
+        q->size <<= 1;
+    q->size_mask = q->size - 1;
+    q->stride = MQNIC_DESC_SIZE;
+
+    q->cq_size = q->size;
+    q->cq_size_mask = q->cq_size - 1;
+    q->cq_stride = MQNIC_CPL_SIZE;
+
+    q->index = mqnic_res_alloc(res);
+    if (q->index < 0)
+    {
+        fprintf(stderr, "Error: no free queues\n");
+        return -1;
+    }
+
+    q->cqn = mqnic_res_alloc(interface->cq_res);
+    if (q->cqn < 0)
+    {
+        fprintf(stderr, "Error: no free completion queues\n");
+        return -1;
+    }
+
+    q->ring_buf = mqnic_buf_alloc(dev, q->size * q->stride);
+    if (!q->ring_buf)
+        return -1;
+
+    q->ring = q->ring_buf->addr;
+    q->ring_size = q->ring_buf->size;
+
+    q->cq_ring_buf = mqnic_buf_alloc(dev, q->cq_size * q->cq_stride);
+    if (!q->cq_ring_buf)
+        return -1;
+
+    q->cq_ring = q->cq_ring_buf->addr;
+    q->cq_ring_size = q->cq_ring_buf->size;
+
+    q->regs = mqnic_res_get_addr(res, q->index);
+    q->cq_regs = mqnic_res_get_addr(interface->cq_res, q->cqn);
+
+    // deactivate completion queue
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 0);
+    // set base address
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_BASE_ADDR_VF_REG + 0, q->cq_ring_buf->dma_addr[0] & 0xfffff000);
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_BASE_ADDR_VF_REG + 4, q->cq_ring_buf->dma_addr[0] >> 32);
+    // set size
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_SIZE | __builtin_ctz(q->cq_size));
+    // set EQN
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_EQN | q->eq->eqn);
+    // set pointers
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_PROD_PTR | 0);
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_CONS_PTR | 0);
+    // activate completion queue
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 1);
+
+    // deactivate queue
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_ENABLE | 0);
+    // set base address
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_BASE_ADDR_VF_REG + 0, q->ring_buf->dma_addr[0] & 0xfffff000);
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_BASE_ADDR_VF_REG + 4, q->ring_buf->dma_addr[0] >> 32);
+    // set size
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_SIZE | __builtin_ctz(q->size));
+    // set CQN
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_CQN | q->cqn);
+    // set pointers
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_PROD_PTR | 0);
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_CONS_PTR | 0);
+    // activate queue
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_ENABLE | 1);
+
+    return 0;
+}
+
+static void mqnic_queue_free_direct(struct mqnic_queue *q)
+{
+    struct mqnic_if *interface = q->interface;
+
+    if (q->regs)
+        mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG, MQNIC_QUEUE_CMD_SET_ENABLE | 0);
+    if (q->cq_regs)
+        mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ENABLE | 0);
+
+    mqnic_buf_unregister(q->cq_ring_buf);
+    mqnic_buf_unregister(q->ring_buf);
+
+    if (q->cqn >= 0)
+        mqnic_res_free(interface->cq_res, q->cqn);
+
+    if (q->index >= 0)
+    {
+        if (q->type == MQNIC_QUEUE_TYPE_TX)
+            mqnic_res_free(interface->txq_res, q->index);
+        else
+            mqnic_res_free(interface->rxq_res, q->index);
+    }
+}
+
+struct mqnic_queue *mqnic_queue_open(struct mqnic_if *interface, int type, unsigned int size)
+{
+    struct mqnic *dev = interface->mqnic;
+    struct mqnic_queue *q = calloc(1, sizeof(struct mqnic_queue));
+    int ret;
+
+    if (!q)
+        return NULL;
+
+    q->mqnic = dev;
+    q->interface = interface;
+    q->type = type;
+    q->index = -1;
+    q->cqn = -1;
+
+    if (mqnic_owns_device(dev))
+        ret = mqnic_queue_alloc_direct(q, size);
+    else
+        ret = mqnic_queue_alloc_ioctl(q, size);
+
+    if (ret)
+        goto fail;
+
+    q->pkts = calloc(q->size, sizeof(*q->pkts));
+    if (!q->pkts)
+        goto fail;
+
+    return q;
+
+fail:
+    mqnic_queue_close(q);
+    return NULL;
+}
+
+void mqnic_queue_close(struct mqnic_queue *q)
+{
+    if (!q)
+        return;
+
+    if (mqnic_owns_device(q->mqnic))
+        mqnic_queue_free_direct(q);
+    else
+        mqnic_queue_free_ioctl(q);
+
+    free(q->pkts);
+    free(q);
+}
+
+static int mqnic_queue_flow_ioctl(struct mqnic_queue *q, unsigned long cmd, uint32_t saddr,
+        uint32_t daddr, uint16_t sport, uint16_t dport)
+{
+    struct mqnic_ioctl_flow info;
+
+    if (q->type != MQNIC_QUEUE_TYPE_RX)
+    {
+        fprintf(stderr, "Error: flows can only be steered to RX queues\n");
+        return -1;
+    }
+
+    // the flow table is managed by the kernel driver
+    if (mqnic_owns_device(q->mqnic))
+    {
+        fprintf(stderr, "Error: flow steering requires the kernel driver\n");
+        return -1;
+    }
+
+    memset(&info, 0, sizeof(info));
+    info.argsz = sizeof(info);
+    info.handle = q->handle;
+    info.saddr = saddr;
+    info.daddr = daddr;
+    info.sport = sport;
+    info.dport = dport;
+
+    if (ioctl(q->mqnic->fd, cmd, &info) != 0)
+    {
+        perror(cmd == MQNIC_IOCTL_ADD_FLOW ? "MQNIC_IOCTL_ADD_FLOW ioctl failed" :
+                "MQNIC_IOCTL_DEL_FLOW ioctl failed");
+        return -1;
+    }
+
+    return info.location;
+}
+
+// steer an IPv4 TCP or UDP flow to an RX queue, addresses and ports are in
+// network byte order; returns the flow table slot
+int mqnic_queue_add_flow(struct mqnic_queue *q, uint32_t saddr, uint32_t daddr,
+        uint16_t sport, uint16_t dport)
+{
+    return mqnic_queue_flow_ioctl(q, MQNIC_IOCTL_ADD_FLOW, saddr, daddr, sport, dport);
+}
+
+int mqnic_queue_del_flow(struct mqnic_queue *q, uint32_t saddr, uint32_t daddr,
+        uint16_t sport, uint16_t dport)
+{
+    return mqnic_queue_flow_ioctl(q, MQNIC_IOCTL_DEL_FLOW, saddr, daddr, sport, dport) < 0 ? -1 : 0;
+}
+
+static inline void mqnic_queue_write_prod_ptr(struct mqnic_queue *q)
+{
+    mqnic_wmb();
+    mqnic_reg_write32(q->regs, MQNIC_QUEUE_CTRL_STATUS_REG,
+            MQNIC_QUEUE_CMD_SET_PROD_PTR | (q->prod_ptr & MQNIC_QUEUE_PTR_MASK));
+}
+
+static inline void mqnic_queue_write_cq_cons_ptr(struct mqnic_queue *q)
+{
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG,
+            MQNIC_CQ_CMD_SET_CONS_PTR | (q->cq_cons_ptr & MQNIC_CQ_PTR_MASK));
+}
+
+static inline void mqnic_queue_post(struct mqnic_queue *q, struct mqnic_pkt *pkt)
+{
+    uint32_t index = q->prod_ptr & q->size_mask;
+    struct mqnic_desc *desc = (struct mqnic_desc *)(q->ring + index * q->stride);
+
+    desc->tx_csum_cmd = 0;
+    desc->len = htole32(pkt->len);
+    desc->addr = htole64(pkt->dma_addr);
+
+    q->pkts[index] = pkt;
+    q->prod_ptr++;
+}
+
+// poll the completion queue, returning the packets in completion order
+static int mqnic_queue_poll(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count)
+{
+    struct mqnic_cpl *cpl;
+    struct mqnic_pkt *pkt;
+    uint32_t index;
+    int done = 0;
+
+    while (done < count)
+    {
+        cpl = (struct mqnic_cpl *)(q->cq_ring + (q->cq_cons_ptr & q->cq_size_mask) * q->cq_stride);
+
+        if (!!(cpl->phase & htole32(0x80000000)) == !!(q->cq_cons_ptr & q->cq_size))
+            break;
+
+        mqnic_rmb();
+
+        index = le16toh(cpl->index) & q->size_mask;
+        pkt = q->pkts[index];
+        q->pkts[index] = NULL;
+
+        if (q->type == MQNIC_QUEUE_TYPE_RX)
+        {
+            pkt->len = le16toh(cpl->len);
+            pkt->rx_hash = le32toh(cpl->rx_hash);
+            pkt->rx_hash_type = cpl->rx_hash_type;
+            pkt->rx_csum = le16toh(cpl->rx_csum);
+            pkt->port = cpl->port;
+        }
+
+        pkt->ts_ns = le32toh(cpl->ts_ns);
+        pkt->ts_s = le16toh(cpl->ts_s);
+
+        pkts[done++] = pkt;
+
+        q->cq_cons_ptr++;
+        q->cons_ptr++;
+    }
+
+    if (done)
+        mqnic_queue_write_cq_cons_ptr(q);
+
+    return done;
+}
+
+int mqnic_tx_burst(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count)
+{
+    int n;
+
+    for (n = 0; n < count && q->prod_ptr - q->cons_ptr < q->size; n++)
+        mqnic_queue_post(q, pkts[n]);
+
+    if (n)
+        mqnic_queue_write_prod_ptr(q);
+
+    return n;
+}
+
+int mqnic_tx_complete(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count)
+{
+    return mqnic_queue_poll(q, pkts, count);
+}
+
+int mqnic_rx_refill(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count)
+{
+    int n;
+
+    for (n = 0; n < count && q->prod_ptr - q->cons_ptr < q->size; n++)
+        mqnic_queue_post(q, pkts[n]);
+
+    if (n)
+        mqnic_queue_write_prod_ptr(q);
+
+    return n;
+}
+
+int mqnic_rx_burst(struct mqnic_queue *q, struct mqnic_pkt **pkts, int count)
+{
+    return mqnic_queue_poll(q, pkts, count);
+}
+
+// request an event on the EQ for the next completion (VFIO or software model)
+int mqnic_queue_arm(struct mqnic_queue *q)
+{
+    if (!q->eq)
+        return -1;
+
+    mqnic_reg_write32(q->cq_regs, MQNIC_CQ_CTRL_STATUS_REG, MQNIC_CQ_CMD_SET_ARM | 1);
+
+    return 0;
+}
@@ -19,6 +19,13 @@ struct mqnic_res *mqnic_res_open(unsigned int count, volatile uint8_t *base, uns
     res->base = base;
     res->stride = stride;
 
+    res->bmap = calloc((count + 63) / 64, sizeof(*res->bmap));
+    if (!res->bmap)
+    {
+        free(res);
+        return NULL;
+    }
+
     return res;
 }
 
@@ -27,9 +34,32 @@ void mqnic_res_close(struct mqnic_res *res)
     if (!res)
         return;
 
+    free(res->bmap);
     free(res);
 }
 
+int mqnic_res_alloc(struct mqnic_res *res)
+{
+    for (int k = 0; k < res->count; k++)
+    {
+        if (!(res->bmap[k / 64] & (1ULL << (k % 64))))
+        {
+            res->bmap[k / 64] |= 1ULL << (k % 64);
+            return k;
+        }
+    }
+
+    return -1;
+}
+
+void mqnic_res_free(struct mqnic_res *res, int index)
+{
+    if (index < 0 || index >= res->count)
+        return;
+
+    res->bmap[index / 64] &= ~(1ULL << (index % 64));
+}
+
 unsigned int mqnic_res_get_count(struct mqnic_res *res)
 {
     return res->count;
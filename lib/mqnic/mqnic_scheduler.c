@@ -49,3 +49,18 @@ void mqnic_sched_close(struct mqnic_sched *sched)
 
     free(sched);
 }
+
+void mqnic_sched_enable(struct mqnic_sched *sched)
+{
+    // enable scheduler
+    mqnic_reg_write32(sched->rb->regs, MQNIC_RB_SCHED_RR_REG_CTRL, 1);
+
+    // enable queues
+    for (int k = 0; k < sched->channel_count; k++)
+        mqnic_reg_write32(sched->regs, k*sched->channel_stride, 3);
+}
+
+void mqnic_sched_disable(struct mqnic_sched *sched)
+{
+    mqnic_reg_write32(sched->rb->regs, MQNIC_RB_SCHED_RR_REG_CTRL, 0);
+}
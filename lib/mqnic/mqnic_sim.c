@@ -0,0 +1,1006 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Software device model, opened with mqnic_open("sim").  The register space
+// is anonymous memory holding the register block lists, with a register
+// window redirecting accesses to the model.  Static registers are served from
+// memory, queue, PHC and statistics registers from the model state.  The
+// datapath runs synchronously in the register write that triggers it: a TX
+// doorbell processes the queue and loops every frame back to the RX queue
+// selected by the first entry of the indirection table, dropping it if that
+// queue has no free descriptor.  DMA addresses are host virtual addresses.
+
+#define MQNIC_SIM_REGS_SIZE      0x200000
+#define MQNIC_SIM_IF_OFFSET      0x100000
+#define MQNIC_SIM_IF_STRIDE      0x100000
+#define MQNIC_SIM_IF_CSR_OFFSET  0x80000
+
+#define MQNIC_SIM_PHC_OFFSET     0x0300
+#define MQNIC_SIM_STATS_OFFSET   0x10000
+#define MQNIC_SIM_STATS_COUNT    64
+
+#define MQNIC_SIM_EQ_OFFSET      0x00000
+#define MQNIC_SIM_EQ_COUNT       32
+#define MQNIC_SIM_CQ_OFFSET      0x10000
+#define MQNIC_SIM_CQ_COUNT       512
+#define MQNIC_SIM_TXQ_OFFSET     0x20000
+#define MQNIC_SIM_TXQ_COUNT      256
+#define MQNIC_SIM_RXQ_OFFSET     0x30000
+#define MQNIC_SIM_RXQ_COUNT      256
+#define MQNIC_SIM_QUEUE_STRIDE   0x20
+#define MQNIC_SIM_INDIR_OFFSET   0x40000
+#define MQNIC_SIM_INDIR_LOG_SIZE 8
+#define MQNIC_SIM_SCHED_OFFSET   0x50000
+
+#define MQNIC_SIM_PORT_OFFSET    0x81000
+#define MQNIC_SIM_SCHED_BLOCK_OFFSET 0x82000
+
+#define MQNIC_SIM_IRQ_COUNT      8
+#define MQNIC_SIM_MAX_MTU        9214
+
+// stats block indices, matching the DMA counters of the hardware
+#define MQNIC_SIM_STAT_DMA_RD_OP_COUNT  32
+#define MQNIC_SIM_STAT_DMA_RD_OP_BYTES  33
+#define MQNIC_SIM_STAT_DMA_WR_OP_COUNT  48
+#define MQNIC_SIM_STAT_DMA_WR_OP_BYTES  49
+
+struct mqnic_sim_eq {
+    uint64_t base_addr;
+    uint32_t log_size;
+    uint32_t irq;
+    uint16_t prod_ptr;
+    uint16_t cons_ptr;
+    int enable;
+    int armed;
+};
+
+struct mqnic_sim_cq {
+    uint64_t base_addr;
+    uint32_t log_size;
+    uint32_t eqn;
+    uint16_t prod_ptr;
+    uint16_t cons_ptr;
+    int enable;
+    int armed;
+};
+
+struct mqnic_sim_queue {
+    uint64_t base_addr;
+    uint32_t log_size;
+    uint32_t log_block_size;
+    uint32_t cqn;
+    uint16_t prod_ptr;
+    uint16_t cons_ptr;
+    int enable;
+};
+
+struct mqnic_sim {
+    struct mqnic *mqnic;
+    struct mqnic_reg_window window;
+
+    volatile uint8_t *regs;
+    int lock;
+
+    struct mqnic_sim_eq eq[MQNIC_SIM_EQ_COUNT];
+    struct mqnic_sim_cq cq[MQNIC_SIM_CQ_COUNT];
+    struct mqnic_sim_queue txq[MQNIC_SIM_TXQ_COUNT];
+    struct mqnic_sim_queue rxq[MQNIC_SIM_RXQ_COUNT];
+
+    uint64_t stats[MQNIC_SIM_STATS_COUNT];
+
+    int64_t phc_offset;
+    struct timespec phc_get;
+    uint32_t phc_set_ns;
+    uint32_t phc_set_sec_l;
+    uint32_t phc_adj_ns;
+    uint32_t phc_period_fns;
+    uint32_t phc_period_ns;
+
+    uint8_t pkt[16384];
+};
+
+static inline uint32_t mqnic_sim_mem_read(struct mqnic_sim *sim, size_t offset)
+{
+    return *(volatile uint32_t *)(sim->regs + offset);
+}
+
+static inline void mqnic_sim_mem_write(struct mqnic_sim *sim, size_t offset, uint32_t val)
+{
+    *(volatile uint32_t *)(sim->regs + offset) = val;
+}
+
+static void mqnic_sim_rb(struct mqnic_sim *sim, size_t offset, uint32_t type, uint32_t ver, uint32_t next)
+{
+    mqnic_sim_mem_write(sim, offset + MQNIC_RB_REG_TYPE, type);
+    mqnic_sim_mem_write(sim, offset + MQNIC_RB_REG_VER, ver);
+    mqnic_sim_mem_write(sim, offset + MQNIC_RB_REG_NEXT_PTR, next);
+}
+
+static void mqnic_sim_dma_read(struct mqnic_sim *sim, void *dst, uint64_t addr, size_t len)
+{
+    memcpy(dst, (const void *)(uintptr_t)addr, len);
+
+    sim->stats[MQNIC_SIM_STAT_DMA_RD_OP_COUNT]++;
+    sim->stats[MQNIC_SIM_STAT_DMA_RD_OP_BYTES] += len;
+}
+
+static void mqnic_sim_dma_write(struct mqnic_sim *sim, uint64_t addr, const void *src, size_t len)
+{
+    memcpy((void *)(uintptr_t)addr, src, len);
+
+    sim->stats[MQNIC_SIM_STAT_DMA_WR_OP_COUNT]++;
+    sim->stats[MQNIC_SIM_STAT_DMA_WR_OP_BYTES] += len;
+}
+
+// write a completion or event record, publishing it with the phase bit last
+static void mqnic_sim_write_record(struct mqnic_sim *sim, uint64_t addr, void *rec, size_t len, uint32_t phase)
+{
+    volatile uint32_t *phase_ptr = (volatile uint32_t *)(uintptr_t)(addr + len - 4);
+
+    mqnic_sim_dma_write(sim, addr, rec, len - 4);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    *phase_ptr = htole32(phase);
+}
+
+static void mqnic_sim_phc_now(struct mqnic_sim *sim, struct timespec *ts)
+{
+    int64_t ns;
+
+    clock_gettime(CLOCK_REALTIME, ts);
+
+    ns = ts->tv_sec * 1000000000ll + ts->tv_nsec + sim->phc_offset;
+    ts->tv_sec = ns / 1000000000ll;
+    ts->tv_nsec = ns % 1000000000ll;
+}
+
+static void mqnic_sim_eq_irq(struct mqnic_sim *sim, struct mqnic_sim_eq *eq)
+{
+    uint64_t val = 1;
+
+    if (!eq->enable || !eq->armed || eq->prod_ptr == eq->cons_ptr)
+        return;
+
+    eq->armed = 0;
+
+    if (eq->irq < MQNIC_SIM_IRQ_COUNT && write(sim->mqnic->irq_fd[eq->irq], &val, sizeof(val)) < 0)
+        perror("eventfd write failed");
+}
+
+static void mqnic_sim_cq_event(struct mqnic_sim *sim, uint32_t cqn)
+{
+    struct mqnic_sim_cq *cq = &sim->cq[cqn];
+    struct mqnic_sim_eq *eq;
+    struct mqnic_event event;
+    uint32_t size;
+
+    if (!cq->enable || !cq->armed || cq->prod_ptr == cq->cons_ptr)
+        return;
+
+    cq->armed = 0;
+
+    if (cq->eqn >= MQNIC_SIM_EQ_COUNT)
+        return;
+
+    eq = &sim->eq[cq->eqn];
+    size = 1 << eq->log_size;
+
+    if (!eq->enable || (uint16_t)(eq->prod_ptr - eq->cons_ptr) >= size)
+        return;
+
+    memset(&event, 0, sizeof(event));
+    event.type = htole16(MQNIC_EVENT_TYPE_CPL);
+    event.source = htole16(cqn);
+
+    mqnic_sim_write_record(sim, eq->base_addr + (eq->prod_ptr & (size-1)) * MQNIC_EVENT_SIZE,
+            &event, sizeof(event), (eq->prod_ptr & size) ? 0 : 0x80000000);
+    eq->prod_ptr++;
+
+    mqnic_sim_eq_irq(sim, eq);
+}
+
+static int mqnic_sim_cq_full(struct mqnic_sim *sim, uint32_t cqn)
+{
+    struct mqnic_sim_cq *cq;
+
+    if (cqn >= MQNIC_SIM_CQ_COUNT)
+        return 1;
+
+    cq = &sim->cq[cqn];
+
+    return !cq->enable || (uint16_t)(cq->prod_ptr - cq->cons_ptr) >= (1 << cq->log_size);
+}
+
+static void mqnic_sim_cq_write(struct mqnic_sim *sim, uint32_t cqn, struct mqnic_cpl *cpl)
+{
+    struct mqnic_sim_cq *cq = &sim->cq[cqn];
+    uint32_t size = 1 << cq->log_size;
+    struct timespec ts;
+
+    mqnic_sim_phc_now(sim, &ts);
+    cpl->ts_ns = htole32(ts.tv_nsec);
+    cpl->ts_s = htole16(ts.tv_sec & 0xffff);
+
+    mqnic_sim_write_record(sim, cq->base_addr + (cq->prod_ptr & (size-1)) * MQNIC_CPL_SIZE,
+            cpl, sizeof(*cpl), (cq->prod_ptr & size) ? 0 : 0x80000000);
+    cq->prod_ptr++;
+
+    mqnic_sim_cq_event(sim, cqn);
+}
+
+// ones complement sum of the frame after the Ethernet header
+static uint16_t mqnic_sim_rx_csum(const uint8_t *data, size_t len)
+{
+    uint32_t sum = 0;
+
+    for (size_t k = 14; k < len; k += 2)
+        sum += (data[k] << 8) | (k+1 < len ? data[k+1] : 0);
+
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+
+    return sum;
+}
+
+static void mqnic_sim_rx(struct mqnic_sim *sim, const uint8_t *data, size_t len)
+{
+    uint32_t rxqn = mqnic_sim_mem_read(sim, MQNIC_SIM_IF_OFFSET + MQNIC_SIM_INDIR_OFFSET);
+    uint32_t rx_mtu = mqnic_sim_mem_read(sim, MQNIC_SIM_IF_OFFSET + MQNIC_SIM_IF_CSR_OFFSET + MQNIC_RB_IF_CTRL_REG_RX_MTU);
+    struct mqnic_sim_queue *q;
+    struct mqnic_desc desc;
+    struct mqnic_cpl cpl;
+    uint64_t desc_addr;
+    size_t offset = 0;
+
+    if (rxqn >= MQNIC_SIM_RXQ_COUNT || len > rx_mtu)
+        return;
+
+    q = &sim->rxq[rxqn];
+
+    if (!q->enable || q->prod_ptr == q->cons_ptr || mqnic_sim_cq_full(sim, q->cqn))
+        return;
+
+    desc_addr = q->base_addr + (q->cons_ptr & ((1 << q->log_size)-1)) * (MQNIC_DESC_SIZE << q->log_block_size);
+
+    // scatter across the descriptor block
+    for (int k = 0; k < (1 << q->log_block_size) && offset < len; k++)
+    {
+        size_t seg;
+
+        mqnic_sim_dma_read(sim, &desc, desc_addr + k*MQNIC_DESC_SIZE, sizeof(desc));
+
+        seg = le32toh(desc.len);
+        if (seg > len - offset)
+            seg = len - offset;
+
+        mqnic_sim_dma_write(sim, le64toh(desc.addr), data + offset, seg);
+        offset += seg;
+    }
+
+    memset(&cpl, 0, sizeof(cpl));
+    cpl.queue = htole16(rxqn);
+    cpl.index = htole16(q->cons_ptr);
+    cpl.len = htole16(offset);
+    cpl.rx_csum = htole16(mqnic_sim_rx_csum(data, offset));
+
+    q->cons_ptr++;
+    mqnic_sim_cq_write(sim, q->cqn, &cpl);
+}
+
+static int mqnic_sim_txq_sched_enabled(struct mqnic_sim *sim, uint32_t txqn)
+{
+    size_t sched_rb = MQNIC_SIM_IF_OFFSET + MQNIC_SIM_SCHED_BLOCK_OFFSET + 0x100;
+
+    if (!mqnic_sim_mem_read(sim, sched_rb + MQNIC_RB_SCHED_RR_REG_CTRL))
+        return 0;
+
+    return mqnic_sim_mem_read(sim, MQNIC_SIM_IF_OFFSET + MQNIC_SIM_SCHED_OFFSET + txqn*4) & 1;
+}
+
+static void mqnic_sim_tx(struct mqnic_sim *sim, uint32_t txqn)
+{
+    struct mqnic_sim_queue *q = &sim->txq[txqn];
+    struct mqnic_desc desc;
+    struct mqnic_cpl cpl;
+
+    if (!q->enable || !mqnic_sim_txq_sched_enabled(sim, txqn))
+        return;
+
+    while (q->prod_ptr != q->cons_ptr && !mqnic_sim_cq_full(sim, q->cqn))
+    {
+        uint64_t desc_addr = q->base_addr + (q->cons_ptr & ((1 << q->log_size)-1)) * (MQNIC_DESC_SIZE << q->log_block_size);
+        size_t len = 0;
+
+        // gather from the descriptor block
+        for (int k = 0; k < (1 << q->log_block_size); k++)
+        {
+            size_t seg;
+
+            mqnic_sim_dma_read(sim, &desc, desc_addr + k*MQNIC_DESC_SIZE, sizeof(desc));
+
+            seg = le32toh(desc.len);
+            if (!seg)
+                break;
+            if (seg > sizeof(sim->pkt) - len)
+                seg = sizeof(sim->pkt) - len;
+
+            mqnic_sim_dma_read(sim, sim->pkt + len, le64toh(desc.addr), seg);
+            len += seg;
+        }
+
+        memset(&cpl, 0, sizeof(cpl));
+        cpl.queue = htole16(txqn);
+        cpl.index = htole16(q->cons_ptr);
+        cpl.len = htole16(len);
+
+        q->cons_ptr++;
+        mqnic_sim_cq_write(sim, q->cqn, &cpl);
+
+        mqnic_sim_rx(sim, sim->pkt, len);
+    }
+}
+
+static void mqnic_sim_tx_all(struct mqnic_sim *sim)
+{
+    for (int k = 0; k < MQNIC_SIM_TXQ_COUNT; k++)
+        mqnic_sim_tx(sim, k);
+}
+
+static uint32_t mqnic_sim_queue_read(struct mqnic_sim_queue *q, size_t reg)
+{
+    switch (reg)
+    {
+    case MQNIC_QUEUE_BASE_ADDR_VF_REG:
+        return q->base_addr;
+    case MQNIC_QUEUE_BASE_ADDR_VF_REG+4:
+        return q->base_addr >> 32;
+    case MQNIC_QUEUE_CTRL_STATUS_REG:
+        return q->enable ? MQNIC_QUEUE_ENABLE_MASK | MQNIC_QUEUE_ACTIVE_MASK : 0;
+    case MQNIC_QUEUE_SIZE_CQN_REG:
+        return q->cqn | (q->log_size << 24) | (q->log_block_size << 28);
+    case MQNIC_QUEUE_PTR_REG:
+        return q->prod_ptr | (q->cons_ptr << 16);
+    }
+
+    return 0;
+}
+
+// returns 1 when the producer pointer was written
+static int mqnic_sim_queue_write(struct mqnic_sim_queue *q, size_t reg, uint32_t val)
+{
+    if (reg < MQNIC_QUEUE_CTRL_STATUS_REG)
+    {
+        // base address is only writable while the queue is disabled
+        if (q->enable)
+            return 0;
+
+        if (reg == MQNIC_QUEUE_BASE_ADDR_VF_REG)
+            q->base_addr = (q->base_addr & ~0xffffffffull) | (val & 0xfffff000);
+        else
+            q->base_addr = (q->base_addr & 0xffffffffull) | ((uint64_t)val << 32);
+
+        return 0;
+    }
+
+    if ((val & 0xC0000000) == MQNIC_QUEUE_CMD_SET_CQN)
+    {
+        q->cqn = val & 0xffffff;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_QUEUE_CMD_SET_SIZE)
+    {
+        q->log_size = val & 0xff;
+        q->log_block_size = (val >> 8) & 0xff;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_QUEUE_CMD_SET_PROD_PTR)
+    {
+        q->prod_ptr = val & MQNIC_QUEUE_PTR_MASK;
+        return 1;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_QUEUE_CMD_SET_CONS_PTR)
+    {
+        q->cons_ptr = val & MQNIC_QUEUE_PTR_MASK;
+    }
+    else if ((val & 0xFFFFFF00) == MQNIC_QUEUE_CMD_SET_ENABLE)
+    {
+        q->enable = val & 1;
+        return q->enable;
+    }
+
+    return 0;
+}
+
+static uint32_t mqnic_sim_cq_read(struct mqnic_sim_cq *cq, size_t reg)
+{
+    switch (reg)
+    {
+    case MQNIC_CQ_BASE_ADDR_VF_REG:
+        return cq->base_addr;
+    case MQNIC_CQ_BASE_ADDR_VF_REG+4:
+        return cq->base_addr >> 32;
+    case MQNIC_CQ_CTRL_STATUS_REG:
+        return cq->eqn | (cq->enable ? MQNIC_CQ_ENABLE_MASK | MQNIC_CQ_ACTIVE_MASK : 0) |
+            (cq->armed ? MQNIC_CQ_ARM_MASK : 0) | (cq->log_size << 28);
+    case MQNIC_CQ_PTR_REG:
+        return cq->prod_ptr | (cq->cons_ptr << 16);
+    }
+
+    return 0;
+}
+
+// returns 1 when completion queue space was freed
+static int mqnic_sim_cq_write_reg(struct mqnic_sim *sim, uint32_t cqn, size_t reg, uint32_t val)
+{
+    struct mqnic_sim_cq *cq = &sim->cq[cqn];
+
+    if (reg < MQNIC_CQ_CTRL_STATUS_REG)
+    {
+        if (cq->enable)
+            return 0;
+
+        if (reg == MQNIC_CQ_BASE_ADDR_VF_REG)
+            cq->base_addr = (cq->base_addr & ~0xffffffffull) | (val & 0xfffff000);
+        else
+            cq->base_addr = (cq->base_addr & 0xffffffffull) | ((uint64_t)val << 32);
+
+        return 0;
+    }
+
+    if ((val & 0xC0000000) == MQNIC_CQ_CMD_SET_EQN)
+    {
+        cq->eqn = val & 0xffff;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_CQ_CMD_SET_SIZE)
+    {
+        cq->log_size = val & 0xff;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_CQ_CMD_SET_PROD_PTR)
+    {
+        cq->prod_ptr = val & MQNIC_CQ_PTR_MASK;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_CQ_CMD_SET_CONS_PTR)
+    {
+        cq->cons_ptr = val & MQNIC_CQ_PTR_MASK;
+        return 1;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_CQ_CMD_SET_CONS_PTR_ARM)
+    {
+        cq->cons_ptr = val & MQNIC_CQ_PTR_MASK;
+        cq->armed = 1;
+        mqnic_sim_cq_event(sim, cqn);
+        return 1;
+    }
+    else if ((val & 0xFFFFFF00) == MQNIC_CQ_CMD_SET_ENABLE)
+    {
+        cq->enable = val & 1;
+        return cq->enable;
+    }
+    else if ((val & 0xFFFFFF00) == MQNIC_CQ_CMD_SET_ARM)
+    {
+        cq->armed = val & 1;
+        mqnic_sim_cq_event(sim, cqn);
+    }
+
+    // holdoff and VF commands are accepted and ignored
+
+    return 0;
+}
+
+static uint32_t mqnic_sim_eq_read(struct mqnic_sim_eq *eq, size_t reg)
+{
+    switch (reg)
+    {
+    case MQNIC_EQ_BASE_ADDR_VF_REG:
+        return eq->base_addr;
+    case MQNIC_EQ_BASE_ADDR_VF_REG+4:
+        return eq->base_addr >> 32;
+    case MQNIC_EQ_CTRL_STATUS_REG:
+        return eq->irq | (eq->enable ? MQNIC_EQ_ENABLE_MASK | MQNIC_EQ_ACTIVE_MASK : 0) |
+            (eq->armed ? MQNIC_EQ_ARM_MASK : 0) | (eq->log_size << 28);
+    case MQNIC_EQ_PTR_REG:
+        return eq->prod_ptr | (eq->cons_ptr << 16);
+    }
+
+    return 0;
+}
+
+static void mqnic_sim_eq_write(struct mqnic_sim *sim, struct mqnic_sim_eq *eq, size_t reg, uint32_t val)
+{
+    if (reg < MQNIC_EQ_CTRL_STATUS_REG)
+    {
+        if (eq->enable)
+            return;
+
+        if (reg == MQNIC_EQ_BASE_ADDR_VF_REG)
+            eq->base_addr = (eq->base_addr & ~0xffffffffull) | (val & 0xfffff000);
+        else
+            eq->base_addr = (eq->base_addr & 0xffffffffull) | ((uint64_t)val << 32);
+
+        return;
+    }
+
+    if ((val & 0xC0000000) == MQNIC_EQ_CMD_SET_IRQN)
+    {
+        eq->irq = val & 0xffff;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_EQ_CMD_SET_SIZE)
+    {
+        eq->log_size = val & 0xff;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_EQ_CMD_SET_PROD_PTR)
+    {
+        eq->prod_ptr = val & MQNIC_EQ_PTR_MASK;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_EQ_CMD_SET_CONS_PTR)
+    {
+        eq->cons_ptr = val & MQNIC_EQ_PTR_MASK;
+    }
+    else if ((val & 0xFFFF0000) == MQNIC_EQ_CMD_SET_CONS_PTR_ARM)
+    {
+        eq->cons_ptr = val & MQNIC_EQ_PTR_MASK;
+        eq->armed = 1;
+        mqnic_sim_eq_irq(sim, eq);
+    }
+    else if ((val & 0xFFFFFF00) == MQNIC_EQ_CMD_SET_ENABLE)
+    {
+        eq->enable = val & 1;
+    }
+    else if ((val & 0xFFFFFF00) == MQNIC_EQ_CMD_SET_ARM)
+    {
+        eq->armed = val & 1;
+        mqnic_sim_eq_irq(sim, eq);
+    }
+}
+
+static uint32_t mqnic_sim_phc_read(struct mqnic_sim *sim, size_t reg)
+{
+    struct timespec ts;
+
+    switch (reg)
+    {
+    case MQNIC_RB_PHC_REG_CUR_FNS:
+        return 0;
+    case MQNIC_RB_PHC_REG_CUR_NS:
+        mqnic_sim_phc_now(sim, &ts);
+        return ts.tv_nsec;
+    case MQNIC_RB_PHC_REG_CUR_SEC_L:
+        mqnic_sim_phc_now(sim, &ts);
+        return ts.tv_sec;
+    case MQNIC_RB_PHC_REG_CUR_SEC_H:
+        mqnic_sim_phc_now(sim, &ts);
+        return (uint64_t)ts.tv_sec >> 32;
+    case MQNIC_RB_PHC_REG_GET_FNS:
+        // reading FNS latches the time
+        mqnic_sim_phc_now(sim, &sim->phc_get);
+        return 0;
+    case MQNIC_RB_PHC_REG_GET_NS:
+        return sim->phc_get.tv_nsec;
+    case MQNIC_RB_PHC_REG_GET_SEC_L:
+        return sim->phc_get.tv_sec;
+    case MQNIC_RB_PHC_REG_GET_SEC_H:
+        return (uint64_t)sim->phc_get.tv_sec >> 32;
+    case MQNIC_RB_PHC_REG_PERIOD_FNS:
+        return sim->phc_period_fns;
+    case MQNIC_RB_PHC_REG_PERIOD_NS:
+        return sim->phc_period_ns;
+    case MQNIC_RB_PHC_REG_NOM_PERIOD_FNS:
+        return 0;
+    case MQNIC_RB_PHC_REG_NOM_PERIOD_NS:
+        return 4;
+    }
+
+    return mqnic_sim_mem_read(sim, MQNIC_SIM_PHC_OFFSET + reg);
+}
+
+static void mqnic_sim_phc_write(struct mqnic_sim *sim, size_t reg, uint32_t val)
+{
+    struct timespec ts;
+
+    switch (reg)
+    {
+    case MQNIC_RB_PHC_REG_SET_NS:
+        sim->phc_set_ns = val;
+        break;
+    case MQNIC_RB_PHC_REG_SET_SEC_L:
+        sim->phc_set_sec_l = val;
+        break;
+    case MQNIC_RB_PHC_REG_SET_SEC_H:
+        // writing the seconds MSBs sets the time
+        clock_gettime(CLOCK_REALTIME, &ts);
+        sim->phc_offset = (int64_t)(((uint64_t)val << 32) | sim->phc_set_sec_l) * 1000000000ll + sim->phc_set_ns -
+            (ts.tv_sec * 1000000000ll + ts.tv_nsec);
+        break;
+    case MQNIC_RB_PHC_REG_PERIOD_FNS:
+        sim->phc_period_fns = val;
+        break;
+    case MQNIC_RB_PHC_REG_PERIOD_NS:
+        // frequency adjustments are accepted but the model follows the host clock
+        sim->phc_period_ns = val;
+        break;
+    case MQNIC_RB_PHC_REG_ADJ_NS:
+        sim->phc_adj_ns = val;
+        break;
+    case MQNIC_RB_PHC_REG_ADJ_COUNT:
+        sim->phc_offset += (int64_t)(int32_t)sim->phc_adj_ns * val;
+        break;
+    }
+}
+
+// registers outside of the model state that software may write
+static int mqnic_sim_reg_writable(size_t offset)
+{
+    size_t csr = MQNIC_SIM_IF_OFFSET + MQNIC_SIM_IF_CSR_OFFSET;
+
+    if (offset == csr + MQNIC_RB_IF_CTRL_REG_TX_MTU || offset == csr + MQNIC_RB_IF_CTRL_REG_RX_MTU)
+        return 1;
+
+    // RX queue map channel 0
+    if (offset >= csr + 0x500 + MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET + MQNIC_RB_RX_QUEUE_MAP_CH_REG_RSS_MASK &&
+            offset <= csr + 0x500 + MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET + MQNIC_RB_RX_QUEUE_MAP_CH_REG_APP_MASK)
+        return 1;
+
+    if (offset >= MQNIC_SIM_IF_OFFSET + MQNIC_SIM_INDIR_OFFSET &&
+            offset < MQNIC_SIM_IF_OFFSET + MQNIC_SIM_INDIR_OFFSET + (4 << MQNIC_SIM_INDIR_LOG_SIZE))
+        return 1;
+
+    return 0;
+}
+
+static uint32_t mqnic_sim_read(struct mqnic_sim *sim, size_t offset)
+{
+    size_t reg;
+
+    if (offset >= MQNIC_SIM_PHC_OFFSET && offset < MQNIC_SIM_PHC_OFFSET + 0x100)
+        return mqnic_sim_phc_read(sim, offset - MQNIC_SIM_PHC_OFFSET);
+
+    if (offset >= MQNIC_SIM_STATS_OFFSET && offset < MQNIC_SIM_STATS_OFFSET + MQNIC_SIM_STATS_COUNT*8)
+    {
+        reg = offset - MQNIC_SIM_STATS_OFFSET;
+        return sim->stats[reg / 8] >> ((reg & 4) ? 32 : 0);
+    }
+
+    if (offset < MQNIC_SIM_IF_OFFSET)
+        return mqnic_sim_mem_read(sim, offset);
+
+    reg = offset - MQNIC_SIM_IF_OFFSET;
+
+    if (reg - MQNIC_SIM_EQ_OFFSET < MQNIC_SIM_EQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_EQ_OFFSET;
+        return mqnic_sim_eq_read(&sim->eq[reg / MQNIC_SIM_QUEUE_STRIDE], reg % MQNIC_SIM_QUEUE_STRIDE);
+    }
+
+    if (reg >= MQNIC_SIM_CQ_OFFSET && reg < MQNIC_SIM_CQ_OFFSET + MQNIC_SIM_CQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_CQ_OFFSET;
+        return mqnic_sim_cq_read(&sim->cq[reg / MQNIC_SIM_QUEUE_STRIDE], reg % MQNIC_SIM_QUEUE_STRIDE);
+    }
+
+    if (reg >= MQNIC_SIM_TXQ_OFFSET && reg < MQNIC_SIM_TXQ_OFFSET + MQNIC_SIM_TXQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_TXQ_OFFSET;
+        return mqnic_sim_queue_read(&sim->txq[reg / MQNIC_SIM_QUEUE_STRIDE], reg % MQNIC_SIM_QUEUE_STRIDE);
+    }
+
+    if (reg >= MQNIC_SIM_RXQ_OFFSET && reg < MQNIC_SIM_RXQ_OFFSET + MQNIC_SIM_RXQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_RXQ_OFFSET;
+        return mqnic_sim_queue_read(&sim->rxq[reg / MQNIC_SIM_QUEUE_STRIDE], reg % MQNIC_SIM_QUEUE_STRIDE);
+    }
+
+    return mqnic_sim_mem_read(sim, offset);
+}
+
+static void mqnic_sim_write(struct mqnic_sim *sim, size_t offset, uint32_t val)
+{
+    size_t sched_rb = MQNIC_SIM_IF_OFFSET + MQNIC_SIM_SCHED_BLOCK_OFFSET + 0x100;
+    size_t reg;
+    uint32_t n;
+
+    if (offset >= MQNIC_SIM_PHC_OFFSET && offset < MQNIC_SIM_PHC_OFFSET + 0x100)
+    {
+        mqnic_sim_phc_write(sim, offset - MQNIC_SIM_PHC_OFFSET, val);
+        return;
+    }
+
+    if (offset < MQNIC_SIM_IF_OFFSET)
+        return;
+
+    reg = offset - MQNIC_SIM_IF_OFFSET;
+
+    if (reg - MQNIC_SIM_EQ_OFFSET < MQNIC_SIM_EQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_EQ_OFFSET;
+        mqnic_sim_eq_write(sim, &sim->eq[reg / MQNIC_SIM_QUEUE_STRIDE], reg % MQNIC_SIM_QUEUE_STRIDE, val);
+        return;
+    }
+
+    if (reg >= MQNIC_SIM_CQ_OFFSET && reg < MQNIC_SIM_CQ_OFFSET + MQNIC_SIM_CQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_CQ_OFFSET;
+        n = reg / MQNIC_SIM_QUEUE_STRIDE;
+
+        // freed completion queue space may unblock TX queues
+        if (mqnic_sim_cq_write_reg(sim, n, reg % MQNIC_SIM_QUEUE_STRIDE, val))
+        {
+            for (int k = 0; k < MQNIC_SIM_TXQ_COUNT; k++)
+                if (sim->txq[k].cqn == n)
+                    mqnic_sim_tx(sim, k);
+        }
+        return;
+    }
+
+    if (reg >= MQNIC_SIM_TXQ_OFFSET && reg < MQNIC_SIM_TXQ_OFFSET + MQNIC_SIM_TXQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_TXQ_OFFSET;
+        n = reg / MQNIC_SIM_QUEUE_STRIDE;
+
+        // doorbell
+        if (mqnic_sim_queue_write(&sim->txq[n], reg % MQNIC_SIM_QUEUE_STRIDE, val))
+            mqnic_sim_tx(sim, n);
+        return;
+    }
+
+    if (reg >= MQNIC_SIM_RXQ_OFFSET && reg < MQNIC_SIM_RXQ_OFFSET + MQNIC_SIM_RXQ_COUNT*MQNIC_SIM_QUEUE_STRIDE)
+    {
+        reg -= MQNIC_SIM_RXQ_OFFSET;
+        mqnic_sim_queue_write(&sim->rxq[reg / MQNIC_SIM_QUEUE_STRIDE], reg % MQNIC_SIM_QUEUE_STRIDE, val);
+        return;
+    }
+
+    if (reg >= MQNIC_SIM_SCHED_OFFSET && reg < MQNIC_SIM_SCHED_OFFSET + MQNIC_SIM_TXQ_COUNT*4)
+    {
+        mqnic_sim_mem_write(sim, offset, val);
+        mqnic_sim_tx(sim, (reg - MQNIC_SIM_SCHED_OFFSET) / 4);
+        return;
+    }
+
+    if (offset == sched_rb + MQNIC_RB_SCHED_RR_REG_CTRL)
+    {
+        mqnic_sim_mem_write(sim, offset, val & 1);
+        mqnic_sim_tx_all(sim);
+        return;
+    }
+
+    if (mqnic_sim_reg_writable(offset))
+        mqnic_sim_mem_write(sim, offset, val);
+}
+
+static void mqnic_sim_lock(struct mqnic_sim *sim)
+{
+    while (__atomic_test_and_set(&sim->lock, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static void mqnic_sim_unlock(struct mqnic_sim *sim)
+{
+    __atomic_clear(&sim->lock, __ATOMIC_RELEASE);
+}
+
+static int mqnic_sim_reg_read32(const struct mqnic_reg_if *reg, ptrdiff_t offset, uint32_t *value)
+{
+    struct mqnic_sim *sim = reg->priv;
+
+    if (offset < 0 || offset + 4 > MQNIC_SIM_REGS_SIZE || offset & 3)
+        return -1;
+
+    mqnic_sim_lock(sim);
+    *value = mqnic_sim_read(sim, offset);
+    mqnic_sim_unlock(sim);
+
+    return 0;
+}
+
+static int mqnic_sim_reg_write32(const struct mqnic_reg_if *reg, ptrdiff_t offset, uint32_t value)
+{
+    struct mqnic_sim *sim = reg->priv;
+
+    if (offset < 0 || offset + 4 > MQNIC_SIM_REGS_SIZE || offset & 3)
+        return -1;
+
+    mqnic_sim_lock(sim);
+    mqnic_sim_write(sim, offset, value);
+    mqnic_sim_unlock(sim);
+
+    return 0;
+}
+
+static const struct mqnic_reg_if_ops mqnic_sim_reg_if_ops = {
+    .read32 = mqnic_sim_reg_read32,
+    .write32 = mqnic_sim_reg_write32,
+};
+
+static void mqnic_sim_init_regs(struct mqnic_sim *sim)
+{
+    size_t base;
+
+    // top level register blocks
+    mqnic_sim_rb(sim, 0x0000, MQNIC_RB_FW_ID_TYPE, MQNIC_RB_FW_ID_VER, 0x0100);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_FPGA_ID, 0);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_FW_ID, 0);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_FW_VER, 0x00000100);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_BOARD_ID, 0);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_BOARD_VER, 0);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_BUILD_DATE, time(NULL));
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_GIT_HASH, 0);
+    mqnic_sim_mem_write(sim, 0x0000 + MQNIC_RB_FW_ID_REG_REL_INFO, 0);
+
+    mqnic_sim_rb(sim, 0x0100, MQNIC_RB_IF_TYPE, MQNIC_RB_IF_VER, 0x0200);
+    mqnic_sim_mem_write(sim, 0x0100 + MQNIC_RB_IF_REG_OFFSET, MQNIC_SIM_IF_OFFSET);
+    mqnic_sim_mem_write(sim, 0x0100 + MQNIC_RB_IF_REG_COUNT, 1);
+    mqnic_sim_mem_write(sim, 0x0100 + MQNIC_RB_IF_REG_STRIDE, MQNIC_SIM_IF_STRIDE);
+    mqnic_sim_mem_write(sim, 0x0100 + MQNIC_RB_IF_REG_CSR_OFFSET, MQNIC_SIM_IF_CSR_OFFSET);
+
+    // 156.25 MHz reference clock, 250 MHz core clock
+    mqnic_sim_rb(sim, 0x0200, MQNIC_RB_CLK_INFO_TYPE, MQNIC_RB_CLK_INFO_VER, MQNIC_SIM_PHC_OFFSET);
+    mqnic_sim_mem_write(sim, 0x0200 + MQNIC_RB_CLK_INFO_COUNT, 0);
+    mqnic_sim_mem_write(sim, 0x0200 + MQNIC_RB_CLK_INFO_REF_NOM_PER, (32 << 16) | 5);
+    mqnic_sim_mem_write(sim, 0x0200 + MQNIC_RB_CLK_INFO_CLK_NOM_PER, (4 << 16) | 1);
+    mqnic_sim_mem_write(sim, 0x0200 + MQNIC_RB_CLK_INFO_CLK_FREQ, 250000000);
+
+    mqnic_sim_rb(sim, MQNIC_SIM_PHC_OFFSET, MQNIC_RB_PHC_TYPE, MQNIC_RB_PHC_VER, 0x0400);
+
+    mqnic_sim_rb(sim, 0x0400, MQNIC_RB_STATS_TYPE, MQNIC_RB_STATS_VER, 0);
+    mqnic_sim_mem_write(sim, 0x0400 + MQNIC_RB_STATS_REG_OFFSET, MQNIC_SIM_STATS_OFFSET);
+    mqnic_sim_mem_write(sim, 0x0400 + MQNIC_RB_STATS_REG_COUNT, MQNIC_SIM_STATS_COUNT);
+    mqnic_sim_mem_write(sim, 0x0400 + MQNIC_RB_STATS_REG_STRIDE, 8);
+    mqnic_sim_mem_write(sim, 0x0400 + MQNIC_RB_STATS_REG_FLAGS, 0);
+
+    // interface register blocks
+    base = MQNIC_SIM_IF_OFFSET + MQNIC_SIM_IF_CSR_OFFSET;
+
+    mqnic_sim_rb(sim, base + 0x000, MQNIC_RB_IF_CTRL_TYPE, MQNIC_RB_IF_CTRL_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x100);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_FEATURES, MQNIC_IF_FEATURE_PTP_TS | MQNIC_IF_FEATURE_RX_CSUM);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_PORT_COUNT, 1);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_SCHED_COUNT, 1);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_MAX_TX_MTU, MQNIC_SIM_MAX_MTU);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_MAX_RX_MTU, MQNIC_SIM_MAX_MTU);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_TX_MTU, MQNIC_SIM_MAX_MTU);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_IF_CTRL_REG_RX_MTU, MQNIC_SIM_MAX_MTU);
+
+    mqnic_sim_rb(sim, base + 0x100, MQNIC_RB_EQM_TYPE, MQNIC_RB_EQM_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x200);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_EQM_REG_OFFSET, MQNIC_SIM_EQ_OFFSET);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_EQM_REG_COUNT, MQNIC_SIM_EQ_COUNT);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_EQM_REG_STRIDE, MQNIC_SIM_QUEUE_STRIDE);
+
+    mqnic_sim_rb(sim, base + 0x200, MQNIC_RB_CQM_TYPE, MQNIC_RB_CQM_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x300);
+    mqnic_sim_mem_write(sim, base + 0x200 + MQNIC_RB_CQM_REG_OFFSET, MQNIC_SIM_CQ_OFFSET);
+    mqnic_sim_mem_write(sim, base + 0x200 + MQNIC_RB_CQM_REG_COUNT, MQNIC_SIM_CQ_COUNT);
+    mqnic_sim_mem_write(sim, base + 0x200 + MQNIC_RB_CQM_REG_STRIDE, MQNIC_SIM_QUEUE_STRIDE);
+
+    mqnic_sim_rb(sim, base + 0x300, MQNIC_RB_TX_QM_TYPE, MQNIC_RB_TX_QM_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x400);
+    mqnic_sim_mem_write(sim, base + 0x300 + MQNIC_RB_TX_QM_REG_OFFSET, MQNIC_SIM_TXQ_OFFSET);
+    mqnic_sim_mem_write(sim, base + 0x300 + MQNIC_RB_TX_QM_REG_COUNT, MQNIC_SIM_TXQ_COUNT);
+    mqnic_sim_mem_write(sim, base + 0x300 + MQNIC_RB_TX_QM_REG_STRIDE, MQNIC_SIM_QUEUE_STRIDE);
+
+    mqnic_sim_rb(sim, base + 0x400, MQNIC_RB_RX_QM_TYPE, MQNIC_RB_RX_QM_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x500);
+    mqnic_sim_mem_write(sim, base + 0x400 + MQNIC_RB_RX_QM_REG_OFFSET, MQNIC_SIM_RXQ_OFFSET);
+    mqnic_sim_mem_write(sim, base + 0x400 + MQNIC_RB_RX_QM_REG_COUNT, MQNIC_SIM_RXQ_COUNT);
+    mqnic_sim_mem_write(sim, base + 0x400 + MQNIC_RB_RX_QM_REG_STRIDE, MQNIC_SIM_QUEUE_STRIDE);
+
+    mqnic_sim_rb(sim, base + 0x500, MQNIC_RB_RX_QUEUE_MAP_TYPE, MQNIC_RB_RX_QUEUE_MAP_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x600);
+    mqnic_sim_mem_write(sim, base + 0x500 + MQNIC_RB_RX_QUEUE_MAP_REG_CFG, (MQNIC_SIM_INDIR_LOG_SIZE << 8) | 1);
+    mqnic_sim_mem_write(sim, base + 0x500 + MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET + MQNIC_RB_RX_QUEUE_MAP_CH_REG_OFFSET, MQNIC_SIM_INDIR_OFFSET);
+
+    mqnic_sim_rb(sim, base + 0x600, MQNIC_RB_PORT_TYPE, MQNIC_RB_PORT_VER, MQNIC_SIM_IF_CSR_OFFSET + 0x700);
+    mqnic_sim_mem_write(sim, base + 0x600 + MQNIC_RB_PORT_REG_OFFSET, MQNIC_SIM_PORT_OFFSET);
+
+    mqnic_sim_rb(sim, base + 0x700, MQNIC_RB_SCHED_BLOCK_TYPE, MQNIC_RB_SCHED_BLOCK_VER, 0);
+    mqnic_sim_mem_write(sim, base + 0x700 + MQNIC_RB_SCHED_BLOCK_REG_OFFSET, MQNIC_SIM_SCHED_BLOCK_OFFSET);
+
+    // port, with the link always up
+    base = MQNIC_SIM_IF_OFFSET + MQNIC_SIM_PORT_OFFSET;
+
+    mqnic_sim_rb(sim, base, MQNIC_RB_PORT_CTRL_TYPE, MQNIC_RB_PORT_CTRL_VER, 0);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_PORT_CTRL_REG_FEATURES, 0);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_PORT_CTRL_REG_TX_STATUS, 1);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_PORT_CTRL_REG_RX_STATUS, 1);
+
+    // scheduler block, one round-robin scheduler
+    base = MQNIC_SIM_IF_OFFSET + MQNIC_SIM_SCHED_BLOCK_OFFSET;
+
+    mqnic_sim_rb(sim, base, MQNIC_RB_SCHED_BLOCK_TYPE, MQNIC_RB_SCHED_BLOCK_VER, MQNIC_SIM_SCHED_BLOCK_OFFSET + 0x100);
+    mqnic_sim_mem_write(sim, base + MQNIC_RB_SCHED_BLOCK_REG_OFFSET, MQNIC_SIM_SCHED_BLOCK_OFFSET);
+
+    mqnic_sim_rb(sim, base + 0x100, MQNIC_RB_SCHED_RR_TYPE, MQNIC_RB_SCHED_RR_VER, 0);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_SCHED_RR_REG_OFFSET, MQNIC_SIM_SCHED_OFFSET);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_SCHED_RR_REG_CH_COUNT, MQNIC_SIM_TXQ_COUNT);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_SCHED_RR_REG_CH_STRIDE, 4);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_SCHED_RR_REG_CTRL, 0);
+    mqnic_sim_mem_write(sim, base + 0x100 + MQNIC_RB_SCHED_RR_REG_DEST, 0);
+}
+
+int mqnic_sim_open(struct mqnic *dev)
+{
+    struct mqnic_sim *sim = calloc(1, sizeof(struct mqnic_sim));
+
+    if (!sim)
+    {
+        perror("memory allocation failed");
+        return -1;
+    }
+
+    // the window provides the register memory
+    sim->window.size = MQNIC_SIM_REGS_SIZE;
+    sim->window.reg.ops = &mqnic_sim_reg_if_ops;
+    sim->window.reg.priv = sim;
+
+    if (mqnic_reg_window_register(&sim->window))
+    {
+        free(sim);
+        return -1;
+    }
+
+    sim->mqnic = dev;
+    sim->regs = sim->window.base;
+    sim->phc_period_ns = 4;
+
+    mqnic_sim_init_regs(sim);
+
+    dev->sim = sim;
+    dev->regs = sim->regs;
+    dev->regs_size = MQNIC_SIM_REGS_SIZE;
+
+    snprintf(dev->device_path, sizeof(dev->device_path), "sim");
+    dev->pci_device_path[0] = 0;
+
+    // one eventfd per interrupt, signalled when an armed EQ has events
+    dev->irq_count = MQNIC_SIM_IRQ_COUNT;
+    dev->irq_fd = calloc(dev->irq_count, sizeof(*dev->irq_fd));
+    if (!dev->irq_fd)
+        goto fail;
+
+    for (int k = 0; k < dev->irq_count; k++)
+        dev->irq_fd[k] = -1;
+
+    for (int k = 0; k < dev->irq_count; k++)
+    {
+        dev->irq_fd[k] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (dev->irq_fd[k] < 0)
+        {
+            perror("eventfd failed");
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    mqnic_sim_close(dev);
+    return -1;
+}
+
+void mqnic_sim_close(struct mqnic *dev)
+{
+    struct mqnic_sim *sim = dev->sim;
+
+    if (!sim)
+        return;
+
+    if (dev->irq_fd)
+    {
+        for (int k = 0; k < dev->irq_count; k++)
+            if (dev->irq_fd[k] >= 0)
+                close(dev->irq_fd[k]);
+
+        free(dev->irq_fd);
+        dev->irq_fd = NULL;
+    }
+
+    mqnic_reg_window_unregister(&sim->window);
+    dev->regs = NULL;
+    dev->regs_size = 0;
+
+    free(sim);
+    dev->sim = NULL;
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Loopback self-test for the software device model: every frame sent on a
+// TX queue must complete, and arrive unmodified and in order on the RX queue
+// selected by the first indirection table entry.
+
+#define TEST_QUEUE_SIZE  1024
+#define TEST_FRAME_COUNT 256
+#define TEST_BUF_SIZE    2048
+
+static int test_loopback(struct mqnic *dev)
+{
+    struct mqnic_if *interface = dev->interfaces[0];
+    struct mqnic_pkt tx_pkt[TEST_FRAME_COUNT];
+    struct mqnic_pkt rx_pkt[TEST_FRAME_COUNT];
+    struct mqnic_pkt *pkts[TEST_FRAME_COUNT];
+    struct mqnic_queue *txq = NULL;
+    struct mqnic_queue *rxq = NULL;
+    struct mqnic_buf *buf = NULL;
+    uint8_t *data;
+    int ret = -1;
+    int n;
+
+    txq = mqnic_queue_open(interface, MQNIC_QUEUE_TYPE_TX, TEST_QUEUE_SIZE);
+    rxq = mqnic_queue_open(interface, MQNIC_QUEUE_TYPE_RX, TEST_QUEUE_SIZE);
+    buf = mqnic_buf_alloc(dev, 2 * TEST_FRAME_COUNT * TEST_BUF_SIZE);
+
+    if (!txq || !rxq || !buf)
+    {
+        fprintf(stderr, "Error: failed to set up queues\n");
+        goto done;
+    }
+
+    mqnic_interface_set_rx_queue_map_indir_table(interface, 0, 0, rxq->index);
+    mqnic_sched_enable(interface->sched_blocks[0]->sched[0]);
+
+    data = buf->addr;
+
+    for (int k = 0; k < TEST_FRAME_COUNT; k++)
+    {
+        rx_pkt[k].data = data + k*TEST_BUF_SIZE;
+        rx_pkt[k].dma_addr = mqnic_buf_dma_addr(buf, rx_pkt[k].data);
+        rx_pkt[k].len = TEST_BUF_SIZE;
+        pkts[k] = &rx_pkt[k];
+    }
+
+    if (mqnic_rx_refill(rxq, pkts, TEST_FRAME_COUNT) != TEST_FRAME_COUNT)
+    {
+        fprintf(stderr, "Error: RX refill failed\n");
+        goto done;
+    }
+
+    // frame k is 60+k bytes, each byte tagged with the frame number
+    for (int k = 0; k < TEST_FRAME_COUNT; k++)
+    {
+        tx_pkt[k].data = data + (TEST_FRAME_COUNT + k)*TEST_BUF_SIZE;
+        tx_pkt[k].dma_addr = mqnic_buf_dma_addr(buf, tx_pkt[k].data);
+        tx_pkt[k].len = 60 + k;
+        for (int i = 0; i < tx_pkt[k].len; i++)
+            ((uint8_t *)tx_pkt[k].data)[i] = k + i;
+        pkts[k] = &tx_pkt[k];
+    }
+
+    if (mqnic_tx_burst(txq, pkts, TEST_FRAME_COUNT) != TEST_FRAME_COUNT)
+    {
+        fprintf(stderr, "Error: TX burst failed\n");
+        goto done;
+    }
+
+    n = mqnic_tx_complete(txq, pkts, TEST_FRAME_COUNT);
+    if (n != TEST_FRAME_COUNT)
+    {
+        fprintf(stderr, "Error: %d of %d TX completions\n", n, TEST_FRAME_COUNT);
+        goto done;
+    }
+
+    n = mqnic_rx_burst(rxq, pkts, TEST_FRAME_COUNT);
+    if (n != TEST_FRAME_COUNT)
+    {
+        fprintf(stderr, "Error: %d of %d frames received\n", n, TEST_FRAME_COUNT);
+        goto done;
+    }
+
+    for (int k = 0; k < TEST_FRAME_COUNT; k++)
+    {
+        if (pkts[k] != &rx_pkt[k] || pkts[k]->len != tx_pkt[k].len ||
+                memcmp(pkts[k]->data, tx_pkt[k].data, tx_pkt[k].len))
+        {
+            fprintf(stderr, "Error: frame %d corrupted or out of order\n", k);
+            goto done;
+        }
+    }
+
+    ret = 0;
+
+done:
+    mqnic_queue_close(rxq);
+    mqnic_queue_close(txq);
+    mqnic_buf_unregister(buf);
+    return ret;
+}
+
+int main(void)
+{
+    struct mqnic *dev;
+    int ret;
+
+    dev = mqnic_open("sim");
+
+    if (!dev)
+    {
+        fprintf(stderr, "Failed to open software model\n");
+        return 1;
+    }
+
+    ret = test_loopback(dev);
+
+    mqnic_close(dev);
+
+    printf("sim loopback test %s\n", ret ? "FAILED" : "passed");
+
+    return ret ? 1 : 0;
+}
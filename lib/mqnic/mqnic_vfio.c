@@ -0,0 +1,569 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/pci_regs.h>
+#include <linux/vfio.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+// VFIO backend: the device is bound to vfio-pci and owned by this process,
+// with no kernel driver involved.  BARs are mapped through the VFIO device,
+// DMA memory is mapped into the IOMMU at IOVAs allocated from the ranges the
+// IOMMU reports as usable, and every MSI-X vector is routed to an eventfd.
+
+// DMA mapping, kept in IOVA order
+struct mqnic_vfio_mapping {
+    struct mqnic_vfio_mapping *next;
+    void *addr;
+    uint64_t iova;
+    size_t size;
+};
+
+static int mqnic_vfio_map_region(struct mqnic *dev, int index, volatile uint8_t **addr, size_t *size)
+{
+    struct vfio_region_info region_info;
+
+    memset(&region_info, 0, sizeof(region_info));
+    region_info.argsz = sizeof(region_info);
+    region_info.index = index;
+
+    if (ioctl(dev->vfio_device_fd, VFIO_DEVICE_GET_REGION_INFO, &region_info) != 0)
+    {
+        perror("VFIO_DEVICE_GET_REGION_INFO ioctl failed");
+        return -1;
+    }
+
+    // BAR not implemented
+    if (!region_info.size || !(region_info.flags & VFIO_REGION_INFO_FLAG_MMAP))
+        return 0;
+
+    *addr = (volatile uint8_t *)mmap(NULL, region_info.size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->vfio_device_fd, region_info.offset);
+    if (*addr == MAP_FAILED)
+    {
+        perror("mmap BAR failed");
+        *addr = NULL;
+        return -1;
+    }
+
+    *size = region_info.size;
+
+    return 0;
+}
+
+static int mqnic_vfio_get_iova_ranges(struct mqnic *dev)
+{
+    struct vfio_iommu_type1_info *info;
+    struct vfio_info_cap_header *hdr;
+    struct vfio_iommu_type1_info_cap_iova_range *cap;
+    size_t argsz = sizeof(*info);
+    uint32_t offset;
+
+    for (;;)
+    {
+        info = calloc(1, argsz);
+        if (!info)
+            return -1;
+
+        info->argsz = argsz;
+
+        if (ioctl(dev->vfio_container_fd, VFIO_IOMMU_GET_INFO, info) != 0)
+        {
+            perror("VFIO_IOMMU_GET_INFO ioctl failed");
+            free(info);
+            return -1;
+        }
+
+        // retry with room for the capability chain
+        if (info->argsz <= argsz)
+            break;
+
+        argsz = info->argsz;
+        free(info);
+    }
+
+    // smallest supported IOMMU page size
+    if ((info->flags & VFIO_IOMMU_INFO_PGSIZES) && info->iova_pgsizes)
+        dev->vfio_iova_page_size = info->iova_pgsizes & -info->iova_pgsizes;
+    else
+        dev->vfio_iova_page_size = sysconf(_SC_PAGESIZE);
+
+    offset = (info->flags & VFIO_IOMMU_INFO_CAPS) ? info->cap_offset : 0;
+
+    while (offset && offset + sizeof(*hdr) <= argsz)
+    {
+        hdr = (struct vfio_info_cap_header *)((uint8_t *)info + offset);
+
+        if (hdr->id == VFIO_IOMMU_TYPE1_INFO_CAP_IOVA_RANGE)
+        {
+            cap = (struct vfio_iommu_type1_info_cap_iova_range *)hdr;
+
+            dev->vfio_iova_ranges = calloc(cap->nr_iovas, sizeof(*dev->vfio_iova_ranges));
+            if (cap->nr_iovas && !dev->vfio_iova_ranges)
+            {
+                free(info);
+                return -1;
+            }
+
+            memcpy(dev->vfio_iova_ranges, cap->iova_ranges, cap->nr_iovas * sizeof(*dev->vfio_iova_ranges));
+            dev->vfio_iova_range_count = cap->nr_iovas;
+            break;
+        }
+
+        offset = hdr->next;
+    }
+
+    free(info);
+
+    // kernels before 5.4 do not report ranges, assume the 39-bit address
+    // width supported by every IOMMU in common use
+    if (!dev->vfio_iova_ranges)
+    {
+        dev->vfio_iova_ranges = calloc(1, sizeof(*dev->vfio_iova_ranges));
+        if (!dev->vfio_iova_ranges)
+            return -1;
+
+        dev->vfio_iova_ranges[0].start = 0;
+        dev->vfio_iova_ranges[0].end = (1ULL << 39) - 1;
+        dev->vfio_iova_range_count = 1;
+    }
+
+    return 0;
+}
+
+// first fit over the usable ranges, IOVA 0 is never handed out
+static int mqnic_vfio_alloc_iova(struct mqnic *dev, size_t size, uint64_t *iova)
+{
+    uint64_t mask = dev->vfio_iova_page_size - 1;
+
+    for (int k = 0; k < dev->vfio_iova_range_count; k++)
+    {
+        struct vfio_iova_range *range = &dev->vfio_iova_ranges[k];
+        struct mqnic_vfio_mapping *m;
+        uint64_t start = range->start ? range->start : 1;
+
+        start = (start + mask) & ~mask;
+
+        for (m = dev->vfio_mappings; m; m = m->next)
+        {
+            // mappings are sorted, so the first one past the candidate ends the search
+            if (m->iova >= start + size)
+                break;
+
+            if (m->iova + m->size > start)
+                start = (m->iova + m->size + mask) & ~mask;
+        }
+
+        // ranges may end at the top of the address space
+        if (!start || start < range->start || start + size < start || start + size - 1 > range->end)
+            continue;
+
+        *iova = start;
+        return 0;
+    }
+
+    fprintf(stderr, "Error: no free IOVA range for %zu byte mapping\n", size);
+    return -1;
+}
+
+static int mqnic_vfio_enable_bus_master(struct mqnic *dev)
+{
+    struct vfio_region_info region_info;
+    uint16_t cmd;
+
+    memset(&region_info, 0, sizeof(region_info));
+    region_info.argsz = sizeof(region_info);
+    region_info.index = VFIO_PCI_CONFIG_REGION_INDEX;
+
+    if (ioctl(dev->vfio_device_fd, VFIO_DEVICE_GET_REGION_INFO, &region_info) != 0)
+    {
+        perror("VFIO_DEVICE_GET_REGION_INFO ioctl failed");
+        return -1;
+    }
+
+    if (pread(dev->vfio_device_fd, &cmd, sizeof(cmd), region_info.offset + PCI_COMMAND) != sizeof(cmd))
+    {
+        perror("config space read failed");
+        return -1;
+    }
+
+    cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+
+    if (pwrite(dev->vfio_device_fd, &cmd, sizeof(cmd), region_info.offset + PCI_COMMAND) != sizeof(cmd))
+    {
+        perror("config space write failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int mqnic_vfio_setup_irqs(struct mqnic *dev)
+{
+    struct vfio_irq_info irq_info;
+    struct vfio_irq_set *irq_set;
+    size_t irq_set_size;
+    int ret;
+
+    memset(&irq_info, 0, sizeof(irq_info));
+    irq_info.argsz = sizeof(irq_info);
+    irq_info.index = VFIO_PCI_MSIX_IRQ_INDEX;
+
+    if (ioctl(dev->vfio_device_fd, VFIO_DEVICE_GET_IRQ_INFO, &irq_info) != 0)
+    {
+        perror("VFIO_DEVICE_GET_IRQ_INFO ioctl failed");
+        return -1;
+    }
+
+    dev->irq_count = irq_info.count;
+
+    if (dev->irq_count > MQNIC_MAX_IRQ)
+        dev->irq_count = MQNIC_MAX_IRQ;
+
+    if (!dev->irq_count)
+        return 0;
+
+    dev->irq_fd = calloc(dev->irq_count, sizeof(*dev->irq_fd));
+    if (!dev->irq_fd)
+        return -1;
+
+    for (int k = 0; k < dev->irq_count; k++)
+        dev->irq_fd[k] = -1;
+
+    for (int k = 0; k < dev->irq_count; k++)
+    {
+        dev->irq_fd[k] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (dev->irq_fd[k] < 0)
+        {
+            perror("eventfd failed");
+            return -1;
+        }
+    }
+
+    // route every MSI-X vector to its eventfd
+    irq_set_size = sizeof(*irq_set) + dev->irq_count * sizeof(int);
+    irq_set = calloc(1, irq_set_size);
+    if (!irq_set)
+        return -1;
+
+    irq_set->argsz = irq_set_size;
+    irq_set->flags = VFIO_IRQ_SET_DATA_EVENTFD | VFIO_IRQ_SET_ACTION_TRIGGER;
+    irq_set->index = VFIO_PCI_MSIX_IRQ_INDEX;
+    irq_set->start = 0;
+    irq_set->count = dev->irq_count;
+    memcpy(irq_set->data, dev->irq_fd, dev->irq_count * sizeof(int));
+
+    ret = ioctl(dev->vfio_device_fd, VFIO_DEVICE_SET_IRQS, irq_set);
+    free(irq_set);
+
+    if (ret != 0)
+    {
+        perror("VFIO_DEVICE_SET_IRQS ioctl failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+int mqnic_vfio_open(struct mqnic *dev, const char *pci_device_path)
+{
+    struct vfio_group_status group_status;
+    struct vfio_device_info device_info;
+    char path[PATH_MAX+32];
+    char link[PATH_MAX];
+    char *ptr;
+
+    if (!realpath(pci_device_path, dev->pci_device_path))
+        goto fail_path;
+
+    // device must be bound to vfio-pci
+    snprintf(path, sizeof(path), "%s/driver", dev->pci_device_path);
+
+    if (!realpath(path, link))
+        goto fail_path;
+
+    ptr = strrchr(link, '/');
+    if (!ptr || strcmp(ptr+1, "vfio-pci"))
+        goto fail_path;
+
+    // locate IOMMU group
+    snprintf(path, sizeof(path), "%s/iommu_group", dev->pci_device_path);
+
+    if (!realpath(path, link))
+        goto fail_path;
+
+    ptr = strrchr(link, '/');
+    if (!ptr)
+        goto fail_path;
+
+    snprintf(dev->device_path, sizeof(dev->device_path), "/dev/vfio/%s", ptr+1);
+
+    dev->vfio_container_fd = open("/dev/vfio/vfio", O_RDWR);
+
+    if (dev->vfio_container_fd < 0)
+    {
+        perror("open VFIO container failed");
+        goto fail;
+    }
+
+    if (ioctl(dev->vfio_container_fd, VFIO_GET_API_VERSION) != VFIO_API_VERSION)
+    {
+        fprintf(stderr, "Error: unknown VFIO API version\n");
+        goto fail;
+    }
+
+    if (!ioctl(dev->vfio_container_fd, VFIO_CHECK_EXTENSION, VFIO_TYPE1v2_IOMMU))
+    {
+        fprintf(stderr, "Error: VFIO type 1 IOMMU not supported\n");
+        goto fail;
+    }
+
+    dev->vfio_group_fd = open(dev->device_path, O_RDWR);
+
+    if (dev->vfio_group_fd < 0)
+    {
+        perror("open VFIO group failed");
+        goto fail;
+    }
+
+    memset(&group_status, 0, sizeof(group_status));
+    group_status.argsz = sizeof(group_status);
+
+    if (ioctl(dev->vfio_group_fd, VFIO_GROUP_GET_STATUS, &group_status) != 0)
+    {
+        perror("VFIO_GROUP_GET_STATUS ioctl failed");
+        goto fail;
+    }
+
+    if (!(group_status.flags & VFIO_GROUP_FLAGS_VIABLE))
+    {
+        fprintf(stderr, "Error: IOMMU group not viable, bind all devices in the group to vfio-pci\n");
+        goto fail;
+    }
+
+    if (ioctl(dev->vfio_group_fd, VFIO_GROUP_SET_CONTAINER, &dev->vfio_container_fd) != 0)
+    {
+        perror("VFIO_GROUP_SET_CONTAINER ioctl failed");
+        goto fail;
+    }
+
+    if (ioctl(dev->vfio_container_fd, VFIO_SET_IOMMU, VFIO_TYPE1v2_IOMMU) != 0)
+    {
+        perror("VFIO_SET_IOMMU ioctl failed");
+        goto fail;
+    }
+
+    if (mqnic_vfio_get_iova_ranges(dev))
+        goto fail;
+
+    ptr = strrchr(dev->pci_device_path, '/');
+    ptr = ptr ? ptr+1 : dev->pci_device_path;
+
+    dev->vfio_device_fd = ioctl(dev->vfio_group_fd, VFIO_GROUP_GET_DEVICE_FD, ptr);
+
+    if (dev->vfio_device_fd < 0)
+    {
+        perror("VFIO_GROUP_GET_DEVICE_FD ioctl failed");
+        goto fail;
+    }
+
+    memset(&device_info, 0, sizeof(device_info));
+    device_info.argsz = sizeof(device_info);
+
+    if (ioctl(dev->vfio_device_fd, VFIO_DEVICE_GET_INFO, &device_info) != 0)
+    {
+        perror("VFIO_DEVICE_GET_INFO ioctl failed");
+        goto fail;
+    }
+
+    if (!(device_info.flags & VFIO_DEVICE_FLAGS_PCI))
+    {
+        fprintf(stderr, "Error: not a PCI device\n");
+        goto fail;
+    }
+
+    // start from a clean state, a previous owner may have left queues enabled
+    if (device_info.flags & VFIO_DEVICE_FLAGS_RESET)
+        ioctl(dev->vfio_device_fd, VFIO_DEVICE_RESET);
+
+    // map registers
+    if (mqnic_vfio_map_region(dev, VFIO_PCI_BAR0_REGION_INDEX, &dev->regs, &dev->regs_size))
+        goto fail;
+
+    if (!dev->regs)
+    {
+        fprintf(stderr, "Error: BAR 0 not mappable\n");
+        goto fail;
+    }
+
+    // map application section registers
+    if (mqnic_vfio_map_region(dev, VFIO_PCI_BAR2_REGION_INDEX, &dev->app_regs, &dev->app_regs_size))
+        goto fail;
+
+    // map RAM
+    if (mqnic_vfio_map_region(dev, VFIO_PCI_BAR4_REGION_INDEX, &dev->ram, &dev->ram_size))
+        goto fail;
+
+    if (mqnic_vfio_enable_bus_master(dev))
+        goto fail;
+
+    if (mqnic_vfio_setup_irqs(dev))
+        goto fail;
+
+    return 0;
+
+fail:
+    if (dev->ram)
+        munmap((void *)dev->ram, dev->ram_size);
+    dev->ram = NULL;
+    if (dev->app_regs)
+        munmap((void *)dev->app_regs, dev->app_regs_size);
+    dev->app_regs = NULL;
+    if (dev->regs)
+        munmap((void *)dev->regs, dev->regs_size);
+    dev->regs = NULL;
+    mqnic_vfio_close(dev);
+fail_path:
+    dev->device_path[0] = 0;
+    dev->pci_device_path[0] = 0;
+    return -1;
+}
+
+void mqnic_vfio_close(struct mqnic *dev)
+{
+    if (dev->irq_fd && dev->vfio_device_fd >= 0)
+    {
+        struct vfio_irq_set irq_set;
+
+        memset(&irq_set, 0, sizeof(irq_set));
+        irq_set.argsz = sizeof(irq_set);
+        irq_set.flags = VFIO_IRQ_SET_DATA_NONE | VFIO_IRQ_SET_ACTION_TRIGGER;
+        irq_set.index = VFIO_PCI_MSIX_IRQ_INDEX;
+        irq_set.start = 0;
+        irq_set.count = 0;
+
+        ioctl(dev->vfio_device_fd, VFIO_DEVICE_SET_IRQS, &irq_set);
+
+        for (int k = 0; k < dev->irq_count; k++)
+        {
+            if (dev->irq_fd[k] >= 0)
+                close(dev->irq_fd[k]);
+        }
+
+        free(dev->irq_fd);
+        dev->irq_fd = NULL;
+    }
+
+    // closing the container drops all IOMMU mappings
+    while (dev->vfio_mappings)
+    {
+        struct mqnic_vfio_mapping *m = dev->vfio_mappings;
+
+        dev->vfio_mappings = m->next;
+        free(m);
+    }
+
+    free(dev->vfio_iova_ranges);
+    dev->vfio_iova_ranges = NULL;
+    dev->vfio_iova_range_count = 0;
+
+    if (dev->vfio_device_fd >= 0)
+        close(dev->vfio_device_fd);
+    dev->vfio_device_fd = -1;
+    if (dev->vfio_group_fd >= 0)
+        close(dev->vfio_group_fd);
+    dev->vfio_group_fd = -1;
+    if (dev->vfio_container_fd >= 0)
+        close(dev->vfio_container_fd);
+    dev->vfio_container_fd = -1;
+}
+
+int mqnic_vfio_dma_map(struct mqnic *dev, void *addr, size_t size, uint64_t *iova)
+{
+    struct vfio_iommu_type1_dma_map dma_map;
+    struct mqnic_vfio_mapping *m, **link;
+
+    if (!size)
+        return -1;
+
+    m = calloc(1, sizeof(*m));
+    if (!m)
+        return -1;
+
+    if (mqnic_vfio_alloc_iova(dev, size, &m->iova))
+    {
+        free(m);
+        return -1;
+    }
+
+    m->addr = addr;
+    m->size = size;
+
+    memset(&dma_map, 0, sizeof(dma_map));
+    dma_map.argsz = sizeof(dma_map);
+    dma_map.flags = VFIO_DMA_MAP_FLAG_READ | VFIO_DMA_MAP_FLAG_WRITE;
+    dma_map.vaddr = (uintptr_t)addr;
+    dma_map.iova = m->iova;
+    dma_map.size = size;
+
+    if (ioctl(dev->vfio_container_fd, VFIO_IOMMU_MAP_DMA, &dma_map) != 0)
+    {
+        perror("VFIO_IOMMU_MAP_DMA ioctl failed");
+        free(m);
+        return -1;
+    }
+
+    for (link = &dev->vfio_mappings; *link && (*link)->iova < m->iova; link = &(*link)->next);
+    m->next = *link;
+    *link = m;
+
+    *iova = m->iova;
+
+    return 0;
+}
+
+int mqnic_vfio_dma_unmap(struct mqnic *dev, void *addr, size_t size)
+{
+    struct vfio_iommu_type1_dma_unmap dma_unmap;
+    struct mqnic_vfio_mapping *m, **link;
+
+    for (link = &dev->vfio_mappings; *link; link = &(*link)->next)
+    {
+        if ((*link)->addr == addr && (*link)->size == size)
+            break;
+    }
+
+    m = *link;
+
+    if (!m)
+    {
+        fprintf(stderr, "Error: no DMA mapping for %p\n", addr);
+        return -1;
+    }
+
+    memset(&dma_unmap, 0, sizeof(dma_unmap));
+    dma_unmap.argsz = sizeof(dma_unmap);
+    dma_unmap.iova = m->iova;
+    dma_unmap.size = m->size;
+
+    if (ioctl(dev->vfio_container_fd, VFIO_IOMMU_UNMAP_DMA, &dma_unmap) != 0)
+    {
+        perror("VFIO_IOMMU_UNMAP_DMA ioctl failed");
+        return -1;
+    }
+
+    *link = m->next;
+    free(m);
+
+    return 0;
+}
+
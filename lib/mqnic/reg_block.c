@@ -45,9 +45,9 @@ struct mqnic_reg_block *mqnic_enumerate_reg_block_list(volatile uint8_t *base, s
             }
         }
 
-        rb_type = *((uint32_t *)(ptr + MQNIC_RB_REG_TYPE));
-        rb_version = *((uint32_t *)(ptr + MQNIC_RB_REG_VER));
-        offset = *((uint32_t *)(ptr + MQNIC_RB_REG_NEXT_PTR));
+        rb_type = mqnic_reg_read32(ptr, MQNIC_RB_REG_TYPE);
+        rb_version = mqnic_reg_read32(ptr, MQNIC_RB_REG_VER);
+        offset = mqnic_reg_read32(ptr, MQNIC_RB_REG_NEXT_PTR);
 
         reg_block_list[count].type = rb_type;
         reg_block_list[count].version = rb_version;
@@ -5,6 +5,9 @@
 
 #include "reg_if.h"
 
+#include <stdio.h>
+#include <sys/mman.h>
+
 int mqnic_reg_if_read8(const struct mqnic_reg_if *reg, ptrdiff_t offset, uint8_t *value)
 {
     if (!reg || !reg->ops || !reg->ops->read8)
@@ -133,3 +136,103 @@ void mqnic_reg_if_setup_raw(struct mqnic_reg_if *reg, void *regs)
     reg->priv = regs;
     reg->ops = &mqnic_reg_if_raw_ops;
 }
+
+// reserved on first registration and kept for the lifetime of the process
+volatile uint8_t *mqnic_reg_window_arena = NULL;
+struct mqnic_reg_window *mqnic_reg_window_slots[MQNIC_REG_WINDOW_SLOTS];
+static int mqnic_reg_window_lock;
+
+int mqnic_reg_window_register(struct mqnic_reg_window *window)
+{
+    size_t slot_size = (size_t)1 << MQNIC_REG_WINDOW_SHIFT;
+    volatile uint8_t *arena;
+    void *ptr;
+    int ret = -1;
+
+    if (!window->size || window->size > slot_size)
+        return -1;
+
+    while (__atomic_test_and_set(&mqnic_reg_window_lock, __ATOMIC_ACQUIRE))
+        ;
+
+    arena = mqnic_reg_window_arena;
+
+    if (!arena)
+    {
+        ptr = mmap(NULL, MQNIC_REG_WINDOW_SLOTS * slot_size, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (ptr == MAP_FAILED)
+        {
+            perror("mmap register window arena failed");
+            goto out;
+        }
+
+        arena = ptr;
+        __atomic_store_n(&mqnic_reg_window_arena, arena, __ATOMIC_RELEASE);
+    }
+
+    for (int k = 0; k < MQNIC_REG_WINDOW_SLOTS; k++)
+    {
+        if (mqnic_reg_window_slots[k])
+            continue;
+
+        ptr = mmap((void *)(arena + k * slot_size), window->size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+
+        if (ptr == MAP_FAILED)
+        {
+            perror("mmap register window failed");
+            goto out;
+        }
+
+        window->base = ptr;
+        __atomic_store_n(&mqnic_reg_window_slots[k], window, __ATOMIC_RELEASE);
+        ret = 0;
+        goto out;
+    }
+
+    fprintf(stderr, "Error: no free register window slot\n");
+
+out:
+    __atomic_clear(&mqnic_reg_window_lock, __ATOMIC_RELEASE);
+    return ret;
+}
+
+void mqnic_reg_window_unregister(struct mqnic_reg_window *window)
+{
+    size_t slot_size = (size_t)1 << MQNIC_REG_WINDOW_SHIFT;
+    uintptr_t k;
+
+    if (!window->base)
+        return;
+
+    while (__atomic_test_and_set(&mqnic_reg_window_lock, __ATOMIC_ACQUIRE))
+        ;
+
+    k = ((uintptr_t)window->base - (uintptr_t)mqnic_reg_window_arena) / slot_size;
+
+    __atomic_store_n(&mqnic_reg_window_slots[k], NULL, __ATOMIC_RELEASE);
+
+    // return the memory, keeping the slot reserved
+    mmap((void *)window->base, window->size, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+
+    window->base = NULL;
+
+    __atomic_clear(&mqnic_reg_window_lock, __ATOMIC_RELEASE);
+}
+
+uint32_t mqnic_reg_window_read32(struct mqnic_reg_window *window, volatile uint8_t *addr)
+{
+    uint32_t value = 0xffffffff;
+
+    mqnic_reg_if_read32(&window->reg, addr - window->base, &value);
+
+    return value;
+}
+
+void mqnic_reg_window_write32(struct mqnic_reg_window *window, volatile uint8_t *addr, uint32_t value)
+{
+    mqnic_reg_if_write32(&window->reg, addr - window->base, value);
+}
@@ -36,4 +36,42 @@ int mqnic_reg_if_write64(const struct mqnic_reg_if *reg, ptrdiff_t offset, uint6
 
 void mqnic_reg_if_setup_raw(struct mqnic_reg_if *reg, void *regs);
 
+// address range whose 32 bit accesses are redirected to a register
+// interface, used to back a mapped register space with a software model.
+// Registering a window allocates its memory in a slot of a reserved address
+// range, so an access finds the window of its own device from the address
+// alone, and accesses to other memory only check that the range is unused.
+#define MQNIC_REG_WINDOW_SHIFT 21
+#define MQNIC_REG_WINDOW_SLOTS 64
+
+struct mqnic_reg_window {
+    volatile uint8_t *base;
+    size_t size;
+    struct mqnic_reg_if reg;
+};
+
+extern volatile uint8_t *mqnic_reg_window_arena;
+extern struct mqnic_reg_window *mqnic_reg_window_slots[MQNIC_REG_WINDOW_SLOTS];
+
+int mqnic_reg_window_register(struct mqnic_reg_window *window);
+void mqnic_reg_window_unregister(struct mqnic_reg_window *window);
+uint32_t mqnic_reg_window_read32(struct mqnic_reg_window *window, volatile uint8_t *addr);
+void mqnic_reg_window_write32(struct mqnic_reg_window *window, volatile uint8_t *addr, uint32_t value);
+
+static inline struct mqnic_reg_window *mqnic_reg_window_lookup(volatile uint8_t *addr)
+{
+    volatile uint8_t *arena = __atomic_load_n(&mqnic_reg_window_arena, __ATOMIC_ACQUIRE);
+    uintptr_t offset;
+
+    if (__builtin_expect(arena == NULL, 1))
+        return NULL;
+
+    offset = (uintptr_t)addr - (uintptr_t)arena;
+
+    if (offset >= ((uintptr_t)MQNIC_REG_WINDOW_SLOTS << MQNIC_REG_WINDOW_SHIFT))
+        return NULL;
+
+    return __atomic_load_n(&mqnic_reg_window_slots[offset >> MQNIC_REG_WINDOW_SHIFT], __ATOMIC_ACQUIRE);
+}
+
 #endif /* REG_IF_H */
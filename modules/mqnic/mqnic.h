@@ -7,6 +7,7 @@
 #define MQNIC_H
 
 #include <linux/kernel.h>
+#include <linux/version.h>
 #ifdef CONFIG_PCI
 #include <linux/pci.h>
 #endif
@@ -15,11 +16,22 @@
 #endif
 #include <linux/platform_device.h>
 #include <linux/miscdevice.h>
+#include <linux/idr.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/net_tstamp.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/timer.h>
+#include <linux/dim.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/bpf.h>
+#include <net/xdp.h>
+#include <net/xdp_sock_drv.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 6, 0)
+#include <net/page_pool/helpers.h>
+#else
+#include <net/page_pool.h>
+#endif
 
 #include <linux/i2c.h>
 #include <linux/i2c-algo-bit.h>
@@ -40,12 +52,63 @@
 // default interval to poll port TX/RX status, in ms
 #define MQNIC_LINK_STATUS_POLL_MS 1000
 
+// default lifetime of the cached hardware statistics block, in ms
+#define MQNIC_STATS_REFRESH_MS 1000
+
+// XDP buffers are single pages with headroom and room for skb_shared_info
+#define MQNIC_XDP_TAILROOM SKB_DATA_ALIGN(sizeof(struct skb_shared_info))
+#define MQNIC_XDP_MAX_MTU (PAGE_SIZE - XDP_PACKET_HEADROOM - MQNIC_XDP_TAILROOM - ETH_HLEN)
+
+// default interrupt moderation settings
+#define MQNIC_DEFAULT_RX_COAL_USECS 8
+#define MQNIC_DEFAULT_TX_COAL_USECS 16
+#define MQNIC_MAX_COAL_FRAMES 0xffff
+
+// Toeplitz hash key size required for software flow hash
+#define MQNIC_FLOW_HASH_KEY_SIZE 40
+
+// RX header split: header buffer slab stride and default split length
+#define MQNIC_RX_HDR_STRIDE 256
+#define MQNIC_RX_HDR_DEFAULT_LEN 128
+
+// RX descriptor block size limit, bounds the RX buffers per slot
+#define MQNIC_MAX_RX_DESC_BLOCK_SIZE 4
+
+// TX copy-break: bounce buffer slab stride bounds the threshold
+#define MQNIC_TX_BOUNCE_STRIDE 256
+#define MQNIC_DEFAULT_TX_COPYBREAK 128
+
+// userspace queue rings are mapped through the misc device at
+// (region << 40) | (handle << shift), with the CQ flag for completion rings
+#define MQNIC_UQ_MMAP_REGION 3
+#define MQNIC_UQ_MMAP_HANDLE_SHIFT 29
+#define MQNIC_UQ_MMAP_CQ BIT_ULL(28)
+
+// TX completions gathered per batch in mqnic_process_tx_cq
+#define MQNIC_TX_CPL_BATCH 16
+
+// RX copy-break: small frames are copied out and the buffer is reposted
+#define MQNIC_DEFAULT_RX_COPYBREAK 256
+#define MQNIC_MAX_RX_COPYBREAK 1024
+
+// TX CQ consumer pointer doorbells are deferred by up to this many completions
+// while a poll leaves completions pending, capped at a quarter of the CQ
+#define MQNIC_CQ_CONS_BATCH 256
+
 extern unsigned int mqnic_num_eq_entries;
 extern unsigned int mqnic_num_txq_entries;
 extern unsigned int mqnic_num_rxq_entries;
 
 extern unsigned int mqnic_link_status_poll;
 
+extern unsigned int mqnic_threaded_napi;
+
+extern unsigned int mqnic_rx_hdr_len;
+
+extern unsigned int mqnic_stats_refresh_ms;
+
+extern unsigned int mqnic_cq_cons_batch;
+
 struct mqnic_dev;
 struct mqnic_if;
 
@@ -92,8 +155,10 @@ struct mqnic_i2c_bus {
 struct mqnic_irq {
 	int index;
 	int irqn;
+	int cpu;
 	char name[16 + 3];
 	struct atomic_notifier_head nh;
+	struct irq_affinity_notify affinity_notify;
 };
 
 #ifdef CONFIG_AUXILIARY_BUS
@@ -170,6 +235,12 @@ struct mqnic_dev {
 	u32 stats_stride;
 	u32 stats_flags;
 
+	// hardware statistics snapshot, refreshed at most every stats_refresh_ms
+	struct mutex stats_cache_lock;
+	u64 *stats_cache;
+	unsigned long stats_cache_jiffies;
+	bool stats_cache_valid;
+
 	u32 core_clk_nom_per_ns_num;
 	u32 core_clk_nom_per_ns_denom;
 	u32 core_clk_nom_freq_hz;
@@ -203,8 +274,20 @@ struct mqnic_frag {
 	u32 len;
 };
 
+enum mqnic_tx_type {
+	MQNIC_TX_TYPE_SKB,
+	MQNIC_TX_TYPE_XDP_TX,
+	MQNIC_TX_TYPE_XDP_NDO,
+	MQNIC_TX_TYPE_XSK,
+	MQNIC_TX_TYPE_BOUNCE,
+};
+
 struct mqnic_tx_info {
 	struct sk_buff *skb;
+	struct xdp_frame *xdpf;
+	enum mqnic_tx_type type;
+	u32 bytes;
+	u64 enqueue_ns;
 	DEFINE_DMA_UNMAP_ADDR(dma_addr);
 	DEFINE_DMA_UNMAP_LEN(len);
 	u32 frag_count;
@@ -212,27 +295,64 @@ struct mqnic_tx_info {
 	int ts_requested;
 };
 
+struct mqnic_ring_stats {
+	u64 packets;
+	u64 bytes;
+	u64 dropped;
+	u64 alloc_failed;
+	u64 linearized;
+	u64 csum_fallback;
+	u64 sojourn_ns;
+	u64 sojourn_packets;
+	u64 sojourn_max_ns;
+};
+
+struct mqnic_rx_frag {
+	struct page *page;
+	u32 page_offset;
+	dma_addr_t dma_addr;
+};
+
 struct mqnic_rx_info {
 	struct page *page;
+	struct xdp_buff *xdp;
 	u32 page_order;
 	u32 page_offset;
 	dma_addr_t dma_addr;
 	u32 len;
+
+	// multi-buffer payload buffers, kept across refills until used
+	struct mqnic_rx_frag frags[MQNIC_MAX_RX_DESC_BLOCK_SIZE];
 };
 
 struct mqnic_ring {
 	// written on enqueue (i.e. start_xmit)
 	u32 prod_ptr;
+	struct netdev_queue *tx_queue;
+
+	// counters, single writer (TX: queue lock, RX: NAPI)
+	struct u64_stats_sync syncp;
 	u64 bytes;
 	u64 packets;
 	u64 dropped_packets;
-	struct netdev_queue *tx_queue;
+	u64 alloc_failed;
+	u64 linearized;
+	u64 csum_fallback;
 
 	// written from completion
 	u32 cons_ptr ____cacheline_aligned_in_smp;
 	u64 ts_s;
 	u8 ts_valid;
 
+	// TX sojourn time, enqueue to departure; completion is a separate
+	// writer from start_xmit, so these have their own u64_stats_sync
+	struct u64_stats_sync cpl_syncp;
+	u64 sojourn_ns;
+	u64 sojourn_packets;
+	u64 sojourn_max_ns;
+	s64 phc_offset_ns;
+	u64 phc_offset_update_ns;
+
 	// mostly constant
 	u32 size;
 	u32 full_size;
@@ -243,6 +363,22 @@ struct mqnic_ring {
 
 	u32 mtu;
 	u32 page_order;
+	u32 rx_buf_size;
+	u32 rx_headroom;
+	u32 rx_tailroom;
+
+	// multi-buffer RX: optional per-slot header buffer, payload spread
+	// over rx_frag_count buffers in rx_info frags (0 for single buffer)
+	u32 rx_frag_count;
+	u32 rx_hdr_len;
+	size_t rx_hdr_buf_size;
+	u8 *rx_hdr_buf;
+	dma_addr_t rx_hdr_buf_dma_addr;
+
+	// TX copy-break: per-slot bounce buffers, mapped for the ring lifetime
+	size_t tx_bounce_buf_size;
+	u8 *tx_bounce_buf;
+	dma_addr_t tx_bounce_buf_dma_addr;
 
 	u32 desc_block_size;
 	u32 log_desc_block_size;
@@ -256,20 +392,38 @@ struct mqnic_ring {
 		struct mqnic_rx_info *rx_info;
 	};
 
+	struct page_pool *page_pool;
+	struct xdp_rxq_info xdp_rxq;
+	struct xsk_buff_pool *xsk_pool;
+
+	// serializes XDP TX rings shared between CPUs
+	spinlock_t xdp_tx_lock;
+
 	struct device *dev;
 	struct mqnic_if *interface;
 	struct mqnic_priv *priv;
 	int index;
+	// netdev queue number; the hardware index changes on every reopen
+	int queue_index;
+	int numa_node;
 	struct mqnic_cq *cq;
 	int enabled;
 
 	u8 __iomem *hw_addr;
 } ____cacheline_aligned_in_smp;
 
+// flat ring lookup table indexed by logical queue number, published as a
+// whole on port start and freed after an RCU grace period on port stop
+struct mqnic_ring_table {
+	u32 count;
+	struct mqnic_ring *ring[];
+};
+
 struct mqnic_cq {
 	u32 prod_ptr;
 
 	u32 cons_ptr;
+	u32 hw_cons_ptr;
 
 	u32 size;
 	u32 size_mask;
@@ -283,10 +437,19 @@ struct mqnic_cq {
 	struct mqnic_if *interface;
 	struct napi_struct napi;
 	int cqn;
+	int numa_node;
 	struct mqnic_eq *eq;
 	struct mqnic_ring *src_ring;
 	int enabled;
 
+	// interrupt holdoff
+	u32 holdoff_usecs;
+	u32 holdoff_frames;
+
+	// dynamic interrupt moderation
+	struct dim dim;
+	u16 dim_event_ctr;
+
 	void (*handler)(struct mqnic_cq *cq);
 
 	u8 __iomem *hw_addr;
@@ -316,7 +479,6 @@ struct mqnic_eq {
 	void (*handler)(struct mqnic_eq *eq);
 
 	spinlock_t table_lock;
-	struct radix_tree_root cq_table;
 
 	u8 __iomem *hw_addr;
 };
@@ -336,6 +498,29 @@ struct mqnic_sched {
 	u32 channel_stride;
 
 	u8 __iomem *hw_addr;
+
+	// optional rate limiting and weighting controller
+	struct mqnic_reg_block *shaper_rb;
+	u32 shaper_offset;
+	u32 shaper_channel_count;
+	u32 shaper_channel_stride;
+	u32 shaper_refill_period;
+
+	u8 __iomem *shaper_hw_addr;
+
+	unsigned long *shaped_channels;
+
+	// optional TDMA scheduler and timeslot controller
+	struct mqnic_reg_block *tdma_ctrl_rb;
+	struct mqnic_reg_block *tdma_rb;
+	u32 tdma_ctrl_offset;
+	u32 tdma_ctrl_channel_count;
+	u32 tdma_ctrl_channel_stride;
+	u32 tdma_timeslot_count;
+
+	u8 __iomem *tdma_ctrl_hw_addr;
+
+	unsigned long *gated_channels;
 };
 
 struct mqnic_port {
@@ -392,6 +577,9 @@ struct mqnic_if {
 	struct mqnic_res *txq_res;
 	struct mqnic_res *rxq_res;
 
+	// CQ lookup by CQN for event dispatch, entries updated under RCU
+	struct mqnic_cq __rcu **cq_table;
+
 	u32 eq_count;
 	struct mqnic_eq *eq[MQNIC_MAX_EQ];
 
@@ -406,6 +594,12 @@ struct mqnic_if {
 	u32 rx_queue_map_indir_table_size;
 	u8 __iomem *rx_queue_map_indir_table[MQNIC_MAX_PORTS];
 
+	u32 rx_hash_key_size;
+	u8 __iomem *rx_hash_key_regs;
+
+	u32 rx_flow_table_size;
+	u8 __iomem *rx_flow_table_regs;
+
 	resource_size_t hw_regs_size;
 	u8 __iomem *hw_addr;
 	u8 __iomem *csr_hw_addr;
@@ -416,14 +610,119 @@ struct mqnic_if {
 	struct i2c_client *mod_i2c_client;
 };
 
+enum mqnic_flow_type {
+	MQNIC_FLOW_FREE,
+	MQNIC_FLOW_NTUPLE,
+	MQNIC_FLOW_ARFS,
+	MQNIC_FLOW_USER
+};
+
+struct mqnic_flow_entry {
+	enum mqnic_flow_type type;
+	u32 hash;
+	u16 rxq;
+	u32 hw_index;
+	u32 flow_id;
+	u32 location;
+};
+
+// flow steered to a userspace RX queue, kept until the queue is freed
+struct mqnic_user_flow {
+	struct list_head list;
+	struct mqnic_uq *owner;
+	u32 hw_index;
+	__be32 saddr;
+	__be32 daddr;
+	__be16 sport;
+	__be16 dport;
+	int slot;
+};
+
+struct mqnic_ntuple_rule {
+	bool valid;
+	u32 slot;
+	struct ethtool_rx_flow_spec fs;
+};
+
+// TX or RX queue owned by a userspace process
+struct mqnic_uq {
+	struct list_head list;
+	struct mqnic_uq_ctx *ctx;
+	struct device *dev;
+	struct mqnic_if *interface;
+
+	u32 handle;
+	int type;
+	int index;
+
+	u32 size;
+	u32 stride;
+	u32 log_desc_block_size;
+
+	size_t buf_size;
+	u8 *buf;
+	dma_addr_t buf_dma_addr;
+
+	struct mqnic_cq *cq;
+
+	// ring and CQ mappings, the queue cannot be freed while mapped
+	atomic_t map_count;
+
+	u8 __iomem *hw_addr;
+};
+
+// pinned and DMA mapped userspace buffer region
+struct mqnic_uq_buf {
+	struct list_head list;
+
+	u32 handle;
+
+	unsigned long npages;
+	unsigned long pinned;
+	struct page **pages;
+	dma_addr_t *dma_addr;
+
+	// locked_vm accounting of the mapping process
+	struct mm_struct *mm;
+	unsigned long accounted;
+};
+
+// per open file of the misc device
+struct mqnic_uq_ctx {
+	struct mqnic_dev *mdev;
+
+	// protects the lists and the event queues
+	struct mutex lock;
+
+	struct list_head queues;
+	struct list_head bufs;
+	struct ida handle_ida;
+
+	struct mqnic_eq *eq[MQNIC_MAX_IF];
+};
+
+struct mqnic_tx_shaper {
+	u32 maxrate;
+	u64 tc_rate;
+	u32 quantum;
+};
+
+struct mqnic_tx_tdma {
+	bool enabled;
+	u64 base_time;
+	u64 cycle_time;
+	u64 timeslot_period;
+	u32 timeslot_count;
+	// open gates per timeslot, one bit per traffic class
+	u32 *gate_mask;
+};
+
 struct mqnic_priv {
 	struct device *dev;
 	struct net_device *ndev;
 	struct mqnic_dev *mdev;
 	struct mqnic_if *interface;
 
-	spinlock_t stats_lock;
-
 	int index;
 	bool registered;
 	bool port_up;
@@ -439,20 +738,62 @@ struct mqnic_priv {
 	u32 tx_ring_size;
 	u32 rx_ring_size;
 
+	// RX header split length, 0 when disabled
+	u32 rx_hdr_len;
+
+	// TX packets up to this length are copied to bounce buffers, 0 when disabled
+	u32 tx_copybreak;
+	// RX frames up to this length are copied out of the RX buffer, 0 when disabled
+	u32 rx_copybreak;
+
+	// interrupt moderation
+	u32 rx_coal_usecs;
+	u32 rx_coal_frames;
+	u32 tx_coal_usecs;
+	u32 tx_coal_frames;
+	bool rx_dim_enabled;
+
+	// ring tables are published under RCU for the datapath, the
+	// semaphores serialize control path access against port start/stop
 	struct rw_semaphore txq_table_sem;
-	struct radix_tree_root txq_table;
+	struct mqnic_ring_table __rcu *txq_table;
 
 	struct rw_semaphore rxq_table_sem;
-	struct radix_tree_root rxq_table;
+	struct mqnic_ring_table __rcu *rxq_table;
+
+	struct bpf_prog *xdp_prog;
+
+	// XDP TX rings, protected by txq_table_sem
+	u32 xdp_txq_count;
+	struct mqnic_ring_table __rcu *xdp_txq_table;
+
+	// queues with an AF_XDP zero-copy buffer pool attached
+	unsigned long *xsk_zc_qps;
 
 	u32 sched_block_count;
 	struct mqnic_sched_block *sched_block[MQNIC_MAX_PORTS];
 
+	// per TX queue shaping, protected by mdev->state_lock
+	struct mqnic_tx_shaper *tx_shaper;
+	bool ets_offloaded;
+
+	// TX gate schedule from taprio, protected by mdev->state_lock
+	struct mqnic_tx_tdma tx_tdma;
+
 	u32 max_desc_block_size;
 
 	u32 rx_queue_map_indir_table_size;
 	u32 *rx_queue_map_indir_table;
 
+	// flow steering, protected by flow_lock
+	spinlock_t flow_lock;
+	u32 flow_table_size;
+	struct mqnic_flow_entry *flow_table;
+	struct mqnic_ntuple_rule *ntuple_rules;
+	u32 ntuple_rule_count;
+	struct list_head user_flows;
+	u8 flow_hash_key[MQNIC_FLOW_HASH_KEY_SIZE];
+
 	struct hwtstamp_config hwts_config;
 
 	struct i2c_client *mod_i2c_client;
@@ -467,6 +808,7 @@ int mqnic_res_alloc(struct mqnic_res *res);
 void mqnic_res_free(struct mqnic_res *res, int index);
 unsigned int mqnic_res_get_count(struct mqnic_res *res);
 u8 __iomem *mqnic_res_get_addr(struct mqnic_res *res, int index);
+void *mqnic_dma_alloc_coherent_node(struct device *dev, size_t size, dma_addr_t *dma_handle, int node);
 
 // mqnic_reg_block.c
 struct mqnic_reg_block *mqnic_enumerate_reg_block_list(u8 __iomem *base, size_t offset, size_t size);
@@ -481,6 +823,12 @@ int mqnic_irq_init_platform(struct mqnic_dev *mdev);
 // mqnic_dev.c
 extern const struct file_operations mqnic_fops;
 
+// mqnic_uq.c
+struct mqnic_uq_ctx *mqnic_create_uq_ctx(struct mqnic_dev *mdev);
+void mqnic_destroy_uq_ctx(struct mqnic_uq_ctx *ctx);
+int mqnic_uq_mmap(struct mqnic_uq_ctx *ctx, struct vm_area_struct *vma, u64 offset);
+long mqnic_uq_ioctl(struct mqnic_uq_ctx *ctx, unsigned int cmd, unsigned long arg);
+
 // mqnic_if.c
 struct mqnic_if *mqnic_create_interface(struct mqnic_dev *mdev, int index, u8 __iomem *hw_addr);
 void mqnic_destroy_interface(struct mqnic_if *interface);
@@ -494,6 +842,9 @@ u32 mqnic_interface_get_rx_queue_map_app_mask(struct mqnic_if *interface, int po
 void mqnic_interface_set_rx_queue_map_app_mask(struct mqnic_if *interface, int port, u32 val);
 u32 mqnic_interface_get_rx_queue_map_indir_table(struct mqnic_if *interface, int port, int index);
 void mqnic_interface_set_rx_queue_map_indir_table(struct mqnic_if *interface, int port, int index, u32 val);
+void mqnic_interface_get_rx_hash_key(struct mqnic_if *interface, u8 *key);
+void mqnic_interface_set_rx_hash_key(struct mqnic_if *interface, const u8 *key);
+void mqnic_interface_set_rx_flow_table_entry(struct mqnic_if *interface, int index, u32 hash, u32 queue, bool valid);
 
 // mqnic_port.c
 struct mqnic_port *mqnic_create_port(struct mqnic_if *interface, int index,
@@ -506,6 +857,10 @@ u32 mqnic_port_get_rx_status(struct mqnic_port *port);
 int mqnic_start_port(struct net_device *ndev);
 void mqnic_stop_port(struct net_device *ndev);
 int mqnic_update_indir_table(struct net_device *ndev);
+int mqnic_update_ring_size(struct net_device *ndev, u32 tx_ring_size, u32 rx_ring_size);
+int mqnic_update_queue_count(struct net_device *ndev, u32 txq_count, u32 rxq_count);
+void mqnic_update_coalesce(struct net_device *ndev);
+void mqnic_get_ring_stats(const struct mqnic_ring *ring, struct mqnic_ring_stats *stats);
 void mqnic_update_stats(struct net_device *ndev);
 struct net_device *mqnic_create_netdev(struct mqnic_if *interface, int index, int dev_port);
 void mqnic_destroy_netdev(struct net_device *ndev);
@@ -523,12 +878,19 @@ struct mqnic_sched *mqnic_create_scheduler(struct mqnic_sched_block *block,
 void mqnic_destroy_scheduler(struct mqnic_sched *sched);
 int mqnic_scheduler_enable(struct mqnic_sched *sched);
 void mqnic_scheduler_disable(struct mqnic_sched *sched);
+int mqnic_scheduler_set_channel_shaper(struct mqnic_sched *sched, int ch, u64 rate, u32 quantum);
+int mqnic_scheduler_set_channel_timeslots(struct mqnic_sched *sched, int ch,
+		const unsigned long *timeslots);
+int mqnic_scheduler_tdma_enable(struct mqnic_sched *sched, u64 start_ns, u64 period_ns,
+		u64 timeslot_period_ns, u64 active_period_ns);
+void mqnic_scheduler_tdma_disable(struct mqnic_sched *sched);
 
 // mqnic_ptp.c
 void mqnic_register_phc(struct mqnic_dev *mdev);
 void mqnic_unregister_phc(struct mqnic_dev *mdev);
 ktime_t mqnic_read_cpl_ts(struct mqnic_dev *mdev, struct mqnic_ring *ring,
 		const struct mqnic_cpl *cpl);
+s64 mqnic_read_phc_offset(struct mqnic_dev *mdev);
 
 // mqnic_i2c.c
 struct mqnic_i2c_bus *mqnic_i2c_bus_create(struct mqnic_dev *mqnic, int index);
@@ -556,6 +918,9 @@ u64 mqnic_ref_clk_ns_to_cycles(struct mqnic_dev *mdev, u64 ns);
 // mqnic_stats.c
 void mqnic_stats_init(struct mqnic_dev *mdev);
 u64 mqnic_stats_read(struct mqnic_dev *mdev, int index);
+int mqnic_stats_get_named_count(struct mqnic_dev *mdev);
+void mqnic_stats_get_named_strings(struct mqnic_dev *mdev, u8 *data);
+void mqnic_stats_get_named(struct mqnic_dev *mdev, u64 *data);
 
 // mqnic_eq.c
 struct mqnic_eq *mqnic_create_eq(struct mqnic_if *interface);
@@ -570,16 +935,18 @@ void mqnic_arm_eq(struct mqnic_eq *eq);
 void mqnic_process_eq(struct mqnic_eq *eq);
 
 // mqnic_cq.c
-struct mqnic_cq *mqnic_create_cq(struct mqnic_if *interface);
+struct mqnic_cq *mqnic_create_cq(struct mqnic_if *interface, int numa_node);
 void mqnic_destroy_cq(struct mqnic_cq *cq);
 int mqnic_open_cq(struct mqnic_cq *cq, struct mqnic_eq *eq, int size);
 void mqnic_close_cq(struct mqnic_cq *cq);
 void mqnic_cq_read_prod_ptr(struct mqnic_cq *cq);
 void mqnic_cq_write_cons_ptr(struct mqnic_cq *cq);
+void mqnic_cq_defer_cons_ptr(struct mqnic_cq *cq);
 void mqnic_arm_cq(struct mqnic_cq *cq);
+void mqnic_cq_set_holdoff(struct mqnic_cq *cq, u32 usecs, u32 frames);
 
 // mqnic_tx.c
-struct mqnic_ring *mqnic_create_tx_ring(struct mqnic_if *interface);
+struct mqnic_ring *mqnic_create_tx_ring(struct mqnic_if *interface, int numa_node);
 void mqnic_destroy_tx_ring(struct mqnic_ring *ring);
 int mqnic_open_tx_ring(struct mqnic_ring *ring, struct mqnic_priv *priv,
 		struct mqnic_cq *cq, int size, int desc_block_size);
@@ -598,7 +965,7 @@ int mqnic_poll_tx_cq(struct napi_struct *napi, int budget);
 netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *dev);
 
 // mqnic_rx.c
-struct mqnic_ring *mqnic_create_rx_ring(struct mqnic_if *interface);
+struct mqnic_ring *mqnic_create_rx_ring(struct mqnic_if *interface, int numa_node);
 void mqnic_destroy_rx_ring(struct mqnic_ring *ring);
 int mqnic_open_rx_ring(struct mqnic_ring *ring, struct mqnic_priv *priv,
 		struct mqnic_cq *cq, int size, int desc_block_size);
@@ -616,6 +983,58 @@ int mqnic_refill_rx_buffers(struct mqnic_ring *ring);
 int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget);
 void mqnic_rx_irq(struct mqnic_cq *cq);
 int mqnic_poll_rx_cq(struct napi_struct *napi, int budget);
+void mqnic_rx_dim_work(struct work_struct *work);
+void mqnic_rx_set_hash(struct sk_buff *skb, struct mqnic_priv *priv, struct mqnic_cpl *cpl);
+
+// mqnic_xdp.c
+int mqnic_bpf(struct net_device *ndev, struct netdev_bpf *bpf);
+int mqnic_xdp_xmit(struct net_device *ndev, int n, struct xdp_frame **frames, u32 flags);
+int mqnic_xdp_tx_buff(struct mqnic_priv *priv, struct xdp_buff *xdp);
+void mqnic_xdp_flush_tx(struct mqnic_priv *priv);
+
+// mqnic_xsk.c
+struct xsk_buff_pool *mqnic_xsk_pool(struct mqnic_priv *priv, int qid);
+int mqnic_xsk_pool_setup(struct net_device *ndev, struct xsk_buff_pool *pool, u16 qid);
+int mqnic_xsk_wakeup(struct net_device *ndev, u32 qid, u32 flags);
+int mqnic_prepare_rx_desc_zc(struct mqnic_ring *ring, int index);
+int mqnic_process_rx_cq_zc(struct mqnic_cq *cq, int napi_budget);
+bool mqnic_xsk_xmit(struct mqnic_ring *ring, int budget);
+
+// mqnic_flow.c
+int mqnic_get_flow_rule_count(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc);
+int mqnic_get_flow_rule(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc);
+int mqnic_get_flow_rule_locs(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc, u32 *rule_locs);
+int mqnic_add_flow_rule(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc);
+int mqnic_del_flow_rule(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc);
+#ifdef CONFIG_RFS_ACCEL
+int mqnic_rx_flow_steer(struct net_device *ndev, const struct sk_buff *skb,
+		u16 rxq_index, u32 flow_id);
+#endif
+int mqnic_add_user_flow(struct net_device *ndev, struct mqnic_uq *owner, u32 hw_index,
+		__be32 saddr, __be32 daddr, __be16 sport, __be16 dport);
+int mqnic_del_user_flow(struct net_device *ndev, struct mqnic_uq *owner,
+		__be32 saddr, __be32 daddr, __be16 sport, __be16 dport);
+void mqnic_del_user_flows(struct net_device *ndev, struct mqnic_uq *owner);
+void mqnic_update_flow_table(struct net_device *ndev);
+void mqnic_flush_flow_table(struct net_device *ndev);
+void mqnic_refresh_flow_table(struct net_device *ndev);
+void mqnic_free_rx_cpu_rmap(struct net_device *ndev);
+
+// mqnic_tc.c
+bool mqnic_has_tx_shaper(struct mqnic_priv *priv);
+int mqnic_update_tx_shaper(struct net_device *ndev);
+void mqnic_clear_tx_shaper(struct net_device *ndev);
+int mqnic_update_tx_ring_shaper(struct net_device *ndev, struct mqnic_ring *ring, int k);
+void mqnic_clear_tx_ring_shaper(struct net_device *ndev, struct mqnic_ring *ring);
+bool mqnic_has_tx_tdma(struct mqnic_priv *priv);
+int mqnic_update_tx_tdma(struct net_device *ndev);
+void mqnic_clear_tx_tdma(struct net_device *ndev);
+int mqnic_update_tx_ring_tdma(struct net_device *ndev, struct mqnic_ring *ring, int k);
+void mqnic_clear_tx_ring_tdma(struct net_device *ndev, struct mqnic_ring *ring);
+int mqnic_set_tx_maxrate(struct net_device *ndev, int queue_index, u32 maxrate);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+int mqnic_setup_tc(struct net_device *ndev, enum tc_setup_type type, void *type_data);
+#endif
 
 // mqnic_ethtool.c
 extern const struct ethtool_ops mqnic_ethtool_ops;
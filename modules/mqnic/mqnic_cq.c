@@ -5,16 +5,17 @@
 
 #include "mqnic.h"
 
-struct mqnic_cq *mqnic_create_cq(struct mqnic_if *interface)
+struct mqnic_cq *mqnic_create_cq(struct mqnic_if *interface, int numa_node)
 {
 	struct mqnic_cq *cq;
 
-	cq = kzalloc(sizeof(*cq), GFP_KERNEL);
+	cq = kzalloc_node(sizeof(*cq), GFP_KERNEL, numa_node);
 	if (!cq)
 		return ERR_PTR(-ENOMEM);
 
 	cq->dev = interface->dev;
 	cq->interface = interface;
+	cq->numa_node = numa_node;
 
 	cq->cqn = -1;
 	cq->enabled = 0;
@@ -50,7 +51,7 @@ int mqnic_open_cq(struct mqnic_cq *cq, struct mqnic_eq *eq, int size)
 	cq->stride = roundup_pow_of_two(MQNIC_CPL_SIZE);
 
 	cq->buf_size = cq->size * cq->stride;
-	cq->buf = dma_alloc_coherent(cq->dev, cq->buf_size, &cq->buf_dma_addr, GFP_KERNEL);
+	cq->buf = mqnic_dma_alloc_coherent_node(cq->dev, cq->buf_size, &cq->buf_dma_addr, cq->numa_node);
 	if (!cq->buf) {
 		ret = -ENOMEM;
 		goto fail;
@@ -78,11 +79,14 @@ int mqnic_open_cq(struct mqnic_cq *cq, struct mqnic_eq *eq, int size)
 	// set EQN
 	iowrite32(MQNIC_CQ_CMD_SET_EQN | cq->eq->eqn,
 			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
+	// set interrupt holdoff
+	mqnic_cq_set_holdoff(cq, cq->holdoff_usecs, cq->holdoff_frames);
 	// set pointers
 	iowrite32(MQNIC_CQ_CMD_SET_PROD_PTR | (cq->prod_ptr & MQNIC_CQ_PTR_MASK),
 			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
 	iowrite32(MQNIC_CQ_CMD_SET_CONS_PTR | (cq->cons_ptr & MQNIC_CQ_PTR_MASK),
 			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
+	cq->hw_cons_ptr = cq->cons_ptr;
 	// activate queue
 	iowrite32(MQNIC_CQ_CMD_SET_ENABLE | 1, cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
 
@@ -91,7 +95,7 @@ int mqnic_open_cq(struct mqnic_cq *cq, struct mqnic_eq *eq, int size)
 	return 0;
 
 fail:
-	mqnic_close_eq(eq);
+	mqnic_close_cq(cq);
 	return ret;
 }
 
@@ -128,14 +132,61 @@ void mqnic_cq_read_prod_ptr(struct mqnic_cq *cq)
 
 void mqnic_cq_write_cons_ptr(struct mqnic_cq *cq)
 {
+	// skip the doorbell if the hardware is already up to date
+	if (cq->hw_cons_ptr == cq->cons_ptr)
+		return;
+
+	cq->hw_cons_ptr = cq->cons_ptr;
 	iowrite32(MQNIC_CQ_CMD_SET_CONS_PTR | (cq->cons_ptr & MQNIC_CQ_PTR_MASK),
 			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
 }
 
+// Write the consumer pointer only once enough completions have been consumed.
+// The hardware sees the CQ fuller than it is until then, so callers must
+// flush with mqnic_cq_write_cons_ptr() or mqnic_arm_cq() once the CQ drains.
+// Only for TX: a TX ring fills to half its size, leaving the CQ room for the
+// lag, whereas an RX ring is refilled to the full CQ size.
+void mqnic_cq_defer_cons_ptr(struct mqnic_cq *cq)
+{
+	u32 batch = min(READ_ONCE(mqnic_cq_cons_batch), cq->size / 4);
+
+	if (cq->cons_ptr - cq->hw_cons_ptr >= batch)
+		mqnic_cq_write_cons_ptr(cq);
+}
+
 void mqnic_arm_cq(struct mqnic_cq *cq)
 {
 	if (!cq->enabled)
 		return;
 
-	iowrite32(MQNIC_CQ_CMD_SET_ARM | 1, cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
+	// update the consumer pointer and arm in one doorbell
+	cq->hw_cons_ptr = cq->cons_ptr;
+	iowrite32(MQNIC_CQ_CMD_SET_CONS_PTR_ARM | (cq->cons_ptr & MQNIC_CQ_PTR_MASK),
+			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
+}
+
+void mqnic_cq_set_holdoff(struct mqnic_cq *cq, u32 usecs, u32 frames)
+{
+	u64 cycles;
+	u32 ticks;
+
+	cq->holdoff_usecs = usecs;
+	cq->holdoff_frames = frames;
+
+	if (!cq->hw_addr)
+		return;
+
+	// holdoff time is in units of MQNIC_HOLDOFF_TICK_CYCLES core clock cycles
+	cycles = mqnic_core_clk_ns_to_cycles(cq->interface->mdev, usecs * 1000ull);
+	// assume 250 MHz core clock if clock information is not available
+	if (!cycles)
+		cycles = usecs * 250ull;
+
+	ticks = min_t(u64, DIV_ROUND_UP_ULL(cycles, MQNIC_HOLDOFF_TICK_CYCLES), 0xffff);
+	frames = min_t(u32, frames, MQNIC_MAX_COAL_FRAMES);
+
+	iowrite32(MQNIC_CQ_CMD_SET_HOLDOFF_TIME | ticks,
+			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
+	iowrite32(MQNIC_CQ_CMD_SET_HOLDOFF_COUNT | frames,
+			cq->hw_addr + MQNIC_CQ_CTRL_STATUS_REG);
 }
@@ -10,24 +10,33 @@
 
 static int mqnic_open(struct inode *inode, struct file *file)
 {
-	// struct miscdevice *miscdev = file->private_data;
-	// struct mqnic_dev *mqnic = container_of(miscdev, struct mqnic_dev, misc_dev);
+	struct miscdevice *miscdev = file->private_data;
+	struct mqnic_dev *mqnic = container_of(miscdev, struct mqnic_dev, misc_dev);
+	struct mqnic_uq_ctx *ctx;
+
+	// per-file context, owns any userspace queues
+	ctx = mqnic_create_uq_ctx(mqnic);
+	if (IS_ERR(ctx))
+		return PTR_ERR(ctx);
+
+	file->private_data = ctx;
 
 	return 0;
 }
 
 static int mqnic_release(struct inode *inode, struct file *file)
 {
-	// struct miscdevice *miscdev = file->private_data;
-	// struct mqnic_dev *mqnic = container_of(miscdev, struct mqnic_dev, misc_dev);
+	struct mqnic_uq_ctx *ctx = file->private_data;
+
+	mqnic_destroy_uq_ctx(ctx);
 
 	return 0;
 }
 
 static int mqnic_mmap(struct file *file, struct vm_area_struct *vma)
 {
-	struct miscdevice *miscdev = file->private_data;
-	struct mqnic_dev *mqnic = container_of(miscdev, struct mqnic_dev, misc_dev);
+	struct mqnic_uq_ctx *ctx = file->private_data;
+	struct mqnic_dev *mqnic = ctx->mdev;
 	int index;
 	u64 pgoff, req_len, req_start;
 
@@ -64,6 +73,8 @@ static int mqnic_mmap(struct file *file, struct vm_area_struct *vma)
 		return io_remap_pfn_range(vma, vma->vm_start,
 				(mqnic->ram_hw_regs_phys >> PAGE_SHIFT) + pgoff,
 				req_len, pgprot_noncached(vma->vm_page_prot));
+	case MQNIC_UQ_MMAP_REGION:
+		return mqnic_uq_mmap(ctx, vma, req_start);
 	default:
 		dev_err(mqnic->dev, "%s: Tried to map an unknown region at page offset 0x%lx",
 				__func__, vma->vm_pgoff);
@@ -75,8 +86,8 @@ static int mqnic_mmap(struct file *file, struct vm_area_struct *vma)
 
 static long mqnic_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
-	struct miscdevice *miscdev = file->private_data;
-	struct mqnic_dev *mqnic = container_of(miscdev, struct mqnic_dev, misc_dev);
+	struct mqnic_uq_ctx *ctx = file->private_data;
+	struct mqnic_dev *mqnic = ctx->mdev;
 	size_t minsz;
 
 	if (cmd == MQNIC_IOCTL_GET_API_VERSION) {
@@ -103,7 +114,7 @@ static long mqnic_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		info.git_hash = mqnic->git_hash;
 		info.rel_info = mqnic->rel_info;
 		info.num_regions = 3;
-		info.num_irqs = 0;
+		info.num_irqs = mqnic->irq_count;
 
 		return copy_to_user((void __user *)arg, &info, minsz) ? -EFAULT : 0;
 
@@ -158,6 +169,33 @@ static long mqnic_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
 		return copy_to_user((void __user *)arg, &info, minsz) ? -EFAULT : 0;
 
+	} else if (cmd == MQNIC_IOCTL_GET_IRQ_INFO) {
+		// Get IRQ information
+		struct mqnic_ioctl_irq_info info;
+
+		minsz = offsetofend(struct mqnic_ioctl_irq_info, numa_node);
+
+		if (copy_from_user(&info, (void __user *)arg, minsz))
+			return -EFAULT;
+
+		if (info.argsz < minsz)
+			return -EINVAL;
+
+		if (info.index >= mqnic->irq_count || !mqnic->irq[info.index])
+			return -EINVAL;
+
+		info.flags = 0;
+		info.irqn = mqnic->irq[info.index]->irqn;
+		info.cpu = READ_ONCE(mqnic->irq[info.index]->cpu);
+		info.numa_node = cpu_to_node(info.cpu);
+
+		return copy_to_user((void __user *)arg, &info, minsz) ? -EFAULT : 0;
+
+	} else if (cmd == MQNIC_IOCTL_ALLOC_QUEUE || cmd == MQNIC_IOCTL_FREE_QUEUE ||
+			cmd == MQNIC_IOCTL_MAP_BUFFER || cmd == MQNIC_IOCTL_UNMAP_BUFFER ||
+			cmd == MQNIC_IOCTL_ADD_FLOW || cmd == MQNIC_IOCTL_DEL_FLOW) {
+		// Userspace queues, buffers, and flows
+		return mqnic_uq_ioctl(ctx, cmd, arg);
 	}
 
 	return -EINVAL;
@@ -38,8 +38,6 @@ struct mqnic_eq *mqnic_create_eq(struct mqnic_if *interface)
 
 	spin_lock_init(&eq->table_lock);
 
-	INIT_RADIX_TREE(&eq->cq_table, GFP_KERNEL);
-
 	return eq;
 }
 
@@ -147,31 +145,45 @@ void mqnic_close_eq(struct mqnic_eq *eq)
 
 int mqnic_eq_attach_cq(struct mqnic_eq *eq, struct mqnic_cq *cq)
 {
-	int ret;
+	struct mqnic_if *interface = eq->interface;
+	int ret = 0;
+
+	if (cq->cqn < 0 || cq->cqn >= mqnic_res_get_count(interface->cq_res))
+		return -EINVAL;
 
 	spin_lock_irq(&eq->table_lock);
-	ret = radix_tree_insert(&eq->cq_table, cq->cqn, cq);
+	if (rcu_access_pointer(interface->cq_table[cq->cqn]))
+		ret = -EEXIST;
+	else
+		rcu_assign_pointer(interface->cq_table[cq->cqn], cq);
 	spin_unlock_irq(&eq->table_lock);
 	return ret;
 }
 
 void mqnic_eq_detach_cq(struct mqnic_eq *eq, struct mqnic_cq *cq)
 {
-	struct mqnic_cq *item;
+	struct mqnic_if *interface = eq->interface;
+	struct mqnic_cq *item = NULL;
+
+	if (cq->cqn < 0 || cq->cqn >= mqnic_res_get_count(interface->cq_res)) {
+		dev_err(eq->dev, "%s on IF %d EQ %d: CQ %d out of range",
+				__func__, interface->index, eq->eqn, cq->cqn);
+		return;
+	}
 
 	spin_lock_irq(&eq->table_lock);
-	item = radix_tree_delete(&eq->cq_table, cq->cqn);
+	item = rcu_dereference_protected(interface->cq_table[cq->cqn],
+			lockdep_is_held(&eq->table_lock));
+	if (item == cq)
+		RCU_INIT_POINTER(interface->cq_table[cq->cqn], NULL);
 	spin_unlock_irq(&eq->table_lock);
 
-	if (IS_ERR(item)) {
-		dev_err(eq->dev, "%s on IF %d EQ %d: radix_tree_delete failed: %ld",
-				__func__, eq->interface->index, eq->eqn, PTR_ERR(item));
-	} else if (!item) {
+	if (!item) {
 		dev_err(eq->dev, "%s on IF %d EQ %d: CQ %d not in table",
-				__func__, eq->interface->index, eq->eqn, cq->cqn);
+				__func__, interface->index, eq->eqn, cq->cqn);
 	} else if (item != cq) {
 		dev_err(eq->dev, "%s on IF %d EQ %d: entry mismatch when removing CQ %d",
-				__func__, eq->interface->index, eq->eqn, cq->cqn);
+				__func__, interface->index, eq->eqn, cq->cqn);
 	}
 }
 
@@ -191,7 +203,9 @@ void mqnic_arm_eq(struct mqnic_eq *eq)
 	if (!eq->enabled)
 		return;
 
-	iowrite32(MQNIC_EQ_CMD_SET_ARM | 1, eq->hw_addr + MQNIC_EQ_CTRL_STATUS_REG);
+	// update the consumer pointer and arm in one doorbell
+	iowrite32(MQNIC_EQ_CMD_SET_CONS_PTR_ARM | (eq->cons_ptr & MQNIC_EQ_PTR_MASK),
+			eq->hw_addr + MQNIC_EQ_CTRL_STATUS_REG);
 }
 
 void mqnic_process_eq(struct mqnic_eq *eq)
@@ -199,6 +213,8 @@ void mqnic_process_eq(struct mqnic_eq *eq)
 	struct mqnic_if *interface = eq->interface;
 	struct mqnic_event *event;
 	struct mqnic_cq *cq;
+	u32 cq_count = mqnic_res_get_count(interface->cq_res);
+	u32 source;
 	u32 eq_index;
 	u32 eq_cons_ptr;
 	int done = 0;
@@ -216,11 +232,13 @@ void mqnic_process_eq(struct mqnic_eq *eq)
 
 		if (event->type == MQNIC_EVENT_TYPE_CPL) {
 			// completion event
+			source = le16_to_cpu(event->source);
+
 			rcu_read_lock();
-			cq = radix_tree_lookup(&eq->cq_table, le16_to_cpu(event->source));
+			cq = likely(source < cq_count) ? rcu_dereference(interface->cq_table[source]) : NULL;
 			rcu_read_unlock();
 
-			if (likely(cq)) {
+			if (likely(cq && cq->eq == eq)) {
 				if (likely(cq->handler))
 					cq->handler(cq);
 			} else {
@@ -244,7 +262,6 @@ void mqnic_process_eq(struct mqnic_eq *eq)
 		eq_index = eq_cons_ptr & eq->size_mask;
 	}
 
-	// update EQ consumer pointer
+	// the consumer pointer is written to the hardware by mqnic_arm_eq()
 	eq->cons_ptr = eq_cons_ptr;
-	mqnic_eq_write_cons_ptr(eq);
 }
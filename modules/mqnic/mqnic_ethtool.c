@@ -69,6 +69,10 @@ static void mqnic_get_ringparam(struct net_device *ndev,
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
 	kernel_param->cqe_size = MQNIC_CPL_SIZE;
 #endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	kernel_param->tcp_data_split = priv->rx_hdr_len ?
+		ETHTOOL_TCP_DATA_SPLIT_ENABLED : ETHTOOL_TCP_DATA_SPLIT_DISABLED;
+#endif
 }
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
@@ -83,12 +87,35 @@ static int mqnic_set_ringparam(struct net_device *ndev,
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
 	u32 tx_ring_size, rx_ring_size;
+	u32 old_tx_ring_size, old_rx_ring_size;
+	u32 rx_hdr_len = priv->rx_hdr_len;
+	u32 old_rx_hdr_len = priv->rx_hdr_len;
 	int port_up = priv->port_up;
 	int ret = 0;
+	int err;
 
 	if (param->rx_mini_pending || param->rx_jumbo_pending)
 		return -EINVAL;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	switch (kernel_param->tcp_data_split) {
+	case ETHTOOL_TCP_DATA_SPLIT_ENABLED:
+		if (priv->max_desc_block_size < 2) {
+			NL_SET_ERR_MSG_MOD(ext_ack, "Header split requires multi-descriptor RX blocks");
+			return -EOPNOTSUPP;
+		}
+		if (!rx_hdr_len)
+			rx_hdr_len = clamp_t(u32, mqnic_rx_hdr_len ?: MQNIC_RX_HDR_DEFAULT_LEN,
+					ETH_HLEN, MQNIC_RX_HDR_STRIDE);
+		break;
+	case ETHTOOL_TCP_DATA_SPLIT_DISABLED:
+		rx_hdr_len = 0;
+		break;
+	default:
+		break;
+	}
+#endif
+
 	if (param->rx_pending < MQNIC_MIN_RX_RING_SZ)
 		return -EINVAL;
 
@@ -104,6 +131,44 @@ static int mqnic_set_ringparam(struct net_device *ndev,
 	rx_ring_size = roundup_pow_of_two(param->rx_pending);
 	tx_ring_size = roundup_pow_of_two(param->tx_pending);
 
+	if (rx_hdr_len != priv->rx_hdr_len) {
+		// RX buffer layout changes, rebuild the port
+		netdev_info(ndev, "RX header split length: %d", rx_hdr_len);
+
+		mutex_lock(&priv->mdev->state_lock);
+
+		old_tx_ring_size = priv->tx_ring_size;
+		old_rx_ring_size = priv->rx_ring_size;
+
+		if (port_up)
+			mqnic_stop_port(ndev);
+
+		priv->tx_ring_size = tx_ring_size;
+		priv->rx_ring_size = rx_ring_size;
+		priv->rx_hdr_len = rx_hdr_len;
+
+		if (port_up) {
+			ret = mqnic_start_port(ndev);
+
+			if (ret) {
+				netdev_err(ndev, "%s: Failed to start port: %d", __func__, ret);
+
+				// bring the port back up with the previous layout
+				priv->tx_ring_size = old_tx_ring_size;
+				priv->rx_ring_size = old_rx_ring_size;
+				priv->rx_hdr_len = old_rx_hdr_len;
+
+				err = mqnic_start_port(ndev);
+				if (err)
+					netdev_err(ndev, "%s: Failed to restart port: %d", __func__, err);
+			}
+		}
+
+		mutex_unlock(&priv->mdev->state_lock);
+
+		return ret;
+	}
+
 	if (rx_ring_size == priv->rx_ring_size && tx_ring_size == priv->tx_ring_size)
 		return 0;
 
@@ -112,17 +177,41 @@ static int mqnic_set_ringparam(struct net_device *ndev,
 
 	mutex_lock(&priv->mdev->state_lock);
 
-	if (port_up)
+	old_tx_ring_size = priv->tx_ring_size;
+	old_rx_ring_size = priv->rx_ring_size;
+
+	ret = mqnic_update_ring_size(ndev, tx_ring_size, rx_ring_size);
+
+	if (ret == -EOPNOTSUPP && port_up) {
+		// rings cannot be resized in place, rebuild the port with the new sizes
+		netdev_info(ndev, "%s: restarting port", __func__);
+
 		mqnic_stop_port(ndev);
 
-	priv->tx_ring_size = tx_ring_size;
-	priv->rx_ring_size = rx_ring_size;
+		priv->tx_ring_size = tx_ring_size;
+		priv->rx_ring_size = rx_ring_size;
 
-	if (port_up) {
 		ret = mqnic_start_port(ndev);
 
 		if (ret)
 			netdev_err(ndev, "%s: Failed to start port: %d", __func__, ret);
+	} else if (ret && port_up) {
+		// resize failed part way through, rebuild the port with the old sizes
+		netdev_err(ndev, "%s: Failed to resize rings: %d", __func__, ret);
+
+		mqnic_stop_port(ndev);
+	}
+
+	if (ret && port_up) {
+		// restore the last known good sizes
+		priv->tx_ring_size = old_tx_ring_size;
+		priv->rx_ring_size = old_rx_ring_size;
+
+		netdev_info(ndev, "%s: restarting port with previous ring sizes", __func__);
+
+		err = mqnic_start_port(ndev);
+		if (err)
+			netdev_err(ndev, "%s: Failed to restart port: %d", __func__, err);
 	}
 
 	mutex_unlock(&priv->mdev->state_lock);
@@ -130,6 +219,61 @@ static int mqnic_set_ringparam(struct net_device *ndev,
 	return ret;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int mqnic_get_coalesce(struct net_device *ndev,
+		struct ethtool_coalesce *coal,
+		struct kernel_ethtool_coalesce *kernel_coal,
+		struct netlink_ext_ack *ext_ack)
+#else
+static int mqnic_get_coalesce(struct net_device *ndev,
+		struct ethtool_coalesce *coal)
+#endif
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	coal->rx_coalesce_usecs = priv->rx_coal_usecs;
+	coal->rx_max_coalesced_frames = priv->rx_coal_frames;
+	coal->tx_coalesce_usecs = priv->tx_coal_usecs;
+	coal->tx_max_coalesced_frames = priv->tx_coal_frames;
+	coal->use_adaptive_rx_coalesce = priv->rx_dim_enabled;
+
+	return 0;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+static int mqnic_set_coalesce(struct net_device *ndev,
+		struct ethtool_coalesce *coal,
+		struct kernel_ethtool_coalesce *kernel_coal,
+		struct netlink_ext_ack *ext_ack)
+#else
+static int mqnic_set_coalesce(struct net_device *ndev,
+		struct ethtool_coalesce *coal)
+#endif
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	if (coal->rx_max_coalesced_frames > MQNIC_MAX_COAL_FRAMES)
+		return -EINVAL;
+
+	if (coal->tx_max_coalesced_frames > MQNIC_MAX_COAL_FRAMES)
+		return -EINVAL;
+
+	mutex_lock(&priv->mdev->state_lock);
+
+	priv->rx_coal_usecs = coal->rx_coalesce_usecs;
+	priv->rx_coal_frames = coal->rx_max_coalesced_frames;
+	priv->tx_coal_usecs = coal->tx_coalesce_usecs;
+	priv->tx_coal_frames = coal->tx_max_coalesced_frames;
+	WRITE_ONCE(priv->rx_dim_enabled, !!coal->use_adaptive_rx_coalesce);
+
+	if (priv->port_up)
+		mqnic_update_coalesce(ndev);
+
+	mutex_unlock(&priv->mdev->state_lock);
+
+	return 0;
+}
+
 static int mqnic_get_rxnfc(struct net_device *ndev,
 		struct ethtool_rxnfc *rxnfc, u32 *rule_locs)
 {
@@ -139,6 +283,12 @@ static int mqnic_get_rxnfc(struct net_device *ndev,
 	case ETHTOOL_GRXRINGS:
 		rxnfc->data = priv->rxq_count;
 		break;
+	case ETHTOOL_GRXCLSRLCNT:
+		return mqnic_get_flow_rule_count(priv, rxnfc);
+	case ETHTOOL_GRXCLSRULE:
+		return mqnic_get_flow_rule(priv, rxnfc);
+	case ETHTOOL_GRXCLSRLALL:
+		return mqnic_get_flow_rule_locs(priv, rxnfc, rule_locs);
 	default:
 		return -EOPNOTSUPP;
 	}
@@ -146,6 +296,20 @@ static int mqnic_get_rxnfc(struct net_device *ndev,
 	return 0;
 }
 
+static int mqnic_set_rxnfc(struct net_device *ndev, struct ethtool_rxnfc *rxnfc)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	switch (rxnfc->cmd) {
+	case ETHTOOL_SRXCLSRLINS:
+		return mqnic_add_flow_rule(priv, rxnfc);
+	case ETHTOOL_SRXCLSRLDEL:
+		return mqnic_del_flow_rule(priv, rxnfc);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 static u32 mqnic_get_rxfh_indir_size(struct net_device *ndev)
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
@@ -153,31 +317,76 @@ static u32 mqnic_get_rxfh_indir_size(struct net_device *ndev)
 	return priv->rx_queue_map_indir_table_size;
 }
 
+static u32 mqnic_get_rxfh_key_size(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	return priv->interface->rx_hash_key_size;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+static int mqnic_get_rxfh(struct net_device *ndev,
+		struct ethtool_rxfh_param *rxfh)
+#else
 static int mqnic_get_rxfh(struct net_device *ndev, u32 *indir, u8 *key,
 		u8 *hfunc)
+#endif
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
 	int k;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	u32 *indir = rxfh->indir;
+	u8 *key = rxfh->key;
+
+	rxfh->hfunc = ETH_RSS_HASH_TOP;
+#else
 	if (hfunc)
 		*hfunc = ETH_RSS_HASH_TOP;
+#endif
 
 	if (indir)
 		for (k = 0; k < priv->rx_queue_map_indir_table_size; k++)
 			indir[k] = priv->rx_queue_map_indir_table[k];
 
+	if (key)
+		mqnic_interface_get_rx_hash_key(priv->interface, key);
+
 	return 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+static int mqnic_set_rxfh(struct net_device *ndev,
+		struct ethtool_rxfh_param *rxfh,
+		struct netlink_ext_ack *extack)
+#else
 static int mqnic_set_rxfh(struct net_device *ndev, const u32 *indir,
 		const u8 *key, const u8 hfunc)
+#endif
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
 	int k;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	const u32 *indir = rxfh->indir;
+	const u8 *key = rxfh->key;
+	const u8 hfunc = rxfh->hfunc;
+#endif
+
 	if (hfunc != ETH_RSS_HASH_NO_CHANGE && hfunc != ETH_RSS_HASH_TOP)
 		return -EOPNOTSUPP;
 
+	if (key) {
+		if (!priv->interface->rx_hash_key_size)
+			return -EOPNOTSUPP;
+
+		mqnic_interface_set_rx_hash_key(priv->interface, key);
+
+		// flow table entries are keyed on the flow hash
+		if (priv->port_up)
+			mqnic_update_flow_table(ndev);
+	}
+
 	if (!indir)
 		return 0;
 
@@ -239,13 +448,17 @@ static int mqnic_set_channels(struct net_device *ndev,
 
 	mutex_lock(&priv->mdev->state_lock);
 
-	if (port_up)
+	ret = mqnic_update_queue_count(ndev, txq_count, rxq_count);
+
+	if (ret && port_up) {
+		// fall back to rebuilding the port
+		netdev_info(ndev, "%s: restarting port (%d)", __func__, ret);
+
 		mqnic_stop_port(ndev);
 
-	priv->txq_count = txq_count;
-	priv->rxq_count = rxq_count;
+		priv->txq_count = txq_count;
+		priv->rxq_count = rxq_count;
 
-	if (port_up) {
 		ret = mqnic_start_port(ndev);
 
 		if (ret)
@@ -257,6 +470,75 @@ static int mqnic_set_channels(struct net_device *ndev,
 	return ret;
 }
 
+static int mqnic_get_tunable(struct net_device *ndev,
+		const struct ethtool_tunable *tuna, void *data)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	switch (tuna->id) {
+	case ETHTOOL_TX_COPYBREAK:
+		*(u32 *)data = priv->tx_copybreak;
+		return 0;
+	case ETHTOOL_RX_COPYBREAK:
+		*(u32 *)data = priv->rx_copybreak;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int mqnic_set_tunable(struct net_device *ndev,
+		const struct ethtool_tunable *tuna, const void *data)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	int port_up = priv->port_up;
+	u32 tx_copybreak;
+	int ret = 0;
+
+	switch (tuna->id) {
+	case ETHTOOL_TX_COPYBREAK:
+		tx_copybreak = *(u32 *)data;
+
+		if (tx_copybreak > MQNIC_TX_BOUNCE_STRIDE)
+			return -EINVAL;
+
+		if (!tx_copybreak == !priv->tx_copybreak) {
+			// bounce buffers already in place (or not needed)
+			WRITE_ONCE(priv->tx_copybreak, tx_copybreak);
+			return 0;
+		}
+
+		// bounce buffers are allocated with the TX rings, rebuild the port
+		netdev_info(ndev, "TX copy-break: %d", tx_copybreak);
+
+		mutex_lock(&priv->mdev->state_lock);
+
+		if (port_up)
+			mqnic_stop_port(ndev);
+
+		priv->tx_copybreak = tx_copybreak;
+
+		if (port_up) {
+			ret = mqnic_start_port(ndev);
+
+			if (ret)
+				netdev_err(ndev, "%s: Failed to start port: %d", __func__, ret);
+		}
+
+		mutex_unlock(&priv->mdev->state_lock);
+
+		return ret;
+	case ETHTOOL_RX_COPYBREAK:
+		if (*(u32 *)data > MQNIC_MAX_RX_COPYBREAK)
+			return -EINVAL;
+
+		WRITE_ONCE(priv->rx_copybreak, *(u32 *)data);
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 static int mqnic_get_ts_info(struct net_device *ndev,
 		struct ethtool_ts_info *info)
 {
@@ -281,6 +563,149 @@ static int mqnic_get_ts_info(struct net_device *ndev,
 	return 0;
 }
 
+static const char mqnic_txq_stats_strings[][ETH_GSTRING_LEN] = {
+	"packets",
+	"bytes",
+	"dropped",
+	"linearized",
+	"csum_fallback",
+	"sojourn_ns",
+	"sojourn_packets",
+	"sojourn_max_ns",
+};
+
+#define MQNIC_TXQ_STATS_LEN ARRAY_SIZE(mqnic_txq_stats_strings)
+
+static const char mqnic_rxq_stats_strings[][ETH_GSTRING_LEN] = {
+	"packets",
+	"bytes",
+	"dropped",
+	"alloc_failed",
+};
+
+#define MQNIC_RXQ_STATS_LEN ARRAY_SIZE(mqnic_rxq_stats_strings)
+
+static int mqnic_get_sset_count(struct net_device *ndev, int sset)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	int count;
+
+	switch (sset) {
+	case ETH_SS_STATS:
+		count = priv->txq_count * MQNIC_TXQ_STATS_LEN;
+		count += priv->rxq_count * MQNIC_RXQ_STATS_LEN;
+		count += mqnic_stats_get_named_count(priv->mdev);
+#if defined(CONFIG_PAGE_POOL_STATS) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+		count += page_pool_ethtool_stats_get_count();
+#endif
+		return count;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void mqnic_get_strings(struct net_device *ndev, u32 sset, u8 *data)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	int k, i;
+
+	switch (sset) {
+	case ETH_SS_STATS:
+		for (k = 0; k < priv->txq_count; k++) {
+			for (i = 0; i < MQNIC_TXQ_STATS_LEN; i++) {
+				snprintf(data, ETH_GSTRING_LEN, "tx_queue_%d_%s",
+						k, mqnic_txq_stats_strings[i]);
+				data += ETH_GSTRING_LEN;
+			}
+		}
+		for (k = 0; k < priv->rxq_count; k++) {
+			for (i = 0; i < MQNIC_RXQ_STATS_LEN; i++) {
+				snprintf(data, ETH_GSTRING_LEN, "rx_queue_%d_%s",
+						k, mqnic_rxq_stats_strings[i]);
+				data += ETH_GSTRING_LEN;
+			}
+		}
+		mqnic_stats_get_named_strings(priv->mdev, data);
+		data += mqnic_stats_get_named_count(priv->mdev) * ETH_GSTRING_LEN;
+#if defined(CONFIG_PAGE_POOL_STATS) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+		page_pool_ethtool_stats_get_strings(data);
+#endif
+		break;
+	}
+}
+
+static void mqnic_get_ethtool_stats(struct net_device *ndev,
+		struct ethtool_stats *stats, u64 *data)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+#if defined(CONFIG_PAGE_POOL_STATS) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	struct page_pool_stats pp_stats = {};
+#endif
+	struct mqnic_ring_stats ring_stats;
+	struct mqnic_ring_table *table;
+	struct mqnic_ring *q;
+	int k;
+
+	rcu_read_lock();
+
+	// per TX queue counters and sojourn time, from enqueue to departure
+	// from the NIC
+	table = rcu_dereference(priv->txq_table);
+	for (k = 0; k < priv->txq_count; k++) {
+		q = table && k < table->count ? table->ring[k] : NULL;
+
+		if (q) {
+			mqnic_get_ring_stats(q, &ring_stats);
+
+			*data++ = ring_stats.packets;
+			*data++ = ring_stats.bytes;
+			*data++ = ring_stats.dropped;
+			*data++ = ring_stats.linearized;
+			*data++ = ring_stats.csum_fallback;
+			*data++ = ring_stats.sojourn_ns;
+			*data++ = ring_stats.sojourn_packets;
+			*data++ = ring_stats.sojourn_max_ns;
+		} else {
+			memset(data, 0, MQNIC_TXQ_STATS_LEN * sizeof(*data));
+			data += MQNIC_TXQ_STATS_LEN;
+		}
+	}
+
+	// per RX queue counters; page pool allocation and recycling counters
+	// are summed over all RX queues
+	table = rcu_dereference(priv->rxq_table);
+	for (k = 0; k < priv->rxq_count; k++) {
+		q = table && k < table->count ? table->ring[k] : NULL;
+
+		if (q) {
+			mqnic_get_ring_stats(q, &ring_stats);
+
+			*data++ = ring_stats.packets;
+			*data++ = ring_stats.bytes;
+			*data++ = ring_stats.dropped;
+			*data++ = ring_stats.alloc_failed;
+
+#if defined(CONFIG_PAGE_POOL_STATS) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+			if (q->page_pool)
+				page_pool_get_stats(q->page_pool, &pp_stats);
+#endif
+		} else {
+			memset(data, 0, MQNIC_RXQ_STATS_LEN * sizeof(*data));
+			data += MQNIC_RXQ_STATS_LEN;
+		}
+	}
+
+	rcu_read_unlock();
+
+	// device statistics block, cached in the device
+	mqnic_stats_get_named(priv->mdev, data);
+	data += mqnic_stats_get_named_count(priv->mdev);
+
+#if defined(CONFIG_PAGE_POOL_STATS) && LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+	page_pool_ethtool_stats_get(data, &pp_stats);
+#endif
+}
+
 static int mqnic_read_module_eeprom(struct net_device *ndev,
 		u16 offset, u16 len, u8 *data)
 {
@@ -554,19 +979,36 @@ static int mqnic_get_module_eeprom_by_page(struct net_device *ndev,
 #endif
 
 const struct ethtool_ops mqnic_ethtool_ops = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+	.supported_coalesce_params = ETHTOOL_COALESCE_USECS |
+		ETHTOOL_COALESCE_MAX_FRAMES |
+		ETHTOOL_COALESCE_USE_ADAPTIVE_RX,
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	.supported_ring_params = ETHTOOL_RING_USE_TCP_DATA_SPLIT,
+#endif
 	.get_drvinfo = mqnic_get_drvinfo,
 	.get_regs_len = mqnic_get_regs_len,
 	.get_regs = mqnic_get_regs,
 	.get_link = ethtool_op_get_link,
 	.get_ringparam = mqnic_get_ringparam,
 	.set_ringparam = mqnic_set_ringparam,
+	.get_coalesce = mqnic_get_coalesce,
+	.set_coalesce = mqnic_set_coalesce,
 	.get_rxnfc = mqnic_get_rxnfc,
+	.set_rxnfc = mqnic_set_rxnfc,
 	.get_rxfh_indir_size = mqnic_get_rxfh_indir_size,
+	.get_rxfh_key_size = mqnic_get_rxfh_key_size,
 	.get_rxfh = mqnic_get_rxfh,
 	.set_rxfh = mqnic_set_rxfh,
 	.get_channels = mqnic_get_channels,
 	.set_channels = mqnic_set_channels,
+	.get_tunable = mqnic_get_tunable,
+	.set_tunable = mqnic_set_tunable,
 	.get_ts_info = mqnic_get_ts_info,
+	.get_sset_count = mqnic_get_sset_count,
+	.get_strings = mqnic_get_strings,
+	.get_ethtool_stats = mqnic_get_ethtool_stats,
 	.get_module_info = mqnic_get_module_info,
 	.get_module_eeprom = mqnic_get_module_eeprom,
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 13, 0)
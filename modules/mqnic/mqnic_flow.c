@@ -0,0 +1,593 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <linux/cpu_rmap.h>
+#include <linux/irq.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 9, 0)
+#include <net/rps.h>
+#endif
+
+// Flow table entries are matched on the 32-bit Toeplitz flow hash computed
+// by the NIC, and are direct-mapped into the table by the low hash bits.
+// Rules are restricted to IPv4 TCP and UDP, which hash over the 4-tuple.
+
+static u32 mqnic_flow_hash(struct mqnic_priv *priv, __be32 saddr, __be32 daddr,
+		__be16 sport, __be16 dport)
+{
+	const u8 *key = priv->flow_hash_key;
+	u8 data[12];
+	u32 hash = 0;
+	u32 v;
+	int i, j;
+
+	memcpy(data + 0, &saddr, 4);
+	memcpy(data + 4, &daddr, 4);
+	memcpy(data + 8, &sport, 2);
+	memcpy(data + 10, &dport, 2);
+
+	v = ((u32)key[0] << 24) | (key[1] << 16) | (key[2] << 8) | key[3];
+
+	for (i = 0; i < sizeof(data); i++) {
+		for (j = 0; j < 8; j++) {
+			if (data[i] & (0x80 >> j))
+				hash ^= v;
+			v = (v << 1) | ((key[i + 4] >> (7 - j)) & 1);
+		}
+	}
+
+	return hash;
+}
+
+static void mqnic_flow_write_slot(struct mqnic_priv *priv, int slot)
+{
+	struct mqnic_flow_entry *entry = &priv->flow_table[slot];
+	struct mqnic_ring_table *rxq_table;
+	struct mqnic_ring *q = NULL;
+
+	// user queues are not in the ring table and do not follow the port state
+	if (entry->type == MQNIC_FLOW_USER) {
+		mqnic_interface_set_rx_flow_table_entry(priv->interface, slot, entry->hash,
+				entry->hw_index, true);
+		return;
+	}
+
+	rcu_read_lock();
+	rxq_table = rcu_dereference(priv->rxq_table);
+	if (entry->type != MQNIC_FLOW_FREE && priv->port_up &&
+			rxq_table && entry->rxq < rxq_table->count)
+		q = rxq_table->ring[entry->rxq];
+
+	// program hardware queue index
+	if (q)
+		mqnic_interface_set_rx_flow_table_entry(priv->interface, slot, entry->hash, q->index, true);
+	else
+		mqnic_interface_set_rx_flow_table_entry(priv->interface, slot, 0, 0, false);
+	rcu_read_unlock();
+}
+
+static int mqnic_flow_parse_spec(struct mqnic_priv *priv, struct ethtool_rx_flow_spec *fs, u32 *hash)
+{
+	struct ethtool_tcpip4_spec *spec = &fs->h_u.tcp_ip4_spec;
+	struct ethtool_tcpip4_spec *mask = &fs->m_u.tcp_ip4_spec;
+
+	if (fs->flow_type != TCP_V4_FLOW && fs->flow_type != UDP_V4_FLOW)
+		return -EOPNOTSUPP;
+
+	// hardware matches on the full flow hash only
+	if (mask->ip4src != htonl(0xffffffff) || mask->ip4dst != htonl(0xffffffff) ||
+			mask->psrc != htons(0xffff) || mask->pdst != htons(0xffff) || mask->tos)
+		return -EOPNOTSUPP;
+
+	if (fs->ring_cookie == RX_CLS_FLOW_DISC || ethtool_get_flow_spec_ring_vf(fs->ring_cookie))
+		return -EOPNOTSUPP;
+
+	if (ethtool_get_flow_spec_ring(fs->ring_cookie) >= priv->rxq_count)
+		return -EINVAL;
+
+	*hash = mqnic_flow_hash(priv, spec->ip4src, spec->ip4dst, spec->psrc, spec->pdst);
+
+	return 0;
+}
+
+int mqnic_get_flow_rule_count(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc)
+{
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	rxnfc->rule_cnt = priv->ntuple_rule_count;
+	rxnfc->data = priv->flow_table_size;
+
+	return 0;
+}
+
+int mqnic_get_flow_rule(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc)
+{
+	struct mqnic_ntuple_rule *rule;
+
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	if (rxnfc->fs.location >= priv->flow_table_size)
+		return -EINVAL;
+
+	rule = &priv->ntuple_rules[rxnfc->fs.location];
+
+	if (!rule->valid)
+		return -ENOENT;
+
+	rxnfc->fs = rule->fs;
+
+	return 0;
+}
+
+int mqnic_get_flow_rule_locs(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc, u32 *rule_locs)
+{
+	int cnt = 0;
+	int k;
+
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	rxnfc->data = priv->flow_table_size;
+
+	for (k = 0; k < priv->flow_table_size; k++) {
+		if (!priv->ntuple_rules[k].valid)
+			continue;
+
+		if (cnt >= rxnfc->rule_cnt)
+			return -EMSGSIZE;
+
+		rule_locs[cnt++] = k;
+	}
+
+	rxnfc->rule_cnt = cnt;
+
+	return 0;
+}
+
+int mqnic_add_flow_rule(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc)
+{
+	struct ethtool_rx_flow_spec *fs = &rxnfc->fs;
+	struct mqnic_ntuple_rule *rule;
+	struct mqnic_flow_entry *entry;
+	u32 hash;
+	int slot;
+	int ret;
+
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	if (fs->location >= priv->flow_table_size)
+		return -EINVAL;
+
+	ret = mqnic_flow_parse_spec(priv, fs, &hash);
+	if (ret)
+		return ret;
+
+	rule = &priv->ntuple_rules[fs->location];
+	slot = hash & (priv->flow_table_size - 1);
+
+	spin_lock_bh(&priv->flow_lock);
+
+	// drop existing rule at this location
+	if (rule->valid) {
+		priv->flow_table[rule->slot].type = MQNIC_FLOW_FREE;
+		mqnic_flow_write_slot(priv, rule->slot);
+		rule->valid = false;
+		priv->ntuple_rule_count--;
+	}
+
+	entry = &priv->flow_table[slot];
+
+	if (entry->type == MQNIC_FLOW_NTUPLE) {
+		spin_unlock_bh(&priv->flow_lock);
+		netdev_err(priv->ndev, "%s: flow table slot %d in use by rule %d",
+				__func__, slot, entry->location);
+		return -EBUSY;
+	}
+
+	if (entry->type == MQNIC_FLOW_USER) {
+		spin_unlock_bh(&priv->flow_lock);
+		netdev_err(priv->ndev, "%s: flow table slot %d in use by a user queue",
+				__func__, slot);
+		return -EBUSY;
+	}
+
+	// ntuple rules take priority over aRFS entries
+	entry->type = MQNIC_FLOW_NTUPLE;
+	entry->hash = hash;
+	entry->rxq = ethtool_get_flow_spec_ring(fs->ring_cookie);
+	entry->location = fs->location;
+	mqnic_flow_write_slot(priv, slot);
+
+	rule->fs = *fs;
+	rule->slot = slot;
+	rule->valid = true;
+	priv->ntuple_rule_count++;
+
+	spin_unlock_bh(&priv->flow_lock);
+
+	return 0;
+}
+
+int mqnic_del_flow_rule(struct mqnic_priv *priv, struct ethtool_rxnfc *rxnfc)
+{
+	struct mqnic_ntuple_rule *rule;
+
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	if (rxnfc->fs.location >= priv->flow_table_size)
+		return -EINVAL;
+
+	rule = &priv->ntuple_rules[rxnfc->fs.location];
+
+	spin_lock_bh(&priv->flow_lock);
+
+	if (!rule->valid) {
+		spin_unlock_bh(&priv->flow_lock);
+		return -ENOENT;
+	}
+
+	priv->flow_table[rule->slot].type = MQNIC_FLOW_FREE;
+	mqnic_flow_write_slot(priv, rule->slot);
+	rule->valid = false;
+	priv->ntuple_rule_count--;
+
+	spin_unlock_bh(&priv->flow_lock);
+
+	return 0;
+}
+
+static bool mqnic_user_flow_match(struct mqnic_user_flow *uf, __be32 saddr, __be32 daddr,
+		__be16 sport, __be16 dport)
+{
+	return uf->saddr == saddr && uf->daddr == daddr && uf->sport == sport && uf->dport == dport;
+}
+
+static void mqnic_user_flow_remove(struct mqnic_priv *priv, struct mqnic_user_flow *uf)
+{
+	// the slot may have been taken over while the flow was inactive
+	if (uf->slot >= 0 && priv->flow_table[uf->slot].type == MQNIC_FLOW_USER) {
+		priv->flow_table[uf->slot].type = MQNIC_FLOW_FREE;
+		mqnic_flow_write_slot(priv, uf->slot);
+	}
+
+	list_del(&uf->list);
+	kfree(uf);
+}
+
+// steer an IPv4 TCP or UDP flow to a userspace RX queue, returns the slot
+int mqnic_add_user_flow(struct net_device *ndev, struct mqnic_uq *owner, u32 hw_index,
+		__be32 saddr, __be32 daddr, __be16 sport, __be16 dport)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_flow_entry *entry;
+	struct mqnic_user_flow *uf, *it;
+	u32 hash;
+	int slot;
+
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	uf = kzalloc(sizeof(*uf), GFP_KERNEL);
+	if (!uf)
+		return -ENOMEM;
+
+	uf->owner = owner;
+	uf->hw_index = hw_index;
+	uf->saddr = saddr;
+	uf->daddr = daddr;
+	uf->sport = sport;
+	uf->dport = dport;
+
+	spin_lock_bh(&priv->flow_lock);
+
+	list_for_each_entry(it, &priv->user_flows, list) {
+		if (mqnic_user_flow_match(it, saddr, daddr, sport, dport)) {
+			spin_unlock_bh(&priv->flow_lock);
+			kfree(uf);
+			return -EEXIST;
+		}
+	}
+
+	hash = mqnic_flow_hash(priv, saddr, daddr, sport, dport);
+	slot = hash & (priv->flow_table_size - 1);
+	entry = &priv->flow_table[slot];
+
+	// ntuple rules and other user flows take priority, aRFS entries are evicted
+	if (entry->type == MQNIC_FLOW_NTUPLE || entry->type == MQNIC_FLOW_USER) {
+		spin_unlock_bh(&priv->flow_lock);
+		kfree(uf);
+		netdev_err(ndev, "%s: flow table slot %d in use", __func__, slot);
+		return -EBUSY;
+	}
+
+	entry->type = MQNIC_FLOW_USER;
+	entry->hash = hash;
+	entry->hw_index = hw_index;
+	mqnic_flow_write_slot(priv, slot);
+
+	uf->slot = slot;
+	list_add_tail(&uf->list, &priv->user_flows);
+
+	spin_unlock_bh(&priv->flow_lock);
+
+	return slot;
+}
+
+int mqnic_del_user_flow(struct net_device *ndev, struct mqnic_uq *owner,
+		__be32 saddr, __be32 daddr, __be16 sport, __be16 dport)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_user_flow *uf;
+
+	if (!priv->flow_table_size)
+		return -EOPNOTSUPP;
+
+	spin_lock_bh(&priv->flow_lock);
+
+	list_for_each_entry(uf, &priv->user_flows, list) {
+		if (uf->owner == owner && mqnic_user_flow_match(uf, saddr, daddr, sport, dport)) {
+			mqnic_user_flow_remove(priv, uf);
+			spin_unlock_bh(&priv->flow_lock);
+			return 0;
+		}
+	}
+
+	spin_unlock_bh(&priv->flow_lock);
+
+	return -ENOENT;
+}
+
+void mqnic_del_user_flows(struct net_device *ndev, struct mqnic_uq *owner)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_user_flow *uf, *tmp;
+
+	if (!priv->flow_table_size)
+		return;
+
+	spin_lock_bh(&priv->flow_lock);
+
+	list_for_each_entry_safe(uf, tmp, &priv->user_flows, list) {
+		if (uf->owner == owner)
+			mqnic_user_flow_remove(priv, uf);
+	}
+
+	spin_unlock_bh(&priv->flow_lock);
+}
+
+#ifdef CONFIG_RFS_ACCEL
+int mqnic_rx_flow_steer(struct net_device *ndev, const struct sk_buff *skb,
+		u16 rxq_index, u32 flow_id)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_flow_entry *entry;
+	struct flow_keys fk;
+	u32 hash;
+	int slot;
+
+	if (!priv->flow_table_size || !priv->port_up)
+		return -EOPNOTSUPP;
+
+	// the rmap is sized at port start and may cover removed queues
+	if (rxq_index >= READ_ONCE(priv->rxq_count))
+		return -EINVAL;
+
+	if (skb->protocol != htons(ETH_P_IP))
+		return -EPROTONOSUPPORT;
+
+	// reuse the NIC flow hash when the packet carries it
+	if (skb->l4_hash && !skb->sw_hash) {
+		hash = skb_get_hash_raw(skb);
+	} else {
+		if (!skb_flow_dissect_flow_keys(skb, &fk, 0))
+			return -EPROTONOSUPPORT;
+
+		if (fk.basic.n_proto != htons(ETH_P_IP) || (fk.control.flags & FLOW_DIS_IS_FRAGMENT))
+			return -EPROTONOSUPPORT;
+
+		if (fk.basic.ip_proto != IPPROTO_TCP && fk.basic.ip_proto != IPPROTO_UDP)
+			return -EPROTONOSUPPORT;
+
+		hash = mqnic_flow_hash(priv, fk.addrs.v4addrs.src, fk.addrs.v4addrs.dst,
+				fk.ports.src, fk.ports.dst);
+	}
+
+	slot = hash & (priv->flow_table_size - 1);
+	entry = &priv->flow_table[slot];
+
+	spin_lock_bh(&priv->flow_lock);
+
+	switch (entry->type) {
+	case MQNIC_FLOW_NTUPLE:
+	case MQNIC_FLOW_USER:
+		spin_unlock_bh(&priv->flow_lock);
+		return -EBUSY;
+	case MQNIC_FLOW_ARFS:
+		if (entry->hash == hash)
+			break;
+
+		// evict colliding flow only if the stack no longer needs it
+		if (!rps_may_expire_flow(ndev, entry->rxq, entry->flow_id, slot)) {
+			spin_unlock_bh(&priv->flow_lock);
+			return -EBUSY;
+		}
+		break;
+	default:
+		break;
+	}
+
+	entry->type = MQNIC_FLOW_ARFS;
+	entry->hash = hash;
+	entry->rxq = rxq_index;
+	entry->flow_id = flow_id;
+	mqnic_flow_write_slot(priv, slot);
+
+	spin_unlock_bh(&priv->flow_lock);
+
+	return slot;
+}
+
+static int mqnic_init_rx_cpu_rmap(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_if *iface = priv->interface;
+	struct mqnic_ring_table *rxq_table;
+	struct mqnic_ring *q;
+	int k;
+
+	ndev->rx_cpu_rmap = alloc_cpu_rmap(priv->rxq_count, GFP_KERNEL);
+	if (!ndev->rx_cpu_rmap)
+		return -ENOMEM;
+
+	for (k = 0; k < priv->rxq_count; k++) {
+		cpu_rmap_add(ndev->rx_cpu_rmap, NULL);
+
+		rcu_read_lock();
+		rxq_table = rcu_dereference(priv->rxq_table);
+		q = rxq_table && k < rxq_table->count ? rxq_table->ring[k] : NULL;
+		rcu_read_unlock();
+
+		// queues share event queue IRQs, so take a snapshot of the affinity
+		if (q && q->cq->eq->irq)
+			cpu_rmap_update(ndev->rx_cpu_rmap, k,
+					irq_get_affinity_mask(q->cq->eq->irq->irqn));
+		else
+			cpu_rmap_update(ndev->rx_cpu_rmap, k, cpu_online_mask);
+	}
+
+	return 0;
+}
+#endif
+
+void mqnic_update_flow_table(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ntuple_rule *rule;
+	struct mqnic_flow_entry *entry;
+	struct mqnic_user_flow *uf;
+	u8 key[MQNIC_FLOW_HASH_KEY_SIZE];
+	u32 hash;
+	int slot;
+	int k;
+
+	if (!priv->flow_table_size)
+		return;
+
+	mqnic_interface_get_rx_hash_key(priv->interface, key);
+
+	spin_lock_bh(&priv->flow_lock);
+
+	memcpy(priv->flow_hash_key, key, sizeof(key));
+
+	for (k = 0; k < priv->flow_table_size; k++)
+		priv->flow_table[k].type = MQNIC_FLOW_FREE;
+
+	// rehash ntuple rules, as the hash key or queue mapping may have changed
+	for (k = 0; k < priv->flow_table_size; k++) {
+		rule = &priv->ntuple_rules[k];
+
+		if (!rule->valid)
+			continue;
+
+		hash = mqnic_flow_hash(priv, rule->fs.h_u.tcp_ip4_spec.ip4src,
+				rule->fs.h_u.tcp_ip4_spec.ip4dst, rule->fs.h_u.tcp_ip4_spec.psrc,
+				rule->fs.h_u.tcp_ip4_spec.pdst);
+
+		rule->slot = hash & (priv->flow_table_size - 1);
+		entry = &priv->flow_table[rule->slot];
+
+		if (entry->type == MQNIC_FLOW_NTUPLE) {
+			// drop the rule so that ethtool no longer reports it
+			netdev_warn(ndev, "%s: rule %d collides with rule %d, removed",
+					__func__, k, entry->location);
+			rule->valid = false;
+			priv->ntuple_rule_count--;
+			continue;
+		}
+
+		entry->type = MQNIC_FLOW_NTUPLE;
+		entry->hash = hash;
+		entry->rxq = ethtool_get_flow_spec_ring(rule->fs.ring_cookie);
+		entry->location = k;
+	}
+
+	// user flows yield to ntuple rules and stay inactive until the next update
+	list_for_each_entry(uf, &priv->user_flows, list) {
+		hash = mqnic_flow_hash(priv, uf->saddr, uf->daddr, uf->sport, uf->dport);
+		slot = hash & (priv->flow_table_size - 1);
+		entry = &priv->flow_table[slot];
+
+		if (entry->type != MQNIC_FLOW_FREE) {
+			netdev_warn(ndev, "%s: user flow collides at slot %d, disabled",
+					__func__, slot);
+			uf->slot = -1;
+			continue;
+		}
+
+		entry->type = MQNIC_FLOW_USER;
+		entry->hash = hash;
+		entry->hw_index = uf->hw_index;
+		uf->slot = slot;
+	}
+
+	for (k = 0; k < priv->flow_table_size; k++)
+		mqnic_flow_write_slot(priv, k);
+
+	spin_unlock_bh(&priv->flow_lock);
+
+#ifdef CONFIG_RFS_ACCEL
+	if (!ndev->rx_cpu_rmap && mqnic_init_rx_cpu_rmap(ndev))
+		netdev_warn(ndev, "%s: failed to allocate RX CPU rmap", __func__);
+#endif
+}
+
+// rewrite hardware entries after RX queues were reopened on new hardware indices
+void mqnic_refresh_flow_table(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	int k;
+
+	if (!priv->flow_table_size)
+		return;
+
+	spin_lock_bh(&priv->flow_lock);
+	for (k = 0; k < priv->flow_table_size; k++)
+		mqnic_flow_write_slot(priv, k);
+	spin_unlock_bh(&priv->flow_lock);
+}
+
+void mqnic_flush_flow_table(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	int k;
+
+	if (!priv->flow_table_size)
+		return;
+
+	// ntuple rules and user flows are kept and reinstalled on the next start
+	spin_lock_bh(&priv->flow_lock);
+	for (k = 0; k < priv->flow_table_size; k++) {
+		priv->flow_table[k].type = MQNIC_FLOW_FREE;
+		mqnic_interface_set_rx_flow_table_entry(priv->interface, k, 0, 0, false);
+	}
+	spin_unlock_bh(&priv->flow_lock);
+}
+
+// the rmap is read by set_rps_cpu() on the RX path, so it is only freed once
+// NAPI is shut down on all RX queues; it keeps its size until the next start
+void mqnic_free_rx_cpu_rmap(struct net_device *ndev)
+{
+#ifdef CONFIG_RFS_ACCEL
+	if (ndev->rx_cpu_rmap) {
+		cpu_rmap_put(ndev->rx_cpu_rmap);
+		ndev->rx_cpu_rmap = NULL;
+	}
+#endif
+}
@@ -195,6 +195,12 @@
 #define MQNIC_RB_RX_QUEUE_MAP_CH_REG_OFFSET    0x00
 #define MQNIC_RB_RX_QUEUE_MAP_CH_REG_RSS_MASK  0x04
 #define MQNIC_RB_RX_QUEUE_MAP_CH_REG_APP_MASK  0x08
+#define MQNIC_RB_RX_QUEUE_MAP_HASH_KEY_STRIDE  0x04
+#define MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_INDEX   0x00
+#define MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_HASH    0x04
+#define MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_QUEUE   0x08
+
+#define MQNIC_RX_FLOW_TABLE_VALID 0x80000000
 
 #define MQNIC_RB_EQM_TYPE        0x0000C010
 #define MQNIC_RB_EQM_VER         0x00000400
@@ -250,6 +256,19 @@
 #define MQNIC_RB_SCHED_CTRL_TDMA_REG_CTRL       0x18
 #define MQNIC_RB_SCHED_CTRL_TDMA_REG_TS_COUNT   0x1C
 
+#define MQNIC_RB_SCHED_CTRL_SHAPER_TYPE              0x0000C051
+#define MQNIC_RB_SCHED_CTRL_SHAPER_VER               0x00000100
+#define MQNIC_RB_SCHED_CTRL_SHAPER_REG_OFFSET        0x0C
+#define MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_COUNT      0x10
+#define MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_STRIDE     0x14
+#define MQNIC_RB_SCHED_CTRL_SHAPER_REG_CTRL          0x18
+#define MQNIC_RB_SCHED_CTRL_SHAPER_REG_REFILL_PERIOD 0x1C
+
+#define MQNIC_SCHED_SHAPER_CH_REG_RATE     0x00
+#define MQNIC_SCHED_SHAPER_CH_REG_QUANTUM  0x04
+#define MQNIC_SCHED_SHAPER_CH_REG_TOKENS   0x08
+#define MQNIC_SCHED_SHAPER_CH_REG_DEFICIT  0x0C
+
 #define MQNIC_RB_TDMA_SCH_TYPE                     0x0000C060
 #define MQNIC_RB_TDMA_SCH_VER                      0x00000100
 #define MQNIC_RB_TDMA_SCH_REG_TS_COUNT             0x0C
@@ -307,6 +326,8 @@
 
 #define MQNIC_CQ_CMD_SET_VF_ID         0x80010000
 #define MQNIC_CQ_CMD_SET_SIZE          0x80020000
+#define MQNIC_CQ_CMD_SET_HOLDOFF_TIME  0x80030000
+#define MQNIC_CQ_CMD_SET_HOLDOFF_COUNT 0x80040000
 #define MQNIC_CQ_CMD_SET_EQN           0xC0000000
 #define MQNIC_CQ_CMD_SET_PROD_PTR      0x80800000
 #define MQNIC_CQ_CMD_SET_CONS_PTR      0x80900000
@@ -327,6 +348,8 @@
 
 #define MQNIC_EQ_CMD_SET_VF_ID         0x80010000
 #define MQNIC_EQ_CMD_SET_SIZE          0x80020000
+#define MQNIC_EQ_CMD_SET_HOLDOFF_TIME  0x80030000
+#define MQNIC_EQ_CMD_SET_HOLDOFF_COUNT 0x80040000
 #define MQNIC_EQ_CMD_SET_IRQN          0xC0000000
 #define MQNIC_EQ_CMD_SET_PROD_PTR      0x80800000
 #define MQNIC_EQ_CMD_SET_CONS_PTR      0x80900000
@@ -334,6 +357,9 @@
 #define MQNIC_EQ_CMD_SET_ENABLE        0x40000100
 #define MQNIC_EQ_CMD_SET_ARM           0x40000200
 
+// interrupt holdoff time unit, in core clock cycles
+#define MQNIC_HOLDOFF_TICK_CYCLES 256
+
 #define MQNIC_EVENT_TYPE_CPL 0x0000
 
 #define MQNIC_DESC_SIZE 16
@@ -347,6 +373,11 @@ struct mqnic_desc {
 	__le64 addr;
 };
 
+#define MQNIC_RX_HASH_TYPE_IPV4  (1 << 0)
+#define MQNIC_RX_HASH_TYPE_IPV6  (1 << 1)
+#define MQNIC_RX_HASH_TYPE_TCP   (1 << 2)
+#define MQNIC_RX_HASH_TYPE_UDP   (1 << 3)
+
 struct mqnic_cpl {
 	__le16 queue;
 	__le16 index;
@@ -112,6 +112,12 @@ struct mqnic_if *mqnic_create_interface(struct mqnic_dev *mdev, int index, u8 __
 		goto fail;
 	}
 
+	interface->cq_table = kvcalloc(count, sizeof(*interface->cq_table), GFP_KERNEL);
+	if (!interface->cq_table) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
 	interface->txq_rb = mqnic_find_reg_block(interface->rb_list, MQNIC_RB_TX_QM_TYPE, MQNIC_RB_TX_QM_VER, 0);
 
 	if (!interface->txq_rb) {
@@ -175,6 +181,22 @@ struct mqnic_if *mqnic_create_interface(struct mqnic_dev *mdev, int index, u8 __
 
 	dev_info(dev, "RX queue map indirection table size: %d", interface->rx_queue_map_indir_table_size);
 
+	// flow hash key follows per-port registers
+	interface->rx_hash_key_size = ((val >> 16) & 0xff) * 4;
+	interface->rx_hash_key_regs = interface->rx_queue_map_rb->regs + MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET +
+		MQNIC_RB_RX_QUEUE_MAP_CH_STRIDE*(val & 0xff);
+
+	dev_info(dev, "RX hash key size: %d", interface->rx_hash_key_size);
+
+	// flow table follows flow hash key
+	interface->rx_flow_table_size = (val >> 24) & 0xff ? 1 << ((val >> 24) & 0xff) : 0;
+	interface->rx_flow_table_regs = interface->rx_hash_key_regs + interface->rx_hash_key_size;
+
+	dev_info(dev, "RX flow table size: %d", interface->rx_flow_table_size);
+
+	for (k = 0; k < interface->rx_flow_table_size; k++)
+		mqnic_interface_set_rx_flow_table_entry(interface, k, 0, 0, false);
+
 	for (k = 0; k < interface->port_count; k++) {
 		interface->rx_queue_map_indir_table[k] = interface->hw_addr + ioread32(interface->rx_queue_map_rb->regs +
 			MQNIC_RB_RX_QUEUE_MAP_CH_OFFSET + MQNIC_RB_RX_QUEUE_MAP_CH_STRIDE*k + MQNIC_RB_RX_QUEUE_MAP_CH_REG_OFFSET);
@@ -324,6 +346,8 @@ void mqnic_destroy_interface(struct mqnic_if *interface)
 	mqnic_destroy_res(interface->eq_res);
 	mqnic_destroy_res(interface->cq_res);
 	mqnic_destroy_res(interface->txq_res);
+
+	kvfree(interface->cq_table);
 	mqnic_destroy_res(interface->rxq_res);
 
 	if (interface->rb_list)
@@ -395,3 +419,41 @@ void mqnic_interface_set_rx_queue_map_indir_table(struct mqnic_if *interface, in
 	iowrite32(val, interface->rx_queue_map_indir_table[port] + index*4);
 }
 EXPORT_SYMBOL(mqnic_interface_set_rx_queue_map_indir_table);
+
+void mqnic_interface_get_rx_hash_key(struct mqnic_if *interface, u8 *key)
+{
+	u32 val;
+	int k;
+
+	// first key byte in MSBs of first word
+	for (k = 0; k < interface->rx_hash_key_size / 4; k++) {
+		val = ioread32(interface->rx_hash_key_regs + MQNIC_RB_RX_QUEUE_MAP_HASH_KEY_STRIDE*k);
+		key[k*4+0] = val >> 24;
+		key[k*4+1] = val >> 16;
+		key[k*4+2] = val >> 8;
+		key[k*4+3] = val;
+	}
+}
+EXPORT_SYMBOL(mqnic_interface_get_rx_hash_key);
+
+void mqnic_interface_set_rx_hash_key(struct mqnic_if *interface, const u8 *key)
+{
+	u32 val;
+	int k;
+
+	for (k = 0; k < interface->rx_hash_key_size / 4; k++) {
+		val = ((u32)key[k*4+0] << 24) | (key[k*4+1] << 16) | (key[k*4+2] << 8) | key[k*4+3];
+		iowrite32(val, interface->rx_hash_key_regs + MQNIC_RB_RX_QUEUE_MAP_HASH_KEY_STRIDE*k);
+	}
+}
+EXPORT_SYMBOL(mqnic_interface_set_rx_hash_key);
+
+void mqnic_interface_set_rx_flow_table_entry(struct mqnic_if *interface, int index, u32 hash, u32 queue, bool valid)
+{
+	// entry is written on queue register write
+	iowrite32(index, interface->rx_flow_table_regs + MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_INDEX);
+	iowrite32(hash, interface->rx_flow_table_regs + MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_HASH);
+	iowrite32(queue | (valid ? MQNIC_RX_FLOW_TABLE_VALID : 0),
+			interface->rx_flow_table_regs + MQNIC_RB_RX_QUEUE_MAP_FLOW_REG_QUEUE);
+}
+EXPORT_SYMBOL(mqnic_interface_set_rx_flow_table_entry);
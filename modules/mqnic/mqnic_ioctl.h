@@ -56,4 +56,86 @@ struct mqnic_ioctl_region_info {
 
 #define MQNIC_IOCTL_GET_REGION_INFO _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 2)
 
+// get IRQ information
+// cpu tracks the IRQ affinity, it is the first online CPU in the current
+// affinity mask and follows changes made through /proc/irq
+struct mqnic_ioctl_irq_info {
+	__u32 argsz;
+	__u32 flags;
+	__u32 index;
+	__u32 irqn;
+	__s32 cpu;
+	__s32 numa_node;
+};
+
+#define MQNIC_IOCTL_GET_IRQ_INFO _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 3)
+
+enum {
+	MQNIC_QUEUE_TYPE_TX = 0,
+	MQNIC_QUEUE_TYPE_RX = 1
+};
+
+// allocate or free a TX or RX queue with its completion queue
+// register offsets are relative to the ctrl region, ring offsets are mmap
+// offsets on the device file
+struct mqnic_ioctl_queue {
+	__u32 argsz;
+	__u32 flags;
+	__u32 handle;
+	__u32 if_index;
+	__u32 type;
+	__u32 index;
+	__u32 size;
+	__u32 desc_block_size;
+	__u32 stride;
+	__u32 cqn;
+	__u32 cq_size;
+	__u32 cq_stride;
+	__u32 eqn;
+	__u32 rsvd;
+	__u64 regs_offset;
+	__u64 cq_regs_offset;
+	__u64 ring_offset;
+	__u64 ring_size;
+	__u64 cq_ring_offset;
+	__u64 cq_ring_size;
+};
+
+#define MQNIC_IOCTL_ALLOC_QUEUE _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 4)
+#define MQNIC_IOCTL_FREE_QUEUE _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 5)
+
+// pin and DMA map a buffer region, one DMA address per page is written to
+// the array at dma_addr_table; pinned pages count against RLIMIT_MEMLOCK,
+// and buffers cannot be unmapped while the file has queues allocated
+struct mqnic_ioctl_buffer {
+	__u32 argsz;
+	__u32 flags;
+	__u32 handle;
+	__u32 page_size;
+	__u64 addr;
+	__u64 size;
+	__u64 dma_addr_table;
+};
+
+#define MQNIC_IOCTL_MAP_BUFFER _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 6)
+#define MQNIC_IOCTL_UNMAP_BUFFER _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 7)
+
+// steer an IPv4 TCP or UDP flow to a user RX queue through the flow table,
+// addresses and ports are in network byte order; location returns the flow
+// table slot, and flows are removed when the queue is freed
+struct mqnic_ioctl_flow {
+	__u32 argsz;
+	__u32 flags;
+	__u32 handle;
+	__u32 location;
+	__u32 saddr;
+	__u32 daddr;
+	__u16 sport;
+	__u16 dport;
+	__u32 rsvd;
+};
+
+#define MQNIC_IOCTL_ADD_FLOW _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 8)
+#define MQNIC_IOCTL_DEL_FLOW _IO(MQNIC_IOCTL_TYPE, MQNIC_IOCTL_BASE + 9)
+
 #endif /* MQNIC_IOCTL_H */
@@ -14,6 +14,56 @@ static irqreturn_t mqnic_irq_handler(int irqn, void *data)
 	return IRQ_HANDLED;
 }
 
+// keep irq->cpu in sync when the affinity is changed from userspace
+static void mqnic_irq_affinity_notify(struct irq_affinity_notify *notify,
+		const cpumask_t *mask)
+{
+	struct mqnic_irq *irq = container_of(notify, struct mqnic_irq, affinity_notify);
+	unsigned int cpu;
+
+	cpu = cpumask_first_and(mask, cpu_online_mask);
+	if (cpu >= nr_cpu_ids)
+		cpu = cpumask_first(mask);
+	if (cpu < nr_cpu_ids)
+		WRITE_ONCE(irq->cpu, cpu);
+}
+
+static void mqnic_irq_affinity_release(struct kref *ref)
+{
+	// notifier is embedded in struct mqnic_irq, nothing to free
+}
+
+// spread IRQs over CPUs, starting with the CPUs local to the device
+static void mqnic_irq_set_affinity(struct mqnic_dev *mdev, struct mqnic_irq *irq)
+{
+	irq->cpu = cpumask_local_spread(irq->index, dev_to_node(mdev->dev));
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+	irq_set_affinity_and_hint(irq->irqn, cpumask_of(irq->cpu));
+#else
+	irq_set_affinity_hint(irq->irqn, cpumask_of(irq->cpu));
+#endif
+
+	irq->affinity_notify.notify = mqnic_irq_affinity_notify;
+	irq->affinity_notify.release = mqnic_irq_affinity_release;
+	if (irq_set_affinity_notifier(irq->irqn, &irq->affinity_notify))
+		dev_warn(mdev->dev, "Failed to register affinity notifier for IRQ %d", irq->index);
+}
+
+static void mqnic_irq_clear_affinity(void *data)
+{
+	struct mqnic_irq *irq = data;
+
+	// notifier must be removed before the IRQ is freed
+	irq_set_affinity_notifier(irq->irqn, NULL);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+	irq_update_affinity_hint(irq->irqn, NULL);
+#else
+	irq_set_affinity_hint(irq->irqn, NULL);
+#endif
+}
+
 int mqnic_irq_init_pcie(struct mqnic_dev *mdev)
 {
 	struct pci_dev *pdev = mdev->pdev;
@@ -52,6 +102,8 @@ int mqnic_irq_init_pcie(struct mqnic_dev *mdev)
 		irq->index = k;
 		irq->irqn = pci_irq_vector(pdev, k);
 		mdev->irq[k] = irq;
+
+		mqnic_irq_set_affinity(mdev, irq);
 	}
 
 	dev_info(dev, "Configured %d IRQs", mdev->irq_count);
@@ -69,6 +121,7 @@ void mqnic_irq_deinit_pcie(struct mqnic_dev *mdev)
 
 	for (k = 0; k < MQNIC_MAX_IRQ; k++) {
 		if (mdev->irq[k]) {
+			mqnic_irq_clear_affinity(mdev->irq[k]);
 			pci_free_irq(pdev, k, mdev->irq[k]);
 			kfree(mdev->irq[k]);
 			mdev->irq[k] = NULL;
@@ -113,6 +166,13 @@ int mqnic_irq_init_platform(struct mqnic_dev *mdev)
 		irq->index = k;
 		irq->irqn = irqn;
 		mdev->irq[k] = irq;
+
+		mqnic_irq_set_affinity(mdev, irq);
+
+		// hint must be cleared before devres frees the IRQ
+		ret = devm_add_action_or_reset(dev, mqnic_irq_clear_affinity, irq);
+		if (ret)
+			return ret;
 	}
 
 	dev_info(dev, "Configured %d IRQs", mdev->irq_count);
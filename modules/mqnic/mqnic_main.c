@@ -36,6 +36,30 @@ module_param_named(link_status_poll, mqnic_link_status_poll, uint, 0444);
 MODULE_PARM_DESC(link_status_poll,
 		 "link status polling interval, in ms (default: 1000; 0 to turn off)");
 
+unsigned int mqnic_threaded_napi;
+
+module_param_named(threaded_napi, mqnic_threaded_napi, uint, 0444);
+MODULE_PARM_DESC(threaded_napi,
+		 "run NAPI polling in kernel threads (default: 0; can be changed per netdev via sysfs)");
+
+unsigned int mqnic_rx_hdr_len;
+
+module_param_named(rx_hdr_len, mqnic_rx_hdr_len, uint, 0444);
+MODULE_PARM_DESC(rx_hdr_len,
+		 "RX header split length, in bytes (default: 0 for no header split; max 256)");
+
+unsigned int mqnic_stats_refresh_ms = MQNIC_STATS_REFRESH_MS;
+
+module_param_named(stats_refresh_ms, mqnic_stats_refresh_ms, uint, 0644);
+MODULE_PARM_DESC(stats_refresh_ms,
+		 "minimum interval between hardware statistics reads, in ms (default: 1000; 0 to read on every query)");
+
+unsigned int mqnic_cq_cons_batch = MQNIC_CQ_CONS_BATCH;
+
+module_param_named(cq_cons_batch, mqnic_cq_cons_batch, uint, 0644);
+MODULE_PARM_DESC(cq_cons_batch,
+		 "TX completions consumed before the CQ consumer pointer is written while more are pending (default: 256; 0 to write after every poll)");
+
 
 #ifdef CONFIG_PCI
 static const struct pci_device_id mqnic_pci_id_table[] = {
@@ -7,132 +7,345 @@
 
 #include <linux/version.h>
 
-int mqnic_start_port(struct net_device *ndev)
+// queues are allocated on the node of the CPU servicing the event queue IRQ
+static int mqnic_eq_numa_node(struct mqnic_eq *eq)
+{
+	if (eq->irq)
+		return cpu_to_node(eq->irq->cpu);
+
+	return dev_to_node(eq->dev);
+}
+
+static struct mqnic_ring_table *mqnic_alloc_ring_table(u32 count)
+{
+	struct mqnic_ring_table *table;
+
+	table = kzalloc(struct_size(table, ring, count), GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	table->count = count;
+
+	return table;
+}
+
+static void mqnic_publish_ring_tables(struct mqnic_priv *priv,
+		struct mqnic_ring_table *txq_table,
+		struct mqnic_ring_table *xdp_txq_table,
+		struct mqnic_ring_table *rxq_table)
+{
+	down_write(&priv->txq_table_sem);
+	rcu_assign_pointer(priv->txq_table, txq_table);
+	rcu_assign_pointer(priv->xdp_txq_table, xdp_txq_table);
+	up_write(&priv->txq_table_sem);
+
+	down_write(&priv->rxq_table_sem);
+	rcu_assign_pointer(priv->rxq_table, rxq_table);
+	up_write(&priv->rxq_table_sem);
+}
+
+static struct mqnic_ring *mqnic_create_rx_qp(struct net_device *ndev, int k)
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
 	struct mqnic_if *iface = priv->interface;
+	struct mqnic_eq *eq = iface->eq[k % iface->eq_count];
+	int numa_node = mqnic_eq_numa_node(eq);
+	u32 desc_block_size;
+	u32 frame_len, payload_len;
+	u32 hdr_len, frag_count;
 	struct mqnic_ring *q;
 	struct mqnic_cq *cq;
-	struct radix_tree_iter iter;
-	void **slot;
-	int k;
 	int ret;
-	u32 desc_block_size;
 
-	netdev_info(ndev, "%s on interface %d netdev %d", __func__,
-			priv->interface->index, priv->index);
+	// create CQ
+	cq = mqnic_create_cq(iface, numa_node);
+	if (IS_ERR(cq))
+		return ERR_CAST(cq);
 
-	netif_set_real_num_tx_queues(ndev, priv->txq_count);
-	netif_set_real_num_rx_queues(ndev, priv->rxq_count);
-
-	desc_block_size = min_t(u32, priv->interface->max_desc_block_size, 4);
-
-	// set up RX queues
-	for (k = 0; k < priv->rxq_count; k++) {
-		// create CQ
-		cq = mqnic_create_cq(iface);
-		if (IS_ERR_OR_NULL(cq)) {
-			ret = PTR_ERR(cq);
-			goto fail;
-		}
+	ret = mqnic_open_cq(cq, eq, priv->rx_ring_size);
+	if (ret) {
+		mqnic_destroy_cq(cq);
+		return ERR_PTR(ret);
+	}
 
-		ret = mqnic_open_cq(cq, iface->eq[k % iface->eq_count], priv->rx_ring_size);
-		if (ret) {
-			mqnic_destroy_cq(cq);
-			goto fail;
-		}
+	INIT_WORK(&cq->dim.work, mqnic_rx_dim_work);
+	cq->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
-		netif_napi_add(ndev, &cq->napi, mqnic_poll_rx_cq);
+	netif_napi_add(ndev, &cq->napi, mqnic_poll_rx_cq);
 #else
-		netif_napi_add(ndev, &cq->napi, mqnic_poll_rx_cq, NAPI_POLL_WEIGHT);
+	netif_napi_add(ndev, &cq->napi, mqnic_poll_rx_cq, NAPI_POLL_WEIGHT);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	if (cq->eq->irq)
+		netif_napi_set_irq(&cq->napi, cq->eq->irq->irqn);
 #endif
-		napi_enable(&cq->napi);
+	napi_enable(&cq->napi);
 
-		mqnic_arm_cq(cq);
+	mqnic_arm_cq(cq);
 
-		// create RX queue
-		q = mqnic_create_rx_ring(iface);
-		if (IS_ERR_OR_NULL(q)) {
-			ret = PTR_ERR(q);
-			mqnic_destroy_cq(cq);
-			goto fail;
-		}
+	// create RX queue
+	q = mqnic_create_rx_ring(iface, numa_node);
+	if (IS_ERR(q)) {
+		ret = PTR_ERR(q);
+		goto fail_cq;
+	}
 
-		q->mtu = ndev->mtu;
-		if (ndev->mtu + ETH_HLEN <= PAGE_SIZE)
-			q->page_order = 0;
-		else
-			q->page_order = ilog2((ndev->mtu + ETH_HLEN + PAGE_SIZE - 1) / PAGE_SIZE - 1) + 1;
+	q->mtu = ndev->mtu;
+	if (ndev->mtu + ETH_HLEN <= PAGE_SIZE)
+		q->page_order = 0;
+	else
+		q->page_order = ilog2((ndev->mtu + ETH_HLEN + PAGE_SIZE - 1) / PAGE_SIZE - 1) + 1;
+
+	if (priv->xdp_prog) {
+		// XDP needs headroom and tailroom around each frame in a single page
+		q->page_order = 0;
+		q->rx_buf_size = PAGE_SIZE;
+		q->rx_headroom = XDP_PACKET_HEADROOM;
+		q->rx_tailroom = MQNIC_XDP_TAILROOM;
+	} else if (ndev->mtu + ETH_HLEN <= PAGE_SIZE / 2) {
+		// split pages into multiple RX buffers when the MTU permits
+		q->rx_buf_size = roundup_pow_of_two(ndev->mtu + ETH_HLEN);
+	} else {
+		q->rx_buf_size = PAGE_SIZE << q->page_order;
+	}
 
-		ret = mqnic_open_rx_ring(q, priv, cq, priv->rx_ring_size, 1);
-		if (ret) {
-			mqnic_destroy_rx_ring(q);
-			mqnic_destroy_cq(cq);
-			goto fail;
-		}
+	q->queue_index = k;
+	q->xsk_pool = mqnic_xsk_pool(priv, k);
+
+	desc_block_size = 1;
+	q->rx_hdr_len = 0;
+	q->rx_frag_count = 0;
+	frame_len = ndev->mtu + ETH_HLEN;
+
+	if ((priv->rx_hdr_len || frame_len > PAGE_SIZE) && iface->max_desc_block_size > 1 &&
+			!priv->xdp_prog && !q->xsk_pool) {
+		// spread each frame over a descriptor block: optional header
+		// buffer, then payload fragments, order 0 where the block is
+		// large enough to cover the MTU
+		hdr_len = priv->rx_hdr_len;
+		payload_len = frame_len > hdr_len ? frame_len - hdr_len : 1;
+		frag_count = DIV_ROUND_UP(payload_len, PAGE_SIZE);
+
+		desc_block_size = roundup_pow_of_two(frag_count + (hdr_len ? 1 : 0));
+		desc_block_size = min_t(u32, desc_block_size,
+				min_t(u32, iface->max_desc_block_size, MQNIC_MAX_RX_DESC_BLOCK_SIZE));
+		frag_count = min_t(u32, frag_count, desc_block_size - (hdr_len ? 1 : 0));
+
+		q->rx_hdr_len = hdr_len;
+		q->rx_frag_count = frag_count;
+		q->page_order = get_order(DIV_ROUND_UP(payload_len, frag_count));
+		q->rx_headroom = 0;
+		q->rx_tailroom = 0;
+
+		if (payload_len <= PAGE_SIZE / 2)
+			q->rx_buf_size = roundup_pow_of_two(payload_len);
+		else
+			q->rx_buf_size = PAGE_SIZE << q->page_order;
+	}
 
-		down_write(&priv->rxq_table_sem);
-		ret = radix_tree_insert(&priv->rxq_table, k, q);
-		up_write(&priv->rxq_table_sem);
-		if (ret) {
-			mqnic_destroy_rx_ring(q);
-			mqnic_destroy_cq(cq);
-			goto fail;
-		}
+	ret = mqnic_open_rx_ring(q, priv, cq, priv->rx_ring_size, desc_block_size);
+	if (ret) {
+		mqnic_destroy_rx_ring(q);
+		goto fail_cq;
 	}
 
-	// set up TX queues
-	for (k = 0; k < priv->txq_count; k++) {
-		// create CQ
-		cq = mqnic_create_cq(iface);
-		if (IS_ERR_OR_NULL(cq)) {
-			ret = PTR_ERR(cq);
-			goto fail;
-		}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	// expose queue to NAPI mapping for busy polling
+	netif_queue_set_napi(ndev, k, NETDEV_QUEUE_TYPE_RX, &cq->napi);
+#endif
 
-		ret = mqnic_open_cq(cq, iface->eq[k % iface->eq_count], priv->tx_ring_size);
-		if (ret) {
-			mqnic_destroy_cq(cq);
-			goto fail;
-		}
+	return q;
+
+fail_cq:
+	napi_disable(&cq->napi);
+	netif_napi_del(&cq->napi);
+	mqnic_destroy_cq(cq);
+	return ERR_PTR(ret);
+}
+
+static void mqnic_destroy_rx_qp(struct net_device *ndev, struct mqnic_ring *q, int k)
+{
+	struct mqnic_cq *cq = q->cq;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(ndev, k, NETDEV_QUEUE_TYPE_RX, NULL);
+#endif
+	napi_disable(&cq->napi);
+	netif_napi_del(&cq->napi);
+	cancel_work_sync(&cq->dim.work);
+	mqnic_close_rx_ring(q);
+	mqnic_destroy_rx_ring(q);
+	mqnic_close_cq(cq);
+	mqnic_destroy_cq(cq);
+}
+
+// k is the netdev TX queue index, or -1 for an XDP TX queue
+static struct mqnic_ring *mqnic_create_tx_qp(struct net_device *ndev, int k, int eq_index)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_if *iface = priv->interface;
+	struct mqnic_eq *eq = iface->eq[eq_index % iface->eq_count];
+	int numa_node = mqnic_eq_numa_node(eq);
+	u32 desc_block_size = min_t(u32, iface->max_desc_block_size, 4);
+	struct mqnic_ring *q;
+	struct mqnic_cq *cq;
+	int ret;
+
+	// create CQ
+	cq = mqnic_create_cq(iface, numa_node);
+	if (IS_ERR(cq))
+		return ERR_CAST(cq);
+
+	ret = mqnic_open_cq(cq, eq, priv->tx_ring_size);
+	if (ret) {
+		mqnic_destroy_cq(cq);
+		return ERR_PTR(ret);
+	}
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
-		netif_napi_add_tx(ndev, &cq->napi, mqnic_poll_tx_cq);
+	netif_napi_add_tx(ndev, &cq->napi, mqnic_poll_tx_cq);
 #else
-		netif_tx_napi_add(ndev, &cq->napi, mqnic_poll_tx_cq, NAPI_POLL_WEIGHT);
+	netif_tx_napi_add(ndev, &cq->napi, mqnic_poll_tx_cq, NAPI_POLL_WEIGHT);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	if (cq->eq->irq)
+		netif_napi_set_irq(&cq->napi, cq->eq->irq->irqn);
+#endif
+	napi_enable(&cq->napi);
+
+	mqnic_arm_cq(cq);
+
+	// create TX queue
+	q = mqnic_create_tx_ring(iface, numa_node);
+	if (IS_ERR(q)) {
+		ret = PTR_ERR(q);
+		goto fail_cq;
+	}
+
+	if (k >= 0) {
+		q->tx_queue = netdev_get_tx_queue(ndev, k);
+		q->xsk_pool = mqnic_xsk_pool(priv, k);
+	} else {
+		q->tx_queue = NULL;
+	}
+
+	ret = mqnic_open_tx_ring(q, priv, cq, priv->tx_ring_size, desc_block_size);
+	if (ret) {
+		mqnic_destroy_tx_ring(q);
+		goto fail_cq;
+	}
+
+	if (k < 0)
+		return q;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(ndev, k, NETDEV_QUEUE_TYPE_TX, &cq->napi);
+#endif
+
+#ifdef CONFIG_XPS
+	// transmit from the CPU that services the completions
+	if (eq->irq)
+		netif_set_xps_queue(ndev, cpumask_of(eq->irq->cpu), k);
+#endif
+
+	return q;
+
+fail_cq:
+	napi_disable(&cq->napi);
+	netif_napi_del(&cq->napi);
+	mqnic_destroy_cq(cq);
+	return ERR_PTR(ret);
+}
+
+static void mqnic_destroy_tx_qp(struct net_device *ndev, struct mqnic_ring *q, int k)
+{
+	struct mqnic_cq *cq = q->cq;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	if (k >= 0)
+		netif_queue_set_napi(ndev, k, NETDEV_QUEUE_TYPE_TX, NULL);
 #endif
-		napi_enable(&cq->napi);
+	napi_disable(&cq->napi);
+	netif_napi_del(&cq->napi);
+	mqnic_close_tx_ring(q);
+	mqnic_destroy_tx_ring(q);
+	mqnic_close_cq(cq);
+	mqnic_destroy_cq(cq);
+}
 
-		mqnic_arm_cq(cq);
+int mqnic_start_port(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_if *iface = priv->interface;
+	struct mqnic_ring_table *txq_table = NULL;
+	struct mqnic_ring_table *xdp_txq_table = NULL;
+	struct mqnic_ring_table *rxq_table = NULL;
+	struct mqnic_ring *q;
+	int k;
+	int ret;
 
-		// create TX queue
-		q = mqnic_create_tx_ring(iface);
-		if (IS_ERR_OR_NULL(q)) {
+	netdev_info(ndev, "%s on interface %d netdev %d", __func__,
+			priv->interface->index, priv->index);
+
+	netif_set_real_num_tx_queues(ndev, priv->txq_count);
+	netif_set_real_num_rx_queues(ndev, priv->rxq_count);
+
+	// rings are collected in private tables and published once all exist
+	rxq_table = mqnic_alloc_ring_table(priv->rxq_count);
+	txq_table = mqnic_alloc_ring_table(priv->txq_count);
+	if (!rxq_table || !txq_table) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	// set up RX queues
+	for (k = 0; k < priv->rxq_count; k++) {
+		q = mqnic_create_rx_qp(ndev, k);
+		if (IS_ERR(q)) {
 			ret = PTR_ERR(q);
-			mqnic_destroy_cq(cq);
 			goto fail;
 		}
 
-		q->tx_queue = netdev_get_tx_queue(ndev, k);
+		rxq_table->ring[k] = q;
+	}
 
-		ret = mqnic_open_tx_ring(q, priv, cq, priv->tx_ring_size, desc_block_size);
-		if (ret) {
-			mqnic_destroy_tx_ring(q);
-			mqnic_destroy_cq(cq);
+	// set up TX queues
+	for (k = 0; k < priv->txq_count; k++) {
+		q = mqnic_create_tx_qp(ndev, k, k);
+		if (IS_ERR(q)) {
+			ret = PTR_ERR(q);
+			goto fail;
+		}
+
+		txq_table->ring[k] = q;
+	}
+
+	// set up XDP TX queues, one per CPU where queues are available
+	if (priv->xdp_prog)
+		priv->xdp_txq_count = min_t(u32, num_online_cpus(),
+				mqnic_res_get_count(iface->txq_res) - priv->txq_count);
+
+	if (priv->xdp_txq_count) {
+		xdp_txq_table = mqnic_alloc_ring_table(priv->xdp_txq_count);
+		if (!xdp_txq_table) {
+			ret = -ENOMEM;
 			goto fail;
 		}
+	}
 
-		down_write(&priv->txq_table_sem);
-		ret = radix_tree_insert(&priv->txq_table, k, q);
-		up_write(&priv->txq_table_sem);
-		if (ret) {
-			mqnic_destroy_tx_ring(q);
-			mqnic_destroy_cq(cq);
+	for (k = 0; k < priv->xdp_txq_count; k++) {
+		q = mqnic_create_tx_qp(ndev, -1, k);
+		if (IS_ERR(q)) {
+			ret = PTR_ERR(q);
 			goto fail;
 		}
+
+		xdp_txq_table->ring[k] = q;
 	}
 
+	mqnic_publish_ring_tables(priv, txq_table, xdp_txq_table, rxq_table);
+
 	// set MTU
 	mqnic_interface_set_tx_mtu(iface, ndev->mtu + ETH_HLEN);
 	mqnic_interface_set_rx_mtu(iface, ndev->mtu + ETH_HLEN);
@@ -140,24 +353,28 @@ int mqnic_start_port(struct net_device *ndev)
 	// configure RX indirection and RSS
 	mqnic_update_indir_table(ndev);
 
+	// configure interrupt moderation
+	mqnic_update_coalesce(ndev);
+
 	priv->port_up = true;
 
+	// configure flow steering
+	mqnic_update_flow_table(ndev);
+
 	// enable TX and RX queues
-	down_read(&priv->txq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->txq_table, &iter, 0) {
-		struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	for (k = 0; k < txq_table->count; k++)
+		mqnic_enable_tx_ring(txq_table->ring[k]);
+	for (k = 0; xdp_txq_table && k < xdp_txq_table->count; k++)
+		mqnic_enable_tx_ring(xdp_txq_table->ring[k]);
 
-		mqnic_enable_tx_ring(q);
-	}
-	up_read(&priv->txq_table_sem);
+	for (k = 0; k < rxq_table->count; k++)
+		mqnic_enable_rx_ring(rxq_table->ring[k]);
 
-	down_read(&priv->rxq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->rxq_table, &iter, 0) {
-		struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	// configure TX rate limits and weights
+	mqnic_update_tx_shaper(ndev);
 
-		mqnic_enable_rx_ring(q);
-	}
-	up_read(&priv->rxq_table_sem);
+	// configure TX gate schedule
+	mqnic_update_tx_tdma(ndev);
 
 	// enable first scheduler
 	mqnic_activate_sched_block(priv->sched_block[0]);
@@ -176,6 +393,8 @@ int mqnic_start_port(struct net_device *ndev)
 	return 0;
 
 fail:
+	// publish partially populated tables so that stop_port cleans up
+	mqnic_publish_ring_tables(priv, txq_table, xdp_txq_table, rxq_table);
 	mqnic_stop_port(ndev);
 	return ret;
 }
@@ -183,9 +402,9 @@ fail:
 void mqnic_stop_port(struct net_device *ndev)
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
-	struct mqnic_cq *cq;
-	struct radix_tree_iter iter;
-	void **slot;
+	struct mqnic_ring_table *txq_table;
+	struct mqnic_ring_table *xdp_txq_table;
+	struct mqnic_ring_table *rxq_table;
 	int k;
 
 	netdev_info(ndev, "%s on interface %d netdev %d", __func__,
@@ -203,65 +422,74 @@ void mqnic_stop_port(struct net_device *ndev)
 	netif_carrier_off(ndev);
 	netif_tx_disable(ndev);
 
-	spin_lock_bh(&priv->stats_lock);
 	mqnic_update_stats(ndev);
-	spin_unlock_bh(&priv->stats_lock);
 
 	// disable schedulers
 	for (k = 0; k < priv->sched_block_count; k++)
 		mqnic_deactivate_sched_block(priv->sched_block[k]);
 
-	// disable TX and RX queues
-	down_read(&priv->txq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->txq_table, &iter, 0) {
-		struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	mqnic_clear_tx_shaper(ndev);
+	mqnic_clear_tx_tdma(ndev);
 
-		mqnic_disable_tx_ring(q);
-	}
+	// tables are only replaced by start_port and stop_port
+	down_read(&priv->txq_table_sem);
+	txq_table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+	xdp_txq_table = rcu_dereference_protected(priv->xdp_txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
 	up_read(&priv->txq_table_sem);
 
 	down_read(&priv->rxq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->rxq_table, &iter, 0) {
-		struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	rxq_table = rcu_dereference_protected(priv->rxq_table,
+			lockdep_is_held(&priv->rxq_table_sem));
+	up_read(&priv->rxq_table_sem);
 
-		mqnic_disable_rx_ring(q);
+	// disable TX and RX queues
+	for (k = 0; txq_table && k < txq_table->count; k++) {
+		if (txq_table->ring[k])
+			mqnic_disable_tx_ring(txq_table->ring[k]);
+	}
+	for (k = 0; xdp_txq_table && k < xdp_txq_table->count; k++) {
+		if (xdp_txq_table->ring[k])
+			mqnic_disable_tx_ring(xdp_txq_table->ring[k]);
+	}
+	for (k = 0; rxq_table && k < rxq_table->count; k++) {
+		if (rxq_table->ring[k])
+			mqnic_disable_rx_ring(rxq_table->ring[k]);
 	}
-	up_read(&priv->rxq_table_sem);
 
 	msleep(20);
 
 	priv->port_up = false;
 
+	// clear flow steering
+	mqnic_flush_flow_table(ndev);
+
+	// unpublish ring tables and wait for datapath lookups to finish
+	mqnic_publish_ring_tables(priv, NULL, NULL, NULL);
+	synchronize_rcu();
+
 	// shut down NAPI and clean queues
-	down_write(&priv->txq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->txq_table, &iter, 0) {
-		struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	for (k = 0; txq_table && k < txq_table->count; k++) {
+		if (txq_table->ring[k])
+			mqnic_destroy_tx_qp(ndev, txq_table->ring[k], k);
+	}
+	for (k = 0; xdp_txq_table && k < xdp_txq_table->count; k++) {
+		if (xdp_txq_table->ring[k])
+			mqnic_destroy_tx_qp(ndev, xdp_txq_table->ring[k], -1);
+	}
+	priv->xdp_txq_count = 0;
 
-		cq = q->cq;
-		napi_disable(&cq->napi);
-		netif_napi_del(&cq->napi);
-		mqnic_close_tx_ring(q);
-		mqnic_destroy_tx_ring(q);
-		radix_tree_delete(&priv->txq_table, iter.index);
-		mqnic_close_cq(cq);
-		mqnic_destroy_cq(cq);
+	for (k = 0; rxq_table && k < rxq_table->count; k++) {
+		if (rxq_table->ring[k])
+			mqnic_destroy_rx_qp(ndev, rxq_table->ring[k], k);
 	}
-	up_write(&priv->txq_table_sem);
 
-	down_write(&priv->rxq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->rxq_table, &iter, 0) {
-		struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	mqnic_free_rx_cpu_rmap(ndev);
 
-		cq = q->cq;
-		napi_disable(&cq->napi);
-		netif_napi_del(&cq->napi);
-		mqnic_close_rx_ring(q);
-		mqnic_destroy_rx_ring(q);
-		radix_tree_delete(&priv->rxq_table, iter.index);
-		mqnic_close_cq(cq);
-		mqnic_destroy_cq(cq);
-	}
-	up_write(&priv->rxq_table_sem);
+	kfree(txq_table);
+	kfree(xdp_txq_table);
+	kfree(rxq_table);
 }
 
 static int mqnic_open(struct net_device *ndev)
@@ -296,70 +524,580 @@ static int mqnic_close(struct net_device *ndev)
 	return ret;
 }
 
-int mqnic_update_indir_table(struct net_device *ndev)
+// entries pointing at a missing or excluded queue fall back to the next live queue
+static void mqnic_write_indir_table(struct net_device *ndev, struct mqnic_ring *exclude)
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
 	struct mqnic_if *iface = priv->interface;
+	struct mqnic_ring_table *rxq_table;
 	struct mqnic_ring *q;
-	int k;
+	u32 rxq;
+	int k, i;
+
+	rcu_read_lock();
+	rxq_table = rcu_dereference(priv->rxq_table);
+	for (k = 0; rxq_table && k < priv->rx_queue_map_indir_table_size; k++) {
+		rxq = priv->rx_queue_map_indir_table[k];
+		q = NULL;
+
+		for (i = 0; i < rxq_table->count && !q; i++) {
+			q = rxq_table->ring[(rxq + i) % rxq_table->count];
+			if (q == exclude)
+				q = NULL;
+		}
+
+		if (q)
+			mqnic_interface_set_rx_queue_map_indir_table(iface, 0, k, q->index);
+	}
+	rcu_read_unlock();
+}
+
+int mqnic_update_indir_table(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_if *iface = priv->interface;
 
 	mqnic_interface_set_rx_queue_map_rss_mask(iface, 0, 0xffffffff);
 	mqnic_interface_set_rx_queue_map_app_mask(iface, 0, 0);
 
-	for (k = 0; k < priv->rx_queue_map_indir_table_size; k++) {
-		rcu_read_lock();
-		q = radix_tree_lookup(&priv->rxq_table, priv->rx_queue_map_indir_table[k]);
-		rcu_read_unlock();
+	mqnic_write_indir_table(ndev, NULL);
 
-		if (q)
-			mqnic_interface_set_rx_queue_map_indir_table(iface, 0, k, q->index);
+	return 0;
+}
+
+static void mqnic_drain_tx_ring(struct mqnic_ring *q)
+{
+	int k;
+
+	// give the hardware a chance to send what is already queued
+	for (k = 0; k < 20 && !mqnic_is_tx_ring_empty(q); k++)
+		msleep(1);
+}
+
+static int mqnic_reopen_tx_qp(struct mqnic_priv *priv, struct mqnic_ring *q,
+		struct mqnic_cq *cq, struct mqnic_eq *eq, u32 size)
+{
+	int ret;
+
+	ret = mqnic_open_cq(cq, eq, size);
+	if (ret)
+		return ret;
+
+	ret = mqnic_open_tx_ring(q, priv, cq, size, q->desc_block_size);
+	if (ret)
+		mqnic_close_cq(cq);
+
+	return ret;
+}
+
+// drop a queue pair that could not be reopened; the NAPI context is already
+// disabled and the ring and CQ are closed, so only the objects remain
+static void mqnic_drop_qp(struct net_device *ndev, struct rw_semaphore *sem,
+		struct mqnic_ring_table *table, int k, bool rx)
+{
+	struct mqnic_ring *q = table->ring[k];
+	struct mqnic_cq *cq = q->cq;
+
+	down_write(sem);
+	WRITE_ONCE(table->ring[k], NULL);
+	up_write(sem);
+
+	synchronize_rcu();
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+	netif_queue_set_napi(ndev, k, rx ? NETDEV_QUEUE_TYPE_RX : NETDEV_QUEUE_TYPE_TX, NULL);
+#endif
+	netif_napi_del(&cq->napi);
+	if (rx)
+		mqnic_destroy_rx_ring(q);
+	else
+		mqnic_destroy_tx_ring(q);
+	mqnic_destroy_cq(cq);
+}
+
+static int mqnic_resize_tx_qp(struct net_device *ndev, struct mqnic_ring_table *table,
+		int k, u32 size)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring *q = table->ring[k];
+	struct netdev_queue *txq = q->tx_queue;
+	struct mqnic_cq *cq = q->cq;
+	struct mqnic_eq *eq = cq->eq;
+	u32 old_size = q->size;
+	int ret;
+
+	__netif_tx_lock_bh(txq);
+	netif_tx_stop_queue(txq);
+	__netif_tx_unlock_bh(txq);
+
+	mqnic_drain_tx_ring(q);
+	mqnic_disable_tx_ring(q);
+	mqnic_clear_tx_ring_shaper(ndev, q);
+	mqnic_clear_tx_ring_tdma(ndev, q);
+
+	napi_disable(&cq->napi);
+	mqnic_close_tx_ring(q);
+	mqnic_close_cq(cq);
+
+	ret = mqnic_reopen_tx_qp(priv, q, cq, eq, size);
+	if (ret) {
+		netdev_warn(ndev, "%s: failed to resize TX queue: %d", __func__, ret);
+		if (mqnic_reopen_tx_qp(priv, q, cq, eq, old_size)) {
+			// leave the queue stopped; the caller restarts the port
+			netdev_err(ndev, "%s: failed to reopen TX queue %d", __func__, k);
+			mqnic_drop_qp(ndev, &priv->txq_table_sem, table, k, false);
+			return ret;
+		}
+	}
+
+	napi_enable(&cq->napi);
+	mqnic_arm_cq(cq);
+
+	// the ring is on a new hardware index
+	mqnic_update_tx_ring_shaper(ndev, q, k);
+	mqnic_update_tx_ring_tdma(ndev, q, k);
+
+	mqnic_enable_tx_ring(q);
+
+	netif_tx_wake_queue(txq);
+
+	return ret;
+}
+
+static int mqnic_reopen_rx_qp(struct mqnic_priv *priv, struct mqnic_ring *q,
+		struct mqnic_cq *cq, struct mqnic_eq *eq, u32 size)
+{
+	int ret;
+
+	ret = mqnic_open_cq(cq, eq, size);
+	if (ret)
+		return ret;
+
+	ret = mqnic_open_rx_ring(q, priv, cq, size, q->desc_block_size);
+	if (ret)
+		mqnic_close_cq(cq);
+
+	return ret;
+}
+
+static int mqnic_resize_rx_qp(struct net_device *ndev, struct mqnic_ring_table *table,
+		int k, u32 size)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring *q = table->ring[k];
+	struct mqnic_cq *cq = q->cq;
+	struct mqnic_eq *eq = cq->eq;
+	u32 old_size = q->size;
+	int ret;
+
+	// point RSS at the other queues while this one is down
+	mqnic_write_indir_table(ndev, q);
+
+	mqnic_disable_rx_ring(q);
+	msleep(20);
+
+	napi_disable(&cq->napi);
+	cancel_work_sync(&cq->dim.work);
+	mqnic_close_rx_ring(q);
+	mqnic_close_cq(cq);
+
+	ret = mqnic_reopen_rx_qp(priv, q, cq, eq, size);
+	if (ret) {
+		netdev_warn(ndev, "%s: failed to resize RX queue: %d", __func__, ret);
+		if (mqnic_reopen_rx_qp(priv, q, cq, eq, old_size)) {
+			// RSS already skips this queue; the caller restarts the port
+			netdev_err(ndev, "%s: failed to reopen RX queue %d", __func__, k);
+			mqnic_drop_qp(ndev, &priv->rxq_table_sem, table, k, true);
+			mqnic_refresh_flow_table(ndev);
+			return ret;
+		}
+	}
+
+	napi_enable(&cq->napi);
+	mqnic_arm_cq(cq);
+	mqnic_enable_rx_ring(q);
+
+	// the hardware queue index may have changed
+	mqnic_write_indir_table(ndev, NULL);
+	mqnic_refresh_flow_table(ndev);
+
+	return ret;
+}
+
+// resize rings one queue at a time, leaving the other queues running
+int mqnic_update_ring_size(struct net_device *ndev, u32 tx_ring_size, u32 rx_ring_size)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	u32 old_tx_ring_size = priv->tx_ring_size;
+	u32 old_rx_ring_size = priv->rx_ring_size;
+	struct mqnic_ring_table *table;
+	int ret;
+	int k;
+
+	if (!priv->port_up) {
+		priv->tx_ring_size = tx_ring_size;
+		priv->rx_ring_size = rx_ring_size;
+		return 0;
+	}
+
+	// XDP TX rings are shared by all CPUs and cannot be quiesced individually
+	if (priv->xdp_prog)
+		return -EOPNOTSUPP;
+
+	if (tx_ring_size != priv->tx_ring_size) {
+		priv->tx_ring_size = tx_ring_size;
+
+		table = rcu_dereference_protected(priv->txq_table,
+				lockdep_is_held(&priv->mdev->state_lock));
+		for (k = 0; k < table->count; k++) {
+			ret = mqnic_resize_tx_qp(ndev, table, k, tx_ring_size);
+			if (ret)
+				goto fail;
+		}
+	}
+
+	if (rx_ring_size != priv->rx_ring_size) {
+		priv->rx_ring_size = rx_ring_size;
+
+		table = rcu_dereference_protected(priv->rxq_table,
+				lockdep_is_held(&priv->mdev->state_lock));
+		for (k = 0; k < table->count; k++) {
+			ret = mqnic_resize_rx_qp(ndev, table, k, rx_ring_size);
+			if (ret)
+				goto fail;
+		}
 	}
 
 	return 0;
+
+fail:
+	// some queues may already use the new size, report the last known good
+	// sizes so that the caller can rebuild the port with them
+	priv->tx_ring_size = old_tx_ring_size;
+	priv->rx_ring_size = old_rx_ring_size;
+	return ret;
 }
 
-void mqnic_update_stats(struct net_device *ndev)
+static int mqnic_update_rxq_count(struct net_device *ndev, u32 rxq_count)
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
-	struct radix_tree_iter iter;
-	void **slot;
-	unsigned long packets, bytes;
-	unsigned long dropped;
+	struct mqnic_ring_table *old_table;
+	struct mqnic_ring_table *new_table;
+	struct mqnic_ring *q;
+	int ret;
+	int k;
 
-	if (unlikely(!priv->port_up))
-		return;
+	old_table = rcu_dereference_protected(priv->rxq_table,
+			lockdep_is_held(&priv->mdev->state_lock));
+
+	new_table = mqnic_alloc_ring_table(rxq_count);
+	if (!new_table)
+		return -ENOMEM;
+
+	for (k = 0; k < rxq_count; k++) {
+		if (k < old_table->count) {
+			new_table->ring[k] = old_table->ring[k];
+			continue;
+		}
+
+		q = mqnic_create_rx_qp(ndev, k);
+		if (IS_ERR(q)) {
+			ret = PTR_ERR(q);
+			goto fail;
+		}
+
+		new_table->ring[k] = q;
+	}
+
+	if (rxq_count > old_table->count) {
+		ret = netif_set_real_num_rx_queues(ndev, rxq_count);
+		if (ret)
+			goto fail;
+
+		for (k = old_table->count; k < rxq_count; k++)
+			mqnic_enable_rx_ring(new_table->ring[k]);
+	} else {
+		// move RSS and flow steering off the queues being removed
+		mqnic_write_indir_table(ndev, NULL);
+		mqnic_flush_flow_table(ndev);
+
+		for (k = rxq_count; k < old_table->count; k++)
+			mqnic_disable_rx_ring(old_table->ring[k]);
+
+		msleep(20);
+
+		netif_set_real_num_rx_queues(ndev, rxq_count);
+	}
+
+	down_write(&priv->rxq_table_sem);
+	rcu_assign_pointer(priv->rxq_table, new_table);
+	priv->rxq_count = rxq_count;
+	up_write(&priv->rxq_table_sem);
+
+	synchronize_rcu();
+
+	for (k = rxq_count; k < old_table->count; k++)
+		mqnic_destroy_rx_qp(ndev, old_table->ring[k], k);
+
+	kfree(old_table);
+
+	// pick up the new queues in RSS, moderation and flow steering
+	mqnic_write_indir_table(ndev, NULL);
+	mqnic_update_coalesce(ndev);
+	mqnic_flush_flow_table(ndev);
+	mqnic_update_flow_table(ndev);
+
+	return 0;
+
+fail:
+	for (k = old_table->count; k < rxq_count; k++) {
+		if (new_table->ring[k])
+			mqnic_destroy_rx_qp(ndev, new_table->ring[k], k);
+	}
+	kfree(new_table);
+	return ret;
+}
+
+static int mqnic_update_txq_count(struct net_device *ndev, u32 txq_count)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring_table *old_table;
+	struct mqnic_ring_table *new_table;
+	struct netdev_queue *txq;
+	struct mqnic_ring *q;
+	int ret;
+	int k;
+
+	old_table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->mdev->state_lock));
+
+	new_table = mqnic_alloc_ring_table(txq_count);
+	if (!new_table)
+		return -ENOMEM;
+
+	for (k = 0; k < txq_count; k++) {
+		if (k < old_table->count) {
+			new_table->ring[k] = old_table->ring[k];
+			continue;
+		}
+
+		q = mqnic_create_tx_qp(ndev, k, k);
+		if (IS_ERR(q)) {
+			ret = PTR_ERR(q);
+			goto fail;
+		}
+
+		new_table->ring[k] = q;
+	}
+
+	if (txq_count < old_table->count) {
+		// stop the stack from using the queues being removed
+		ret = netif_set_real_num_tx_queues(ndev, txq_count);
+		if (ret)
+			goto fail;
+
+		for (k = txq_count; k < old_table->count; k++) {
+			txq = netdev_get_tx_queue(ndev, k);
+			__netif_tx_lock_bh(txq);
+			netif_tx_stop_queue(txq);
+			__netif_tx_unlock_bh(txq);
+		}
+	} else {
+		for (k = old_table->count; k < txq_count; k++) {
+			mqnic_update_tx_ring_shaper(ndev, new_table->ring[k], k);
+			mqnic_update_tx_ring_tdma(ndev, new_table->ring[k], k);
+			mqnic_enable_tx_ring(new_table->ring[k]);
+		}
+	}
+
+	down_write(&priv->txq_table_sem);
+	rcu_assign_pointer(priv->txq_table, new_table);
+	priv->txq_count = txq_count;
+	up_write(&priv->txq_table_sem);
+
+	if (txq_count > old_table->count) {
+		// new queues are reachable from start_xmit, hand them to the stack
+		ret = netif_set_real_num_tx_queues(ndev, txq_count);
+		if (ret)
+			netdev_warn(ndev, "%s: failed to set TX queue count: %d", __func__, ret);
+
+		for (k = old_table->count; k < txq_count; k++)
+			netif_tx_start_queue(netdev_get_tx_queue(ndev, k));
+	}
+
+	synchronize_rcu();
+
+	for (k = txq_count; k < old_table->count; k++) {
+		mqnic_drain_tx_ring(old_table->ring[k]);
+		mqnic_disable_tx_ring(old_table->ring[k]);
+		mqnic_clear_tx_ring_shaper(ndev, old_table->ring[k]);
+		mqnic_clear_tx_ring_tdma(ndev, old_table->ring[k]);
+	}
+
+	for (k = txq_count; k < old_table->count; k++)
+		mqnic_destroy_tx_qp(ndev, old_table->ring[k], k);
+
+	kfree(old_table);
+
+	mqnic_update_coalesce(ndev);
+
+	return 0;
+
+fail:
+	for (k = old_table->count; k < txq_count; k++) {
+		if (new_table->ring[k])
+			mqnic_destroy_tx_qp(ndev, new_table->ring[k], k);
+	}
+	kfree(new_table);
+	return ret;
+}
+
+// add or remove queue pairs, leaving the remaining queues running
+int mqnic_update_queue_count(struct net_device *ndev, u32 txq_count, u32 rxq_count)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	int ret;
+
+	if (!priv->port_up) {
+		priv->txq_count = txq_count;
+		priv->rxq_count = rxq_count;
+		return 0;
+	}
+
+	if (rxq_count != priv->rxq_count) {
+		ret = mqnic_update_rxq_count(ndev, rxq_count);
+		if (ret)
+			return ret;
+	}
+
+	if (txq_count != priv->txq_count) {
+		ret = mqnic_update_txq_count(ndev, txq_count);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+void mqnic_update_coalesce(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring_table *table;
+	struct dim_cq_moder moder;
+	struct mqnic_ring *q;
+	int k;
 
-	packets = 0;
-	bytes = 0;
-	dropped = 0;
 	down_read(&priv->rxq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->rxq_table, &iter, 0) {
-		const struct mqnic_ring *q = (struct mqnic_ring *)*slot;
+	table = rcu_dereference_protected(priv->rxq_table,
+			lockdep_is_held(&priv->rxq_table_sem));
+	for (k = 0; table && k < table->count; k++) {
+		q = table->ring[k];
+		if (!q)
+			continue;
 
-		packets += READ_ONCE(q->packets);
-		bytes += READ_ONCE(q->bytes);
-		dropped += READ_ONCE(q->dropped_packets);
+		if (priv->rx_dim_enabled) {
+			// start from the default profile, net_dim takes over from there
+			moder = net_dim_get_def_rx_moderation(q->cq->dim.mode);
+			mqnic_cq_set_holdoff(q->cq, moder.usec, moder.pkts);
+		} else {
+			cancel_work_sync(&q->cq->dim.work);
+			mqnic_cq_set_holdoff(q->cq, priv->rx_coal_usecs, priv->rx_coal_frames);
+		}
 	}
 	up_read(&priv->rxq_table_sem);
-	ndev->stats.rx_packets = packets;
-	ndev->stats.rx_bytes = bytes;
-	ndev->stats.rx_dropped = dropped;
 
-	packets = 0;
-	bytes = 0;
-	dropped = 0;
 	down_read(&priv->txq_table_sem);
-	radix_tree_for_each_slot(slot, &priv->txq_table, &iter, 0) {
-		const struct mqnic_ring *q = (struct mqnic_ring *)*slot;
-
-		packets += READ_ONCE(q->packets);
-		bytes += READ_ONCE(q->bytes);
-		dropped += READ_ONCE(q->dropped_packets);
+	table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+	for (k = 0; table && k < table->count; k++) {
+		q = table->ring[k];
+		if (q)
+			mqnic_cq_set_holdoff(q->cq, priv->tx_coal_usecs, priv->tx_coal_frames);
+	}
+	table = rcu_dereference_protected(priv->xdp_txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+	for (k = 0; table && k < table->count; k++) {
+		q = table->ring[k];
+		if (q)
+			mqnic_cq_set_holdoff(q->cq, priv->tx_coal_usecs, priv->tx_coal_frames);
 	}
 	up_read(&priv->txq_table_sem);
-	ndev->stats.tx_packets = packets;
-	ndev->stats.tx_bytes = bytes;
-	ndev->stats.tx_dropped = dropped;
+}
+
+void mqnic_get_ring_stats(const struct mqnic_ring *ring, struct mqnic_ring_stats *stats)
+{
+	unsigned int start;
+
+	do {
+		start = u64_stats_fetch_begin(&ring->syncp);
+		stats->packets = ring->packets;
+		stats->bytes = ring->bytes;
+		stats->dropped = ring->dropped_packets;
+		stats->alloc_failed = ring->alloc_failed;
+		stats->linearized = ring->linearized;
+		stats->csum_fallback = ring->csum_fallback;
+	} while (u64_stats_fetch_retry(&ring->syncp, start));
+
+	do {
+		start = u64_stats_fetch_begin(&ring->cpl_syncp);
+		stats->sojourn_ns = ring->sojourn_ns;
+		stats->sojourn_packets = ring->sojourn_packets;
+		stats->sojourn_max_ns = ring->sojourn_max_ns;
+	} while (u64_stats_fetch_retry(&ring->cpl_syncp, start));
+}
+
+static void mqnic_sum_ring_stats(struct mqnic_ring_table *table,
+		u64 *packets, u64 *bytes, u64 *dropped)
+{
+	struct mqnic_ring_stats stats;
+	int k;
+
+	for (k = 0; table && k < table->count; k++) {
+		if (!table->ring[k])
+			continue;
+
+		mqnic_get_ring_stats(table->ring[k], &stats);
+
+		*packets += stats.packets;
+		*bytes += stats.bytes;
+		*dropped += stats.dropped;
+	}
+}
+
+static void mqnic_fold_stats(struct mqnic_priv *priv, struct rtnl_link_stats64 *stats)
+{
+	// lockless; ring tables are walked under RCU and the per-ring
+	// counters are read through their u64_stats_sync
+	rcu_read_lock();
+
+	mqnic_sum_ring_stats(rcu_dereference(priv->rxq_table),
+			&stats->rx_packets, &stats->rx_bytes, &stats->rx_dropped);
+
+	mqnic_sum_ring_stats(rcu_dereference(priv->txq_table),
+			&stats->tx_packets, &stats->tx_bytes, &stats->tx_dropped);
+	mqnic_sum_ring_stats(rcu_dereference(priv->xdp_txq_table),
+			&stats->tx_packets, &stats->tx_bytes, &stats->tx_dropped);
+
+	rcu_read_unlock();
+}
+
+void mqnic_update_stats(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct rtnl_link_stats64 stats = {0};
+
+	if (unlikely(!priv->port_up))
+		return;
+
+	// snapshot the ring counters while the port goes down
+	mqnic_fold_stats(priv, &stats);
+
+	ndev->stats.rx_packets = stats.rx_packets;
+	ndev->stats.rx_bytes = stats.rx_bytes;
+	ndev->stats.rx_dropped = stats.rx_dropped;
+	ndev->stats.tx_packets = stats.tx_packets;
+	ndev->stats.tx_bytes = stats.tx_bytes;
+	ndev->stats.tx_dropped = stats.tx_dropped;
 }
 
 static void mqnic_get_stats64(struct net_device *ndev,
@@ -367,10 +1105,10 @@ static void mqnic_get_stats64(struct net_device *ndev,
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
 
-	spin_lock_bh(&priv->stats_lock);
-	mqnic_update_stats(ndev);
-	netdev_stats_to_stats64(stats, &ndev->stats);
-	spin_unlock_bh(&priv->stats_lock);
+	if (priv->port_up)
+		mqnic_fold_stats(priv, stats);
+	else
+		netdev_stats_to_stats64(stats, &ndev->stats);
 }
 
 static int mqnic_hwtstamp_set(struct net_device *ndev, struct ifreq *ifr)
@@ -444,6 +1182,11 @@ static int mqnic_change_mtu(struct net_device *ndev, int new_mtu)
 		return -EPERM;
 	}
 
+	if (priv->xdp_prog && new_mtu > MQNIC_XDP_MAX_MTU) {
+		netdev_err(ndev, "MTU %d too large for XDP (max %lu)", new_mtu, MQNIC_XDP_MAX_MTU);
+		return -EINVAL;
+	}
+
 	netdev_info(ndev, "New MTU: %d", new_mtu);
 
 	ndev->mtu = new_mtu;
@@ -483,6 +1226,16 @@ static const struct net_device_ops mqnic_netdev_ops = {
 	.ndo_eth_ioctl = mqnic_ioctl,
 #else
 	.ndo_do_ioctl = mqnic_ioctl,
+#endif
+	.ndo_bpf = mqnic_bpf,
+	.ndo_xdp_xmit = mqnic_xdp_xmit,
+	.ndo_xsk_wakeup = mqnic_xsk_wakeup,
+	.ndo_set_tx_maxrate = mqnic_set_tx_maxrate,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+	.ndo_setup_tc = mqnic_setup_tc,
+#endif
+#ifdef CONFIG_RFS_ACCEL
+	.ndo_rx_flow_steer = mqnic_rx_flow_steer,
 #endif
 };
 
@@ -544,8 +1297,6 @@ struct net_device *mqnic_create_netdev(struct mqnic_if *interface, int index, in
 	priv = netdev_priv(ndev);
 	memset(priv, 0, sizeof(struct mqnic_priv));
 
-	spin_lock_init(&priv->stats_lock);
-
 	priv->ndev = ndev;
 	priv->mdev = interface->mdev;
 	priv->interface = interface;
@@ -564,11 +1315,27 @@ struct net_device *mqnic_create_netdev(struct mqnic_if *interface, int index, in
 	priv->rx_ring_size = roundup_pow_of_two(clamp_t(u32, mqnic_num_rxq_entries,
 			MQNIC_MIN_RX_RING_SZ, MQNIC_MAX_RX_RING_SZ));
 
+	// header split needs at least two descriptors per RX block
+	if (mqnic_rx_hdr_len && interface->max_desc_block_size < 2)
+		dev_warn(dev, "RX header split not supported by hardware");
+	else if (mqnic_rx_hdr_len)
+		priv->rx_hdr_len = clamp_t(u32, mqnic_rx_hdr_len, ETH_HLEN, MQNIC_RX_HDR_STRIDE);
+
+	priv->tx_copybreak = MQNIC_DEFAULT_TX_COPYBREAK;
+	priv->rx_copybreak = MQNIC_DEFAULT_RX_COPYBREAK;
+
+	priv->rx_coal_usecs = MQNIC_DEFAULT_RX_COAL_USECS;
+	priv->rx_coal_frames = 0;
+	priv->tx_coal_usecs = MQNIC_DEFAULT_TX_COAL_USECS;
+	priv->tx_coal_frames = 0;
+	priv->rx_dim_enabled = true;
+
 	init_rwsem(&priv->txq_table_sem);
-	INIT_RADIX_TREE(&priv->txq_table, GFP_KERNEL);
+	RCU_INIT_POINTER(priv->txq_table, NULL);
+	RCU_INIT_POINTER(priv->xdp_txq_table, NULL);
 
 	init_rwsem(&priv->rxq_table_sem);
-	INIT_RADIX_TREE(&priv->rxq_table, GFP_KERNEL);
+	RCU_INIT_POINTER(priv->rxq_table, NULL);
 
 	priv->sched_block_count = interface->sched_block_count;
 	for (k = 0; k < interface->sched_block_count; k++)
@@ -612,6 +1379,34 @@ struct net_device *mqnic_create_netdev(struct mqnic_if *interface, int index, in
 	for (k = 0; k < priv->rx_queue_map_indir_table_size; k++)
 		priv->rx_queue_map_indir_table[k] = k % priv->rxq_count;
 
+	// flow steering needs the software flow hash to match the NIC
+	spin_lock_init(&priv->flow_lock);
+	INIT_LIST_HEAD(&priv->user_flows);
+
+	if (interface->rx_hash_key_size == MQNIC_FLOW_HASH_KEY_SIZE)
+		priv->flow_table_size = interface->rx_flow_table_size;
+
+	if (priv->flow_table_size) {
+		priv->flow_table = kcalloc(priv->flow_table_size, sizeof(*priv->flow_table), GFP_KERNEL);
+		priv->ntuple_rules = kcalloc(priv->flow_table_size, sizeof(*priv->ntuple_rules), GFP_KERNEL);
+		if (!priv->flow_table || !priv->ntuple_rules) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+	}
+
+	priv->xsk_zc_qps = bitmap_zalloc(mqnic_res_get_count(interface->rxq_res), GFP_KERNEL);
+	if (!priv->xsk_zc_qps) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	priv->tx_shaper = kcalloc(ndev->num_tx_queues, sizeof(*priv->tx_shaper), GFP_KERNEL);
+	if (!priv->tx_shaper) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
 	// entry points
 	ndev->netdev_ops = &mqnic_netdev_ops;
 	ndev->ethtool_ops = &mqnic_ethtool_ops;
@@ -625,9 +1420,23 @@ struct net_device *mqnic_create_netdev(struct mqnic_if *interface, int index, in
 	if (priv->if_features & MQNIC_IF_FEATURE_TX_CSUM)
 		ndev->hw_features |= NETIF_F_HW_CSUM;
 
+	if (priv->if_features & MQNIC_IF_FEATURE_RX_HASH)
+		ndev->hw_features |= NETIF_F_RXHASH;
+
+	if (priv->flow_table_size)
+		ndev->hw_features |= NETIF_F_NTUPLE;
+
+	if (mqnic_has_tx_shaper(priv) || mqnic_has_tx_tdma(priv))
+		ndev->hw_features |= NETIF_F_HW_TC;
+
 	ndev->features = ndev->hw_features | NETIF_F_HIGHDMA;
 	ndev->hw_features |= 0;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	ndev->xdp_features = NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT |
+			NETDEV_XDP_ACT_NDO_XMIT | NETDEV_XDP_ACT_XSK_ZEROCOPY;
+#endif
+
 	ndev->min_mtu = ETH_MIN_MTU;
 	ndev->max_mtu = 1500;
 
@@ -647,6 +1456,20 @@ struct net_device *mqnic_create_netdev(struct mqnic_if *interface, int index, in
 
 	priv->registered = 1;
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 12, 0)
+	// default NAPI mode, can be changed later through /sys/class/net/<dev>/threaded
+	if (mqnic_threaded_napi) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0)
+		ret = dev_set_threaded(ndev, NETDEV_NAPI_THREADED_ENABLED);
+#else
+		ret = dev_set_threaded(ndev, true);
+#endif
+		if (ret)
+			dev_warn(dev, "failed to enable threaded NAPI on interface %d netdev %d: %d",
+					priv->interface->index, priv->index, ret);
+	}
+#endif
+
 	return ndev;
 
 fail:
@@ -657,11 +1480,22 @@ fail:
 void mqnic_destroy_netdev(struct net_device *ndev)
 {
 	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_user_flow *uf, *tmp;
 
 	if (priv->registered)
 		unregister_netdev(ndev);
 
+	list_for_each_entry_safe(uf, tmp, &priv->user_flows, list) {
+		list_del(&uf->list);
+		kfree(uf);
+	}
+
 	kfree(priv->rx_queue_map_indir_table);
+	kfree(priv->flow_table);
+	kfree(priv->ntuple_rules);
+	bitmap_free(priv->xsk_zc_qps);
+	kfree(priv->tx_shaper);
+	kfree(priv->tx_tdma.gate_mask);
 
 	free_netdev(ndev);
 }
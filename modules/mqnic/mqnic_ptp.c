@@ -26,6 +26,23 @@ ktime_t mqnic_read_cpl_ts(struct mqnic_dev *mdev, struct mqnic_ring *ring,
 	return ktime_set(ts_s, ts_ns);
 }
 
+// offset from the PHC to CLOCK_MONOTONIC, in ns
+s64 mqnic_read_phc_offset(struct mqnic_dev *mdev)
+{
+	struct timespec64 ts;
+	u64 pre_ns, post_ns;
+
+	// reading FNS latches the PHC time
+	pre_ns = ktime_get_ns();
+	ioread32(mdev->phc_rb->regs + MQNIC_RB_PHC_REG_GET_FNS);
+	post_ns = ktime_get_ns();
+	ts.tv_nsec = ioread32(mdev->phc_rb->regs + MQNIC_RB_PHC_REG_GET_NS);
+	ts.tv_sec = ioread32(mdev->phc_rb->regs + MQNIC_RB_PHC_REG_GET_SEC_L);
+	ts.tv_sec |= (u64) ioread32(mdev->phc_rb->regs + MQNIC_RB_PHC_REG_GET_SEC_H) << 32;
+
+	return pre_ns + (post_ns - pre_ns) / 2 - timespec64_to_ns(&ts);
+}
+
 static int mqnic_phc_adjfine(struct ptp_clock_info *ptp, long scaled_ppm)
 {
 	struct mqnic_dev *mdev = container_of(ptp, struct mqnic_dev, ptp_clock_info);
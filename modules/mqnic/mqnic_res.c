@@ -76,3 +76,19 @@ u8 __iomem *mqnic_res_get_addr(struct mqnic_res *res, int index)
     
     return res->base + index * res->stride;
 }
+
+void *mqnic_dma_alloc_coherent_node(struct device *dev, size_t size, dma_addr_t *dma_handle, int node)
+{
+    int orig_node = dev_to_node(dev);
+    void *buf;
+
+    // coherent allocations follow the device node, so retarget it temporarily
+    set_dev_node(dev, node);
+    buf = dma_alloc_coherent(dev, size, dma_handle, GFP_KERNEL);
+    set_dev_node(dev, orig_node);
+
+    if (!buf)
+        buf = dma_alloc_coherent(dev, size, dma_handle, GFP_KERNEL);
+
+    return buf;
+}
@@ -5,16 +5,23 @@
 
 #include "mqnic.h"
 
-struct mqnic_ring *mqnic_create_rx_ring(struct mqnic_if *interface)
+#include <linux/bpf_trace.h>
+#include <linux/version.h>
+
+struct mqnic_ring *mqnic_create_rx_ring(struct mqnic_if *interface, int numa_node)
 {
 	struct mqnic_ring *ring;
 
-	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	ring = kzalloc_node(sizeof(*ring), GFP_KERNEL, numa_node);
 	if (!ring)
 		return ERR_PTR(-ENOMEM);
 
 	ring->dev = interface->dev;
 	ring->interface = interface;
+	ring->numa_node = numa_node;
+
+	u64_stats_init(&ring->syncp);
+	u64_stats_init(&ring->cpl_syncp);
 
 	ring->index = -1;
 	ring->enabled = 0;
@@ -37,6 +44,7 @@ void mqnic_destroy_rx_ring(struct mqnic_ring *ring)
 int mqnic_open_rx_ring(struct mqnic_ring *ring, struct mqnic_priv *priv,
 		struct mqnic_cq *cq, int size, int desc_block_size)
 {
+	struct page_pool_params pp_params = {0};
 	int ret = 0;
 
 	if (ring->enabled || ring->hw_addr || ring->buf || !priv || !cq)
@@ -54,19 +62,97 @@ int mqnic_open_rx_ring(struct mqnic_ring *ring, struct mqnic_priv *priv,
 	ring->size_mask = ring->size - 1;
 	ring->stride = roundup_pow_of_two(MQNIC_DESC_SIZE * ring->desc_block_size);
 
-	ring->rx_info = kvzalloc(sizeof(*ring->rx_info) * ring->size, GFP_KERNEL);
+	ring->rx_info = kvzalloc_node(sizeof(*ring->rx_info) * ring->size, GFP_KERNEL, ring->numa_node);
 	if (!ring->rx_info) {
 		ret = -ENOMEM;
 		goto fail;
 	}
 
 	ring->buf_size = ring->size * ring->stride;
-	ring->buf = dma_alloc_coherent(ring->dev, ring->buf_size, &ring->buf_dma_addr, GFP_KERNEL);
+	ring->buf = mqnic_dma_alloc_coherent_node(ring->dev, ring->buf_size, &ring->buf_dma_addr, ring->numa_node);
 	if (!ring->buf) {
 		ret = -ENOMEM;
 		goto fail;
 	}
 
+	if (ring->desc_block_size < 2) {
+		ring->rx_frag_count = 0;
+		ring->rx_hdr_len = 0;
+	}
+
+	if (ring->rx_hdr_len) {
+		// header buffers are small and reused in place, so keep them in
+		// one coherent slab rather than in page pool fragments
+		ring->rx_hdr_buf_size = ring->size * MQNIC_RX_HDR_STRIDE;
+		ring->rx_hdr_buf = mqnic_dma_alloc_coherent_node(ring->dev, ring->rx_hdr_buf_size,
+				&ring->rx_hdr_buf_dma_addr, ring->numa_node);
+		if (!ring->rx_hdr_buf) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+	}
+
+	if (ring->xsk_pool) {
+		// AF_XDP zero-copy; buffers come from the UMEM fill ring
+		ring->rx_buf_size = xsk_pool_get_rx_frame_size(ring->xsk_pool);
+		ring->rx_headroom = 0;
+		ring->rx_tailroom = 0;
+
+		goto reg_rxq;
+	}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 15, 0)
+	// no page pool fragment support; one buffer per page
+	ring->rx_buf_size = PAGE_SIZE << ring->page_order;
+#endif
+	if (!ring->rx_buf_size || ring->rx_buf_size > PAGE_SIZE << ring->page_order)
+		ring->rx_buf_size = PAGE_SIZE << ring->page_order;
+
+	// page pool for RX buffers; pages stay DMA-mapped while recycled
+	pp_params.order = ring->page_order;
+	pp_params.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0) && LINUX_VERSION_CODE < KERNEL_VERSION(6, 7, 0)
+	if (ring->rx_buf_size < PAGE_SIZE << ring->page_order)
+		pp_params.flags |= PP_FLAG_PAGE_FRAG;
+#endif
+	pp_params.pool_size = ring->size;
+	if (ring->rx_frag_count)
+		pp_params.pool_size *= ring->rx_frag_count;
+	pp_params.nid = ring->numa_node;
+	pp_params.dev = ring->dev;
+	// XDP_TX transmits straight out of RX buffers
+	pp_params.dma_dir = priv->xdp_prog ? DMA_BIDIRECTIONAL : DMA_FROM_DEVICE;
+	pp_params.offset = ring->rx_headroom;
+	pp_params.max_len = (PAGE_SIZE << ring->page_order) - ring->rx_headroom;
+
+	ring->page_pool = page_pool_create(&pp_params);
+	if (IS_ERR(ring->page_pool)) {
+		ret = PTR_ERR(ring->page_pool);
+		ring->page_pool = NULL;
+		goto fail;
+	}
+
+reg_rxq:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+	ret = xdp_rxq_info_reg(&ring->xdp_rxq, priv->ndev, ring->queue_index, cq->napi.napi_id);
+#else
+	ret = xdp_rxq_info_reg(&ring->xdp_rxq, priv->ndev, ring->queue_index);
+#endif
+	if (ret)
+		goto fail;
+
+	if (ring->xsk_pool) {
+		ret = xdp_rxq_info_reg_mem_model(&ring->xdp_rxq, MEM_TYPE_XSK_BUFF_POOL, NULL);
+		if (ret)
+			goto fail;
+
+		xsk_pool_set_rxq_info(ring->xsk_pool, &ring->xdp_rxq);
+	} else {
+		ret = xdp_rxq_info_reg_mem_model(&ring->xdp_rxq, MEM_TYPE_PAGE_POOL, ring->page_pool);
+		if (ret)
+			goto fail;
+	}
+
 	ring->priv = priv;
 	ring->cq = cq;
 	cq->src_ring = ring;
@@ -98,6 +184,9 @@ int mqnic_open_rx_ring(struct mqnic_ring *ring, struct mqnic_priv *priv,
 			ring->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
 
 	ret = mqnic_refill_rx_buffers(ring);
+	// an empty fill ring is not an error; the ring is refilled on wakeup
+	if (ret && ring->xsk_pool)
+		ret = 0;
 	if (ret) {
 		netdev_err(priv->ndev, "failed to allocate RX buffer for RX queue index %d (of %u total) entry index %u (of %u total)",
 				ring->index, priv->rxq_count, ring->prod_ptr, ring->size);
@@ -137,6 +226,20 @@ void mqnic_close_rx_ring(struct mqnic_ring *ring)
 		ring->buf_dma_addr = 0;
 	}
 
+	if (ring->rx_hdr_buf) {
+		dma_free_coherent(ring->dev, ring->rx_hdr_buf_size, ring->rx_hdr_buf, ring->rx_hdr_buf_dma_addr);
+		ring->rx_hdr_buf = NULL;
+		ring->rx_hdr_buf_dma_addr = 0;
+	}
+
+	if (xdp_rxq_info_is_reg(&ring->xdp_rxq))
+		xdp_rxq_info_unreg(&ring->xdp_rxq);
+
+	if (ring->page_pool) {
+		page_pool_destroy(ring->page_pool);
+		ring->page_pool = NULL;
+	}
+
 	if (ring->rx_info) {
 		kvfree(ring->rx_info);
 		ring->rx_info = NULL;
@@ -195,15 +298,28 @@ void mqnic_rx_write_prod_ptr(struct mqnic_ring *ring)
 void mqnic_free_rx_desc(struct mqnic_ring *ring, int index)
 {
 	struct mqnic_rx_info *rx_info = &ring->rx_info[index];
-	// struct page *page = rx_info->page;
+	int i;
+
+	if (rx_info->xdp) {
+		xsk_buff_free(rx_info->xdp);
+		rx_info->xdp = NULL;
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(rx_info->frags); i++) {
+		if (!rx_info->frags[i].page)
+			continue;
+
+		page_pool_put_full_page(ring->page_pool, rx_info->frags[i].page, false);
+		rx_info->frags[i].page = NULL;
+	}
+	rx_info->len = 0;
 
 	if (!rx_info->page)
 		return;
 
-	dma_unmap_page(ring->dev, dma_unmap_addr(rx_info, dma_addr),
-			dma_unmap_len(rx_info, len), DMA_FROM_DEVICE);
+	page_pool_put_full_page(ring->page_pool, rx_info->page, false);
 	rx_info->dma_addr = 0;
-	__free_pages(rx_info->page, rx_info->page_order);
 	rx_info->page = NULL;
 }
 
@@ -219,49 +335,138 @@ int mqnic_free_rx_buf(struct mqnic_ring *ring)
 		cnt++;
 	}
 
+	// slots hold on to buffers left in place by copy-break or not used by
+	// a multi-buffer frame until the next refill
+	for (index = 0; index < ring->size; index++)
+		mqnic_free_rx_desc(ring, index);
+
 	return cnt;
 }
 
+static int mqnic_prepare_rx_desc_multi(struct mqnic_ring *ring, int index)
+{
+	struct mqnic_rx_info *rx_info = &ring->rx_info[index];
+	struct mqnic_desc *rx_desc = (struct mqnic_desc *)(ring->buf + index * ring->stride);
+	struct mqnic_rx_frag *frag;
+	struct page *page;
+	u32 page_offset;
+	u32 i, d = 0;
+
+	if (unlikely(rx_info->len)) {
+		dev_err(ring->dev, "%s: skb not yet processed on interface %d",
+				__func__, ring->interface->index);
+		return -1;
+	}
+
+	// header goes to this slot's entry in the header slab
+	if (ring->rx_hdr_len) {
+		rx_desc[d].len = cpu_to_le32(ring->rx_hdr_len);
+		rx_desc[d].addr = cpu_to_le64(ring->rx_hdr_buf_dma_addr + index * MQNIC_RX_HDR_STRIDE);
+		d++;
+	}
+
+	// payload fragments; buffers not used by the previous packet are reposted
+	for (i = 0; i < ring->rx_frag_count; i++, d++) {
+		frag = &rx_info->frags[i];
+
+		if (!frag->page) {
+			page_offset = 0;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+			if (ring->rx_buf_size < PAGE_SIZE << ring->page_order)
+				page = page_pool_dev_alloc_frag(ring->page_pool, &page_offset, ring->rx_buf_size);
+			else
+#endif
+				page = page_pool_dev_alloc_pages(ring->page_pool);
+			if (unlikely(!page)) {
+				dev_err(ring->dev, "%s: failed to allocate memory on interface %d",
+						__func__, ring->interface->index);
+				u64_stats_update_begin(&ring->syncp);
+				ring->alloc_failed++;
+				u64_stats_update_end(&ring->syncp);
+				return -ENOMEM;
+			}
+
+			frag->page = page;
+			frag->page_offset = page_offset;
+			frag->dma_addr = page_pool_get_dma_addr(page) + page_offset;
+		}
+
+		rx_desc[d].len = cpu_to_le32(ring->rx_buf_size);
+		rx_desc[d].addr = cpu_to_le64(frag->dma_addr);
+	}
+
+	for (; d < ring->desc_block_size; d++) {
+		rx_desc[d].len = 0;
+		rx_desc[d].addr = 0;
+	}
+
+	rx_info->len = ring->rx_hdr_len + ring->rx_frag_count * ring->rx_buf_size;
+
+	return 0;
+}
+
 int mqnic_prepare_rx_desc(struct mqnic_ring *ring, int index)
 {
 	struct mqnic_rx_info *rx_info = &ring->rx_info[index];
 	struct mqnic_desc *rx_desc = (struct mqnic_desc *)(ring->buf + index * ring->stride);
 	struct page *page = rx_info->page;
 	u32 page_order = ring->page_order;
-	u32 len = PAGE_SIZE << page_order;
+	u32 page_offset = 0;
+	u32 len = ring->rx_buf_size - ring->rx_headroom - ring->rx_tailroom;
 	dma_addr_t dma_addr;
 
+	if (ring->xsk_pool)
+		return mqnic_prepare_rx_desc_zc(ring, index);
+
+	if (ring->rx_frag_count)
+		return mqnic_prepare_rx_desc_multi(ring, index);
+
 	if (unlikely(page)) {
-		dev_err(ring->dev, "%s: skb not yet processed on interface %d",
-				__func__, ring->interface->index);
-		return -1;
+		if (unlikely(rx_info->len)) {
+			dev_err(ring->dev, "%s: skb not yet processed on interface %d",
+					__func__, ring->interface->index);
+			return -1;
+		}
+
+		// buffer left in place by copy-break, post it again
+		rx_desc->len = cpu_to_le32(len);
+		rx_desc->addr = cpu_to_le64(rx_info->dma_addr + rx_info->page_offset);
+		rx_info->len = len;
+
+		return 0;
 	}
 
-	page = dev_alloc_pages(page_order);
+	// pages from the pool are already mapped and synced for the device;
+	// small buffers are carved out of a shared page, which goes back to
+	// the pool once the stack has released every slice
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	if (ring->rx_buf_size < PAGE_SIZE << page_order)
+		page = page_pool_dev_alloc_frag(ring->page_pool, &page_offset, ring->rx_buf_size);
+	else
+#endif
+		page = page_pool_dev_alloc_pages(ring->page_pool);
 	if (unlikely(!page)) {
 		dev_err(ring->dev, "%s: failed to allocate memory on interface %d",
 				__func__, ring->interface->index);
+		u64_stats_update_begin(&ring->syncp);
+		ring->alloc_failed++;
+		u64_stats_update_end(&ring->syncp);
 		return -ENOMEM;
 	}
 
-	// map page
-	dma_addr = dma_map_page(ring->dev, page, 0, len, DMA_FROM_DEVICE);
+	dma_addr = page_pool_get_dma_addr(page);
 
-	if (unlikely(dma_mapping_error(ring->dev, dma_addr))) {
-		dev_err(ring->dev, "%s: DMA mapping failed on interface %d",
-				__func__, ring->interface->index);
-		__free_pages(page, page_order);
-		return -1;
-	}
+	// leave room in front of the frame for XDP
+	page_offset += ring->rx_headroom;
 
 	// write descriptor
 	rx_desc->len = cpu_to_le32(len);
-	rx_desc->addr = cpu_to_le64(dma_addr);
+	rx_desc->addr = cpu_to_le64(dma_addr + page_offset);
 
 	// update rx_info
 	rx_info->page = page;
 	rx_info->page_order = page_order;
-	rx_info->page_offset = 0;
+	rx_info->page_offset = page_offset;
 	rx_info->dma_addr = dma_addr;
 	rx_info->len = len;
 
@@ -290,6 +495,189 @@ int mqnic_refill_rx_buffers(struct mqnic_ring *ring)
 	return ret;
 }
 
+static u32 mqnic_rx_run_xdp(struct mqnic_ring *ring, struct bpf_prog *prog,
+		struct mqnic_rx_info *rx_info, u32 *offset, u32 *len)
+{
+	struct mqnic_priv *priv = ring->priv;
+	void *hard_start = page_address(rx_info->page) + rx_info->page_offset - ring->rx_headroom;
+	struct xdp_buff xdp;
+	u32 act;
+	int err;
+
+	xdp_init_buff(&xdp, ring->rx_buf_size, &ring->xdp_rxq);
+	xdp_prepare_buff(&xdp, hard_start, ring->rx_headroom, *len, false);
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+
+	switch (act) {
+	case XDP_PASS:
+		// program may have moved the packet boundaries
+		*offset = xdp.data - page_address(rx_info->page);
+		*len = xdp.data_end - xdp.data;
+		return act;
+	case XDP_TX:
+		err = mqnic_xdp_tx_buff(priv, &xdp);
+		if (unlikely(err))
+			goto out_failure;
+		return act;
+	case XDP_REDIRECT:
+		err = xdp_do_redirect(priv->ndev, &xdp, prog);
+		if (unlikely(err))
+			goto out_failure;
+		return act;
+	default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+		bpf_warn_invalid_xdp_action(priv->ndev, prog, act);
+#else
+		bpf_warn_invalid_xdp_action(act);
+#endif
+		fallthrough;
+	case XDP_ABORTED:
+out_failure:
+		trace_xdp_exception(priv->ndev, prog, act);
+		fallthrough;
+	case XDP_DROP:
+		page_pool_recycle_direct(ring->page_pool, rx_info->page);
+		return XDP_DROP;
+	}
+}
+
+static void mqnic_rx_fill_skb_meta(struct mqnic_cq *cq, struct mqnic_ring *rx_ring,
+		struct mqnic_cpl *cpl, struct sk_buff *skb)
+{
+	struct mqnic_if *interface = cq->interface;
+	struct mqnic_priv *priv = rx_ring->priv;
+
+	// RX hardware timestamp
+	if (interface->if_features & MQNIC_IF_FEATURE_PTP_TS)
+		skb_hwtstamps(skb)->hwtstamp = mqnic_read_cpl_ts(interface->mdev, rx_ring, cpl);
+
+	skb_record_rx_queue(skb, rx_ring->queue_index);
+	skb_mark_napi_id(skb, &cq->napi);
+
+	// RX hardware flow hash
+	mqnic_rx_set_hash(skb, priv, cpl);
+
+	// RX hardware checksum
+	if (priv->ndev->features & NETIF_F_RXCSUM) {
+		skb->csum = csum_unfold((__sum16) cpu_to_be16(le16_to_cpu(cpl->rx_csum)));
+		skb->ip_summed = CHECKSUM_COMPLETE;
+	}
+}
+
+static struct sk_buff *mqnic_rx_copybreak(struct mqnic_cq *cq, struct mqnic_ring *rx_ring,
+		const void *data, dma_addr_t dma_addr, u32 len)
+{
+	struct sk_buff *skb;
+
+	skb = napi_alloc_skb(&cq->napi, len);
+	if (likely(skb))
+		skb_put_data(skb, data, len);
+
+	// buffer stays on the ring; hand it back to the device
+	dma_sync_single_range_for_device(rx_ring->dev, dma_addr, 0, len,
+			page_pool_get_dma_dir(rx_ring->page_pool));
+
+	return skb;
+}
+
+static void mqnic_rx_multi(struct mqnic_cq *cq, struct mqnic_ring *rx_ring,
+		u32 ring_index, struct mqnic_cpl *cpl)
+{
+	struct mqnic_rx_info *rx_info = &rx_ring->rx_info[ring_index];
+	struct mqnic_rx_frag *frag;
+	struct sk_buff *skb;
+	u32 hdr_len;
+	u32 len;
+	u32 flen;
+	u32 i;
+
+	len = min_t(u32, le16_to_cpu(cpl->len), rx_info->len);
+	hdr_len = min_t(u32, len, rx_ring->rx_hdr_len);
+
+	u64_stats_update_begin(&rx_ring->syncp);
+	rx_ring->packets++;
+	rx_ring->bytes += le16_to_cpu(cpl->len);
+	u64_stats_update_end(&rx_ring->syncp);
+
+	if (!hdr_len && len <= READ_ONCE(rx_ring->priv->rx_copybreak)) {
+		// small frame; copy it out and leave the buffer in the slot
+		frag = &rx_info->frags[0];
+
+		dma_sync_single_range_for_cpu(rx_ring->dev, frag->dma_addr, 0,
+				len, page_pool_get_dma_dir(rx_ring->page_pool));
+
+		skb = mqnic_rx_copybreak(cq, rx_ring, page_address(frag->page) + frag->page_offset,
+				frag->dma_addr, len);
+		rx_info->len = 0;
+		if (unlikely(!skb)) {
+			u64_stats_update_begin(&rx_ring->syncp);
+			rx_ring->dropped_packets++;
+			u64_stats_update_end(&rx_ring->syncp);
+			return;
+		}
+
+		mqnic_rx_fill_skb_meta(cq, rx_ring, cpl, skb);
+
+		skb->protocol = eth_type_trans(skb, rx_ring->priv->ndev);
+		napi_gro_receive(&cq->napi, skb);
+		return;
+	}
+
+	if (hdr_len)
+		skb = napi_alloc_skb(&cq->napi, hdr_len);
+	else
+		skb = napi_get_frags(&cq->napi);
+	if (unlikely(!skb)) {
+		// payload buffers stay in the slot and are reposted on refill
+		rx_info->len = 0;
+		u64_stats_update_begin(&rx_ring->syncp);
+		rx_ring->dropped_packets++;
+		u64_stats_update_end(&rx_ring->syncp);
+		return;
+	}
+
+	// header slab is coherent, copy the headers into the linear area
+	if (hdr_len) {
+		skb_put_data(skb, rx_ring->rx_hdr_buf + ring_index * MQNIC_RX_HDR_STRIDE, hdr_len);
+		len -= hdr_len;
+	}
+
+	// attach payload pages; unused ones stay in the slot
+	for (i = 0; len && i < rx_ring->rx_frag_count; i++) {
+		frag = &rx_info->frags[i];
+		flen = min_t(u32, len, rx_ring->rx_buf_size);
+
+		dma_sync_single_range_for_cpu(rx_ring->dev, frag->dma_addr, 0,
+				flen, page_pool_get_dma_dir(rx_ring->page_pool));
+
+		skb_add_rx_frag(skb, i, frag->page, frag->page_offset, flen, rx_ring->rx_buf_size);
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 15, 0)
+		page_pool_release_page(rx_ring->page_pool, frag->page);
+#endif
+		frag->page = NULL;
+		frag->dma_addr = 0;
+		len -= flen;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+	skb_mark_for_recycle(skb);
+#endif
+
+	rx_info->len = 0;
+
+	mqnic_rx_fill_skb_meta(cq, rx_ring, cpl, skb);
+
+	// hand off SKB
+	if (hdr_len) {
+		skb->protocol = eth_type_trans(skb, rx_ring->priv->ndev);
+		napi_gro_receive(&cq->napi, skb);
+	} else {
+		napi_gro_frags(&cq->napi);
+	}
+}
+
 int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget)
 {
 	struct mqnic_if *interface = cq->interface;
@@ -298,6 +686,7 @@ int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget)
 	struct mqnic_priv *priv = rx_ring->priv;
 	struct mqnic_rx_info *rx_info;
 	struct mqnic_cpl *cpl;
+	struct bpf_prog *xdp_prog;
 	struct sk_buff *skb;
 	struct page *page;
 	u32 cq_index;
@@ -306,11 +695,20 @@ int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget)
 	u32 ring_cons_ptr;
 	int done = 0;
 	int budget = napi_budget;
+	bool xdp_tx = false;
+	bool xdp_redirect = false;
+	u32 offset;
 	u32 len;
+	u32 act;
 
 	if (unlikely(!priv || !priv->port_up))
 		return done;
 
+	if (rx_ring->xsk_pool)
+		return mqnic_process_rx_cq_zc(cq, napi_budget);
+
+	xdp_prog = READ_ONCE(priv->xdp_prog);
+
 	// process completion queue
 	cq_cons_ptr = cq->cons_ptr;
 	cq_index = cq_cons_ptr & cq->size_mask;
@@ -325,9 +723,23 @@ int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget)
 
 		ring_index = le16_to_cpu(cpl->index) & rx_ring->size_mask;
 		rx_info = &rx_ring->rx_info[ring_index];
+
+		if (rx_ring->rx_frag_count) {
+			if (unlikely(!rx_info->len)) {
+				netdev_err(priv->ndev, "%s: ring %d no buffers at index %d",
+						__func__, rx_ring->index, ring_index);
+				print_hex_dump(KERN_ERR, "", DUMP_PREFIX_NONE, 16, 1,
+						cpl, MQNIC_CPL_SIZE, true);
+				break;
+			}
+
+			mqnic_rx_multi(cq, rx_ring, ring_index, cpl);
+			goto next;
+		}
+
 		page = rx_info->page;
 
-		if (unlikely(!page)) {
+		if (unlikely(!page || !rx_info->len)) {
 			netdev_err(priv->ndev, "%s: ring %d null page at index %d",
 					__func__, rx_ring->index, ring_index);
 			print_hex_dump(KERN_ERR, "", DUMP_PREFIX_NONE, 16, 1,
@@ -335,59 +747,115 @@ int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget)
 			break;
 		}
 
-		skb = napi_get_frags(&cq->napi);
-		if (unlikely(!skb)) {
-			netdev_err(priv->ndev, "%s: ring %d failed to allocate skb",
-					__func__, rx_ring->index);
-			break;
-		}
+		len = min_t(u32, le16_to_cpu(cpl->len), rx_info->len);
+		offset = rx_info->page_offset;
 
-		// RX hardware timestamp
-		if (interface->if_features & MQNIC_IF_FEATURE_PTP_TS)
-			skb_hwtstamps(skb)->hwtstamp = mqnic_read_cpl_ts(interface->mdev, rx_ring, cpl);
+		// page stays mapped; it goes back to the pool when the stack frees the skb
+		dma_sync_single_range_for_cpu(dev, rx_info->dma_addr, offset,
+				len, page_pool_get_dma_dir(rx_ring->page_pool));
 
-		skb_record_rx_queue(skb, rx_ring->index);
+		u64_stats_update_begin(&rx_ring->syncp);
+		rx_ring->packets++;
+		rx_ring->bytes += le16_to_cpu(cpl->len);
+		u64_stats_update_end(&rx_ring->syncp);
+
+		if (xdp_prog) {
+			act = mqnic_rx_run_xdp(rx_ring, xdp_prog, rx_info, &offset, &len);
+
+			if (act != XDP_PASS) {
+				if (act == XDP_TX) {
+					xdp_tx = true;
+				} else if (act == XDP_REDIRECT) {
+					xdp_redirect = true;
+				} else {
+					u64_stats_update_begin(&rx_ring->syncp);
+					rx_ring->dropped_packets++;
+					u64_stats_update_end(&rx_ring->syncp);
+				}
+
+				rx_info->dma_addr = 0;
+				rx_info->page = NULL;
+				rx_info->len = 0;
+				goto next;
+			}
+		}
 
-		// RX hardware checksum
-		if (priv->ndev->features & NETIF_F_RXCSUM) {
-			skb->csum = csum_unfold((__sum16) cpu_to_be16(le16_to_cpu(cpl->rx_csum)));
-			skb->ip_summed = CHECKSUM_COMPLETE;
+		if (len <= READ_ONCE(priv->rx_copybreak)) {
+			// small frame; copy it out and leave the page on the ring
+			skb = mqnic_rx_copybreak(cq, rx_ring, page_address(page) + offset,
+					rx_info->dma_addr + offset, len);
+			rx_info->len = 0;
+			if (unlikely(!skb)) {
+				u64_stats_update_begin(&rx_ring->syncp);
+				rx_ring->dropped_packets++;
+				u64_stats_update_end(&rx_ring->syncp);
+				goto next;
+			}
+
+			mqnic_rx_fill_skb_meta(cq, rx_ring, cpl, skb);
+
+			skb->protocol = eth_type_trans(skb, priv->ndev);
+			napi_gro_receive(&cq->napi, skb);
+			goto next;
 		}
 
-		// unmap
-		dma_unmap_page(dev, dma_unmap_addr(rx_info, dma_addr),
-				dma_unmap_len(rx_info, len), DMA_FROM_DEVICE);
-		rx_info->dma_addr = 0;
+		skb = napi_get_frags(&cq->napi);
+		if (unlikely(!skb)) {
+			page_pool_recycle_direct(rx_ring->page_pool, page);
+			rx_info->dma_addr = 0;
+			rx_info->page = NULL;
+			rx_info->len = 0;
+			u64_stats_update_begin(&rx_ring->syncp);
+			rx_ring->dropped_packets++;
+			u64_stats_update_end(&rx_ring->syncp);
+			goto next;
+		}
 
-		len = min_t(u32, le16_to_cpu(cpl->len), rx_info->len);
+		mqnic_rx_fill_skb_meta(cq, rx_ring, cpl, skb);
 
-		dma_sync_single_range_for_cpu(dev, rx_info->dma_addr, rx_info->page_offset,
-				rx_info->len, DMA_FROM_DEVICE);
+		rx_info->dma_addr = 0;
 
-		__skb_fill_page_desc(skb, 0, page, rx_info->page_offset, len);
+		__skb_fill_page_desc(skb, 0, page, offset, len);
 		rx_info->page = NULL;
+		rx_info->len = 0;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+		skb_mark_for_recycle(skb);
+#else
+		page_pool_release_page(rx_ring->page_pool, page);
+#endif
 
 		skb_shinfo(skb)->nr_frags = 1;
 		skb->len = len;
 		skb->data_len = len;
-		skb->truesize += rx_info->len;
+		skb->truesize += rx_ring->rx_buf_size;
 
 		// hand off SKB
 		napi_gro_frags(&cq->napi);
 
-		rx_ring->packets++;
-		rx_ring->bytes += le16_to_cpu(cpl->len);
-
+next:
 		done++;
 
 		cq_cons_ptr++;
 		cq_index = cq_cons_ptr & cq->size_mask;
 	}
 
-	// update CQ consumer pointer
+	// update CQ consumer pointer; not deferred, as the RX CQ is only as
+	// large as the ring, which is refilled below
 	cq->cons_ptr = cq_cons_ptr;
 	mqnic_cq_write_cons_ptr(cq);
 
+	// flush XDP actions
+	if (xdp_redirect)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+		xdp_do_flush();
+#else
+		xdp_do_flush_map();
+#endif
+
+	if (xdp_tx)
+		mqnic_xdp_flush_tx(priv);
+
 	// process ring
 	ring_cons_ptr = READ_ONCE(rx_ring->cons_ptr);
 	ring_index = ring_cons_ptr & rx_ring->size_mask;
@@ -395,7 +863,7 @@ int mqnic_process_rx_cq(struct mqnic_cq *cq, int napi_budget)
 	while (ring_cons_ptr != rx_ring->prod_ptr) {
 		rx_info = &rx_ring->rx_info[ring_index];
 
-		if (rx_info->page)
+		if (rx_info->len)
 			break;
 
 		ring_cons_ptr++;
@@ -416,6 +884,21 @@ void mqnic_rx_irq(struct mqnic_cq *cq)
 	napi_schedule_irqoff(&cq->napi);
 }
 
+void mqnic_rx_set_hash(struct sk_buff *skb, struct mqnic_priv *priv, struct mqnic_cpl *cpl)
+{
+	u8 hash_type;
+
+	if (!(priv->ndev->features & NETIF_F_RXHASH))
+		return;
+
+	hash_type = cpl->rx_hash_type;
+
+	if (hash_type & (MQNIC_RX_HASH_TYPE_TCP | MQNIC_RX_HASH_TYPE_UDP))
+		skb_set_hash(skb, le32_to_cpu(cpl->rx_hash), PKT_HASH_TYPE_L4);
+	else if (hash_type & (MQNIC_RX_HASH_TYPE_IPV4 | MQNIC_RX_HASH_TYPE_IPV6))
+		skb_set_hash(skb, le32_to_cpu(cpl->rx_hash), PKT_HASH_TYPE_L3);
+}
+
 int mqnic_poll_rx_cq(struct napi_struct *napi, int budget)
 {
 	struct mqnic_cq *cq = container_of(napi, struct mqnic_cq, napi);
@@ -426,9 +909,38 @@ int mqnic_poll_rx_cq(struct napi_struct *napi, int budget)
 	if (done == budget)
 		return done;
 
-	napi_complete(napi);
+	// leave CQ unarmed while a busy poller owns the NAPI context
+	if (!napi_complete_done(napi, done)) {
+		mqnic_cq_write_cons_ptr(cq);
+		return done;
+	}
+
+	if (cq->src_ring && READ_ONCE(cq->src_ring->priv->rx_dim_enabled)) {
+		struct mqnic_ring *ring = cq->src_ring;
+		struct dim_sample sample = {};
+
+		dim_update_sample(cq->dim_event_ctr++, ring->packets, ring->bytes, &sample);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+		net_dim(&cq->dim, &sample);
+#else
+		net_dim(&cq->dim, sample);
+#endif
+	}
 
 	mqnic_arm_cq(cq);
 
 	return done;
 }
+
+void mqnic_rx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct mqnic_cq *cq = container_of(dim, struct mqnic_cq, dim);
+	struct dim_cq_moder moder;
+
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+
+	mqnic_cq_set_holdoff(cq, moder.usec, moder.pkts);
+
+	dim->state = DIM_START_MEASURE;
+}
@@ -35,6 +35,60 @@ struct mqnic_sched *mqnic_create_scheduler(struct mqnic_sched_block *block,
 	dev_info(dev, "Scheduler channel count: %d", sched->channel_count);
 	dev_info(dev, "Scheduler channel stride: 0x%08x", sched->channel_stride);
 
+	sched->shaper_rb = mqnic_find_reg_block(block->rb_list, MQNIC_RB_SCHED_CTRL_SHAPER_TYPE,
+			MQNIC_RB_SCHED_CTRL_SHAPER_VER, index);
+
+	if (sched->shaper_rb) {
+		sched->shaper_offset = ioread32(sched->shaper_rb->regs + MQNIC_RB_SCHED_CTRL_SHAPER_REG_OFFSET);
+		sched->shaper_channel_count = ioread32(sched->shaper_rb->regs + MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_COUNT);
+		sched->shaper_channel_stride = ioread32(sched->shaper_rb->regs + MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_STRIDE);
+		sched->shaper_refill_period = ioread32(sched->shaper_rb->regs + MQNIC_RB_SCHED_CTRL_SHAPER_REG_REFILL_PERIOD);
+
+		sched->shaper_hw_addr = block->interface->hw_addr + sched->shaper_offset;
+
+		dev_info(dev, "Shaper offset: 0x%08x", sched->shaper_offset);
+		dev_info(dev, "Shaper channel count: %d", sched->shaper_channel_count);
+		dev_info(dev, "Shaper channel stride: 0x%08x", sched->shaper_channel_stride);
+		dev_info(dev, "Shaper refill period: %d cycles", sched->shaper_refill_period);
+
+		sched->shaped_channels = bitmap_zalloc(sched->channel_count, GFP_KERNEL);
+		if (!sched->shaped_channels) {
+			kfree(sched);
+			return ERR_PTR(-ENOMEM);
+		}
+	}
+
+	sched->tdma_ctrl_rb = mqnic_find_reg_block(block->rb_list, MQNIC_RB_SCHED_CTRL_TDMA_TYPE,
+			MQNIC_RB_SCHED_CTRL_TDMA_VER, index);
+	sched->tdma_rb = mqnic_find_reg_block(block->rb_list, MQNIC_RB_TDMA_SCH_TYPE,
+			MQNIC_RB_TDMA_SCH_VER, index);
+
+	if (sched->tdma_ctrl_rb && sched->tdma_rb) {
+		sched->tdma_ctrl_offset = ioread32(sched->tdma_ctrl_rb->regs + MQNIC_RB_SCHED_CTRL_TDMA_REG_OFFSET);
+		sched->tdma_ctrl_channel_count = ioread32(sched->tdma_ctrl_rb->regs + MQNIC_RB_SCHED_CTRL_TDMA_REG_CH_COUNT);
+		sched->tdma_ctrl_channel_stride = ioread32(sched->tdma_ctrl_rb->regs + MQNIC_RB_SCHED_CTRL_TDMA_REG_CH_STRIDE);
+		sched->tdma_timeslot_count = ioread32(sched->tdma_ctrl_rb->regs + MQNIC_RB_SCHED_CTRL_TDMA_REG_TS_COUNT);
+
+		sched->tdma_ctrl_hw_addr = block->interface->hw_addr + sched->tdma_ctrl_offset;
+
+		dev_info(dev, "TDMA controller offset: 0x%08x", sched->tdma_ctrl_offset);
+		dev_info(dev, "TDMA controller channel count: %d", sched->tdma_ctrl_channel_count);
+		dev_info(dev, "TDMA controller channel stride: 0x%08x", sched->tdma_ctrl_channel_stride);
+		dev_info(dev, "TDMA timeslot count: %d", sched->tdma_timeslot_count);
+
+		sched->gated_channels = bitmap_zalloc(sched->channel_count, GFP_KERNEL);
+		if (!sched->gated_channels) {
+			bitmap_free(sched->shaped_channels);
+			kfree(sched);
+			return ERR_PTR(-ENOMEM);
+		}
+
+		mqnic_scheduler_tdma_disable(sched);
+	} else {
+		sched->tdma_ctrl_rb = NULL;
+		sched->tdma_rb = NULL;
+	}
+
 	mqnic_scheduler_disable(sched);
 
 	return sched;
@@ -44,9 +98,26 @@ void mqnic_destroy_scheduler(struct mqnic_sched *sched)
 {
 	mqnic_scheduler_disable(sched);
 
+	if (sched->tdma_rb)
+		mqnic_scheduler_tdma_disable(sched);
+
+	bitmap_free(sched->shaped_channels);
+	bitmap_free(sched->gated_channels);
 	kfree(sched);
 }
 
+static u32 mqnic_scheduler_channel_ctrl(struct mqnic_sched *sched, int ch)
+{
+	// shaped and gated channels are enabled by the scheduler controller
+	// rather than globally
+	if (sched->shaped_channels && test_bit(ch, sched->shaped_channels))
+		return 1;
+	if (sched->gated_channels && test_bit(ch, sched->gated_channels))
+		return 1;
+
+	return 3;
+}
+
 int mqnic_scheduler_enable(struct mqnic_sched *sched)
 {
 	int k;
@@ -56,7 +127,7 @@ int mqnic_scheduler_enable(struct mqnic_sched *sched)
 
 	// enable queues
 	for (k = 0; k < sched->channel_count; k++)
-		iowrite32(3, sched->hw_addr + k * sched->channel_stride);
+		iowrite32(mqnic_scheduler_channel_ctrl(sched, k), sched->hw_addr + k * sched->channel_stride);
 
 	return 0;
 }
@@ -68,3 +139,134 @@ void mqnic_scheduler_disable(struct mqnic_sched *sched)
 	iowrite32(0, sched->rb->regs + MQNIC_RB_SCHED_RR_REG_CTRL);
 }
 EXPORT_SYMBOL(mqnic_scheduler_disable);
+
+int mqnic_scheduler_set_channel_shaper(struct mqnic_sched *sched, int ch, u64 rate, u32 quantum)
+{
+	u8 __iomem *addr;
+	u32 rate_per_period = 0;
+	u32 clk_hz;
+
+	if (!sched->shaper_rb)
+		return -EOPNOTSUPP;
+
+	if (ch < 0 || ch >= sched->shaper_channel_count || ch >= sched->channel_count)
+		return -EINVAL;
+
+	if (rate) {
+		clk_hz = mqnic_get_core_clk_nom_freq_hz(sched->interface->mdev);
+		if (!clk_hz || !sched->shaper_refill_period)
+			return -EOPNOTSUPP;
+
+		// rate in bytes per second to bytes per refill period
+		rate = mul_u64_u32_div(rate, sched->shaper_refill_period, clk_hz);
+		rate_per_period = clamp_t(u64, rate, 1, S32_MAX);
+	}
+
+	quantum = min_t(u32, quantum, S32_MAX);
+
+	addr = sched->shaper_hw_addr + ch * sched->shaper_channel_stride;
+
+	iowrite32(rate_per_period, addr + MQNIC_SCHED_SHAPER_CH_REG_RATE);
+	iowrite32(quantum, addr + MQNIC_SCHED_SHAPER_CH_REG_QUANTUM);
+
+	if (rate_per_period || quantum)
+		set_bit(ch, sched->shaped_channels);
+	else
+		clear_bit(ch, sched->shaped_channels);
+
+	iowrite32(mqnic_scheduler_channel_ctrl(sched, ch), sched->hw_addr + ch * sched->channel_stride);
+
+	return 0;
+}
+EXPORT_SYMBOL(mqnic_scheduler_set_channel_shaper);
+
+int mqnic_scheduler_set_channel_timeslots(struct mqnic_sched *sched, int ch,
+		const unsigned long *timeslots)
+{
+	u8 __iomem *addr;
+	u32 val;
+	int k, j;
+
+	if (!sched->tdma_rb)
+		return -EOPNOTSUPP;
+
+	if (ch < 0 || ch >= sched->tdma_ctrl_channel_count || ch >= sched->channel_count)
+		return -EINVAL;
+
+	addr = sched->tdma_ctrl_hw_addr + ch * sched->tdma_ctrl_channel_stride;
+
+	// one enable bit per timeslot
+	for (k = 0; k < sched->tdma_ctrl_channel_stride / 4; k++) {
+		val = 0;
+
+		for (j = 0; timeslots && j < 32 && k * 32 + j < sched->tdma_timeslot_count; j++)
+			if (test_bit(k * 32 + j, timeslots))
+				val |= BIT(j);
+
+		iowrite32(val, addr + k * 4);
+	}
+
+	if (timeslots)
+		set_bit(ch, sched->gated_channels);
+	else
+		clear_bit(ch, sched->gated_channels);
+
+	iowrite32(mqnic_scheduler_channel_ctrl(sched, ch), sched->hw_addr + ch * sched->channel_stride);
+
+	return 0;
+}
+EXPORT_SYMBOL(mqnic_scheduler_set_channel_timeslots);
+
+int mqnic_scheduler_tdma_enable(struct mqnic_sched *sched, u64 start_ns, u64 period_ns,
+		u64 timeslot_period_ns, u64 active_period_ns)
+{
+	struct mqnic_reg_block *rb = sched->tdma_rb;
+	u32 start_nsec, period_nsec, ts_period_nsec, active_period_nsec;
+	u64 start_sec, period_sec, ts_period_sec, active_period_sec;
+
+	if (!rb)
+		return -EOPNOTSUPP;
+
+	start_sec = div_u64_rem(start_ns, NSEC_PER_SEC, &start_nsec);
+	period_sec = div_u64_rem(period_ns, NSEC_PER_SEC, &period_nsec);
+	ts_period_sec = div_u64_rem(timeslot_period_ns, NSEC_PER_SEC, &ts_period_nsec);
+	active_period_sec = div_u64_rem(active_period_ns, NSEC_PER_SEC, &active_period_nsec);
+
+	dev_info(sched->dev, "%s: start: %llu.%09u", __func__, start_sec, start_nsec);
+	dev_info(sched->dev, "%s: period: %llu.%09u", __func__, period_sec, period_nsec);
+	dev_info(sched->dev, "%s: timeslot period: %llu.%09u", __func__, ts_period_sec, ts_period_nsec);
+	dev_info(sched->dev, "%s: active period: %llu.%09u", __func__, active_period_sec, active_period_nsec);
+
+	// each value is loaded on write to its high seconds word; periods
+	// must be in place before the start time
+	iowrite32(0, rb->regs + MQNIC_RB_TDMA_SCH_REG_TS_PERIOD_FNS);
+	iowrite32(ts_period_nsec, rb->regs + MQNIC_RB_TDMA_SCH_REG_TS_PERIOD_NS);
+	iowrite32(ts_period_sec & 0xffffffff, rb->regs + MQNIC_RB_TDMA_SCH_REG_TS_PERIOD_SEC_L);
+	iowrite32(ts_period_sec >> 32, rb->regs + MQNIC_RB_TDMA_SCH_REG_TS_PERIOD_SEC_H);
+
+	iowrite32(0, rb->regs + MQNIC_RB_TDMA_SCH_REG_ACTIVE_PERIOD_FNS);
+	iowrite32(active_period_nsec, rb->regs + MQNIC_RB_TDMA_SCH_REG_ACTIVE_PERIOD_NS);
+	iowrite32(active_period_sec & 0xffffffff, rb->regs + MQNIC_RB_TDMA_SCH_REG_ACTIVE_PERIOD_SEC_L);
+	iowrite32(active_period_sec >> 32, rb->regs + MQNIC_RB_TDMA_SCH_REG_ACTIVE_PERIOD_SEC_H);
+
+	iowrite32(0, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_PERIOD_FNS);
+	iowrite32(period_nsec, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_PERIOD_NS);
+	iowrite32(period_sec & 0xffffffff, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_PERIOD_SEC_L);
+	iowrite32(period_sec >> 32, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_PERIOD_SEC_H);
+
+	iowrite32(0, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_START_FNS);
+	iowrite32(start_nsec, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_START_NS);
+	iowrite32(start_sec & 0xffffffff, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_START_SEC_L);
+	iowrite32(start_sec >> 32, rb->regs + MQNIC_RB_TDMA_SCH_REG_SCH_START_SEC_H);
+
+	iowrite32(1, rb->regs + MQNIC_RB_TDMA_SCH_REG_CTRL);
+
+	return 0;
+}
+EXPORT_SYMBOL(mqnic_scheduler_tdma_enable);
+
+void mqnic_scheduler_tdma_disable(struct mqnic_sched *sched)
+{
+	iowrite32(0, sched->tdma_rb->regs + MQNIC_RB_TDMA_SCH_REG_CTRL);
+}
+EXPORT_SYMBOL(mqnic_scheduler_tdma_disable);
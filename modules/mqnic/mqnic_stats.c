@@ -5,8 +5,81 @@
 
 #include "mqnic.h"
 
+// statistics block layout of the core; unnamed entries are not reported
+static const char *mqnic_stats_names[] = {
+	// PCIe stats
+	"pcie_rx_tlp_mem_rd",      // index 0
+	"pcie_rx_tlp_mem_wr",      // index 1
+	"pcie_rx_tlp_io",          // index 2
+	"pcie_rx_tlp_cfg",         // index 3
+	"pcie_rx_tlp_msg",         // index 4
+	"pcie_rx_tlp_cpl",         // index 5
+	"pcie_rx_tlp_cpl_ur",      // index 6
+	"pcie_rx_tlp_cpl_ca",      // index 7
+	"pcie_rx_tlp_atomic",      // index 8
+	"pcie_rx_tlp_ep",          // index 9
+	"pcie_rx_tlp_hdr_dw",      // index 10
+	"pcie_rx_tlp_req_dw",      // index 11
+	"pcie_rx_tlp_payload_dw",  // index 12
+	"pcie_rx_tlp_cpl_dw",      // index 13
+	"",                        // index 14
+	"",                        // index 15
+	"pcie_tx_tlp_mem_rd",      // index 16
+	"pcie_tx_tlp_mem_wr",      // index 17
+	"pcie_tx_tlp_io",          // index 18
+	"pcie_tx_tlp_cfg",         // index 19
+	"pcie_tx_tlp_msg",         // index 20
+	"pcie_tx_tlp_cpl",         // index 21
+	"pcie_tx_tlp_cpl_ur",      // index 22
+	"pcie_tx_tlp_cpl_ca",      // index 23
+	"pcie_tx_tlp_atomic",      // index 24
+	"pcie_tx_tlp_ep",          // index 25
+	"pcie_tx_tlp_hdr_dw",      // index 26
+	"pcie_tx_tlp_req_dw",      // index 27
+	"pcie_tx_tlp_payload_dw",  // index 28
+	"pcie_tx_tlp_cpl_dw",      // index 29
+	"",                        // index 30
+	"",                        // index 31
+
+	// DMA statistics
+	"dma_rd_op_count",         // index 0
+	"dma_rd_op_bytes",         // index 1
+	"dma_rd_op_latency",       // index 2
+	"dma_rd_op_error",         // index 3
+	"dma_rd_req_count",        // index 4
+	"dma_rd_req_latency",      // index 5
+	"dma_rd_req_timeout",      // index 6
+	"dma_rd_op_table_full",    // index 7
+	"dma_rd_no_tags",          // index 8
+	"dma_rd_tx_limit",         // index 9
+	"dma_rd_tx_stall",         // index 10
+	"",                        // index 11
+	"",                        // index 12
+	"",                        // index 13
+	"",                        // index 14
+	"",                        // index 15
+	"dma_wr_op_count",         // index 16
+	"dma_wr_op_bytes",         // index 17
+	"dma_wr_op_latency",       // index 18
+	"dma_wr_op_error",         // index 19
+	"dma_wr_req_count",        // index 20
+	"dma_wr_req_latency",      // index 21
+	"",                        // index 22
+	"dma_wr_op_table_full",    // index 23
+	"",                        // index 24
+	"dma_wr_tx_limit",         // index 25
+	"dma_wr_tx_stall",         // index 26
+	"",                        // index 27
+	"",                        // index 28
+	"",                        // index 29
+	"",                        // index 30
+	"",                        // index 31
+};
+
 void mqnic_stats_init(struct mqnic_dev *mdev)
 {
+	mutex_init(&mdev->stats_cache_lock);
+
 	mdev->stats_rb = mqnic_find_reg_block(mdev->rb_list, MQNIC_RB_STATS_TYPE, MQNIC_RB_STATS_VER, 0);
 
 	if (!mdev->stats_rb)
@@ -16,6 +89,10 @@ void mqnic_stats_init(struct mqnic_dev *mdev)
 	mdev->stats_count = ioread32(mdev->stats_rb->regs + MQNIC_RB_STATS_REG_COUNT);
 	mdev->stats_stride = ioread32(mdev->stats_rb->regs + MQNIC_RB_STATS_REG_STRIDE);
 	mdev->stats_flags = ioread32(mdev->stats_rb->regs + MQNIC_RB_STATS_REG_FLAGS);
+
+	mdev->stats_cache = devm_kcalloc(mdev->dev, mdev->stats_count, sizeof(*mdev->stats_cache), GFP_KERNEL);
+	if (!mdev->stats_cache)
+		dev_warn(mdev->dev, "Failed to allocate statistics cache");
 }
 
 u64 mqnic_stats_read(struct mqnic_dev *mdev, int index)
@@ -31,3 +108,68 @@ u64 mqnic_stats_read(struct mqnic_dev *mdev, int index)
 	return val;
 }
 EXPORT_SYMBOL(mqnic_stats_read);
+
+static int mqnic_stats_named_limit(struct mqnic_dev *mdev)
+{
+	if (!mdev->stats_rb || !mdev->stats_cache)
+		return 0;
+
+	return min_t(int, mdev->stats_count, ARRAY_SIZE(mqnic_stats_names));
+}
+
+int mqnic_stats_get_named_count(struct mqnic_dev *mdev)
+{
+	int limit = mqnic_stats_named_limit(mdev);
+	int count = 0;
+	int k;
+
+	for (k = 0; k < limit; k++)
+		if (mqnic_stats_names[k][0])
+			count++;
+
+	return count;
+}
+
+void mqnic_stats_get_named_strings(struct mqnic_dev *mdev, u8 *data)
+{
+	int limit = mqnic_stats_named_limit(mdev);
+	int k;
+
+	for (k = 0; k < limit; k++) {
+		if (!mqnic_stats_names[k][0])
+			continue;
+
+		strscpy(data, mqnic_stats_names[k], ETH_GSTRING_LEN);
+		data += ETH_GSTRING_LEN;
+	}
+}
+
+void mqnic_stats_get_named(struct mqnic_dev *mdev, u64 *data)
+{
+	int limit = mqnic_stats_named_limit(mdev);
+	unsigned int refresh_ms = READ_ONCE(mqnic_stats_refresh_ms);
+	int k;
+
+	if (!limit)
+		return;
+
+	mutex_lock(&mdev->stats_cache_lock);
+
+	// read the whole block in one burst when the snapshot is stale, so
+	// frequent polling costs at most one pass over MMIO per interval
+	if (!mdev->stats_cache_valid || !refresh_ms ||
+			time_after(jiffies, mdev->stats_cache_jiffies + msecs_to_jiffies(refresh_ms))) {
+		for (k = 0; k < limit; k++)
+			if (mqnic_stats_names[k][0])
+				mdev->stats_cache[k] = mqnic_stats_read(mdev, k);
+
+		mdev->stats_cache_jiffies = jiffies;
+		mdev->stats_cache_valid = true;
+	}
+
+	for (k = 0; k < limit; k++)
+		if (mqnic_stats_names[k][0])
+			*data++ = mdev->stats_cache[k];
+
+	mutex_unlock(&mdev->stats_cache_lock);
+}
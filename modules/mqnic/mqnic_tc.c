@@ -0,0 +1,628 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <linux/gcd.h>
+#include <net/pkt_cls.h>
+#include <net/pkt_sched.h>
+
+static struct mqnic_sched *mqnic_get_tx_shaper(struct mqnic_priv *priv)
+{
+	struct mqnic_sched *sched;
+
+	// start_port only activates the first scheduler block
+	if (!priv->sched_block_count || !priv->sched_block[0]->sched_count)
+		return NULL;
+
+	sched = priv->sched_block[0]->sched[0];
+
+	if (!sched->shaper_rb)
+		return NULL;
+
+	return sched;
+}
+
+bool mqnic_has_tx_shaper(struct mqnic_priv *priv)
+{
+	return mqnic_get_tx_shaper(priv) != NULL;
+}
+
+// the shaper config is per netdev queue k, the channel is the hardware index
+static int mqnic_set_ring_shaper(struct net_device *ndev, struct mqnic_sched *sched,
+		struct mqnic_ring *ring, int k)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_tx_shaper *cfg = &priv->tx_shaper[k];
+	u64 rate;
+	int ret;
+
+	// per-queue limit from ndo_set_tx_maxrate (Mbps) overrides the
+	// share of the traffic class limit from mqprio (bytes/s)
+	if (cfg->maxrate)
+		rate = (u64)cfg->maxrate * 1000000 / 8;
+	else
+		rate = cfg->tc_rate;
+
+	ret = mqnic_scheduler_set_channel_shaper(sched, ring->index, rate, cfg->quantum);
+	if (ret)
+		netdev_err(ndev, "%s: failed to configure TX queue %d shaper: %d",
+				__func__, k, ret);
+
+	return ret;
+}
+
+static void mqnic_clear_ring_shaper(struct mqnic_sched *sched, struct mqnic_ring *ring)
+{
+	if (ring->index >= 0 && ring->index < sched->channel_count &&
+			test_bit(ring->index, sched->shaped_channels))
+		mqnic_scheduler_set_channel_shaper(sched, ring->index, 0, 0);
+}
+
+int mqnic_update_tx_shaper(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_sched *sched = mqnic_get_tx_shaper(priv);
+	struct mqnic_ring_table *txq_table;
+	int ret = 0;
+	int k;
+
+	if (!sched)
+		return 0;
+
+	down_read(&priv->txq_table_sem);
+	txq_table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+
+	for (k = 0; txq_table && k < txq_table->count; k++) {
+		if (!txq_table->ring[k])
+			continue;
+
+		ret = mqnic_set_ring_shaper(ndev, sched, txq_table->ring[k], k);
+		if (ret)
+			break;
+	}
+
+	up_read(&priv->txq_table_sem);
+
+	return ret;
+}
+
+void mqnic_clear_tx_shaper(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_sched *sched = mqnic_get_tx_shaper(priv);
+	struct mqnic_ring_table *txq_table;
+	int k;
+
+	if (!sched)
+		return;
+
+	// return hardware queues to the pool unshaped
+	down_read(&priv->txq_table_sem);
+	txq_table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+
+	for (k = 0; txq_table && k < txq_table->count; k++) {
+		if (txq_table->ring[k])
+			mqnic_clear_ring_shaper(sched, txq_table->ring[k]);
+	}
+
+	up_read(&priv->txq_table_sem);
+}
+
+// a reopened TX ring gets a new hardware index, so its shaper is cleared
+// before the ring is closed and programmed again once it is open
+int mqnic_update_tx_ring_shaper(struct net_device *ndev, struct mqnic_ring *ring, int k)
+{
+	struct mqnic_sched *sched = mqnic_get_tx_shaper(netdev_priv(ndev));
+
+	if (!sched)
+		return 0;
+
+	return mqnic_set_ring_shaper(ndev, sched, ring, k);
+}
+
+void mqnic_clear_tx_ring_shaper(struct net_device *ndev, struct mqnic_ring *ring)
+{
+	struct mqnic_sched *sched = mqnic_get_tx_shaper(netdev_priv(ndev));
+
+	if (sched)
+		mqnic_clear_ring_shaper(sched, ring);
+}
+
+int mqnic_set_tx_maxrate(struct net_device *ndev, int queue_index, u32 maxrate)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	int ret = 0;
+
+	if (!mqnic_has_tx_shaper(priv))
+		return -EOPNOTSUPP;
+
+	if (queue_index < 0 || queue_index >= ndev->num_tx_queues)
+		return -EINVAL;
+
+	mutex_lock(&mdev->state_lock);
+
+	priv->tx_shaper[queue_index].maxrate = maxrate;
+
+	if (priv->port_up)
+		ret = mqnic_update_tx_shaper(ndev);
+
+	mutex_unlock(&mdev->state_lock);
+
+	return ret;
+}
+
+static struct mqnic_sched *mqnic_get_tx_tdma(struct mqnic_priv *priv)
+{
+	struct mqnic_sched *sched;
+
+	if (!priv->sched_block_count || !priv->sched_block[0]->sched_count)
+		return NULL;
+
+	sched = priv->sched_block[0]->sched[0];
+
+	// schedule times are in terms of the PHC
+	if (!sched->tdma_rb || !priv->mdev->phc_rb)
+		return NULL;
+
+	return sched;
+}
+
+bool mqnic_has_tx_tdma(struct mqnic_priv *priv)
+{
+	return mqnic_get_tx_tdma(priv) != NULL;
+}
+
+// gate the hardware channel of netdev queue k by the timeslots of its class
+static int mqnic_set_ring_timeslots(struct net_device *ndev, struct mqnic_sched *sched,
+		struct mqnic_ring *ring, int k, unsigned long *timeslots)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_tx_tdma *tdma = &priv->tx_tdma;
+	int ret;
+	int tc, j;
+
+	// gate mask bits select traffic classes, or queues without mqprio
+	tc = netdev_get_num_tc(ndev) ? netdev_txq_to_tc(ndev, k) : k;
+
+	bitmap_zero(timeslots, sched->tdma_timeslot_count);
+
+	for (j = 0; tc >= 0 && tc < 32 && j < tdma->timeslot_count; j++)
+		if (tdma->gate_mask[j] & BIT(tc))
+			set_bit(j, timeslots);
+
+	ret = mqnic_scheduler_set_channel_timeslots(sched, ring->index, timeslots);
+	if (ret)
+		netdev_err(ndev, "%s: failed to configure TX queue %d timeslots: %d",
+				__func__, k, ret);
+
+	return ret;
+}
+
+static void mqnic_clear_ring_timeslots(struct mqnic_sched *sched, struct mqnic_ring *ring)
+{
+	if (ring->index >= 0 && ring->index < sched->channel_count &&
+			test_bit(ring->index, sched->gated_channels))
+		mqnic_scheduler_set_channel_timeslots(sched, ring->index, NULL);
+}
+
+int mqnic_update_tx_tdma(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	struct mqnic_sched *sched = mqnic_get_tx_tdma(priv);
+	struct mqnic_tx_tdma *tdma = &priv->tx_tdma;
+	struct mqnic_ring_table *txq_table;
+	unsigned long *timeslots;
+	struct timespec64 ts;
+	u64 start, now;
+	int ret = 0;
+	int k;
+
+	if (!sched || !tdma->enabled)
+		return 0;
+
+	timeslots = bitmap_zalloc(sched->tdma_timeslot_count, GFP_KERNEL);
+	if (!timeslots)
+		return -ENOMEM;
+
+	down_read(&priv->txq_table_sem);
+	txq_table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+
+	for (k = 0; txq_table && k < txq_table->count; k++) {
+		if (!txq_table->ring[k])
+			continue;
+
+		ret = mqnic_set_ring_timeslots(ndev, sched, txq_table->ring[k], k, timeslots);
+		if (ret)
+			break;
+	}
+
+	up_read(&priv->txq_table_sem);
+
+	bitmap_free(timeslots);
+
+	if (ret)
+		return ret;
+
+	// the hardware walks the schedule forward one period at a time to
+	// catch up, so start it on the next cycle boundary
+	mdev->ptp_clock_info.gettime64(&mdev->ptp_clock_info, &ts);
+	now = timespec64_to_ns(&ts);
+
+	start = tdma->base_time;
+	if (start < now)
+		start += div64_u64(now - start + tdma->cycle_time - 1, tdma->cycle_time) * tdma->cycle_time;
+
+	return mqnic_scheduler_tdma_enable(sched, start, tdma->cycle_time,
+			tdma->timeslot_period, tdma->timeslot_period);
+}
+
+void mqnic_clear_tx_tdma(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_sched *sched = mqnic_get_tx_tdma(priv);
+	struct mqnic_ring_table *txq_table;
+	int k;
+
+	if (!sched)
+		return;
+
+	mqnic_scheduler_tdma_disable(sched);
+
+	// return hardware queues to the pool ungated
+	down_read(&priv->txq_table_sem);
+	txq_table = rcu_dereference_protected(priv->txq_table,
+			lockdep_is_held(&priv->txq_table_sem));
+
+	for (k = 0; txq_table && k < txq_table->count; k++) {
+		if (txq_table->ring[k])
+			mqnic_clear_ring_timeslots(sched, txq_table->ring[k]);
+	}
+
+	up_read(&priv->txq_table_sem);
+}
+
+// as with the shaper, timeslots follow the ring to its new hardware index;
+// the running schedule itself is left alone
+int mqnic_update_tx_ring_tdma(struct net_device *ndev, struct mqnic_ring *ring, int k)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_sched *sched = mqnic_get_tx_tdma(priv);
+	unsigned long *timeslots;
+	int ret;
+
+	if (!sched || !priv->tx_tdma.enabled)
+		return 0;
+
+	timeslots = bitmap_zalloc(sched->tdma_timeslot_count, GFP_KERNEL);
+	if (!timeslots)
+		return -ENOMEM;
+
+	ret = mqnic_set_ring_timeslots(ndev, sched, ring, k, timeslots);
+
+	bitmap_free(timeslots);
+
+	return ret;
+}
+
+void mqnic_clear_tx_ring_tdma(struct net_device *ndev, struct mqnic_ring *ring)
+{
+	struct mqnic_sched *sched = mqnic_get_tx_tdma(netdev_priv(ndev));
+
+	if (sched)
+		mqnic_clear_ring_timeslots(sched, ring);
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
+static int mqnic_setup_tc_mqprio(struct net_device *ndev, struct tc_mqprio_qopt_offload *mqprio)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	u8 num_tc = mqprio->qopt.num_tc;
+	bool rlimit = mqprio->shaper == TC_MQPRIO_SHAPER_BW_RLIMIT;
+	int ret = 0;
+	int tc, k;
+
+	if (num_tc) {
+		if (mqprio->mode != TC_MQPRIO_MODE_DCB && mqprio->mode != TC_MQPRIO_MODE_CHANNEL)
+			return -EOPNOTSUPP;
+
+		if (rlimit && !mqnic_has_tx_shaper(priv))
+			return -EOPNOTSUPP;
+
+		for (tc = 0; tc < num_tc; tc++) {
+			if (!mqprio->qopt.count[tc] ||
+					mqprio->qopt.offset[tc] + mqprio->qopt.count[tc] > priv->txq_count)
+				return -EINVAL;
+
+			// the shaper only enforces upper limits
+			if (rlimit && mqprio->min_rate[tc]) {
+				netdev_err(ndev, "%s: minimum rate not supported", __func__);
+				return -EOPNOTSUPP;
+			}
+		}
+	}
+
+	mutex_lock(&mdev->state_lock);
+
+	for (k = 0; k < ndev->num_tx_queues; k++)
+		priv->tx_shaper[k].tc_rate = 0;
+
+	if (!num_tc) {
+		netdev_reset_tc(ndev);
+		goto update;
+	}
+
+	ret = netdev_set_num_tc(ndev, num_tc);
+	if (ret)
+		goto out;
+
+	for (tc = 0; tc < num_tc; tc++) {
+		u16 count = mqprio->qopt.count[tc];
+		u16 offset = mqprio->qopt.offset[tc];
+
+		netdev_set_tc_queue(ndev, tc, count, offset);
+
+		// the traffic class limit is split evenly across its queues
+		if (rlimit && mqprio->max_rate[tc])
+			for (k = offset; k < offset + count; k++)
+				priv->tx_shaper[k].tc_rate = max_t(u64, div_u64(mqprio->max_rate[tc], count), 1);
+	}
+
+	for (k = 0; k <= TC_BITMASK; k++)
+		netdev_set_prio_tc_map(ndev, k, mqprio->qopt.prio_tc_map[k]);
+
+	mqprio->qopt.hw = TC_MQPRIO_HW_OFFLOAD_TCS;
+
+update:
+	if (priv->port_up)
+		ret = mqnic_update_tx_shaper(ndev);
+
+out:
+	mutex_unlock(&mdev->state_lock);
+
+	return ret;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+static int mqnic_ets_replace(struct net_device *ndev, struct tc_ets_qopt_offload *ets)
+{
+	struct tc_ets_qopt_offload_replace_params *p = &ets->replace_params;
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	unsigned int count;
+	int ret = 0;
+	int band, k;
+
+	if (ets->parent != TC_H_ROOT || !mqnic_has_tx_shaper(priv))
+		return -EOPNOTSUPP;
+
+	if (!p->bands || p->bands > priv->txq_count || p->bands > TC_MAX_QUEUE)
+		return -EOPNOTSUPP;
+
+	// the round-robin scheduler has no strict priority
+	for (band = 0; band < p->bands; band++) {
+		if (!p->quanta[band]) {
+			netdev_err(ndev, "%s: strict priority bands not supported", __func__);
+			return -EOPNOTSUPP;
+		}
+	}
+
+	count = priv->txq_count / p->bands;
+
+	mutex_lock(&mdev->state_lock);
+
+	for (k = 0; k < ndev->num_tx_queues; k++)
+		priv->tx_shaper[k].quantum = 0;
+
+	// each band gets its own range of queues, weighted by the band quantum
+	ret = netdev_set_num_tc(ndev, p->bands);
+	if (ret)
+		goto out;
+
+	for (band = 0; band < p->bands; band++) {
+		netdev_set_tc_queue(ndev, band, count, band * count);
+
+		for (k = band * count; k < (band + 1) * count; k++)
+			priv->tx_shaper[k].quantum = p->quanta[band];
+	}
+
+	for (k = 0; k <= TC_PRIO_MAX; k++)
+		netdev_set_prio_tc_map(ndev, k, p->priomap[k]);
+
+	priv->ets_offloaded = true;
+
+	if (priv->port_up)
+		ret = mqnic_update_tx_shaper(ndev);
+
+out:
+	mutex_unlock(&mdev->state_lock);
+
+	return ret;
+}
+
+static int mqnic_ets_destroy(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	int ret = 0;
+	int k;
+
+	mutex_lock(&mdev->state_lock);
+
+	if (priv->ets_offloaded) {
+		netdev_reset_tc(ndev);
+
+		for (k = 0; k < ndev->num_tx_queues; k++)
+			priv->tx_shaper[k].quantum = 0;
+
+		priv->ets_offloaded = false;
+
+		if (priv->port_up)
+			ret = mqnic_update_tx_shaper(ndev);
+	}
+
+	mutex_unlock(&mdev->state_lock);
+
+	return ret;
+}
+
+static int mqnic_setup_tc_ets(struct net_device *ndev, struct tc_ets_qopt_offload *ets)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	switch (ets->command) {
+	case TC_ETS_REPLACE:
+		return mqnic_ets_replace(ndev, ets);
+	case TC_ETS_DESTROY:
+		return mqnic_ets_destroy(ndev);
+	case TC_ETS_STATS:
+		// no hardware counters, software qdisc stats are accurate
+		return priv->ets_offloaded ? 0 : -EOPNOTSUPP;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+static int mqnic_taprio_replace(struct net_device *ndev, struct tc_taprio_qopt_offload *qopt)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	struct mqnic_sched *sched = mqnic_get_tx_tdma(priv);
+	struct mqnic_tx_tdma *tdma = &priv->tx_tdma;
+	u32 timeslot_period = 0;
+	u64 cycle_time = 0;
+	u32 *gate_mask;
+	u64 count;
+	int ret = 0;
+	int k, j, slot;
+
+	if (!sched)
+		return -EOPNOTSUPP;
+
+	if (!qopt->num_entries || ktime_to_ns(qopt->base_time) < 0)
+		return -EINVAL;
+
+	// timeslots are uniform, so use the largest period that divides
+	// every interval
+	for (k = 0; k < qopt->num_entries; k++) {
+		if (qopt->entries[k].command != TC_TAPRIO_CMD_SET_GATES) {
+			netdev_err(ndev, "%s: only set gates commands supported", __func__);
+			return -EOPNOTSUPP;
+		}
+
+		if (!qopt->entries[k].interval)
+			return -EINVAL;
+
+		timeslot_period = gcd(timeslot_period, qopt->entries[k].interval);
+		cycle_time += qopt->entries[k].interval;
+	}
+
+	if (qopt->cycle_time != cycle_time) {
+		netdev_err(ndev, "%s: cycle time must equal the sum of the intervals", __func__);
+		return -EOPNOTSUPP;
+	}
+
+	count = div_u64(cycle_time, timeslot_period);
+
+	if (count > sched->tdma_timeslot_count) {
+		netdev_err(ndev, "%s: schedule needs %llu timeslots of %u ns, hardware has %d",
+				__func__, count, timeslot_period, sched->tdma_timeslot_count);
+		return -EOPNOTSUPP;
+	}
+
+	gate_mask = kcalloc(count, sizeof(*gate_mask), GFP_KERNEL);
+	if (!gate_mask)
+		return -ENOMEM;
+
+	for (k = 0, slot = 0; k < qopt->num_entries; k++)
+		for (j = 0; j < qopt->entries[k].interval / timeslot_period; j++)
+			gate_mask[slot++] = qopt->entries[k].gate_mask;
+
+	mutex_lock(&mdev->state_lock);
+
+	kfree(tdma->gate_mask);
+
+	tdma->enabled = true;
+	tdma->base_time = ktime_to_ns(qopt->base_time);
+	tdma->cycle_time = cycle_time;
+	tdma->timeslot_period = timeslot_period;
+	tdma->timeslot_count = count;
+	tdma->gate_mask = gate_mask;
+
+	if (priv->port_up)
+		ret = mqnic_update_tx_tdma(ndev);
+
+	mutex_unlock(&mdev->state_lock);
+
+	return ret;
+}
+
+static int mqnic_taprio_destroy(struct net_device *ndev)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	struct mqnic_tx_tdma *tdma = &priv->tx_tdma;
+
+	mutex_lock(&mdev->state_lock);
+
+	if (tdma->enabled) {
+		if (priv->port_up)
+			mqnic_clear_tx_tdma(ndev);
+
+		kfree(tdma->gate_mask);
+		memset(tdma, 0, sizeof(*tdma));
+	}
+
+	mutex_unlock(&mdev->state_lock);
+
+	return 0;
+}
+
+static int mqnic_setup_tc_taprio(struct net_device *ndev, struct tc_taprio_qopt_offload *qopt)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	switch (qopt->cmd) {
+	case TAPRIO_CMD_REPLACE:
+		return mqnic_taprio_replace(ndev, qopt);
+	case TAPRIO_CMD_DESTROY:
+		return mqnic_taprio_destroy(ndev);
+	default:
+		return -EOPNOTSUPP;
+	}
+#else
+	if (qopt->enable)
+		return mqnic_taprio_replace(ndev, qopt);
+	else
+		return mqnic_taprio_destroy(ndev);
+#endif
+}
+#endif
+
+int mqnic_setup_tc(struct net_device *ndev, enum tc_setup_type type, void *type_data)
+{
+	switch (type) {
+	case TC_SETUP_QDISC_MQPRIO:
+		return mqnic_setup_tc_mqprio(ndev, type_data);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 7, 0)
+	case TC_SETUP_QDISC_ETS:
+		return mqnic_setup_tc_ets(ndev, type_data);
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0)
+	case TC_SETUP_QDISC_TAPRIO:
+		return mqnic_setup_tc_taprio(ndev, type_data);
+#endif
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+#endif
@@ -6,16 +6,20 @@
 #include <linux/version.h>
 #include "mqnic.h"
 
-struct mqnic_ring *mqnic_create_tx_ring(struct mqnic_if *interface)
+struct mqnic_ring *mqnic_create_tx_ring(struct mqnic_if *interface, int numa_node)
 {
 	struct mqnic_ring *ring;
 
-	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	ring = kzalloc_node(sizeof(*ring), GFP_KERNEL, numa_node);
 	if (!ring)
 		return ERR_PTR(-ENOMEM);
 
 	ring->dev = interface->dev;
 	ring->interface = interface;
+	ring->numa_node = numa_node;
+
+	u64_stats_init(&ring->syncp);
+	u64_stats_init(&ring->cpl_syncp);
 
 	ring->index = -1;
 	ring->enabled = 0;
@@ -25,6 +29,8 @@ struct mqnic_ring *mqnic_create_tx_ring(struct mqnic_if *interface)
 	ring->prod_ptr = 0;
 	ring->cons_ptr = 0;
 
+	spin_lock_init(&ring->xdp_tx_lock);
+
 	return ring;
 }
 
@@ -55,19 +61,31 @@ int mqnic_open_tx_ring(struct mqnic_ring *ring, struct mqnic_priv *priv,
 	ring->size_mask = ring->size - 1;
 	ring->stride = roundup_pow_of_two(MQNIC_DESC_SIZE * ring->desc_block_size);
 
-	ring->tx_info = kvzalloc(sizeof(*ring->tx_info) * ring->size, GFP_KERNEL);
+	ring->tx_info = kvzalloc_node(sizeof(*ring->tx_info) * ring->size, GFP_KERNEL, ring->numa_node);
 	if (!ring->tx_info) {
 		ret = -ENOMEM;
 		goto fail;
 	}
 
 	ring->buf_size = ring->size * ring->stride;
-	ring->buf = dma_alloc_coherent(ring->dev, ring->buf_size, &ring->buf_dma_addr, GFP_KERNEL);
+	ring->buf = mqnic_dma_alloc_coherent_node(ring->dev, ring->buf_size, &ring->buf_dma_addr, ring->numa_node);
 	if (!ring->buf) {
 		ret = -ENOMEM;
 		goto fail;
 	}
 
+	if (priv->tx_copybreak) {
+		// one bounce buffer per descriptor, so small packets can be sent
+		// without a per-packet DMA mapping
+		ring->tx_bounce_buf_size = ring->size * MQNIC_TX_BOUNCE_STRIDE;
+		ring->tx_bounce_buf = mqnic_dma_alloc_coherent_node(ring->dev, ring->tx_bounce_buf_size,
+				&ring->tx_bounce_buf_dma_addr, ring->numa_node);
+		if (!ring->tx_bounce_buf) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+	}
+
 	ring->priv = priv;
 	ring->cq = cq;
 	cq->src_ring = ring;
@@ -127,6 +145,13 @@ void mqnic_close_tx_ring(struct mqnic_ring *ring)
 		ring->buf_dma_addr = 0;
 	}
 
+	if (ring->tx_bounce_buf) {
+		dma_free_coherent(ring->dev, ring->tx_bounce_buf_size, ring->tx_bounce_buf,
+				ring->tx_bounce_buf_dma_addr);
+		ring->tx_bounce_buf = NULL;
+		ring->tx_bounce_buf_dma_addr = 0;
+	}
+
 	if (ring->tx_info) {
 		kvfree(ring->tx_info);
 		ring->tx_info = NULL;
@@ -188,8 +213,33 @@ void mqnic_free_tx_desc(struct mqnic_ring *ring, int index, int napi_budget)
 	struct sk_buff *skb = tx_info->skb;
 	u32 i;
 
+	if (tx_info->type == MQNIC_TX_TYPE_XSK) {
+		// UMEM stays mapped; completion is reported to the XSK pool by the caller
+		tx_info->type = MQNIC_TX_TYPE_SKB;
+		return;
+	}
+
+	if (tx_info->xdpf) {
+		if (tx_info->type == MQNIC_TX_TYPE_XDP_NDO)
+			dma_unmap_single(ring->dev, dma_unmap_addr(tx_info, dma_addr),
+					dma_unmap_len(tx_info, len), DMA_TO_DEVICE);
+		dma_unmap_addr_set(tx_info, dma_addr, 0);
+
+		xdp_return_frame(tx_info->xdpf);
+		tx_info->xdpf = NULL;
+		return;
+	}
+
 	prefetchw(&skb->users);
 
+	if (tx_info->type == MQNIC_TX_TYPE_BOUNCE) {
+		// data was copied to the bounce buffer, nothing to unmap
+		tx_info->type = MQNIC_TX_TYPE_SKB;
+		napi_consume_skb(skb, napi_budget);
+		tx_info->skb = NULL;
+		return;
+	}
+
 	dma_unmap_single(ring->dev, dma_unmap_addr(tx_info, dma_addr),
 			dma_unmap_len(tx_info, len), DMA_TO_DEVICE);
 	dma_unmap_addr_set(tx_info, dma_addr, 0);
@@ -206,18 +256,61 @@ void mqnic_free_tx_desc(struct mqnic_ring *ring, int index, int napi_budget)
 int mqnic_free_tx_buf(struct mqnic_ring *ring)
 {
 	u32 index;
+	u32 xsk_frames = 0;
 	int cnt = 0;
 
 	while (!mqnic_is_tx_ring_empty(ring)) {
 		index = ring->cons_ptr & ring->size_mask;
+		if (ring->tx_info[index].type == MQNIC_TX_TYPE_XSK)
+			xsk_frames++;
 		mqnic_free_tx_desc(ring, index, 0);
 		ring->cons_ptr++;
 		cnt++;
 	}
 
+	if (xsk_frames)
+		xsk_tx_completed(ring->xsk_pool, xsk_frames);
+
+	// BQL
+	if (ring->tx_queue)
+		netdev_tx_reset_queue(ring->tx_queue);
+
 	return cnt;
 }
 
+static void mqnic_tx_update_sojourn(struct mqnic_ring *ring, struct mqnic_tx_info *tx_info,
+		const struct mqnic_cpl *cpl, u64 now_ns)
+{
+	struct mqnic_dev *mdev = ring->interface->mdev;
+	u64 departure_ns;
+	s64 sojourn_ns;
+
+	if (ring->interface->if_features & MQNIC_IF_FEATURE_PTP_TS && mdev->phc_rb) {
+		// completion carries the departure time from the PHC; map it to
+		// CLOCK_MONOTONIC, refreshing the offset every 10 ms to track drift
+		if (now_ns - ring->phc_offset_update_ns > 10 * NSEC_PER_MSEC) {
+			ring->phc_offset_ns = mqnic_read_phc_offset(mdev);
+			ring->phc_offset_update_ns = now_ns;
+		}
+
+		departure_ns = ktime_to_ns(mqnic_read_cpl_ts(mdev, ring, cpl)) + ring->phc_offset_ns;
+	} else {
+		// no timestamps, use completion processing time
+		departure_ns = now_ns;
+	}
+
+	sojourn_ns = departure_ns - tx_info->enqueue_ns;
+	if (unlikely(sojourn_ns < 0))
+		return;
+
+	u64_stats_update_begin(&ring->cpl_syncp);
+	ring->sojourn_ns += sojourn_ns;
+	ring->sojourn_packets++;
+	if (sojourn_ns > ring->sojourn_max_ns)
+		ring->sojourn_max_ns = sojourn_ns;
+	u64_stats_update_end(&ring->cpl_syncp);
+}
+
 int mqnic_process_tx_cq(struct mqnic_cq *cq, int napi_budget)
 {
 	struct mqnic_if *interface = cq->interface;
@@ -226,66 +319,109 @@ int mqnic_process_tx_cq(struct mqnic_cq *cq, int napi_budget)
 	struct mqnic_tx_info *tx_info;
 	struct mqnic_cpl *cpl;
 	struct skb_shared_hwtstamps hwts;
+	u32 batch_index[MQNIC_TX_CPL_BATCH];
 	u32 cq_index;
 	u32 cq_cons_ptr;
 	u32 ring_index;
 	u32 ring_cons_ptr;
 	u32 packets = 0;
 	u32 bytes = 0;
+	u32 xsk_frames = 0;
+	u64 now_ns;
 	int done = 0;
 	int budget = napi_budget;
+	int n, k;
 
 	if (unlikely(!priv || !priv->port_up))
 		return done;
 
+	now_ns = ktime_get_ns();
+
 	// prefetch for BQL
-	netdev_txq_bql_complete_prefetchw(tx_ring->tx_queue);
+	if (tx_ring->tx_queue)
+		netdev_txq_bql_complete_prefetchw(tx_ring->tx_queue);
 
 	// process completion queue
 	cq_cons_ptr = cq->cons_ptr;
-	cq_index = cq_cons_ptr & cq->size_mask;
+	ring_cons_ptr = READ_ONCE(tx_ring->cons_ptr);
 
 	while (done < budget) {
-		cpl = (struct mqnic_cpl *)(cq->buf + cq_index * cq->stride);
+		// gather a batch of completions
+		for (n = 0; n < MQNIC_TX_CPL_BATCH && done + n < budget; n++) {
+			cq_index = (cq_cons_ptr + n) & cq->size_mask;
+			cpl = (struct mqnic_cpl *)(cq->buf + cq_index * cq->stride);
+
+			if (!!(cpl->phase & cpu_to_le32(0x80000000)) == !!((cq_cons_ptr + n) & cq->size))
+				break;
+		}
 
-		if (!!(cpl->phase & cpu_to_le32(0x80000000)) == !!(cq_cons_ptr & cq->size))
+		if (!n)
 			break;
 
 		dma_rmb();
 
-		ring_index = le16_to_cpu(cpl->index) & tx_ring->size_mask;
-		tx_info = &tx_ring->tx_info[ring_index];
+		// look up the descriptors and prefetch their TX state ahead of use
+		for (k = 0; k < n; k++) {
+			cq_index = (cq_cons_ptr + k) & cq->size_mask;
+			cpl = (struct mqnic_cpl *)(cq->buf + cq_index * cq->stride);
 
-		// TX hardware timestamp
-		if (unlikely(tx_info->ts_requested)) {
-			netdev_dbg(priv->ndev, "%s: TX TS requested", __func__);
-			hwts.hwtstamp = mqnic_read_cpl_ts(interface->mdev, tx_ring, cpl);
-			skb_tstamp_tx(tx_info->skb, &hwts);
+			batch_index[k] = le16_to_cpu(cpl->index) & tx_ring->size_mask;
+			prefetch(&tx_ring->tx_info[batch_index[k]]);
 		}
-		// free TX descriptor
-		mqnic_free_tx_desc(tx_ring, ring_index, napi_budget);
 
-		packets++;
-		bytes += le16_to_cpu(cpl->len);
+		for (k = 0; k < n; k++) {
+			cq_index = (cq_cons_ptr + k) & cq->size_mask;
+			cpl = (struct mqnic_cpl *)(cq->buf + cq_index * cq->stride);
+
+			ring_index = batch_index[k];
+			tx_info = &tx_ring->tx_info[ring_index];
+
+			// TX hardware timestamp
+			if (unlikely(tx_info->ts_requested)) {
+				netdev_dbg(priv->ndev, "%s: TX TS requested", __func__);
+				hwts.hwtstamp = mqnic_read_cpl_ts(interface->mdev, tx_ring, cpl);
+				skb_tstamp_tx(tx_info->skb, &hwts);
+			}
+			// TX sojourn time
+			if (tx_info->enqueue_ns)
+				mqnic_tx_update_sojourn(tx_ring, tx_info, cpl, now_ns);
+
+			// only stack packets are accounted in BQL
+			if (tx_info->skb) {
+				packets++;
+				bytes += tx_info->bytes;
+			}
+
+			// free TX descriptor; skbs go to the per-CPU NAPI cache in bulk
+			if (tx_info->type == MQNIC_TX_TYPE_XSK)
+				xsk_frames++;
+			mqnic_free_tx_desc(tx_ring, ring_index, napi_budget);
 
-		done++;
+			// completions normally arrive in ring order, so the consumer
+			// pointer can follow along without a second walk
+			if (likely(ring_index == (ring_cons_ptr & tx_ring->size_mask)))
+				ring_cons_ptr++;
+		}
 
-		cq_cons_ptr++;
-		cq_index = cq_cons_ptr & cq->size_mask;
+		done += n;
+		cq_cons_ptr += n;
 	}
 
 	// update CQ consumer pointer
 	cq->cons_ptr = cq_cons_ptr;
-	mqnic_cq_write_cons_ptr(cq);
+	mqnic_cq_defer_cons_ptr(cq);
 
-	// process ring
-	ring_cons_ptr = READ_ONCE(tx_ring->cons_ptr);
+	if (xsk_frames)
+		xsk_tx_completed(tx_ring->xsk_pool, xsk_frames);
+
+	// skip over descriptors freed out of order; in the common case this
+	// stops at the first in-flight descriptor
 	ring_index = ring_cons_ptr & tx_ring->size_mask;
 
 	while (ring_cons_ptr != tx_ring->prod_ptr) {
 		tx_info = &tx_ring->tx_info[ring_index];
 
-		if (tx_info->skb)
+		if (tx_info->skb || tx_info->xdpf || tx_info->type == MQNIC_TX_TYPE_XSK)
 			break;
 
 		ring_cons_ptr++;
@@ -295,8 +431,16 @@ int mqnic_process_tx_cq(struct mqnic_cq *cq, int napi_budget)
 	// update consumer pointer
 	WRITE_ONCE(tx_ring->cons_ptr, ring_cons_ptr);
 
+	// XDP TX rings are not attached to a netdev queue
+	if (!tx_ring->tx_queue)
+		return done;
+
 	// BQL
-	//netdev_tx_completed_queue(tx_ring->tx_queue, packets, bytes);
+	netdev_tx_completed_queue(tx_ring->tx_queue, packets, bytes);
+
+	// make the consumer pointer update visible before checking the queue
+	// state; pairs with the barrier after stopping the queue in start_xmit
+	smp_mb();
 
 	// wake queue if it is stopped
 	if (netif_tx_queue_stopped(tx_ring->tx_queue) && !mqnic_is_tx_ring_full(tx_ring))
@@ -317,16 +461,50 @@ int mqnic_poll_tx_cq(struct napi_struct *napi, int budget)
 
 	done = mqnic_process_tx_cq(cq, budget);
 
+	// transmit from the AF_XDP TX ring
+	if (cq->src_ring->xsk_pool && !mqnic_xsk_xmit(cq->src_ring, budget))
+		done = budget;
+
 	if (done == budget)
 		return done;
 
-	napi_complete(napi);
+	if (!napi_complete_done(napi, done)) {
+		mqnic_cq_write_cons_ptr(cq);
+		return done;
+	}
 
 	mqnic_arm_cq(cq);
 
 	return done;
 }
 
+static void mqnic_copy_skb(struct mqnic_ring *ring, struct mqnic_tx_info *tx_info,
+		struct mqnic_desc *tx_desc, u32 index, struct sk_buff *skb)
+{
+	u32 offset = index * MQNIC_TX_BOUNCE_STRIDE;
+	u32 i;
+
+	// update tx_info
+	tx_info->skb = skb;
+	tx_info->xdpf = NULL;
+	tx_info->type = MQNIC_TX_TYPE_BOUNCE;
+	tx_info->frag_count = 0;
+	dma_unmap_addr_set(tx_info, dma_addr, 0);
+	dma_unmap_len_set(tx_info, len, 0);
+
+	// bounce buffer is coherent; the doorbell barrier orders the copy
+	skb_copy_bits(skb, 0, ring->tx_bounce_buf + offset, skb->len);
+
+	// write descriptor
+	tx_desc[0].len = cpu_to_le32(skb->len);
+	tx_desc[0].addr = cpu_to_le64(ring->tx_bounce_buf_dma_addr + offset);
+
+	for (i = 1; i < ring->desc_block_size; i++) {
+		tx_desc[i].len = 0;
+		tx_desc[i].addr = 0;
+	}
+}
+
 static bool mqnic_map_skb(struct mqnic_ring *ring, struct mqnic_tx_info *tx_info,
 		struct mqnic_desc *tx_desc, struct sk_buff *skb)
 {
@@ -338,6 +516,8 @@ static bool mqnic_map_skb(struct mqnic_ring *ring, struct mqnic_tx_info *tx_info
 
 	// update tx_info
 	tx_info->skb = skb;
+	tx_info->xdpf = NULL;
+	tx_info->type = MQNIC_TX_TYPE_SKB;
 	tx_info->frag_count = 0;
 
 	for (i = 0; i < shinfo->nr_frags; i++) {
@@ -400,12 +580,14 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 {
 	struct skb_shared_info *shinfo = skb_shinfo(skb);
 	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring_table *txq_table;
 	struct mqnic_ring *ring;
 	struct mqnic_tx_info *tx_info;
 	struct mqnic_desc *tx_desc;
-	int ring_index;
+	u32 ring_index;
 	u32 index;
 	bool stop_queue;
+	bool ring_doorbell;
 	u32 cons_ptr;
 
 	if (unlikely(!priv->port_up))
@@ -414,7 +596,8 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 	ring_index = skb_get_queue_mapping(skb);
 
 	rcu_read_lock();
-	ring = radix_tree_lookup(&priv->txq_table, ring_index);
+	txq_table = rcu_dereference(priv->txq_table);
+	ring = likely(txq_table && ring_index < txq_table->count) ? txq_table->ring[ring_index] : NULL;
 	rcu_read_unlock();
 
 	if (unlikely(!ring))
@@ -450,6 +633,10 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 					__func__, csum_start, csum_offset);
 
 			// offset out of range, fall back on software checksum
+			u64_stats_update_begin(&ring->syncp);
+			ring->csum_fallback++;
+			u64_stats_update_end(&ring->syncp);
+
 			if (skb_checksum_help(skb)) {
 				// software checksumming failed
 				goto tx_drop_count;
@@ -462,8 +649,18 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 		tx_desc->tx_csum_cmd = 0;
 	}
 
+	if (ring->tx_bounce_buf && skb->len <= READ_ONCE(priv->tx_copybreak)) {
+		// small packet; copy to the bounce buffer instead of mapping
+		mqnic_copy_skb(ring, tx_info, tx_desc, index, skb);
+		goto enqueue;
+	}
+
 	if (shinfo->nr_frags > ring->desc_block_size - 1 || (skb->data_len && skb->data_len < 32)) {
 		// too many frags or very short data portion; linearize
+		u64_stats_update_begin(&ring->syncp);
+		ring->linearized++;
+		u64_stats_update_end(&ring->syncp);
+
 		if (skb_linearize(skb))
 			goto tx_drop_count;
 	}
@@ -473,9 +670,15 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 		// map failed
 		goto tx_drop_count;
 
+enqueue:
+	tx_info->bytes = skb->len;
+	tx_info->enqueue_ns = ktime_get_ns();
+
 	// count packet
+	u64_stats_update_begin(&ring->syncp);
 	ring->packets++;
 	ring->bytes += skb->len;
+	u64_stats_update_end(&ring->syncp);
 
 	// enqueue
 	ring->prod_ptr++;
@@ -489,23 +692,25 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 		netif_tx_stop_queue(ring->tx_queue);
 	}
 
-	// BQL
-	//netdev_tx_sent_queue(ring->tx_queue, tx_info->len);
-	//__netdev_tx_sent_queue(ring->tx_queue, tx_info->len, skb->xmit_more);
-
-	// enqueue on NIC
+	// BQL; defer the doorbell while more packets are coming, unless BQL
+	// has stopped the queue
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
-	if (unlikely(!netdev_xmit_more() || stop_queue)) {
+	ring_doorbell = __netdev_tx_sent_queue(ring->tx_queue, tx_info->bytes, netdev_xmit_more());
 #else
-	if (unlikely(!skb->xmit_more || stop_queue)) {
+	netdev_tx_sent_queue(ring->tx_queue, tx_info->bytes);
+	ring_doorbell = !skb->xmit_more || netif_xmit_stopped(ring->tx_queue);
 #endif
+
+	// enqueue on NIC
+	if (ring_doorbell || unlikely(stop_queue)) {
 		dma_wmb();
 		mqnic_tx_write_prod_ptr(ring);
 	}
 
 	// check if queue restarted
 	if (unlikely(stop_queue)) {
-		smp_rmb();
+		// pairs with the barrier in mqnic_process_tx_cq
+		smp_mb();
 
 		cons_ptr = READ_ONCE(ring->cons_ptr);
 
@@ -516,7 +721,9 @@ netdev_tx_t mqnic_start_xmit(struct sk_buff *skb, struct net_device *ndev)
 	return NETDEV_TX_OK;
 
 tx_drop_count:
+	u64_stats_update_begin(&ring->syncp);
 	ring->dropped_packets++;
+	u64_stats_update_end(&ring->syncp);
 tx_drop:
 	dev_kfree_skb_any(skb);
 	return NETDEV_TX_OK;
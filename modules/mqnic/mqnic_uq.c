@@ -0,0 +1,642 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+#include "mqnic_ioctl.h"
+
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/uaccess.h>
+
+// Userspace queues: TX and RX queues owned by a process through the misc
+// device.  The driver allocates the hardware queue, completion queue and
+// ring memory, the process maps the rings and drives the queue registers
+// in the ctrl region directly.  Completion queues are attached to an event
+// queue owned by the context but are never armed, so they are polled.
+
+#define MQNIC_UQ_MAX_HANDLE ((1 << (40 - MQNIC_UQ_MMAP_HANDLE_SHIFT)) - 1)
+
+struct mqnic_uq_ctx *mqnic_create_uq_ctx(struct mqnic_dev *mdev)
+{
+	struct mqnic_uq_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return ERR_PTR(-ENOMEM);
+
+	ctx->mdev = mdev;
+
+	mutex_init(&ctx->lock);
+	INIT_LIST_HEAD(&ctx->queues);
+	INIT_LIST_HEAD(&ctx->bufs);
+	ida_init(&ctx->handle_ida);
+
+	return ctx;
+}
+
+static void mqnic_uq_free_queue(struct mqnic_uq *uq);
+static void mqnic_uq_unmap_buffer(struct mqnic_uq_ctx *ctx, struct mqnic_uq_buf *buf);
+
+void mqnic_destroy_uq_ctx(struct mqnic_uq_ctx *ctx)
+{
+	struct mqnic_uq *uq, *uq_tmp;
+	struct mqnic_uq_buf *buf, *buf_tmp;
+	int k;
+
+	// the file is being released, so nothing is mapped any more
+	list_for_each_entry_safe(uq, uq_tmp, &ctx->queues, list)
+		mqnic_uq_free_queue(uq);
+
+	list_for_each_entry_safe(buf, buf_tmp, &ctx->bufs, list)
+		mqnic_uq_unmap_buffer(ctx, buf);
+
+	for (k = 0; k < ARRAY_SIZE(ctx->eq); k++) {
+		if (ctx->eq[k])
+			mqnic_destroy_eq(ctx->eq[k]);
+	}
+
+	ida_destroy(&ctx->handle_ida);
+
+	kfree(ctx);
+}
+
+static struct mqnic_eq *mqnic_uq_get_eq(struct mqnic_uq_ctx *ctx, struct mqnic_if *interface)
+{
+	struct mqnic_dev *mdev = ctx->mdev;
+	struct mqnic_irq *irq = NULL;
+	struct mqnic_eq *eq;
+	int cpu = raw_smp_processor_id();
+	int ret;
+	int k;
+
+	if (ctx->eq[interface->index])
+		return ctx->eq[interface->index];
+
+	// prefer the IRQ serviced by the calling CPU
+	for (k = 0; k < mdev->irq_count; k++) {
+		if (!mdev->irq[k])
+			continue;
+
+		if (!irq || mdev->irq[k]->cpu == cpu)
+			irq = mdev->irq[k];
+
+		if (irq->cpu == cpu)
+			break;
+	}
+
+	if (!irq)
+		return ERR_PTR(-ENODEV);
+
+	eq = mqnic_create_eq(interface);
+	if (IS_ERR(eq))
+		return eq;
+
+	ret = mqnic_open_eq(eq, irq, mqnic_num_eq_entries);
+	if (ret) {
+		mqnic_destroy_eq(eq);
+		return ERR_PTR(ret);
+	}
+
+	ctx->eq[interface->index] = eq;
+
+	return eq;
+}
+
+static struct mqnic_uq *mqnic_uq_find_queue(struct mqnic_uq_ctx *ctx, u32 handle)
+{
+	struct mqnic_uq *uq;
+
+	list_for_each_entry(uq, &ctx->queues, list) {
+		if (uq->handle == handle)
+			return uq;
+	}
+
+	return NULL;
+}
+
+static void mqnic_uq_free_queue(struct mqnic_uq *uq)
+{
+	struct mqnic_uq_ctx *ctx = uq->ctx;
+
+	// stop steering flows to the queue before its index is reused
+	if (uq->type == MQNIC_QUEUE_TYPE_RX && uq->index >= 0 && uq->interface->ndev[0])
+		mqnic_del_user_flows(uq->interface->ndev[0], uq);
+
+	if (uq->hw_addr) {
+		// deactivate queue
+		iowrite32(MQNIC_QUEUE_CMD_SET_ENABLE | 0,
+				uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+	}
+
+	if (uq->cq)
+		mqnic_destroy_cq(uq->cq);
+
+	if (uq->buf)
+		dma_free_coherent(uq->dev, uq->buf_size, uq->buf, uq->buf_dma_addr);
+
+	if (uq->index >= 0) {
+		if (uq->type == MQNIC_QUEUE_TYPE_TX)
+			mqnic_res_free(uq->interface->txq_res, uq->index);
+		else
+			mqnic_res_free(uq->interface->rxq_res, uq->index);
+	}
+
+	if (uq->handle)
+		ida_free(&ctx->handle_ida, uq->handle);
+
+	list_del(&uq->list);
+
+	kfree(uq);
+}
+
+static int mqnic_uq_alloc_queue(struct mqnic_uq_ctx *ctx, struct mqnic_ioctl_queue *info)
+{
+	struct mqnic_dev *mdev = ctx->mdev;
+	struct mqnic_if *interface;
+	struct mqnic_res *res;
+	struct mqnic_uq *uq;
+	struct mqnic_eq *eq;
+	u32 desc_block_size;
+	u32 size;
+	int ret;
+
+	if (info->if_index >= mdev->if_count || !mdev->interface[info->if_index])
+		return -EINVAL;
+
+	interface = mdev->interface[info->if_index];
+
+	if (info->type == MQNIC_QUEUE_TYPE_TX)
+		res = interface->txq_res;
+	else if (info->type == MQNIC_QUEUE_TYPE_RX)
+		res = interface->rxq_res;
+	else
+		return -EINVAL;
+
+	if (info->type == MQNIC_QUEUE_TYPE_TX)
+		size = clamp_t(u32, info->size, MQNIC_MIN_TX_RING_SZ, MQNIC_MAX_TX_RING_SZ);
+	else
+		size = clamp_t(u32, info->size, MQNIC_MIN_RX_RING_SZ, MQNIC_MAX_RX_RING_SZ);
+	desc_block_size = clamp_t(u32, info->desc_block_size, 1, interface->max_desc_block_size);
+
+	eq = mqnic_uq_get_eq(ctx, interface);
+	if (IS_ERR(eq))
+		return PTR_ERR(eq);
+
+	uq = kzalloc(sizeof(*uq), GFP_KERNEL);
+	if (!uq)
+		return -ENOMEM;
+
+	uq->ctx = ctx;
+	uq->dev = interface->dev;
+	uq->interface = interface;
+	uq->type = info->type;
+	uq->index = -1;
+
+	list_add_tail(&uq->list, &ctx->queues);
+
+	ret = ida_alloc_range(&ctx->handle_ida, 1, MQNIC_UQ_MAX_HANDLE, GFP_KERNEL);
+	if (ret < 0)
+		goto fail;
+
+	uq->handle = ret;
+
+	uq->index = mqnic_res_alloc(res);
+	if (uq->index < 0) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	uq->log_desc_block_size = desc_block_size < 2 ? 0 : ilog2(desc_block_size - 1) + 1;
+	uq->size = roundup_pow_of_two(size);
+	uq->stride = roundup_pow_of_two(MQNIC_DESC_SIZE << uq->log_desc_block_size);
+
+	uq->buf_size = PAGE_ALIGN(uq->size * uq->stride);
+	uq->buf = mqnic_dma_alloc_coherent_node(uq->dev, uq->buf_size, &uq->buf_dma_addr,
+			dev_to_node(uq->dev));
+	if (!uq->buf) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	uq->cq = mqnic_create_cq(interface, dev_to_node(uq->dev));
+	if (IS_ERR(uq->cq)) {
+		ret = PTR_ERR(uq->cq);
+		uq->cq = NULL;
+		goto fail;
+	}
+
+	ret = mqnic_open_cq(uq->cq, eq, uq->size);
+	if (ret)
+		goto fail;
+
+	uq->hw_addr = mqnic_res_get_addr(res, uq->index);
+
+	// deactivate queue
+	iowrite32(MQNIC_QUEUE_CMD_SET_ENABLE | 0,
+			uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+	// set base address
+	iowrite32((uq->buf_dma_addr & 0xfffff000),
+			uq->hw_addr + MQNIC_QUEUE_BASE_ADDR_VF_REG + 0);
+	iowrite32(uq->buf_dma_addr >> 32,
+			uq->hw_addr + MQNIC_QUEUE_BASE_ADDR_VF_REG + 4);
+	// set size
+	iowrite32(MQNIC_QUEUE_CMD_SET_SIZE | ilog2(uq->size) | (uq->log_desc_block_size << 8),
+			uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+	// set CQN
+	iowrite32(MQNIC_QUEUE_CMD_SET_CQN | uq->cq->cqn,
+			uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+	// set pointers
+	iowrite32(MQNIC_QUEUE_CMD_SET_PROD_PTR | 0,
+			uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+	iowrite32(MQNIC_QUEUE_CMD_SET_CONS_PTR | 0,
+			uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+	// activate queue
+	iowrite32(MQNIC_QUEUE_CMD_SET_ENABLE | 1,
+			uq->hw_addr + MQNIC_QUEUE_CTRL_STATUS_REG);
+
+	info->handle = uq->handle;
+	info->index = uq->index;
+	info->size = uq->size;
+	info->desc_block_size = 1 << uq->log_desc_block_size;
+	info->stride = uq->stride;
+	info->cqn = uq->cq->cqn;
+	info->cq_size = uq->cq->size;
+	info->cq_stride = uq->cq->stride;
+	info->eqn = eq->eqn;
+	info->regs_offset = uq->hw_addr - mdev->hw_addr;
+	info->cq_regs_offset = uq->cq->hw_addr - mdev->hw_addr;
+	info->ring_offset = ((u64)MQNIC_UQ_MMAP_REGION << 40) |
+			((u64)uq->handle << MQNIC_UQ_MMAP_HANDLE_SHIFT);
+	info->ring_size = uq->buf_size;
+	info->cq_ring_offset = info->ring_offset | MQNIC_UQ_MMAP_CQ;
+	info->cq_ring_size = PAGE_ALIGN(uq->cq->buf_size);
+
+	dev_dbg(mdev->dev, "%s: IF %d %s queue %d CQ %d for pid %d", __func__,
+			interface->index, uq->type == MQNIC_QUEUE_TYPE_TX ? "TX" : "RX",
+			uq->index, uq->cq->cqn, task_pid_nr(current));
+
+	return 0;
+
+fail:
+	mqnic_uq_free_queue(uq);
+	return ret;
+}
+
+static void mqnic_uq_vm_open(struct vm_area_struct *vma)
+{
+	struct mqnic_uq *uq = vma->vm_private_data;
+
+	atomic_inc(&uq->map_count);
+}
+
+static void mqnic_uq_vm_close(struct vm_area_struct *vma)
+{
+	struct mqnic_uq *uq = vma->vm_private_data;
+
+	atomic_dec(&uq->map_count);
+}
+
+static const struct vm_operations_struct mqnic_uq_vm_ops = {
+	.open = mqnic_uq_vm_open,
+	.close = mqnic_uq_vm_close,
+};
+
+int mqnic_uq_mmap(struct mqnic_uq_ctx *ctx, struct vm_area_struct *vma, u64 offset)
+{
+	u32 handle = offset >> MQNIC_UQ_MMAP_HANDLE_SHIFT;
+	u64 req_len = vma->vm_end - vma->vm_start;
+	struct mqnic_uq *uq;
+	int ret = -EINVAL;
+
+	// rings are mapped as a whole
+	if (offset & ((1ull << MQNIC_UQ_MMAP_HANDLE_SHIFT) - 1) & ~MQNIC_UQ_MMAP_CQ)
+		return -EINVAL;
+
+	mutex_lock(&ctx->lock);
+
+	uq = mqnic_uq_find_queue(ctx, handle);
+	if (!uq)
+		goto out;
+
+	vma->vm_pgoff = 0;
+
+	if (offset & MQNIC_UQ_MMAP_CQ) {
+		if (req_len > PAGE_ALIGN(uq->cq->buf_size))
+			goto out;
+
+		ret = dma_mmap_coherent(uq->dev, vma, uq->cq->buf, uq->cq->buf_dma_addr, req_len);
+	} else {
+		if (req_len > uq->buf_size)
+			goto out;
+
+		ret = dma_mmap_coherent(uq->dev, vma, uq->buf, uq->buf_dma_addr, req_len);
+	}
+
+	if (ret)
+		goto out;
+
+	vma->vm_private_data = uq;
+	vma->vm_ops = &mqnic_uq_vm_ops;
+	mqnic_uq_vm_open(vma);
+
+out:
+	mutex_unlock(&ctx->lock);
+
+	return ret;
+}
+
+static struct mqnic_uq_buf *mqnic_uq_find_buffer(struct mqnic_uq_ctx *ctx, u32 handle)
+{
+	struct mqnic_uq_buf *buf;
+
+	list_for_each_entry(buf, &ctx->bufs, list) {
+		if (buf->handle == handle)
+			return buf;
+	}
+
+	return NULL;
+}
+
+static int mqnic_uq_account_pages(struct mm_struct *mm, unsigned long npages, bool inc)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 2, 0)
+	return account_locked_vm(mm, npages, inc);
+#else
+	unsigned long limit;
+	int ret = 0;
+
+	down_write(&mm->mmap_sem);
+	if (inc) {
+		limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+		if (mm->locked_vm + npages > limit && !capable(CAP_IPC_LOCK))
+			ret = -ENOMEM;
+		else
+			mm->locked_vm += npages;
+	} else {
+		mm->locked_vm -= min(npages, mm->locked_vm);
+	}
+	up_write(&mm->mmap_sem);
+
+	return ret;
+#endif
+}
+
+static void mqnic_uq_unmap_buffer(struct mqnic_uq_ctx *ctx, struct mqnic_uq_buf *buf)
+{
+	struct device *dev = ctx->mdev->dev;
+	unsigned long k;
+
+	for (k = 0; k < buf->npages; k++) {
+		if (buf->dma_addr && buf->dma_addr[k])
+			dma_unmap_page(dev, buf->dma_addr[k], PAGE_SIZE, DMA_BIDIRECTIONAL);
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+	if (buf->pinned)
+		unpin_user_pages_dirty_lock(buf->pages, buf->pinned, true);
+#else
+	for (k = 0; k < buf->pinned; k++) {
+		set_page_dirty_lock(buf->pages[k]);
+		put_page(buf->pages[k]);
+	}
+#endif
+
+	if (buf->mm) {
+		// the process may already have exited on release
+		if (buf->accounted && mmget_not_zero(buf->mm)) {
+			mqnic_uq_account_pages(buf->mm, buf->accounted, false);
+			mmput(buf->mm);
+		}
+		mmdrop(buf->mm);
+	}
+
+	if (buf->handle)
+		ida_free(&ctx->handle_ida, buf->handle);
+
+	list_del(&buf->list);
+
+	kvfree(buf->dma_addr);
+	kvfree(buf->pages);
+	kfree(buf);
+}
+
+static int mqnic_uq_map_buffer(struct mqnic_uq_ctx *ctx, struct mqnic_ioctl_buffer *info)
+{
+	struct device *dev = ctx->mdev->dev;
+	u64 __user *table = u64_to_user_ptr(info->dma_addr_table);
+	struct mqnic_uq_buf *buf;
+	unsigned long npages;
+	unsigned long k;
+	dma_addr_t dma_addr;
+	int ret;
+
+	if (!info->size || !PAGE_ALIGNED(info->addr) || !PAGE_ALIGNED(info->size))
+		return -EINVAL;
+
+	npages = info->size >> PAGE_SHIFT;
+
+	buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	list_add_tail(&buf->list, &ctx->bufs);
+
+	ret = ida_alloc_range(&ctx->handle_ida, 1, MQNIC_UQ_MAX_HANDLE, GFP_KERNEL);
+	if (ret < 0)
+		goto fail;
+
+	buf->handle = ret;
+	buf->npages = npages;
+
+	buf->pages = kvcalloc(npages, sizeof(*buf->pages), GFP_KERNEL);
+	buf->dma_addr = kvcalloc(npages, sizeof(*buf->dma_addr), GFP_KERNEL);
+	if (!buf->pages || !buf->dma_addr) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	// pinned pages are charged to the locked memory limit of the caller
+	ret = mqnic_uq_account_pages(current->mm, npages, true);
+	if (ret)
+		goto fail;
+
+	mmgrab(current->mm);
+	buf->mm = current->mm;
+	buf->accounted = npages;
+
+	// long-term pin, the device writes into these pages at any time
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+	ret = pin_user_pages_fast(info->addr, npages, FOLL_WRITE | FOLL_LONGTERM, buf->pages);
+#else
+	ret = get_user_pages_fast(info->addr, npages, FOLL_WRITE, buf->pages);
+#endif
+	if (ret < 0)
+		goto fail;
+
+	buf->pinned = ret;
+
+	if (buf->pinned != npages) {
+		ret = -EFAULT;
+		goto fail;
+	}
+
+	// map page by page, packet buffers must not straddle a page boundary
+	// unless the DMA addresses of adjacent pages turn out to be contiguous
+	for (k = 0; k < npages; k++) {
+		dma_addr = dma_map_page(dev, buf->pages[k], 0, PAGE_SIZE, DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(dev, dma_addr)) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+
+		buf->dma_addr[k] = dma_addr;
+
+		if (put_user(dma_addr, table + k)) {
+			ret = -EFAULT;
+			goto fail;
+		}
+	}
+
+	info->handle = buf->handle;
+	info->page_size = PAGE_SIZE;
+
+	return 0;
+
+fail:
+	mqnic_uq_unmap_buffer(ctx, buf);
+	return ret;
+}
+
+long mqnic_uq_ioctl(struct mqnic_uq_ctx *ctx, unsigned int cmd, unsigned long arg)
+{
+	size_t minsz;
+	int ret = -EINVAL;
+
+	if (cmd == MQNIC_IOCTL_ALLOC_QUEUE || cmd == MQNIC_IOCTL_FREE_QUEUE) {
+		struct mqnic_ioctl_queue info;
+		struct mqnic_uq *uq;
+
+		minsz = offsetofend(struct mqnic_ioctl_queue, cq_ring_size);
+
+		if (copy_from_user(&info, (void __user *)arg, minsz))
+			return -EFAULT;
+
+		if (info.argsz < minsz)
+			return -EINVAL;
+
+		mutex_lock(&ctx->lock);
+
+		if (cmd == MQNIC_IOCTL_ALLOC_QUEUE) {
+			ret = mqnic_uq_alloc_queue(ctx, &info);
+		} else {
+			uq = mqnic_uq_find_queue(ctx, info.handle);
+
+			if (!uq)
+				ret = -EINVAL;
+			else if (atomic_read(&uq->map_count))
+				ret = -EBUSY;
+			else
+				ret = 0;
+
+			if (!ret)
+				mqnic_uq_free_queue(uq);
+		}
+
+		mutex_unlock(&ctx->lock);
+
+		if (ret)
+			return ret;
+
+		return copy_to_user((void __user *)arg, &info, minsz) ? -EFAULT : 0;
+
+	} else if (cmd == MQNIC_IOCTL_MAP_BUFFER || cmd == MQNIC_IOCTL_UNMAP_BUFFER) {
+		struct mqnic_ioctl_buffer info;
+		struct mqnic_uq_buf *buf;
+
+		minsz = offsetofend(struct mqnic_ioctl_buffer, dma_addr_table);
+
+		if (copy_from_user(&info, (void __user *)arg, minsz))
+			return -EFAULT;
+
+		if (info.argsz < minsz)
+			return -EINVAL;
+
+		mutex_lock(&ctx->lock);
+
+		if (cmd == MQNIC_IOCTL_MAP_BUFFER) {
+			ret = mqnic_uq_map_buffer(ctx, &info);
+		} else {
+			buf = mqnic_uq_find_buffer(ctx, info.handle);
+
+			// descriptors of enabled queues may still point into the
+			// buffer, and the device would DMA into freed pages
+			if (!buf)
+				ret = -EINVAL;
+			else if (!list_empty(&ctx->queues))
+				ret = -EBUSY;
+			else
+				ret = 0;
+
+			if (!ret)
+				mqnic_uq_unmap_buffer(ctx, buf);
+		}
+
+		mutex_unlock(&ctx->lock);
+
+		if (ret)
+			return ret;
+
+		return copy_to_user((void __user *)arg, &info, minsz) ? -EFAULT : 0;
+
+	} else if (cmd == MQNIC_IOCTL_ADD_FLOW || cmd == MQNIC_IOCTL_DEL_FLOW) {
+		struct mqnic_ioctl_flow info;
+		struct net_device *ndev;
+		struct mqnic_uq *uq;
+
+		minsz = offsetofend(struct mqnic_ioctl_flow, dport);
+
+		if (copy_from_user(&info, (void __user *)arg, minsz))
+			return -EFAULT;
+
+		if (info.argsz < minsz)
+			return -EINVAL;
+
+		mutex_lock(&ctx->lock);
+
+		uq = mqnic_uq_find_queue(ctx, info.handle);
+
+		if (!uq || uq->type != MQNIC_QUEUE_TYPE_RX) {
+			ret = -EINVAL;
+		} else if (!uq->interface->ndev[0]) {
+			ret = -ENODEV;
+		} else {
+			ndev = uq->interface->ndev[0];
+
+			if (cmd == MQNIC_IOCTL_ADD_FLOW) {
+				ret = mqnic_add_user_flow(ndev, uq, uq->index,
+						(__force __be32)info.saddr, (__force __be32)info.daddr,
+						(__force __be16)info.sport, (__force __be16)info.dport);
+				if (ret >= 0) {
+					info.location = ret;
+					ret = 0;
+				}
+			} else {
+				ret = mqnic_del_user_flow(ndev, uq,
+						(__force __be32)info.saddr, (__force __be32)info.daddr,
+						(__force __be16)info.sport, (__force __be16)info.dport);
+			}
+		}
+
+		mutex_unlock(&ctx->lock);
+
+		if (ret)
+			return ret;
+
+		return copy_to_user((void __user *)arg, &info, minsz) ? -EFAULT : 0;
+	}
+
+	return -EINVAL;
+}
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <linux/version.h>
+
+// caller holds rcu_read_lock() for as long as it uses the ring; stop_port
+// waits for a grace period before the rings are destroyed
+static struct mqnic_ring *mqnic_xdp_get_tx_ring(struct mqnic_priv *priv)
+{
+	struct mqnic_ring_table *xdp_txq_table;
+
+	xdp_txq_table = rcu_dereference(priv->xdp_txq_table);
+	if (likely(xdp_txq_table && xdp_txq_table->count))
+		return xdp_txq_table->ring[smp_processor_id() % xdp_txq_table->count];
+
+	return NULL;
+}
+
+static int mqnic_xdp_xmit_frame(struct mqnic_ring *ring, struct xdp_frame *xdpf, bool dma_map)
+{
+	struct mqnic_tx_info *tx_info;
+	struct mqnic_desc *tx_desc;
+	struct page *page;
+	dma_addr_t dma_addr;
+	u32 index;
+	u32 i;
+
+	if (unlikely(mqnic_is_tx_ring_full(ring)))
+		return -ENOSPC;
+
+	index = ring->prod_ptr & ring->size_mask;
+
+	tx_desc = (struct mqnic_desc *)(ring->buf + index * ring->stride);
+
+	tx_info = &ring->tx_info[index];
+
+	if (dma_map) {
+		// frame from ndo_xdp_xmit, map it
+		dma_addr = dma_map_single(ring->dev, xdpf->data, xdpf->len, DMA_TO_DEVICE);
+
+		if (unlikely(dma_mapping_error(ring->dev, dma_addr)))
+			return -ENOMEM;
+
+		tx_info->type = MQNIC_TX_TYPE_XDP_NDO;
+		dma_unmap_addr_set(tx_info, dma_addr, dma_addr);
+		dma_unmap_len_set(tx_info, len, xdpf->len);
+	} else {
+		// XDP_TX, frame is in a page from the RX page pool, already mapped
+		page = virt_to_page(xdpf->data);
+		dma_addr = page_pool_get_dma_addr(page) + (xdpf->data - page_address(page));
+
+		dma_sync_single_for_device(ring->dev, dma_addr, xdpf->len, DMA_BIDIRECTIONAL);
+
+		tx_info->type = MQNIC_TX_TYPE_XDP_TX;
+	}
+
+	// write descriptor
+	tx_desc[0].tx_csum_cmd = 0;
+	tx_desc[0].len = cpu_to_le32(xdpf->len);
+	tx_desc[0].addr = cpu_to_le64(dma_addr);
+
+	for (i = 1; i < ring->desc_block_size; i++) {
+		tx_desc[i].len = 0;
+		tx_desc[i].addr = 0;
+	}
+
+	// update tx_info
+	tx_info->skb = NULL;
+	tx_info->xdpf = xdpf;
+	tx_info->enqueue_ns = 0;
+	tx_info->frag_count = 0;
+	tx_info->ts_requested = 0;
+
+	// count packet
+	u64_stats_update_begin(&ring->syncp);
+	ring->packets++;
+	ring->bytes += xdpf->len;
+	u64_stats_update_end(&ring->syncp);
+
+	// enqueue
+	ring->prod_ptr++;
+
+	return 0;
+}
+
+int mqnic_xdp_tx_buff(struct mqnic_priv *priv, struct xdp_buff *xdp)
+{
+	struct mqnic_ring *ring;
+	struct xdp_frame *xdpf;
+	int ret;
+
+	rcu_read_lock();
+
+	ring = mqnic_xdp_get_tx_ring(priv);
+	if (unlikely(!ring)) {
+		ret = -ENXIO;
+		goto out;
+	}
+
+	xdpf = xdp_convert_buff_to_frame(xdp);
+	if (unlikely(!xdpf)) {
+		ret = -EOVERFLOW;
+		goto out;
+	}
+
+	spin_lock(&ring->xdp_tx_lock);
+	ret = mqnic_xdp_xmit_frame(ring, xdpf, false);
+	spin_unlock(&ring->xdp_tx_lock);
+
+out:
+	rcu_read_unlock();
+
+	return ret;
+}
+
+void mqnic_xdp_flush_tx(struct mqnic_priv *priv)
+{
+	struct mqnic_ring *ring;
+
+	rcu_read_lock();
+
+	ring = mqnic_xdp_get_tx_ring(priv);
+	if (likely(ring)) {
+		// enqueue on NIC
+		spin_lock(&ring->xdp_tx_lock);
+		dma_wmb();
+		mqnic_tx_write_prod_ptr(ring);
+		spin_unlock(&ring->xdp_tx_lock);
+	}
+
+	rcu_read_unlock();
+}
+
+int mqnic_xdp_xmit(struct net_device *ndev, int n, struct xdp_frame **frames, u32 flags)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring *ring;
+	int k;
+
+	if (unlikely(!priv->port_up))
+		return -ENETDOWN;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	rcu_read_lock();
+
+	ring = mqnic_xdp_get_tx_ring(priv);
+	if (unlikely(!ring)) {
+		rcu_read_unlock();
+		return -ENXIO;
+	}
+
+	spin_lock(&ring->xdp_tx_lock);
+
+	for (k = 0; k < n; k++) {
+		if (mqnic_xdp_xmit_frame(ring, frames[k], true))
+			break;
+	}
+
+	// enqueue on NIC
+	if (k && (flags & XDP_XMIT_FLUSH)) {
+		dma_wmb();
+		mqnic_tx_write_prod_ptr(ring);
+	}
+
+	spin_unlock(&ring->xdp_tx_lock);
+
+	rcu_read_unlock();
+
+	return k;
+}
+
+static int mqnic_xdp_setup(struct net_device *ndev, struct bpf_prog *prog,
+		struct netlink_ext_ack *extack)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_dev *mdev = priv->mdev;
+	struct bpf_prog *old_prog;
+	bool reconfig;
+	int ret = 0;
+
+	if (prog && ndev->mtu > MQNIC_XDP_MAX_MTU) {
+		NL_SET_ERR_MSG_MOD(extack, "MTU too large for XDP");
+		return -EINVAL;
+	}
+
+	mutex_lock(&mdev->state_lock);
+
+	// RX buffer layout and XDP TX rings change when XDP is turned on or off
+	reconfig = priv->port_up && !priv->xdp_prog != !prog;
+
+	if (reconfig)
+		mqnic_stop_port(ndev);
+
+	old_prog = xchg(&priv->xdp_prog, prog);
+
+	if (reconfig) {
+		ret = mqnic_start_port(ndev);
+
+		if (ret) {
+			netdev_err(ndev, "%s: Failed to start port: %d", __func__, ret);
+			xchg(&priv->xdp_prog, old_prog);
+
+			// bring the datapath back up with the previous program
+			if (mqnic_start_port(ndev))
+				netdev_err(ndev, "%s: Failed to restart port", __func__);
+
+			mutex_unlock(&mdev->state_lock);
+			return ret;
+		}
+	}
+
+	mutex_unlock(&mdev->state_lock);
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+int mqnic_bpf(struct net_device *ndev, struct netdev_bpf *bpf)
+{
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		return mqnic_xdp_setup(ndev, bpf->prog, bpf->extack);
+	case XDP_SETUP_XSK_POOL:
+		return mqnic_xsk_pool_setup(ndev, bpf->xsk.pool, bpf->xsk.queue_id);
+	default:
+		return -EINVAL;
+	}
+}
@@ -0,0 +1,447 @@
+// SPDX-License-Identifier: BSD-2-Clause-Views
+/*
+ * Copyright (c) 2023 The Regents of the University of California
+ */
+
+#include "mqnic.h"
+
+#include <linux/bpf_trace.h>
+#include <linux/version.h>
+
+struct xsk_buff_pool *mqnic_xsk_pool(struct mqnic_priv *priv, int qid)
+{
+	if (!priv->xsk_zc_qps || !test_bit(qid, priv->xsk_zc_qps))
+		return NULL;
+
+	return xsk_get_pool_from_qid(priv->ndev, qid);
+}
+
+static int mqnic_xsk_restart_port(struct mqnic_priv *priv)
+{
+	if (!priv->port_up)
+		return 0;
+
+	mqnic_stop_port(priv->ndev);
+	return mqnic_start_port(priv->ndev);
+}
+
+static int mqnic_xsk_pool_enable(struct mqnic_priv *priv, struct xsk_buff_pool *pool, u16 qid)
+{
+	struct mqnic_dev *mdev = priv->mdev;
+	int ret;
+
+	if (qid >= priv->rxq_count || qid >= priv->txq_count)
+		return -EINVAL;
+
+	if (xsk_pool_get_rx_frame_size(pool) < priv->ndev->mtu + ETH_HLEN) {
+		netdev_err(priv->ndev, "%s: UMEM frame size %u too small for MTU %d",
+				__func__, xsk_pool_get_rx_frame_size(pool), priv->ndev->mtu);
+		return -EINVAL;
+	}
+
+	ret = xsk_pool_dma_map(pool, priv->dev, 0);
+	if (ret)
+		return ret;
+
+	mutex_lock(&mdev->state_lock);
+
+	set_bit(qid, priv->xsk_zc_qps);
+
+	ret = mqnic_xsk_restart_port(priv);
+	if (ret) {
+		netdev_err(priv->ndev, "%s: Failed to start port: %d", __func__, ret);
+		clear_bit(qid, priv->xsk_zc_qps);
+	}
+
+	mutex_unlock(&mdev->state_lock);
+
+	if (ret)
+		xsk_pool_dma_unmap(pool, 0);
+
+	return ret;
+}
+
+static int mqnic_xsk_pool_disable(struct mqnic_priv *priv, u16 qid)
+{
+	struct mqnic_dev *mdev = priv->mdev;
+	struct xsk_buff_pool *pool;
+	int ret;
+
+	pool = mqnic_xsk_pool(priv, qid);
+	if (!pool)
+		return -EINVAL;
+
+	mutex_lock(&mdev->state_lock);
+
+	clear_bit(qid, priv->xsk_zc_qps);
+
+	ret = mqnic_xsk_restart_port(priv);
+	if (ret)
+		netdev_err(priv->ndev, "%s: Failed to start port: %d", __func__, ret);
+
+	mutex_unlock(&mdev->state_lock);
+
+	// the pool is detached from the rings either way
+	xsk_pool_dma_unmap(pool, 0);
+
+	return ret;
+}
+
+int mqnic_xsk_pool_setup(struct net_device *ndev, struct xsk_buff_pool *pool, u16 qid)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+
+	if (pool)
+		return mqnic_xsk_pool_enable(priv, pool, qid);
+	else
+		return mqnic_xsk_pool_disable(priv, qid);
+}
+
+int mqnic_xsk_wakeup(struct net_device *ndev, u32 qid, u32 flags)
+{
+	struct mqnic_priv *priv = netdev_priv(ndev);
+	struct mqnic_ring_table *rxq_table, *txq_table;
+	struct mqnic_ring *rx_ring = NULL, *tx_ring = NULL;
+
+	if (unlikely(!priv->port_up))
+		return -ENETDOWN;
+
+	if (unlikely(qid >= priv->rxq_count || qid >= priv->txq_count))
+		return -EINVAL;
+
+	rcu_read_lock();
+	rxq_table = rcu_dereference(priv->rxq_table);
+	txq_table = rcu_dereference(priv->txq_table);
+	if (likely(rxq_table && qid < rxq_table->count))
+		rx_ring = rxq_table->ring[qid];
+	if (likely(txq_table && qid < txq_table->count))
+		tx_ring = txq_table->ring[qid];
+	rcu_read_unlock();
+
+	if (unlikely(!rx_ring || !tx_ring || !rx_ring->xsk_pool || !tx_ring->xsk_pool))
+		return -EINVAL;
+
+	// no need to schedule if NAPI is already running; it will poll again
+	if (flags & XDP_WAKEUP_TX) {
+		if (!napi_if_scheduled_mark_missed(&tx_ring->cq->napi))
+			napi_schedule(&tx_ring->cq->napi);
+	}
+
+	if (flags & XDP_WAKEUP_RX) {
+		if (!napi_if_scheduled_mark_missed(&rx_ring->cq->napi))
+			napi_schedule(&rx_ring->cq->napi);
+	}
+
+	return 0;
+}
+
+int mqnic_prepare_rx_desc_zc(struct mqnic_ring *ring, int index)
+{
+	struct mqnic_rx_info *rx_info = &ring->rx_info[index];
+	struct mqnic_desc *rx_desc = (struct mqnic_desc *)(ring->buf + index * ring->stride);
+	struct xdp_buff *xdp;
+	dma_addr_t dma_addr;
+
+	if (unlikely(rx_info->xdp)) {
+		dev_err(ring->dev, "%s: buffer not yet processed on interface %d",
+				__func__, ring->interface->index);
+		return -1;
+	}
+
+	// running out of UMEM frames is expected; user space refills the fill ring
+	xdp = xsk_buff_alloc(ring->xsk_pool);
+	if (!xdp)
+		return -ENOMEM;
+
+	dma_addr = xsk_buff_xdp_get_dma(xdp);
+
+	// write descriptor
+	rx_desc->len = cpu_to_le32(ring->rx_buf_size);
+	rx_desc->addr = cpu_to_le64(dma_addr);
+
+	// update rx_info
+	rx_info->xdp = xdp;
+	rx_info->dma_addr = dma_addr;
+	rx_info->len = ring->rx_buf_size;
+
+	return 0;
+}
+
+static struct sk_buff *mqnic_construct_skb_zc(struct mqnic_cq *cq, struct xdp_buff *xdp)
+{
+	unsigned int len = xdp->data_end - xdp->data;
+	struct sk_buff *skb;
+
+	// UMEM frames belong to user space; copy the packet out for the stack
+	skb = napi_alloc_skb(&cq->napi, len);
+	if (unlikely(!skb))
+		return NULL;
+
+	skb_put_data(skb, xdp->data, len);
+	xsk_buff_free(xdp);
+
+	return skb;
+}
+
+int mqnic_process_rx_cq_zc(struct mqnic_cq *cq, int napi_budget)
+{
+	struct mqnic_if *interface = cq->interface;
+	struct mqnic_ring *rx_ring = cq->src_ring;
+	struct mqnic_priv *priv = rx_ring->priv;
+	struct xsk_buff_pool *pool = rx_ring->xsk_pool;
+	struct mqnic_rx_info *rx_info;
+	struct mqnic_cpl *cpl;
+	struct bpf_prog *xdp_prog;
+	struct xdp_frame *xdpf;
+	struct xdp_buff *xdp;
+	struct sk_buff *skb;
+	u32 cq_index;
+	u32 cq_cons_ptr;
+	u32 ring_index;
+	u32 ring_cons_ptr;
+	int done = 0;
+	int budget = napi_budget;
+	bool xdp_tx = false;
+	bool xdp_redirect = false;
+	u32 len;
+	u32 act;
+	int ret;
+
+	xdp_prog = READ_ONCE(priv->xdp_prog);
+
+	// process completion queue
+	cq_cons_ptr = cq->cons_ptr;
+	cq_index = cq_cons_ptr & cq->size_mask;
+
+	while (done < budget) {
+		cpl = (struct mqnic_cpl *)(cq->buf + cq_index * cq->stride);
+
+		if (!!(cpl->phase & cpu_to_le32(0x80000000)) == !!(cq_cons_ptr & cq->size))
+			break;
+
+		dma_rmb();
+
+		ring_index = le16_to_cpu(cpl->index) & rx_ring->size_mask;
+		rx_info = &rx_ring->rx_info[ring_index];
+		xdp = rx_info->xdp;
+
+		if (unlikely(!xdp)) {
+			netdev_err(priv->ndev, "%s: ring %d null buffer at index %d",
+					__func__, rx_ring->index, ring_index);
+			print_hex_dump(KERN_ERR, "", DUMP_PREFIX_NONE, 16, 1,
+					cpl, MQNIC_CPL_SIZE, true);
+			break;
+		}
+
+		rx_info->xdp = NULL;
+		rx_info->dma_addr = 0;
+
+		len = min_t(u32, le16_to_cpu(cpl->len), rx_info->len);
+		xdp->data_end = xdp->data + len;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 10, 0)
+		xsk_buff_dma_sync_for_cpu(xdp);
+#else
+		xsk_buff_dma_sync_for_cpu(xdp, pool);
+#endif
+
+		u64_stats_update_begin(&rx_ring->syncp);
+		rx_ring->packets++;
+		rx_ring->bytes += le16_to_cpu(cpl->len);
+		u64_stats_update_end(&rx_ring->syncp);
+
+		act = xdp_prog ? bpf_prog_run_xdp(xdp_prog, xdp) : XDP_PASS;
+
+		switch (act) {
+		case XDP_PASS:
+			skb = mqnic_construct_skb_zc(cq, xdp);
+			if (unlikely(!skb)) {
+				xsk_buff_free(xdp);
+				u64_stats_update_begin(&rx_ring->syncp);
+				rx_ring->dropped_packets++;
+				u64_stats_update_end(&rx_ring->syncp);
+				break;
+			}
+
+			// RX hardware timestamp
+			if (interface->if_features & MQNIC_IF_FEATURE_PTP_TS)
+				skb_hwtstamps(skb)->hwtstamp = mqnic_read_cpl_ts(interface->mdev, rx_ring, cpl);
+
+			skb_record_rx_queue(skb, rx_ring->queue_index);
+
+			// RX hardware flow hash
+			mqnic_rx_set_hash(skb, priv, cpl);
+
+			// RX hardware checksum
+			if (priv->ndev->features & NETIF_F_RXCSUM) {
+				skb->csum = csum_unfold((__sum16) cpu_to_be16(le16_to_cpu(cpl->rx_csum)));
+				skb->ip_summed = CHECKSUM_COMPLETE;
+			}
+
+			skb->protocol = eth_type_trans(skb, priv->ndev);
+
+			// hand off SKB
+			napi_gro_receive(&cq->napi, skb);
+			break;
+		case XDP_REDIRECT:
+			if (unlikely(xdp_do_redirect(priv->ndev, xdp, xdp_prog)))
+				goto out_failure;
+			xdp_redirect = true;
+			break;
+		case XDP_TX:
+			// copies the frame out of the UMEM and releases the XSK buffer
+			xdpf = xdp_convert_buff_to_frame(xdp);
+			if (unlikely(!xdpf))
+				goto out_failure;
+			if (unlikely(mqnic_xdp_xmit(priv->ndev, 1, &xdpf, 0) != 1)) {
+				xdp_return_frame(xdpf);
+				trace_xdp_exception(priv->ndev, xdp_prog, act);
+				u64_stats_update_begin(&rx_ring->syncp);
+				rx_ring->dropped_packets++;
+				u64_stats_update_end(&rx_ring->syncp);
+				break;
+			}
+			xdp_tx = true;
+			break;
+		default:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0)
+			bpf_warn_invalid_xdp_action(priv->ndev, xdp_prog, act);
+#else
+			bpf_warn_invalid_xdp_action(act);
+#endif
+			fallthrough;
+		case XDP_ABORTED:
+out_failure:
+			trace_xdp_exception(priv->ndev, xdp_prog, act);
+			fallthrough;
+		case XDP_DROP:
+			xsk_buff_free(xdp);
+			u64_stats_update_begin(&rx_ring->syncp);
+			rx_ring->dropped_packets++;
+			u64_stats_update_end(&rx_ring->syncp);
+			break;
+		}
+
+		done++;
+
+		cq_cons_ptr++;
+		cq_index = cq_cons_ptr & cq->size_mask;
+	}
+
+	// update CQ consumer pointer; not deferred, as the RX CQ is only as
+	// large as the ring, which is refilled below
+	cq->cons_ptr = cq_cons_ptr;
+	mqnic_cq_write_cons_ptr(cq);
+
+	// flush XDP actions
+	if (xdp_redirect)
+		xdp_do_flush();
+
+	if (xdp_tx)
+		mqnic_xdp_flush_tx(priv);
+
+	// process ring
+	ring_cons_ptr = READ_ONCE(rx_ring->cons_ptr);
+	ring_index = ring_cons_ptr & rx_ring->size_mask;
+
+	while (ring_cons_ptr != rx_ring->prod_ptr) {
+		rx_info = &rx_ring->rx_info[ring_index];
+
+		if (rx_info->xdp)
+			break;
+
+		ring_cons_ptr++;
+		ring_index = ring_cons_ptr & rx_ring->size_mask;
+	}
+
+	// update consumer pointer
+	WRITE_ONCE(rx_ring->cons_ptr, ring_cons_ptr);
+
+	// replenish buffers; ask user space for a wakeup if the fill ring ran dry
+	ret = mqnic_refill_rx_buffers(rx_ring);
+
+	if (xsk_uses_need_wakeup(pool)) {
+		if (ret)
+			xsk_set_rx_need_wakeup(pool);
+		else
+			xsk_clear_rx_need_wakeup(pool);
+	}
+
+	return done;
+}
+
+bool mqnic_xsk_xmit(struct mqnic_ring *ring, int budget)
+{
+	struct mqnic_priv *priv = ring->priv;
+	struct xsk_buff_pool *pool = ring->xsk_pool;
+	struct mqnic_tx_info *tx_info;
+	struct mqnic_desc *tx_desc;
+	struct xdp_desc desc;
+	dma_addr_t dma_addr;
+	u32 index;
+	u32 i;
+	int sent = 0;
+
+	if (unlikely(!priv || !priv->port_up))
+		return true;
+
+	// ring is shared with the stack
+	__netif_tx_lock(ring->tx_queue, smp_processor_id());
+
+	while (sent < budget && !mqnic_is_tx_ring_full(ring)) {
+		if (!xsk_tx_peek_desc(pool, &desc))
+			break;
+
+		dma_addr = xsk_buff_raw_get_dma(pool, desc.addr);
+		xsk_buff_raw_dma_sync_for_device(pool, dma_addr, desc.len);
+
+		index = ring->prod_ptr & ring->size_mask;
+
+		tx_desc = (struct mqnic_desc *)(ring->buf + index * ring->stride);
+
+		tx_info = &ring->tx_info[index];
+
+		// write descriptor
+		tx_desc[0].tx_csum_cmd = 0;
+		tx_desc[0].len = cpu_to_le32(desc.len);
+		tx_desc[0].addr = cpu_to_le64(dma_addr);
+
+		for (i = 1; i < ring->desc_block_size; i++) {
+			tx_desc[i].len = 0;
+			tx_desc[i].addr = 0;
+		}
+
+		// update tx_info
+		tx_info->skb = NULL;
+		tx_info->xdpf = NULL;
+		tx_info->type = MQNIC_TX_TYPE_XSK;
+		tx_info->enqueue_ns = 0;
+		tx_info->frag_count = 0;
+		tx_info->ts_requested = 0;
+
+		// count packet
+		u64_stats_update_begin(&ring->syncp);
+		ring->packets++;
+		ring->bytes += desc.len;
+		u64_stats_update_end(&ring->syncp);
+
+		// enqueue
+		ring->prod_ptr++;
+
+		sent++;
+	}
+
+	if (sent) {
+		xsk_tx_release(pool);
+
+		// enqueue on NIC
+		dma_wmb();
+		mqnic_tx_write_prod_ptr(ring);
+	}
+
+	__netif_tx_unlock(ring->tx_queue);
+
+	if (xsk_uses_need_wakeup(pool))
+		xsk_set_tx_need_wakeup(pool);
+
+	return sent < budget;
+}
@@ -0,0 +1,232 @@
+#!/bin/bash
+
+# Copyright 2023, The Regents of the University of California.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+#    1. Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+# 
+#    2. Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE REGENTS OF THE UNIVERSITY OF CALIFORNIA ''AS
+# IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE REGENTS OF THE UNIVERSITY OF CALIFORNIA OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+# IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+# OF SUCH DAMAGE.
+# 
+# The views and conclusions contained in the software and documentation are those
+# of the authors and should not be interpreted as representing official policies,
+# either expressed or implied, of The Regents of the University of California.
+
+repeats=1
+ip=
+netdev=
+duration=10
+modes="irq busypoll threaded"
+tests="UDP_RR TCP_RR"
+req_size=1
+busy_poll_us=50
+base_logdir=./logs/
+
+# completion doorbell batch sizes (mqnic cq_cons_batch), left unchanged if empty
+batches=
+param=/sys/module/mqnic/parameters/cq_cons_batch
+
+while getopts i:c:b:m:T:t:r:s:-: option; do
+    case "${option}" in
+        -)
+            case "${OPTARG}" in
+                busy-poll)
+                    busy_poll_us="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                busy-poll=*)
+                    busy_poll_us=${OPTARG#*=}
+                    ;;
+                logdir)
+                    base_logdir="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                logdir=*)
+                    base_logdir=${OPTARG#*=}
+                    ;;
+                *)
+                    if [ "$OPTERR" = 1 ] && [ "${optspec:0:1}" != ":" ]; then
+                        echo "Unknown option --${OPTARG}" >&2
+                    fi
+                    ;;
+            esac;;
+        i) netdev=${OPTARG};;
+        c) ip=${OPTARG};;
+        b) batches=${OPTARG};;
+        m) modes=${OPTARG};;
+        T) tests=${OPTARG};;
+        t) duration=${OPTARG};;
+        r) repeats=${OPTARG};;
+        s) req_size=${OPTARG};;
+    esac
+done
+shift $((OPTIND -1))
+
+if [ -z "$ip" ]; then
+    echo "Remote address not specified" >&2
+    exit -1
+fi
+
+if [ -z "$netdev" ]; then
+    netdev=$(ip route get $ip | grep -oP "dev\s+\K\w+")
+    echo "Using local device '$netdev'"
+fi
+
+if [ -n "$batches" ] && [ ! -w "$param" ]; then
+    echo "Cannot write '$param'; is the mqnic module loaded?" >&2
+    exit -1
+fi
+
+if [ ! -x "$(command -v netperf)" ] ; then
+    echo "netperf not found" >&2
+    exit -1
+fi
+
+numa_cmd=
+
+if [ ! -x "$(command -v numactl)" ] ; then
+    echo "numactl not found; cannot bind netperf to netdev NUMA node" >&2
+else
+    numa_cmd="numactl -l -N netdev:$netdev"
+fi
+
+# save settings
+orig_busy_read=$(sysctl -n net.core.busy_read)
+orig_busy_poll=$(sysctl -n net.core.busy_poll)
+orig_threaded=$(cat /sys/class/net/$netdev/threaded 2> /dev/null)
+orig_batch=$(cat $param 2> /dev/null)
+
+function set_mode()
+{
+    case "$1" in
+        irq)
+            sysctl -q -w net.core.busy_read=0 net.core.busy_poll=0
+            [ -z "$orig_threaded" ] || echo 0 > /sys/class/net/$netdev/threaded
+            ;;
+        busypoll)
+            sysctl -q -w net.core.busy_read=$busy_poll_us net.core.busy_poll=$busy_poll_us
+            [ -z "$orig_threaded" ] || echo 0 > /sys/class/net/$netdev/threaded
+            ;;
+        threaded)
+            if [ -z "$orig_threaded" ]; then
+                echo "Threaded NAPI not supported on '$netdev'" >&2
+                return 1
+            fi
+            sysctl -q -w net.core.busy_read=0 net.core.busy_poll=0
+            echo 1 > /sys/class/net/$netdev/threaded
+            ;;
+        *)
+            echo "Unknown mode '$1'" >&2
+            return 1
+            ;;
+    esac
+}
+
+function cleanup()
+{
+    echo "Cleaning up..."
+
+    # kill all subprocesses
+    trap '' TERM
+    pkill -P $$
+
+    # restore settings
+    sysctl -q -w net.core.busy_read=$orig_busy_read net.core.busy_poll=$orig_busy_poll
+    [ -z "$orig_threaded" ] || echo $orig_threaded > /sys/class/net/$netdev/threaded
+    [ -z "$batches" ] || echo $orig_batch > $param
+}
+
+trap "exit" INT TERM
+trap cleanup EXIT
+
+# run measurement
+
+function run_meas()
+{
+    batch=$1
+    mode=$2
+    test_type=$3
+    rep=$4
+
+    logdir="$base_logdir/${batch:+batch$batch/}$mode/$test_type/$rep/"
+    mkdir -p $logdir
+
+    if ! set_mode $mode; then
+        echo "Skipping"
+        return
+    fi
+
+    [ -z "$batch" ] || echo $batch > $param
+
+    # capture performance counters
+    cat /proc/net/dev > $logdir/proc_net_dev.log
+    cat /proc/stat > $logdir/proc_stat.log
+
+    if [ "$test_type" = "TCP_STREAM" ]; then
+        $numa_cmd netperf -H $ip -t $test_type -l $duration -P 0 -- \
+            -o THROUGHPUT,LOCAL_CPU_UTIL \
+            > "$logdir/netperf.log" 2>&1
+    else
+        $numa_cmd netperf -H $ip -t $test_type -l $duration -P 0 -- -r $req_size,$req_size \
+            -o MIN_LATENCY,MEAN_LATENCY,P50_LATENCY,P90_LATENCY,P99_LATENCY,MAX_LATENCY,TRANSACTION_RATE \
+            > "$logdir/netperf.log" 2>&1
+    fi
+
+    cat /proc/net/dev >> $logdir/proc_net_dev.log
+    cat /proc/stat >> $logdir/proc_stat.log
+
+    # aggregate
+    result=$(tail -n 1 "$logdir/netperf.log" | tr -d ' ')
+
+    intr_stat=$(grep "intr" "$logdir/proc_stat.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+    cpu_stat=$(grep "cpu\s" "$logdir/proc_stat.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+
+    intr=$(echo $intr_stat | cut -d ' ' -f 1)
+
+    cpu_idle=$(echo $cpu_stat | cut -d ' ' -f 4)
+    cpu_total=$(echo $cpu_stat | tr " " "\n" | grep . | paste -sd+ - | bc)
+    cpu_pct=$(echo "scale=4; ($cpu_total-$cpu_idle) * 100 / $cpu_total" | bc)
+
+    echo $rep, $(echo $result | sed 's/,/, /g'), $intr, $cpu_pct | tee -a "$base_logdir/${batch:+batch$batch-}$mode-$test_type.csv"
+}
+
+mkdir -p $base_logdir
+
+# a single pass with the current batch size when no sizes are given
+for batch in ${batches:-""}; do
+    for mode in $modes; do
+        for test_type in $tests; do
+            if [ "$test_type" = "TCP_STREAM" ]; then
+                echo "rep, tput_mbps, local_cpu, intr, cpu" > "$base_logdir/${batch:+batch$batch-}$mode-$test_type.csv"
+            else
+                echo "rep, min_us, mean_us, p50_us, p90_us, p99_us, max_us, trans_per_sec, intr, cpu" > "$base_logdir/${batch:+batch$batch-}$mode-$test_type.csv"
+            fi
+        done
+    done
+done
+
+for rep in $(seq 1 $repeats); do
+    for batch in ${batches:-""}; do
+        for mode in $modes; do
+            for test_type in $tests; do
+                echo "Running $test_type test${batch:+ with cq_cons_batch=$batch} in $mode mode to '$ip' ($rep/$repeats)"
+                run_meas "$batch" $mode $test_type $rep
+            done
+        done
+    done
+done
@@ -0,0 +1,237 @@
+#!/bin/bash
+
+# Copyright 2023, The Regents of the University of California.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+#    1. Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+# 
+#    2. Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE REGENTS OF THE UNIVERSITY OF CALIFORNIA ''AS
+# IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE REGENTS OF THE UNIVERSITY OF CALIFORNIA OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+# IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+# OF SUCH DAMAGE.
+# 
+# The views and conclusions contained in the software and documentation are those
+# of the authors and should not be interpreted as representing official policies,
+# either expressed or implied, of The Regents of the University of California.
+
+# pktgen TX benchmark
+#
+# Drives the netdev transmit path with in-kernel pktgen, one pktgen thread per
+# TX queue, and reports TX packet rate and CPU cycles per packet.  Useful for
+# measuring per-packet driver overhead such as queue lookup in ndo_start_xmit.
+# Softirq cycles per packet isolate the TX completion path, which runs in
+# NAPI context while pktgen itself runs in its kernel threads.
+
+repeats=1
+netdev=
+dst_ip=198.51.100.1
+dst_mac=ff:ff:ff:ff:ff:ff
+duration=10
+threads_list="1 2 4"
+pkt_size=64
+burst=1
+cpu_mhz=
+base_logdir=./logs/
+
+while getopts i:d:m:t:n:s:b:r:-: option; do
+    case "${option}" in
+        -)
+            case "${OPTARG}" in
+                cpu-mhz)
+                    cpu_mhz="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                cpu-mhz=*)
+                    cpu_mhz=${OPTARG#*=}
+                    ;;
+                logdir)
+                    base_logdir="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                logdir=*)
+                    base_logdir=${OPTARG#*=}
+                    ;;
+                *)
+                    if [ "$OPTERR" = 1 ] && [ "${optspec:0:1}" != ":" ]; then
+                        echo "Unknown option --${OPTARG}" >&2
+                    fi
+                    ;;
+            esac;;
+        i) netdev=${OPTARG};;
+        d) dst_ip=${OPTARG};;
+        m) dst_mac=${OPTARG};;
+        t) duration=${OPTARG};;
+        n) threads_list=${OPTARG};;
+        s) pkt_size=${OPTARG};;
+        b) burst=${OPTARG};;
+        r) repeats=${OPTARG};;
+    esac
+done
+shift $((OPTIND -1))
+
+if [ -z "$netdev" ]; then
+    echo "Interface name not specified" >&2
+    exit -1
+fi
+
+if [ ! -d /proc/net/pktgen ]; then
+    modprobe pktgen
+fi
+
+if [ ! -d /proc/net/pktgen ]; then
+    echo "pktgen not available" >&2
+    exit -1
+fi
+
+if [ -z "$cpu_mhz" ]; then
+    cpu_mhz=$(grep "cpu MHz" /proc/cpuinfo | awk '{s+=$4} END {if (NR) printf "%d", s/NR}')
+fi
+
+clk_tck=$(getconf CLK_TCK)
+
+# pick CPUs local to the netdev
+cpus=$(cat /sys/class/net/$netdev/device/local_cpulist 2> /dev/null)
+if [ -z "$cpus" ]; then
+    cpus="0-$(( $(nproc) - 1 ))"
+fi
+cpus=$(echo $cpus | tr ',' '\n' | awk -F- '{if (NF==2) {for(i=$1;i<=$2;i++) print i} else print $1}' | tr '\n' ' ')
+
+function pgset()
+{
+    echo "$2" > $1
+    if ! grep -q "^Result: OK" $1; then
+        echo "pktgen: '$2' on $1 failed" >&2
+        grep "^Result:" $1 >&2
+    fi
+}
+
+function pktgen_reset()
+{
+    echo "reset" > /proc/net/pktgen/pgctrl 2> /dev/null
+}
+
+function cleanup()
+{
+    echo "Cleaning up..."
+
+    # kill all subprocesses
+    trap '' TERM
+    pkill -P $$
+
+    pktgen_reset
+}
+
+trap "exit" INT TERM
+trap cleanup EXIT
+
+# run measurement
+
+function run_meas()
+{
+    threads=$1
+    rep=$2
+
+    logdir="$base_logdir/$threads/$rep/"
+    mkdir -p $logdir
+
+    pktgen_reset
+
+    # one pktgen thread per CPU, each feeding its own TX queue
+    k=0
+    for cpu in $cpus; do
+        if [ $k -ge $threads ]; then
+            break
+        fi
+
+        dev="$netdev@$k"
+        pgset /proc/net/pktgen/kpktgend_$cpu "rem_device_all"
+        pgset /proc/net/pktgen/kpktgend_$cpu "add_device $dev"
+        pgset /proc/net/pktgen/$dev "count 0"
+        pgset /proc/net/pktgen/$dev "pkt_size $pkt_size"
+        pgset /proc/net/pktgen/$dev "burst $burst"
+        pgset /proc/net/pktgen/$dev "delay 0"
+        pgset /proc/net/pktgen/$dev "queue_map_min $k"
+        pgset /proc/net/pktgen/$dev "queue_map_max $k"
+        pgset /proc/net/pktgen/$dev "dst $dst_ip"
+        pgset /proc/net/pktgen/$dev "dst_mac $dst_mac"
+        pgset /proc/net/pktgen/$dev "flag NO_TIMESTAMP"
+
+        k=$(( $k + 1 ))
+    done
+
+    echo "start" > /proc/net/pktgen/pgctrl &
+    pgctrl_pid=$!
+
+    sleep 2
+
+    # capture performance counters
+    cat /proc/net/dev > $logdir/proc_net_dev.log
+    cat /proc/stat > $logdir/proc_stat.log
+    start_time=$(date +%s.%N)
+    for i in $(seq 1 $duration); do
+        sleep 1
+        cat /proc/net/dev >> $logdir/proc_net_dev.log
+        cat /proc/stat >> $logdir/proc_stat.log
+        echo -n .
+    done
+    end_time=$(date +%s.%N)
+    elapsed=$(echo "scale=4; $end_time - $start_time" | bc)
+
+    echo "stop" > /proc/net/pktgen/pgctrl
+    wait $pgctrl_pid
+    echo
+
+    for f in /proc/net/pktgen/$netdev@*; do
+        cat $f >> $logdir/pktgen.log
+    done
+
+    # aggregate
+    if_stat=$(grep "$netdev:" "$logdir/proc_net_dev.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+    cpu_stat=$(grep "cpu\s" "$logdir/proc_stat.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+
+    if_tx_b=$(echo $if_stat | cut -d ' ' -f 9)
+    if_tx_pkt=$(echo $if_stat | cut -d ' ' -f 10)
+    if_tx_drop=$(echo $if_stat | cut -d ' ' -f 12)
+
+    tx_pps=$(echo "scale=0; $if_tx_pkt / $elapsed" | bc)
+
+    cpu_idle=$(echo $cpu_stat | cut -d ' ' -f 4)
+    cpu_total=$(echo $cpu_stat | tr " " "\n" | grep . | paste -sd+ - | bc)
+    cpu_busy=$(( $cpu_total - $cpu_idle ))
+    cpu_pct=$(echo "scale=4; $cpu_busy * 100 / $cpu_total" | bc)
+
+    # busy jiffies converted to cycles, spread over transmitted packets
+    cpp=$(echo "scale=1; if ($if_tx_pkt > 0) $cpu_busy * $cpu_mhz * 1000000 / $clk_tck / $if_tx_pkt else 0" | bc)
+
+    # TX completion processing
+    cpu_softirq=$(echo $cpu_stat | cut -d ' ' -f 7)
+    sirq_cpp=$(echo "scale=1; if ($if_tx_pkt > 0) $cpu_softirq * $cpu_mhz * 1000000 / $clk_tck / $if_tx_pkt else 0" | bc)
+
+    echo $rep, $elapsed, $if_tx_b, $if_tx_pkt, $if_tx_drop, $tx_pps, $cpu_pct, $cpp, $sirq_cpp | tee -a "$base_logdir/$threads.csv"
+}
+
+mkdir -p $base_logdir
+
+for threads in $threads_list; do
+    echo "rep, sec, if_tx_b, if_tx_pkt, if_tx_drop, tx_pps, cpu, cycles_per_pkt, softirq_cycles_per_pkt" > "$base_logdir/$threads.csv"
+done
+
+for rep in $(seq 1 $repeats); do
+    for threads in $threads_list; do
+        echo "Running pktgen test on '$netdev' with $threads threads, $pkt_size byte packets ($rep/$repeats)"
+        run_meas $threads $rep
+    done
+done
@@ -0,0 +1,238 @@
+#!/bin/bash
+
+# Copyright 2023, The Regents of the University of California.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+#    1. Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+# 
+#    2. Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE REGENTS OF THE UNIVERSITY OF CALIFORNIA ''AS
+# IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE REGENTS OF THE UNIVERSITY OF CALIFORNIA OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+# IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+# OF SUCH DAMAGE.
+# 
+# The views and conclusions contained in the software and documentation are those
+# of the authors and should not be interpreted as representing official policies,
+# either expressed or implied, of The Regents of the University of California.
+
+# RX memory fragmentation stress test
+#
+# Fragments free memory into isolated order-0 pages, then receives jumbo
+# frames with iperf3 in reverse mode while watching the driver RX refill path.
+# With scatter-gather RX over descriptor blocks, refill only needs order-0
+# pages, so the per-queue alloc_failed counters and rx_pp_alloc_slow_ho
+# should stay at zero.
+
+repeats=1
+netdev=
+dest_ip=
+mtu=9000
+duration=60
+iperf_p=4
+fill_pct=80
+base_logdir=./logs/
+
+frag_dir=
+
+while getopts i:d:m:t:P:f:r:-: option; do
+    case "${option}" in
+        -)
+            case "${OPTARG}" in
+                logdir)
+                    base_logdir="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                logdir=*)
+                    base_logdir=${OPTARG#*=}
+                    ;;
+                *)
+                    if [ "$OPTERR" = 1 ] && [ "${optspec:0:1}" != ":" ]; then
+                        echo "Unknown option --${OPTARG}" >&2
+                    fi
+                    ;;
+            esac;;
+        i) netdev=${OPTARG};;
+        d) dest_ip=${OPTARG};;
+        m) mtu=${OPTARG};;
+        t) duration=${OPTARG};;
+        P) iperf_p=${OPTARG};;
+        f) fill_pct=${OPTARG};;
+        r) repeats=${OPTARG};;
+    esac
+done
+shift $((OPTIND -1))
+
+if [ -z "$netdev" ]; then
+    echo "Interface name not specified" >&2
+    exit -1
+fi
+
+if [ -z "$dest_ip" ]; then
+    echo "iperf3 server address not specified" >&2
+    exit -1
+fi
+
+orig_mtu=$(cat /sys/class/net/$netdev/mtu)
+orig_compaction=$(cat /proc/sys/vm/compaction_proactiveness 2> /dev/null)
+
+# sum of ethtool -S counters whose name matches a regex
+function ethtool_stat()
+{
+    ethtool -S $netdev | awk -v k="^$1:\$" '$1 ~ k {s+=$2} END {print s+0}'
+}
+
+# free pages of order 2 and above, all zones
+function free_high_order()
+{
+    awk '{for(i=7;i<=NF;i++) s+=$i} END {print s+0}' /proc/buddyinfo
+}
+
+# fill page cache on tmpfs with single page files, then free every other
+# one, leaving free memory as isolated order-0 holes
+function fragment_memory()
+{
+    frag_dir=$(mktemp -d)
+    mount -t tmpfs -o size=100% tmpfs $frag_dir
+
+    mem_free_kb=$(awk '/^MemAvailable:/ {print $2}' /proc/meminfo)
+    count=$(( $mem_free_kb * $fill_pct / 100 / 4 ))
+
+    echo "Fragmenting memory: $count pages"
+
+    mkdir -p $frag_dir/f
+    for i in $(seq 0 $(( $count - 1 ))); do
+        head -c 4096 /dev/zero > $frag_dir/f/$i
+    done
+    for i in $(seq 0 2 $(( $count - 1 ))); do
+        rm -f $frag_dir/f/$i
+    done
+}
+
+function release_memory()
+{
+    if [ -n "$frag_dir" ]; then
+        umount $frag_dir 2> /dev/null
+        rmdir $frag_dir 2> /dev/null
+        frag_dir=
+    fi
+}
+
+function cleanup()
+{
+    echo "Cleaning up..."
+
+    # kill all subprocesses
+    trap '' TERM
+    pkill -P $$
+
+    release_memory
+
+    ip link set dev $netdev mtu $orig_mtu
+
+    if [ -n "$orig_compaction" ]; then
+        echo $orig_compaction > /proc/sys/vm/compaction_proactiveness
+    fi
+}
+
+trap "exit" INT TERM
+trap cleanup EXIT
+
+# keep the kernel from undoing the fragmentation in the background
+if [ -n "$orig_compaction" ]; then
+    echo 0 > /proc/sys/vm/compaction_proactiveness
+fi
+
+# ring restart picks the RX buffer layout for the new MTU
+ip link set dev $netdev mtu $mtu
+
+# run measurement
+
+failed=0
+
+function run_meas()
+{
+    rep=$1
+
+    logdir="$base_logdir/$rep/"
+    mkdir -p $logdir
+
+    fragment_memory
+
+    # cycle the link so every RX ring refills under fragmentation
+    ip link set dev $netdev down
+    ip link set dev $netdev up
+    sleep 2
+
+    cat /proc/buddyinfo > $logdir/buddyinfo.log
+
+    alloc_failed_start=$(ethtool_stat 'rx_queue_[0-9]+_alloc_failed')
+    slow_ho_start=$(ethtool_stat rx_pp_alloc_slow_ho)
+    free_ho_start=$(free_high_order)
+
+    iperf3 -c $dest_ip -R -P $iperf_p -t $duration -J > $logdir/iperf.json &
+    iperf_pid=$!
+
+    # capture performance counters
+    cat /proc/net/dev > $logdir/proc_net_dev.log
+    start_time=$(date +%s.%N)
+    for i in $(seq 1 $duration); do
+        sleep 1
+        cat /proc/net/dev >> $logdir/proc_net_dev.log
+        echo -n .
+    done
+    end_time=$(date +%s.%N)
+    elapsed=$(echo "scale=4; $end_time - $start_time" | bc)
+
+    wait $iperf_pid
+    echo
+
+    cat /proc/buddyinfo >> $logdir/buddyinfo.log
+    ethtool -S $netdev > $logdir/ethtool_stats.log
+
+    alloc_failed=$(( $(ethtool_stat 'rx_queue_[0-9]+_alloc_failed') - $alloc_failed_start ))
+    slow_ho=$(( $(ethtool_stat rx_pp_alloc_slow_ho) - $slow_ho_start ))
+
+    release_memory
+
+    # aggregate
+    if_stat=$(grep "$netdev:" "$logdir/proc_net_dev.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+
+    if_rx_b=$(echo $if_stat | cut -d ' ' -f 1)
+    if_rx_pkt=$(echo $if_stat | cut -d ' ' -f 2)
+    if_rx_drop=$(echo $if_stat | cut -d ' ' -f 4)
+
+    echo $rep, $elapsed, $if_rx_b, $if_rx_pkt, $if_rx_drop, $free_ho_start, $alloc_failed, $slow_ho | tee -a "$base_logdir/results.csv"
+
+    if [ $alloc_failed -ne 0 ] || [ $slow_ho -ne 0 ]; then
+        echo "FAIL: $alloc_failed refill failures, $slow_ho high-order allocations" >&2
+        failed=1
+    fi
+}
+
+mkdir -p $base_logdir
+
+echo "rep, sec, if_rx_b, if_rx_pkt, if_rx_drop, free_high_order, rx_alloc_failed, rx_pp_alloc_slow_ho" > "$base_logdir/results.csv"
+
+for rep in $(seq 1 $repeats); do
+    echo "Running RX fragmentation test on '$netdev' with MTU $mtu ($rep/$repeats)"
+    run_meas $rep
+done
+
+if [ $failed -ne 0 ]; then
+    exit 1
+fi
+
+echo "PASS"
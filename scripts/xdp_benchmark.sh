@@ -0,0 +1,225 @@
+#!/bin/bash
+
+# Copyright 2023, The Regents of the University of California.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+#    1. Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+# 
+#    2. Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE REGENTS OF THE UNIVERSITY OF CALIFORNIA ''AS
+# IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE REGENTS OF THE UNIVERSITY OF CALIFORNIA OR
+# CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+# EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+# OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+# INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+# IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY
+# OF SUCH DAMAGE.
+# 
+# The views and conclusions contained in the software and documentation are those
+# of the authors and should not be interpreted as representing official policies,
+# either expressed or implied, of The Regents of the University of California.
+
+# XDP benchmark
+#
+# Runs xdp-bench (from xdp-tools) in drop, pass, tx, and redirect modes on a
+# local netdev while traffic is generated externally (e.g. with pktgen on a
+# link partner), and samples interface and CPU counters for each mode.
+#
+# The RX drop counter is also checked against the verdict of each program:
+# in drop mode every received packet must be counted as dropped, while in
+# pass and tx mode (almost) none may be.  The script exits non-zero if any
+# check fails.
+
+repeats=1
+netdev=
+redirect_netdev=
+xdp_mode=native
+duration=10
+modes="drop pass tx redirect"
+base_logdir=./logs/
+drop_check_failed=0
+
+while getopts i:o:m:t:r:-: option; do
+    case "${option}" in
+        -)
+            case "${OPTARG}" in
+                xdp-mode)
+                    xdp_mode="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                xdp-mode=*)
+                    xdp_mode=${OPTARG#*=}
+                    ;;
+                logdir)
+                    base_logdir="${!OPTIND}"; OPTIND=$(( $OPTIND + 1 ))
+                    ;;
+                logdir=*)
+                    base_logdir=${OPTARG#*=}
+                    ;;
+                *)
+                    if [ "$OPTERR" = 1 ] && [ "${optspec:0:1}" != ":" ]; then
+                        echo "Unknown option --${OPTARG}" >&2
+                    fi
+                    ;;
+            esac;;
+        i) netdev=${OPTARG};;
+        o) redirect_netdev=${OPTARG};;
+        m) modes=${OPTARG};;
+        t) duration=${OPTARG};;
+        r) repeats=${OPTARG};;
+    esac
+done
+shift $((OPTIND -1))
+
+if [ -z "$netdev" ]; then
+    echo "Interface name not specified" >&2
+    exit -1
+fi
+
+if [ ! -x "$(command -v xdp-bench)" ] ; then
+    echo "xdp-bench not found; install xdp-tools" >&2
+    exit -1
+fi
+
+numa_cmd=
+
+if [ ! -x "$(command -v numactl)" ] ; then
+    echo "numactl not found; cannot bind xdp-bench to netdev NUMA node" >&2
+else
+    numa_cmd="numactl -l -N netdev:$netdev"
+fi
+
+function cleanup()
+{
+    echo "Cleaning up..."
+
+    # kill all subprocesses
+    trap '' TERM
+    pkill -P $$
+
+    # make sure no program is left attached
+    ip link set dev $netdev xdp off 2> /dev/null
+}
+
+trap "exit" INT TERM
+trap cleanup EXIT
+
+# run measurement
+
+function run_meas()
+{
+    test_type=$1
+    rep=$2
+
+    logdir="$base_logdir/$test_type/$rep/"
+    mkdir -p $logdir
+
+    # start xdp-bench
+    case "$test_type" in
+        drop|pass|tx)
+            $numa_cmd xdp-bench $test_type -m $xdp_mode -e -i 1 $netdev > "$logdir/xdp-bench.log" 2>&1 &
+            ;;
+        redirect)
+            if [ -z "$redirect_netdev" ]; then
+                echo "Redirect interface not specified, skipping"
+                return
+            fi
+            $numa_cmd xdp-bench redirect -m $xdp_mode -e -i 1 $netdev $redirect_netdev > "$logdir/xdp-bench.log" 2>&1 &
+            ;;
+    esac
+    bench_pid=$!
+
+    sleep 2
+
+    # capture performance counters
+    cat /proc/net/dev > $logdir/proc_net_dev.log
+    cat /proc/stat > $logdir/proc_stat.log
+    start_time=$(date +%s.%N)
+    for i in $(seq 1 $duration); do
+        sleep 1
+        cat /proc/net/dev >> $logdir/proc_net_dev.log
+        cat /proc/stat >> $logdir/proc_stat.log
+        echo -n .
+    done
+    end_time=$(date +%s.%N)
+    elapsed=$(echo "scale=4; $end_time - $start_time" | bc)
+
+    kill -INT $bench_pid
+    wait $bench_pid
+    echo
+
+    # aggregate
+    if_stat=$(grep "$netdev:" "$logdir/proc_net_dev.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+    intr_stat=$(grep "intr" "$logdir/proc_stat.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+    cpu_stat=$(grep "cpu\s" "$logdir/proc_stat.log" | tr -s ' ' | cut -d ' ' -f 2- | sed -n '1p;$p' | awk 'NR==1{for(i=1;i<=NF;i++){col[i]=$i};next}{for(i=1;i<=NF;i++){printf "%s ",$i-col[i];col[i]=$i};print ""}')
+
+    if_rx_b=$(echo $if_stat | cut -d ' ' -f 1)
+    if_rx_pkt=$(echo $if_stat | cut -d ' ' -f 2)
+    if_rx_drop=$(echo $if_stat | cut -d ' ' -f 4)
+    if_tx_b=$(echo $if_stat | cut -d ' ' -f 9)
+    if_tx_pkt=$(echo $if_stat | cut -d ' ' -f 10)
+
+    rx_pps=$(echo "scale=0; $if_rx_pkt / $elapsed" | bc)
+    tx_pps=$(echo "scale=0; $if_tx_pkt / $elapsed" | bc)
+
+    intr=$(echo $intr_stat | cut -d ' ' -f 1)
+
+    cpu_idle=$(echo $cpu_stat | cut -d ' ' -f 4)
+    cpu_total=$(echo $cpu_stat | tr " " "\n" | grep . | paste -sd+ - | bc)
+    cpu_pct=$(echo "scale=4; ($cpu_total-$cpu_idle) * 100 / $cpu_total" | bc)
+
+    # check drop counter against XDP verdict, allowing 1% for ring overruns
+    drop_check=ok
+    if [ "$if_rx_pkt" -eq 0 ]; then
+        drop_check=no_traffic
+    else
+        case "$test_type" in
+            drop)
+                # XDP_DROP: every packet counts as dropped
+                if (( if_rx_drop * 100 < if_rx_pkt * 99 )); then
+                    drop_check=fail
+                fi
+                ;;
+            pass|tx)
+                # XDP_PASS and XDP_TX: packets must not count as dropped
+                if (( if_rx_drop * 100 > if_rx_pkt )); then
+                    drop_check=fail
+                fi
+                ;;
+            *)
+                drop_check=skip
+                ;;
+        esac
+    fi
+
+    if [ "$drop_check" = "fail" ]; then
+        echo "Drop counter check failed for XDP $test_type: $if_rx_drop of $if_rx_pkt packets dropped" >&2
+        drop_check_failed=1
+    fi
+
+    echo $rep, $elapsed, $if_rx_b, $if_rx_pkt, $if_rx_drop, $if_tx_b, $if_tx_pkt, $rx_pps, $tx_pps, $intr, $cpu_pct, $drop_check | tee -a "$base_logdir/$test_type.csv"
+}
+
+mkdir -p $base_logdir
+
+for mode in $modes; do
+    echo "rep, sec, if_rx_b, if_rx_pkt, if_rx_drop, if_tx_b, if_tx_pkt, rx_pps, tx_pps, intr, cpu, drop_check" > "$base_logdir/$mode.csv"
+done
+
+for rep in $(seq 1 $repeats); do
+    for mode in $modes; do
+        echo "Running XDP $mode test on '$netdev' ($rep/$repeats)"
+        run_meas $mode $rep
+    done
+done
+
+exit $drop_check_failed
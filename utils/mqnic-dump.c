@@ -102,6 +102,21 @@ int main(int argc, char *argv[])
     printf("IF stride: 0x%08x\n", dev->if_stride);
     printf("IF CSR offset: 0x%08x\n", dev->if_csr_offset);
 
+    if (dev->irq_count)
+    {
+        printf("IRQ info\n");
+        printf("  IRQ  IRQN   CPU  Node\n");
+        for (int k = 0; k < dev->irq_count; k++)
+        {
+            struct mqnic_ioctl_irq_info irq_info;
+
+            if (mqnic_get_irq_info(dev, k, &irq_info))
+                continue;
+
+            printf("  %3d  %4d  %4d  %4d\n", k, irq_info.irqn, irq_info.cpu, irq_info.numa_node);
+        }
+    }
+
     if (dev->phc_rb)
     {
         int ch;
@@ -329,6 +344,15 @@ int main(int argc, char *argv[])
             printf("Sched control: %d\n", mqnic_reg_read32(rb->regs, MQNIC_RB_SCHED_CTRL_TDMA_REG_CTRL));
             printf("Sched timeslot count: %d\n", mqnic_reg_read32(rb->regs, MQNIC_RB_SCHED_CTRL_TDMA_REG_TS_COUNT));
         }
+        else if (rb->type == MQNIC_RB_SCHED_CTRL_SHAPER_TYPE && rb->version == MQNIC_RB_SCHED_CTRL_SHAPER_VER)
+        {
+            printf("Shaper scheduler controller\n");
+
+            printf("Sched channel count: %d\n", mqnic_reg_read32(rb->regs, MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_COUNT));
+            printf("Sched channel stride: %d\n", mqnic_reg_read32(rb->regs, MQNIC_RB_SCHED_CTRL_SHAPER_REG_CH_STRIDE));
+            printf("Sched control: %d\n", mqnic_reg_read32(rb->regs, MQNIC_RB_SCHED_CTRL_SHAPER_REG_CTRL));
+            printf("Sched refill period: %d\n", mqnic_reg_read32(rb->regs, MQNIC_RB_SCHED_CTRL_SHAPER_REG_REFILL_PERIOD));
+        }
         else if (rb->type == MQNIC_RB_TDMA_SCH_TYPE && rb->version == MQNIC_RB_TDMA_SCH_VER)
         {
             printf("TDMA scheduler\n");